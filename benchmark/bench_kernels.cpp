@@ -0,0 +1,406 @@
+// Description: Benchmark of ray tracing kernels (native executable). Runs
+//              all kernels of the modules 'rays' and 'horizon' on synthetic
+//              DEMs of several sizes with several thread counts and writes
+//              one JSON record per run (JSON Lines) for regression tracking.
+//
+// Compilation (Linux, in activated Conda environment; from repository root):
+//   g++ -O3 -std=c++17 -Isubgrid_radiation
+//       -Isubgrid_radiation/sun_position_array -I$CONDA_PREFIX/include
+//       benchmark/bench_kernels.cpp
+//       subgrid_radiation/sun_position_array/rays_comp.cpp
+//       subgrid_radiation/sun_position_array/horizon_comp.cpp
+//       subgrid_radiation/embree_core.cpp subgrid_radiation/horizon_file.cpp
+//       subgrid_radiation/lut_encoding.cpp
+//       subgrid_radiation/cell_schedule.cpp subgrid_radiation/sun_simd.cpp
+//       subgrid_radiation/svf_simd.cpp subgrid_radiation/scratch_arena.cpp
+//       subgrid_radiation/refraction.cpp
+//       subgrid_radiation/dem_vertices.cpp subgrid_radiation/kernel_stats.cpp
+//       subgrid_radiation/kernel_variants.cpp
+//       subgrid_radiation/adaptive_sampling.cpp
+//       subgrid_radiation/heightfield.cpp
+//       -L$CONDA_PREFIX/lib -Wl,-rpath,$CONDA_PREFIX/lib -lembree3 -ltbb
+//       -o bench_kernels
+//   (one command line)
+//
+// Usage:
+//   ./bench_kernels [--sizes 20,40,80] [--threads 1,4,0] [--repeat 1]
+//                   [--geom_types grid,heightfield]
+//                   [--output results.jsonl]
+//   (sizes: number of grid cells per side of inner domain; thread count 0:
+//   all available cores; geometry types of scene: triangle, quad, grid or
+//   heightfield)
+//
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "rays_comp.h"
+#include "horizon_comp.h"
+#include "embree_core.h"
+#include "sun_simd.h"
+#include "svf_simd.h"
+#include "dem_vertices.h"
+#include "kernel_stats.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sys/resource.h>
+#include <tbb/global_control.h>
+#include <tbb/info.h>
+
+using namespace std;
+
+//#############################################################################
+// Hard-coded settings
+//#############################################################################
+
+const int pixel_per_gc = 10;  // subgrid pixels per grid cell [-]
+const int offset_gc = 5;  // offset of inner domain [grid cells]
+const double dx = 100.0;  // pixel spacing [metre]
+const double dist_search = 20.0;  // search distance [kilometre]
+const int hori_azim_num = 72;  // number of azimuth sectors [-]
+const double hori_acc = 1.25;  // horizon accuracy [degree]
+const double elev_ang_low_lim = -15.0;  // lower elevation limit [degree]
+const double sw_dir_cor_max = 25.0;
+const double ang_max = 89.9;
+const int dim_sun_0 = 10;  // sun positions in latitude (0 - 90 degree)
+const int dim_sun_1 = 36;  // sun positions in longitude (10 degree steps)
+
+//#############################################################################
+// Synthetic data
+//#############################################################################
+
+// DEM with 'lowered' hemisphere (as in 'test/*_artificial.py'), scaled with
+// domain extent, in ENU coordinates (padded buffers)
+struct SyntheticDem {
+    int num_gc;
+    int dem_dim_0, dem_dim_1;
+    int dem_dim_in_0, dem_dim_in_1;
+    vector<float> vert_grid;
+    vector<float> vert_grid_in;
+    vector<double> sun_pos;
+    vector<uint8_t> mask;
+};
+
+SyntheticDem synthetic_dem(int num_gc) {
+
+    SyntheticDem d;
+    d.num_gc = num_gc;
+    d.dem_dim_0 = (num_gc + 2 * offset_gc) * pixel_per_gc + 1;
+    d.dem_dim_1 = d.dem_dim_0;
+    d.dem_dim_in_0 = num_gc * pixel_per_gc + 1;
+    d.dem_dim_in_1 = d.dem_dim_in_0;
+    double half = (double)(d.dem_dim_0 - 1) / 2.0 * dx;
+    double radius = 0.4 * half;
+    double lower = 0.25 * radius;
+    d.vert_grid.assign(vertex_buffer_size(d.dem_dim_0 * d.dem_dim_1),
+        0.0f);
+    d.vert_grid_in.assign(vertex_buffer_size(d.dem_dim_in_0
+        * d.dem_dim_in_1), 0.0f);
+    int off_px = offset_gc * pixel_per_gc;
+    for (int i = 0; i < d.dem_dim_0; i++) {
+        for (int j = 0; j < d.dem_dim_1; j++) {
+            double x = -half + (double)j * dx;
+            double y = -half + (double)i * dx;
+            double rad_sq = radius * radius - x * x - y * y;
+            double z = (rad_sq > 0.0) ? sqrt(rad_sq) - lower : 0.0;
+            size_t ind = ((size_t)i * d.dem_dim_1 + j) * 3;
+            d.vert_grid[ind] = (float)x;
+            d.vert_grid[ind + 1] = (float)y;
+            d.vert_grid[ind + 2] = (float)max(z, 0.0);
+            int i_in = i - off_px;
+            int j_in = j - off_px;
+            if ((i_in >= 0) && (i_in < d.dem_dim_in_0) && (j_in >= 0)
+                && (j_in < d.dem_dim_in_1)) {
+                size_t ind_in = ((size_t)i_in * d.dem_dim_in_1 + j_in) * 3;
+                d.vert_grid_in[ind_in] = (float)x;
+                d.vert_grid_in[ind_in + 1] = (float)y;
+            }
+        }
+    }
+    double r_sun = 20000.0 + 1.0e9;
+    d.sun_pos.resize((size_t)dim_sun_0 * dim_sun_1 * 3);
+    for (int i = 0; i < dim_sun_0; i++) {
+        for (int j = 0; j < dim_sun_1; j++) {
+            double lat = (double)i * (90.0 / (dim_sun_0 - 1)) * M_PI / 180.0;
+            double lon = (-180.0 + (double)j * (360.0 / dim_sun_1))
+                * M_PI / 180.0;
+            size_t ind = ((size_t)i * dim_sun_1 + j) * 3;
+            d.sun_pos[ind] = r_sun * cos(lat) * cos(lon);
+            d.sun_pos[ind + 1] = r_sun * cos(lat) * sin(lon);
+            d.sun_pos[ind + 2] = r_sun * sin(lat);
+        }
+    }
+    d.mask.assign((size_t)num_gc * num_gc, 1);
+    return d;
+
+}
+
+//#############################################################################
+// Measurement
+//#############################################################################
+
+// Reset peak resident set size (Linux; no effect otherwise)
+void reset_peak_rss() {
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (file) {
+        fputs("5", file);
+        fclose(file);
+    }
+}
+
+// Peak resident set size since last reset [MB]
+double peak_rss_mb() {
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file) {
+        char line[256];
+        while (fgets(line, sizeof(line), file)) {
+            if (strncmp(line, "VmHWM:", 6) == 0) {
+                fclose(file);
+                return strtod(line + 6, NULL) / 1024.0;  // [kB] to [MB]
+            }
+        }
+        fclose(file);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return (double)usage.ru_maxrss / (1024.0 * 1024.0);  // [byte]
+#else
+    return (double)usage.ru_maxrss / 1024.0;  // [kB]
+#endif
+}
+
+struct Record {
+    string kernel;
+    string ray_algorithm;
+    string geom_type;
+    int num_gc, dem_dim, threads;
+    double bvh_build_time, bvh_memory, wall_time, ray_time, num_rays;
+    double peak_rss;
+};
+
+void write_record(ostream &out, const Record &r) {
+    out << "{\"kernel\": \"" << r.kernel << "\""
+        << ", \"ray_algorithm\": \"" << r.ray_algorithm << "\""
+        << ", \"geom_type\": \"" << r.geom_type << "\""
+        << ", \"num_gc\": " << r.num_gc
+        << ", \"dem_dim\": " << r.dem_dim
+        << ", \"threads\": " << r.threads
+        << ", \"bvh_build_time_s\": " << r.bvh_build_time
+        << ", \"bvh_memory_mb\": " << r.bvh_memory
+        << ", \"wall_time_s\": " << r.wall_time
+        << ", \"ray_time_s\": " << r.ray_time
+        << ", \"num_rays\": " << (long long)r.num_rays
+        << ", \"rays_per_s\": " << (r.num_rays / r.ray_time)
+        << ", \"peak_rss_mb\": " << r.peak_rss
+        << ", \"sun_simd_isa\": \"" << sun_simd_isa() << "\""
+        << ", \"svf_simd_isa\": \"" << svf_simd_isa() << "\"}" << endl;
+}
+
+//#############################################################################
+// Kernels
+//#############################################################################
+
+enum KernelType {
+    DEFAULT, COHERENT, COHERENT_RP8, STREAM, SVF, SVF_F32, SVF_SW_DIR_COR
+};
+
+struct Kernel {
+    const char* name;
+    KernelType type;
+    const char* ray_algorithm;
+};
+
+const Kernel kernels[] = {
+    {"sw_dir_cor", DEFAULT, ""},
+    {"sw_dir_cor_coherent", COHERENT, ""},
+    {"sw_dir_cor_coherent_rp8", COHERENT_RP8, ""},
+    {"sw_dir_cor_stream", STREAM, ""},
+    {"sky_view_factor", SVF, "discrete_sampling"},
+    {"sky_view_factor", SVF, "binary_search"},
+    {"sky_view_factor", SVF, "binary_search_packet4"},
+    {"sky_view_factor", SVF, "binary_search_packet"},
+    {"sky_view_factor", SVF, "binary_search_packet16"},
+    {"sky_view_factor", SVF, "guess_constant"},
+    {"sky_view_factor_float32", SVF_F32, "guess_constant"},
+    {"sky_view_factor_sw_dir_cor", SVF_SW_DIR_COR, "guess_constant"}
+};
+
+void run_kernel(const Kernel &kernel, SyntheticDem &d, RTCScene scene) {
+
+    char geom_type[] = "grid";
+    char build_quality[] = "medium";
+    char hori_file[] = "";
+    char ray_algorithm[32];
+    strncpy(ray_algorithm, kernel.ray_algorithm, sizeof(ray_algorithm) - 1);
+    ray_algorithm[sizeof(ray_algorithm) - 1] = '\0';
+    size_t num_gc = (size_t)d.num_gc * d.num_gc;
+    size_t num_sun = (size_t)dim_sun_0 * dim_sun_1;
+
+    if (kernel.type <= STREAM) {
+        vector<float> sw_dir_cor(num_gc * num_sun, 0.0f);
+        if (kernel.type == DEFAULT) {
+            sw_dir_cor_comp(d.vert_grid.data(), d.dem_dim_0, d.dem_dim_1,
+                d.vert_grid_in.data(), d.dem_dim_in_0, d.dem_dim_in_1,
+                0.0, d.sun_pos.data(), dim_sun_0, dim_sun_1,
+                sw_dir_cor.data(), pixel_per_gc, offset_gc, d.mask.data(),
+                dist_search, geom_type, scene, build_quality, 0, 1, 1, 0, 0,
+                0, sw_dir_cor_max, ang_max, 0, NULL, NULL);
+        } else if (kernel.type == COHERENT) {
+            sw_dir_cor_comp_coherent(d.vert_grid.data(), d.dem_dim_0,
+                d.dem_dim_1, d.vert_grid_in.data(), d.dem_dim_in_0,
+                d.dem_dim_in_1, 0.0, d.sun_pos.data(), dim_sun_0,
+                dim_sun_1, sw_dir_cor.data(), pixel_per_gc, offset_gc,
+                d.mask.data(), dist_search, geom_type, scene, build_quality,
+                0, 1, 1, 0, sw_dir_cor_max, ang_max, 0, NULL, NULL);
+        } else if (kernel.type == COHERENT_RP8) {
+            sw_dir_cor_comp_coherent_rp8(d.vert_grid.data(), d.dem_dim_0,
+                d.dem_dim_1, d.vert_grid_in.data(), d.dem_dim_in_0,
+                d.dem_dim_in_1, 0.0, d.sun_pos.data(), dim_sun_0,
+                dim_sun_1, sw_dir_cor.data(), pixel_per_gc, offset_gc,
+                d.mask.data(), dist_search, geom_type, scene, build_quality,
+                0, 1, 1, 0, sw_dir_cor_max, ang_max, 0, NULL, NULL);
+        } else {
+            sw_dir_cor_comp_stream(d.vert_grid.data(), d.dem_dim_0,
+                d.dem_dim_1, d.vert_grid_in.data(), d.dem_dim_in_0,
+                d.dem_dim_in_1, 0.0, d.sun_pos.data(), dim_sun_0,
+                dim_sun_1, sw_dir_cor.data(), pixel_per_gc, offset_gc,
+                d.mask.data(), dist_search, geom_type, scene, build_quality,
+                0, 1, 1, 0, sw_dir_cor_max, ang_max, 4096, 0, NULL, NULL);
+        }
+    } else {
+        vector<double> svf(num_gc, 0.0), aif(num_gc, 0.0), svaf(num_gc, 0.0);
+        if ((kernel.type == SVF) || (kernel.type == SVF_F32)) {
+            sky_view_factor_comp(d.vert_grid.data(), d.dem_dim_0,
+                d.dem_dim_1, d.vert_grid_in.data(), d.dem_dim_in_0,
+                d.dem_dim_in_1, 0.0, svf.data(), aif.data(), svaf.data(),
+                pixel_per_gc, offset_gc, d.mask.data(), (float)dist_search,
+                hori_azim_num, hori_acc, ray_algorithm, elev_ang_low_lim,
+                geom_type, scene, build_quality, 0, 1, 1, 0,
+                (int)(kernel.type == SVF_F32), 0.0, 8, hori_file, 2);
+        } else {
+            vector<float> sw_dir_cor(num_gc * num_sun, 0.0f);
+            sky_view_factor_sw_dir_cor_comp(d.vert_grid.data(), d.dem_dim_0,
+                d.dem_dim_1, d.vert_grid_in.data(), d.dem_dim_in_0,
+                d.dem_dim_in_1, 0.0, d.sun_pos.data(), dim_sun_0,
+                dim_sun_1, sw_dir_cor.data(), svf.data(), aif.data(),
+                svaf.data(), pixel_per_gc, offset_gc, d.mask.data(),
+                (float)dist_search, hori_azim_num, hori_acc, ray_algorithm,
+                elev_ang_low_lim, geom_type, scene, build_quality, 0, 1, 1,
+                0, 0, 0.0, 8, sw_dir_cor_max, ang_max, 0, NULL, NULL);
+        }
+    }
+
+}
+
+//#############################################################################
+// Main
+//#############################################################################
+
+vector<int> parse_list(const char* arg) {
+    vector<int> values;
+    stringstream stream(arg);
+    string item;
+    while (getline(stream, item, ',')) {
+        values.push_back(atoi(item.c_str()));
+    }
+    return values;
+}
+
+vector<string> parse_names(const char* arg) {
+    vector<string> names;
+    stringstream stream(arg);
+    string item;
+    while (getline(stream, item, ',')) {
+        names.push_back(item);
+    }
+    return names;
+}
+
+int main(int argc, char* argv[]) {
+
+    vector<int> sizes = {20, 40, 80};
+    vector<int> threads = {1, 0};
+    int repeat = 1;
+    vector<string> geom_types = {"grid"};
+    string output;
+    for (int i = 1; i < (argc - 1); i += 2) {
+        if (strcmp(argv[i], "--sizes") == 0) {
+            sizes = parse_list(argv[i + 1]);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = parse_list(argv[i + 1]);
+        } else if (strcmp(argv[i], "--repeat") == 0) {
+            repeat = max(atoi(argv[i + 1]), 1);
+        } else if (strcmp(argv[i], "--geom_types") == 0) {
+            geom_types = parse_names(argv[i + 1]);
+        } else if (strcmp(argv[i], "--output") == 0) {
+            output = argv[i + 1];
+        } else {
+            cerr << "Error: unknown argument " << argv[i] << endl;
+            return 1;
+        }
+    }
+    ofstream file;
+    if (!output.empty()) {
+        file.open(output);
+    }
+    ostream &out = output.empty() ? cout : file;
+    set_verbosity(0);  // timings and ray counts from 'kernel_stats'
+
+    for (int num_gc : sizes) {
+        SyntheticDem d = synthetic_dem(num_gc);
+        for (int num_threads : threads) {
+            if (num_threads <= 0) {
+                num_threads = tbb::info::default_concurrency();
+            }
+            tbb::global_control control(
+                tbb::global_control::max_allowed_parallelism, num_threads);
+            cerr << "Size " << num_gc << " x " << num_gc
+                << " grid cells, " << num_threads << " thread(s)" << endl;
+
+            // Build scene once per thread count and geometry type (BVH
+            // build is parallel)
+            for (string &geom_type : geom_types) {
+                char build_quality[] = "medium";
+                shapes::CppScene scene;
+                scene.initialise(d.vert_grid.data(), d.dem_dim_0,
+                    d.dem_dim_1, &geom_type[0], build_quality, 0, 1);
+                double time_bvh = kernel_stats.time_bvh;
+                double mem_bvh = kernel_stats.mem_bvh;
+
+                for (const Kernel &kernel : kernels) {
+                    Record r = {kernel.name, kernel.ray_algorithm, geom_type,
+                        num_gc, d.dem_dim_0, num_threads,
+                        time_bvh, mem_bvh,
+                        INFINITY, INFINITY, 0.0, 0.0};
+                    // best of 'repeat' runs
+                    for (int k = 0; k < repeat; k++) {
+                        reset_peak_rss();
+                        auto start = chrono::high_resolution_clock::now();
+                        run_kernel(kernel, d, scene.scene);
+                        auto end = chrono::high_resolution_clock::now();
+                        chrono::duration<double> time = end - start;
+                        if (time.count() < r.wall_time) {
+                            r.wall_time = time.count();
+                            r.ray_time = kernel_stats.time_ray;
+                            r.num_rays = (double)kernel_stats.num_rays;
+                        }
+                        r.peak_rss = max(r.peak_rss, peak_rss_mb());
+                    }
+                    write_record(out, r);
+                }
+            }
+        }
+    }
+
+    return 0;
+
+}
@@ -42,6 +42,12 @@ path_work = {"local": "/Users/csteger/Desktop/dir_work/",
              "cscs": "/scratch/snx3000/csteger/Subgrid_radiation_data/"}
 radius_earth = 6_371_229.0  # radius of Earth (according to COSMO/ICON) [m]
 
+# Multi-node runs: start script with several MPI ranks (e.g. 'srun' with
+# '--nodes=N' and '--ntasks-per-node=1'). Rows of grid cells are partitioned
+# into bands with similar numbers of active grid cells; each rank only reads
+# the DEM of its band (including halo) and the (small) output is gathered on
+# rank 0.
+
 # -----------------------------------------------------------------------------
 # Process data
 # -----------------------------------------------------------------------------
@@ -50,6 +56,9 @@ radius_earth = 6_371_229.0  # radius of Earth (according to COSMO/ICON) [m]
 systems = {"Darwin": "local", "Linux": "cscs"}
 path_work = path_work[systems[platform.system()]]
 
+# MPI communicator (None for serial run)
+comm, rank, size = auxiliary.mpi_comm()
+
 # Loop through subdomains
 files_in = glob.glob(path_work + file_in)
 files_in.sort()
@@ -68,71 +77,50 @@ for i in files_in:
     pole_lat = ds["rotated_pole"].grid_north_pole_latitude
     rlon_gc = ds["rlon_gc"].values
     rlat_gc = ds["rlat_gc"].values
+    num_gc_y = int((ds.sizes["rlat"] - 1) / pixel_per_gc) - 2 * offset_gc
+    num_gc_x = int((ds.sizes["rlon"] - 1) / pixel_per_gc) - 2 * offset_gc
     ds.close()
 
-    # Compute vertices of DEM triangles in global ENU coordinates
+    # Mask (optional)
+    mask = np.zeros((num_gc_y, num_gc_x), dtype=np.uint8)
+    mask[-30:, -30:] = 1
+    # mask[:] = 1
+
+    # Band of grid cell rows processed by this rank
+    row_beg, row_end = auxiliary.partition_rows(mask, size)[rank]
+    slice_dem = auxiliary.dem_row_slices(row_beg, row_end, pixel_per_gc,
+                                         offset_gc)[0]
+    if comm is not None:
+        print("Rank " + str(rank) + ": grid cell rows [" + str(row_beg)
+              + ", " + str(row_end) + ")")
+
+    # Compute vertices of DEM triangles and of '0.0 m surface' triangles
+    # (inner domain) in global ENU coordinates (fused transformation and
+    # buffer layout)
     t_beg = time.perf_counter()
     ds = xr.open_dataset(i)
+    ds = ds.isel(rlat=slice_dem)
     lon = ds["lon"].values.astype(np.float64)
     lat = ds["lat"].values.astype(np.float64)
-    elevation = ds["Elevation"].values.astype(np.float64)
+    elevation = ds["Elevation"].values.astype(np.float32)
     ds.close()
     dem_dim_0, dem_dim_1 = elevation.shape
+    dem_dim_in_0 = dem_dim_0 - 2 * pixel_per_gc * offset_gc
+    dem_dim_in_1 = dem_dim_1 - 2 * pixel_per_gc * offset_gc
     trans_lonlat2enu = transform.TransformerLonlat2enu(
         lon_or=lon.mean(), lat_or=lat.mean(), radius_earth=radius_earth)
-    transform.lonlat2ecef(lon, lat, elevation, trans_lonlat2enu, in_place=True)
-    transform.ecef2enu(lon, lat, elevation, trans_lonlat2enu, in_place=True)
-    x_enu = lon.astype(np.float32)
-    del lon
-    y_enu = lat.astype(np.float32)
-    del lat
-    z_enu = elevation.astype(np.float32)
-    del elevation
-    vert_grid = auxiliary.rearrange_pad_buffer(x_enu, y_enu, z_enu)
-    print("Size of elevation data: %.3f" % (vert_grid.nbytes / (10 ** 9))
-          + " GB")
-    del x_enu, y_enu, z_enu
-    print("DEM vertices data prepared (%.1f" % (time.perf_counter() - t_beg)
-          + " s)")
-
-    # Compute vertices of '0.0 m surface' triangles in global ENU coordinates
-    t_beg = time.perf_counter()
-    slice_in = (slice(pixel_per_gc * offset_gc, -pixel_per_gc * offset_gc),
-                slice(pixel_per_gc * offset_gc, -pixel_per_gc * offset_gc))
-    ds = xr.open_dataset(i)
-    ds = ds.isel(rlat=slice_in[0], rlon=slice_in[1])
-    lon = ds["lon"].values.astype(np.float64)
-    lat = ds["lat"].values.astype(np.float64)
-    ds.close()
-    elevation_zero = np.zeros_like(lon)
-    dem_dim_in_0, dem_dim_in_1 = elevation_zero.shape
-    transform.lonlat2ecef(lon, lat, elevation_zero, trans_lonlat2enu,
-                          in_place=True)
-    transform.ecef2enu(lon, lat, elevation_zero, trans_lonlat2enu,
-                       in_place=True)
-    value_abs_max = np.array([np.abs(lon).max(), np.abs(lat).max(),
-                              np.abs(elevation_zero).max()]).max()
+    vert_grid, vert_grid_in, value_abs_max \
+        = transform.dem_vertices(lon, lat, elevation, trans_lonlat2enu,
+                                 offset_px=pixel_per_gc * offset_gc)
+    del lon, lat, elevation
     print("Maximal absolute ENU coordinate value (32-bit float) "
           + "in inner domain: %.2f" % value_abs_max)
-    x_enu = lon.astype(np.float32)
-    del lon
-    y_enu = lat.astype(np.float32)
-    del lat
-    z_enu = elevation_zero.astype(np.float32)
-    del elevation_zero
-    vert_grid_in = auxiliary.rearrange_pad_buffer(x_enu, y_enu, z_enu)
+    print("Size of elevation data: %.3f" % (vert_grid.nbytes / (10 ** 9))
+          + " GB")
     print("Size of elevation data (0.0 m surface): %.3f"
           % (vert_grid_in.nbytes / (10 ** 9)) + " GB")
-    del x_enu, y_enu, z_enu
-    print("'0.0 m surface' vertices data prepared (%.1f"
-          % (time.perf_counter() - t_beg) + " s)")
-
-    # Mask (optional)
-    num_gc_y = int((dem_dim_0 - 1) / pixel_per_gc) - 2 * offset_gc
-    num_gc_x = int((dem_dim_1 - 1) / pixel_per_gc) - 2 * offset_gc
-    mask = np.zeros((num_gc_y, num_gc_x), dtype=np.uint8)
-    mask[-30:, -30:] = 1
-    # mask[:] = 1
+    print("DEM vertices data prepared (%.1f" % (time.perf_counter() - t_beg)
+          + " s)")
 
     # Ray-tracing
     sky_view_factor, area_increase_factor, sky_view_area_factor \
@@ -140,10 +128,22 @@ for i in files_in:
             vert_grid, dem_dim_0, dem_dim_1,
             vert_grid_in, dem_dim_in_0, dem_dim_in_1,
             pixel_per_gc, offset_gc,
-            mask=mask, dist_search=dist_search, hori_azim_num=hori_azim_num,
+            mask=mask[row_beg:row_end, :], dist_search=dist_search,
+            hori_azim_num=hori_azim_num,
             hori_acc=hori_acc, ray_algorithm=ray_algorithm,
             elev_ang_low_lim=elev_ang_low_lim, geom_type=geom_type)
 
+    # Gather bands on rank 0 (MPI run)
+    if comm is not None:
+        sky_view_factor, area_increase_factor, sky_view_area_factor \
+            = [comm.gather(j, root=0) for j in
+               (sky_view_factor, area_increase_factor, sky_view_area_factor)]
+        if rank != 0:
+            continue
+        sky_view_factor = np.concatenate(sky_view_factor, axis=0)
+        area_increase_factor = np.concatenate(area_increase_factor, axis=0)
+        sky_view_area_factor = np.concatenate(sky_view_area_factor, axis=0)
+
     # Check output
     print("Range of values [min, max]:")
     print("Sky view factor: %.4f" % np.nanmin(sky_view_factor)
@@ -207,7 +207,7 @@ for i in files_in:
 # Merge sub-domains (if required)
 # -----------------------------------------------------------------------------
 
-if len(files_in) > 1:
+if (len(files_in) > 1) and (rank == 0):
 
     print("Spatially merge sub-domain output files")
     files_out = glob.glob(path_work + "Sky_view_factor_"
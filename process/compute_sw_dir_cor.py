@@ -11,6 +11,7 @@ import time
 import numpy as np
 import xarray as xr
 from skyfield.api import Distance
+import netCDF4
 from netCDF4 import Dataset
 import glob
 import platform
@@ -35,6 +36,8 @@ dist_search = 100.0  # search distance for terrain shading [kilometre]
 geom_type = "grid"  # "grid" or "quad"
 sw_dir_cor_max = 25.0
 ang_max = 89.9
+block_rows = 5  # grid cell rows per block written to NetCDF file
+out_type = "uint16"  # "float32", "uint16" or "uint8"
 
 # File input/output
 file_in = "MERIT_remapped_COSMO_0.020deg_y0_x?.nc"
@@ -46,6 +49,15 @@ path_work = {"local": "/Users/csteger/Desktop/dir_work/",
 radius_earth = 6_371_229.0  # radius of Earth (according to COSMO/ICON) [m]
 ncview_reorder = True
 # reorder dimensions of NetCDF-output to make it viewable with 'ncview'
+lut_file = True
+# write memory-mappable copy of lookup table (evaluated for arbitrary
+# subsolar points with 'rays.LookupTable')
+
+# Multi-node runs: start script with several MPI ranks (e.g. 'srun' with
+# '--nodes=N' and '--ntasks-per-node=1'). Rows of grid cells are partitioned
+# into bands with similar numbers of active grid cells; each rank only reads
+# the DEM of its band (including halo) and the lookup table is written with
+# parallel NetCDF (requires netCDF4 built with MPI support).
 
 # -----------------------------------------------------------------------------
 # Process data
@@ -55,6 +67,11 @@ ncview_reorder = True
 systems = {"Darwin": "local", "Linux": "cscs"}
 path_work = path_work[systems[platform.system()]]
 
+# MPI communicator (None for serial run)
+comm, rank, size = auxiliary.mpi_comm()
+if (comm is not None) and (not netCDF4.__has_parallel4_support__):
+    raise ImportError("MPI run requires netCDF4 with parallel I/O support")
+
 # Loop through subdomains
 files_in = glob.glob(path_work + file_in)
 files_in.sort()
@@ -75,64 +92,50 @@ for i in files_in:
     pole_lat = ds["rotated_pole"].grid_north_pole_latitude
     rlon_gc = ds["rlon_gc"].values
     rlat_gc = ds["rlat_gc"].values
+    num_gc_y = int((ds.sizes["rlat"] - 1) / pixel_per_gc) - 2 * offset_gc
+    num_gc_x = int((ds.sizes["rlon"] - 1) / pixel_per_gc) - 2 * offset_gc
     ds.close()
 
-    # Compute vertices of DEM triangles in global ENU coordinates
+    # Mask (optional)
+    mask = np.zeros((num_gc_y, num_gc_x), dtype=np.uint8)
+    mask[-30:, -30:] = 1
+    # mask[:] = 1
+
+    # Band of grid cell rows processed by this rank
+    row_beg, row_end = auxiliary.partition_rows(mask, size)[rank]
+    slice_dem = auxiliary.dem_row_slices(row_beg, row_end, pixel_per_gc,
+                                         offset_gc)[0]
+    if comm is not None:
+        print("Rank " + str(rank) + ": grid cell rows [" + str(row_beg)
+              + ", " + str(row_end) + ")")
+
+    # Compute vertices of DEM triangles and of '0.0 m surface' triangles
+    # (inner domain) in global ENU coordinates (fused transformation and
+    # buffer layout)
     t_beg = time.perf_counter()
     ds = xr.open_dataset(i)
+    ds = ds.isel(rlat=slice_dem)
     lon = ds["lon"].values.astype(np.float64)
     lat = ds["lat"].values.astype(np.float64)
-    elevation = ds["Elevation"].values.astype(np.float64)
+    elevation = ds["Elevation"].values.astype(np.float32)
     ds.close()
     dem_dim_0, dem_dim_1 = elevation.shape
+    dem_dim_in_0 = dem_dim_0 - 2 * pixel_per_gc * offset_gc
+    dem_dim_in_1 = dem_dim_1 - 2 * pixel_per_gc * offset_gc
     trans_lonlat2enu = transform.TransformerLonlat2enu(
         lon_or=lon.mean(), lat_or=lat.mean(), radius_earth=radius_earth)
-    transform.lonlat2ecef(lon, lat, elevation, trans_lonlat2enu, in_place=True)
-    transform.ecef2enu(lon, lat, elevation, trans_lonlat2enu, in_place=True)
-    x_enu = lon.astype(np.float32)
-    del lon
-    y_enu = lat.astype(np.float32)
-    del lat
-    z_enu = elevation.astype(np.float32)
-    del elevation
-    vert_grid = auxiliary.rearrange_pad_buffer(x_enu, y_enu, z_enu)
-    print("Size of elevation data: %.3f" % (vert_grid.nbytes / (10 ** 9))
-          + " GB")
-    del x_enu, y_enu, z_enu
-    print("DEM vertices data prepared (%.1f" % (time.perf_counter() - t_beg)
-          + " s)")
-
-    # Compute vertices of '0.0 m surface' triangles in global ENU coordinates
-    t_beg = time.perf_counter()
-    slice_in = (slice(pixel_per_gc * offset_gc, -pixel_per_gc * offset_gc),
-                slice(pixel_per_gc * offset_gc, -pixel_per_gc * offset_gc))
-    ds = xr.open_dataset(i)
-    ds = ds.isel(rlat=slice_in[0], rlon=slice_in[1])
-    lon = ds["lon"].values.astype(np.float64)
-    lat = ds["lat"].values.astype(np.float64)
-    ds.close()
-    elevation_zero = np.zeros_like(lon)
-    dem_dim_in_0, dem_dim_in_1 = elevation_zero.shape
-    transform.lonlat2ecef(lon, lat, elevation_zero, trans_lonlat2enu,
-                          in_place=True)
-    transform.ecef2enu(lon, lat, elevation_zero, trans_lonlat2enu,
-                       in_place=True)
-    value_abs_max = np.array([np.abs(lon).max(), np.abs(lat).max(),
-                              np.abs(elevation_zero).max()]).max()
+    vert_grid, vert_grid_in, value_abs_max \
+        = transform.dem_vertices(lon, lat, elevation, trans_lonlat2enu,
+                                 offset_px=pixel_per_gc * offset_gc)
+    del lon, lat, elevation
     print("Maximal absolute ENU coordinate value (32-bit float) "
           + "in inner domain: %.2f" % value_abs_max)
-    x_enu = lon.astype(np.float32)
-    del lon
-    y_enu = lat.astype(np.float32)
-    del lat
-    z_enu = elevation_zero.astype(np.float32)
-    del elevation_zero
-    vert_grid_in = auxiliary.rearrange_pad_buffer(x_enu, y_enu, z_enu)
+    print("Size of elevation data: %.3f" % (vert_grid.nbytes / (10 ** 9))
+          + " GB")
     print("Size of elevation data (0.0 m surface): %.3f"
           % (vert_grid_in.nbytes / (10 ** 9)) + " GB")
-    del x_enu, y_enu, z_enu
-    print("'0.0 m surface' vertices data prepared (%.1f"
-          % (time.perf_counter() - t_beg) + " s)")
+    print("DEM vertices data prepared (%.1f" % (time.perf_counter() - t_beg)
+          + " s)")
 
     # Compute sun position array in global ENU coordinates
     subsol_lon_2d, subsol_lat_2d = np.meshgrid(subsol_lon, subsol_lat)
@@ -148,32 +151,14 @@ for i in files_in:
                               y_enu[:, :, np.newaxis],
                               z_enu[:, :, np.newaxis]), axis=2)
 
-    # Mask (optional)
-    num_gc_y = int((dem_dim_0 - 1) / pixel_per_gc) - 2 * offset_gc
-    num_gc_x = int((dem_dim_1 - 1) / pixel_per_gc) - 2 * offset_gc
-    mask = np.zeros((num_gc_y, num_gc_x), dtype=np.uint8)
-    mask[-30:, -30:] = 1
-    # mask[:] = 1
-
-    # Ray-tracing
-    # sw_dir_cor = sun_position_array.rays.sw_dir_cor(
-    # sw_dir_cor = sun_position_array.rays.sw_dir_cor_coherent(
-    sw_dir_cor = sun_position_array.rays.sw_dir_cor_coherent_rp8(
-        vert_grid, dem_dim_0, dem_dim_1,
-        vert_grid_in, dem_dim_in_0, dem_dim_in_1,
-        sun_pos, pixel_per_gc, offset_gc, mask,
-        dist_search=dist_search, geom_type=geom_type,
-        ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max)
-
-    # Check output
-    print("Range of 'sw_dir_cor'-values: [%.2f" % np.nanmin(sw_dir_cor)
-          + ", %.2f" % np.nanmax(sw_dir_cor) + "]")
-    print("Size of lookup table: %.2f" % (sw_dir_cor.nbytes / (10 ** 6))
-          + " MB")
-
-    # Save to NetCDF file
+    # Create NetCDF file (lookup table is written block-wise during
+    # ray-tracing; collectively by all ranks for MPI run)
     file_out = file_out_part + "_" + "_".join(i.split("/")[-1].split("_")[2:])
-    ncfile = Dataset(filename=path_work + file_out, mode="w")
+    if comm is None:
+        ncfile = Dataset(filename=path_work + file_out, mode="w")
+    else:
+        ncfile = Dataset(filename=path_work + file_out, mode="w",
+                         parallel=True, comm=comm)
     # -------------------------------------------------------------------------
     ncfile.pixel_per_gc = str(pixel_per_gc)
     ncfile.offset_gc = str(offset_gc)
@@ -188,39 +173,102 @@ for i in files_in:
     nc_meta.grid_north_pole_latitude = pole_lat
     nc_meta.north_pole_grid_longitude = 0.0
     # -------------------------------------------------------------------------
-    ncfile.createDimension(dimname="rlat_gc", size=sw_dir_cor.shape[0])
-    ncfile.createDimension(dimname="rlon_gc", size=sw_dir_cor.shape[1])
-    ncfile.createDimension(dimname="subsolar_lat", size=sw_dir_cor.shape[2])
-    ncfile.createDimension(dimname="subsolar_lon", size=sw_dir_cor.shape[3])
+    ncfile.createDimension(dimname="rlat_gc", size=num_gc_y)
+    ncfile.createDimension(dimname="rlon_gc", size=num_gc_x)
+    ncfile.createDimension(dimname="subsolar_lat", size=subsol_lat.size)
+    ncfile.createDimension(dimname="subsolar_lon", size=subsol_lon.size)
     # -------------------------------------------------------------------------
     nc_rlat = ncfile.createVariable(varname="rlat_gc", datatype="f",
                                     dimensions="rlat_gc")
-    nc_rlat[:] = rlat_gc[offset_gc:-offset_gc]
+    if rank == 0:
+        nc_rlat[:] = rlat_gc[offset_gc:-offset_gc]
     nc_rlat.long_name = "latitude of grid cells in rotated pole grid"
     nc_rlat.units = "degrees"
     nc_rlon = ncfile.createVariable(varname="rlon_gc", datatype="f",
                                     dimensions="rlon_gc")
-    nc_rlon[:] = rlon_gc[offset_gc:-offset_gc]
+    if rank == 0:
+        nc_rlon[:] = rlon_gc[offset_gc:-offset_gc]
     nc_rlon.long_name = "longitude of grid cells in rotated pole grid"
     nc_rlon.units = "degrees"
     # -------------------------------------------------------------------------
     nc_sslat = ncfile.createVariable(varname="subsolar_lat", datatype="f",
                                     dimensions="subsolar_lat")
-    nc_sslat[:] = subsol_lat
+    if rank == 0:
+        nc_sslat[:] = subsol_lat
     nc_sslat.long_name = "subsolar latitude"
     nc_sslat.units = "degrees"
     nc_sslon = ncfile.createVariable(varname="subsolar_lon", datatype="f",
                                     dimensions="subsolar_lon")
-    nc_sslon[:] = subsol_lon
+    if rank == 0:
+        nc_sslon[:] = subsol_lon
     nc_sslon.long_name = "subsolar longitude"
     nc_sslon.units = "degrees"
     # -------------------------------------------------------------------------
-    nc_data = ncfile.createVariable(varname="f_cor", datatype="f",
+    if out_type == "float32":
+        fill_value = None
+    else:
+        scale, offset, fill_value \
+            = rays.encoding_parameters(out_type, sw_dir_cor_max)
+    nc_data = ncfile.createVariable(varname="f_cor", datatype=out_type,
                                     dimensions=("rlat_gc", "rlon_gc",
                                                 "subsolar_lat",
-                                                "subsolar_lon"))
-    nc_data[:] = sw_dir_cor
+                                                "subsolar_lon"),
+                                    zlib=True, complevel=4,
+                                    chunksizes=(1, num_gc_x,
+                                                subsol_lat.size,
+                                                subsol_lon.size),
+                                    fill_value=fill_value)
     nc_data.units = "-"
+    if out_type != "float32":
+        # encoded values are written as is (decoded by NetCDF readers)
+        nc_data.scale_factor = scale
+        nc_data.add_offset = offset
+        nc_data.set_auto_maskandscale(False)
+    if comm is not None:
+        # compressed variables require collective access
+        nc_data.set_collective(True)
+
+    # Write finished blocks of lookup table to NetCDF file
+    sw_dir_cor_range = [np.inf, -np.inf]
+
+    def write_rows(row_beg_block, sw_dir_cor_rows):
+        row_beg_block += row_beg
+        nc_data[row_beg_block:(row_beg_block + sw_dir_cor_rows.shape[0]),
+                ...] = sw_dir_cor_rows
+        if out_type != "float32":
+            sw_dir_cor_rows = rays.decode_sw_dir_cor(sw_dir_cor_rows,
+                                                     sw_dir_cor_max)
+        if not np.all(np.isnan(sw_dir_cor_rows)):
+            sw_dir_cor_range[0] = min(sw_dir_cor_range[0],
+                                      np.nanmin(sw_dir_cor_rows))
+            sw_dir_cor_range[1] = max(sw_dir_cor_range[1],
+                                      np.nanmax(sw_dir_cor_rows))
+
+    # Ray-tracing (MPI run: lookup table of band is computed in memory and
+    # written with one collective call per rank)
+    # sun_position_array.rays.sw_dir_cor(
+    # sun_position_array.rays.sw_dir_cor_coherent(
+    sw_dir_cor_band = sun_position_array.rays.sw_dir_cor_coherent_rp8(
+        vert_grid, dem_dim_0, dem_dim_1,
+        vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+        sun_pos, pixel_per_gc, offset_gc, mask[row_beg:row_end, :],
+        dist_search=dist_search, geom_type=geom_type,
+        ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max,
+        row_callback=(write_rows if comm is None else None),
+        block_rows=block_rows, out_type=out_type)
+    if comm is not None:
+        write_rows(0, sw_dir_cor_band)
+        del sw_dir_cor_band
+        sw_dir_cor_range = [min(comm.allgather(sw_dir_cor_range[0])),
+                            max(comm.allgather(sw_dir_cor_range[1]))]
+
+    # Check output
+    print("Range of 'sw_dir_cor'-values: [%.2f" % sw_dir_cor_range[0]
+          + ", %.2f" % sw_dir_cor_range[1] + "]")
+    print("Size of lookup table: %.2f"
+          % (num_gc_y * num_gc_x * subsol_lat.size * subsol_lon.size
+             * np.dtype(out_type).itemsize / (10 ** 6)) + " MB")
+
     # -------------------------------------------------------------------------
     ncfile.close()
 
@@ -228,7 +276,7 @@ for i in files_in:
 # Merge sub-domains (if required)
 # -----------------------------------------------------------------------------
 
-if len(files_in) > 1:
+if (len(files_in) > 1) and (rank == 0):
 
     print("Spatially merge sub-domain output files")
     files_out = glob.glob(path_work + file_out_part + "_"
@@ -247,11 +295,26 @@ if len(files_in) > 1:
     for i in files_out:
         os.remove(i)
 
+# -----------------------------------------------------------------------------
+# Create memory-mappable lookup table file (optional)
+# -----------------------------------------------------------------------------
+
+if lut_file and (rank == 0):
+
+    print("Write memory-mappable lookup table")
+    ds = xr.open_dataset(path_work + file_out, mask_and_scale=False)
+    rays.save_lookup_table(path_work + file_out[:-3] + ".lut",
+                           ds["f_cor"].values,
+                           ds["subsolar_lat"].values.astype(np.float64),
+                           ds["subsolar_lon"].values.astype(np.float64),
+                           sw_dir_cor_max=sw_dir_cor_max)
+    ds.close()
+
 # -----------------------------------------------------------------------------
 # Create 'ncview-viewable' NetCDF file (optional)
 # -----------------------------------------------------------------------------
 
-if ncview_reorder:
+if ncview_reorder and (rank == 0):
 
     print("Transpose dimensions")
     ds = xr.open_dataset(path_work + file_out)
@@ -3,6 +3,8 @@
 #SBATCH --account="pr133"
 #SBATCH --time=02:58:00
 #SBATCH --nodes=1
+# -> increase number of nodes for multi-node (MPI) run (one rank per node;
+#    requires mpi4py)
 #SBATCH --ntasks-per-core=2
 #SBATCH --ntasks-per-node=1
 #SBATCH --cpus-per-task=24
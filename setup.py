@@ -40,6 +40,38 @@ libraries_cython = ["m", "pthread"]
 include_dirs_cpp = [np.get_include()]
 extra_objects_cpp = [path_lib_conda + i + lib_end for i in ["libembree3"]]
 
+# -----------------------------------------------------------------------------
+# Shared C++ core library (Embree scene, geometry and horizon functions;
+# compiled once and linked by 'build_ext' to all extensions)
+# -----------------------------------------------------------------------------
+
+libraries_core = [
+    ("subgrid_core",
+     {"sources": ["subgrid_radiation/embree_core.cpp",
+                  "subgrid_radiation/horizon_file.cpp",
+                  "subgrid_radiation/lut_encoding.cpp",
+                  "subgrid_radiation/lut_eval.cpp",
+                  "subgrid_radiation/cell_schedule.cpp",
+                  "subgrid_radiation/sun_simd.cpp",
+                  "subgrid_radiation/svf_simd.cpp",
+                  "subgrid_radiation/scratch_arena.cpp",
+                  "subgrid_radiation/refraction.cpp",
+                  "subgrid_radiation/dem_vertices.cpp",
+                  "subgrid_radiation/kernel_stats.cpp",
+                  "subgrid_radiation/kernel_variants.cpp",
+                  "subgrid_radiation/adaptive_sampling.cpp",
+                  "subgrid_radiation/heightfield.cpp"],
+      "include_dirs": include_dirs_cpp + ["subgrid_radiation"],
+      "cflags": ["-O3", "-fPIC"]})]
+
+
+class build_ext_core(build_ext):
+    """Build shared C++ core library before extensions (also for in-place
+    builds, which do not run 'build_clib')."""
+    def run(self):
+        self.run_command("build_clib")
+        build_ext.run(self)
+
 # -----------------------------------------------------------------------------
 # Compile Cython/C++ code
 # -----------------------------------------------------------------------------
@@ -52,18 +84,20 @@ ext_modules = [
               libraries=libraries_cython,
               extra_compile_args=extra_compile_args_cython,
               extra_link_args=["-fopenmp"],
-              include_dirs=[np.get_include()]),
+              include_dirs=include_dirs_cpp + ["subgrid_radiation"],
+              extra_objects=extra_objects_cpp,
+              language="c++"),
     Extension("subgrid_radiation.sun_position_array.rays",
               sources=["subgrid_radiation/sun_position_array/rays.pyx",
               "subgrid_radiation/sun_position_array/rays_comp.cpp"],
-              include_dirs=include_dirs_cpp,
+              include_dirs=include_dirs_cpp + ["subgrid_radiation"],
               extra_objects=extra_objects_cpp,
               extra_compile_args=["-O3"],
               language="c++"),
     Extension("subgrid_radiation.sun_position_array.horizon",
               sources=["subgrid_radiation/sun_position_array/horizon.pyx",
               "subgrid_radiation/sun_position_array/horizon_comp.cpp"],
-              include_dirs=include_dirs_cpp,
+              include_dirs=include_dirs_cpp + ["subgrid_radiation"],
               extra_objects=extra_objects_cpp,
               extra_compile_args=["-O3"],
               language="c++"),
@@ -79,5 +113,6 @@ ext_modules = [
 setup(name="subgrid_radiation",
       version="0.1",
       packages=["subgrid_radiation"],
-      cmdclass={"build_ext": build_ext},
+      cmdclass={"build_ext": build_ext_core},
+      libraries=libraries_core,
       ext_modules=ext_modules)
@@ -3,3 +3,39 @@ from . import sun_position_array
 from . import sun_position
 from . import auxiliary
 from . import ocean_masking
+
+
+# Modules with ray tracing kernels
+_kernel_modules = (sun_position_array.rays, sun_position_array.horizon,
+                   sun_position)
+
+# Settings of ray tracing kernels (shared by all extension modules)
+_verbosity = 1
+_stats_cells = False
+
+
+def set_verbosity(level):
+    """Set verbosity of ray tracing kernels of all extension modules
+    (0: silent, 1: settings, timings and ray counts). Errors are always
+    written to stderr."""
+    global _verbosity
+    if level not in (0, 1):
+        raise ValueError("value for 'level' must be 0 or 1")
+    for module in _kernel_modules:
+        module._set_verbosity(level)
+    _verbosity = level
+
+
+def get_verbosity():
+    """Return verbosity of ray tracing kernels."""
+    return _verbosity
+
+
+def set_stats_cells(record):
+    """Enable/disable recording of the number of rays per grid cell in
+    subsequent kernel calls of all extension modules (returned as 'rays_gc'
+    by 'kernel_stats' of the respective module)."""
+    global _stats_cells
+    for module in _kernel_modules:
+        module._set_stats_cells(bool(record))
+    _stats_cells = bool(record)
@@ -0,0 +1,97 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "adaptive_sampling.h"
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+//#############################################################################
+// Sampling strides
+//#############################################################################
+
+int adapt_stride_init(int pixel_per_gc, int stride_max) {
+
+    int stride = 1;
+    for (int s = 2; s <= std::min(pixel_per_gc, stride_max); s++) {
+        if ((pixel_per_gc % s) == 0) {
+            stride = s;
+        }
+    }
+    return stride;
+
+}
+
+int adapt_stride_refine(int stride) {
+
+    for (int p = 2; p <= stride; p++) {
+        if ((stride % p) == 0) {
+            return stride / p;
+        }
+    }
+    return 1;
+
+}
+
+//#############################################################################
+// Sampled pixels
+//#############################################################################
+
+size_t adapt_level_pixels(int pixel_per_gc, int stride, int stride_prev,
+    int* pixels) {
+    /* Parameters
+       ----------
+       pixel_per_gc: number of subgrid pixels within one grid cell [-]
+       stride: stride of sample [pixels]
+       stride_prev: stride of previous (coarser) sample; 0 if none [pixels]
+       pixels: local linear indices of added pixels (output) [-]
+
+       Returns
+       ----------
+       num_pixels: number of added pixels [-]
+    */
+
+    size_t num_pixels = 0;
+    for (int k = 0; k < pixel_per_gc; k += stride) {
+        for (int m = 0; m < pixel_per_gc; m += stride) {
+            if ((stride_prev > 0) && ((k % stride_prev) == 0)
+                && ((m % stride_prev) == 0)) {
+                continue;  // already in previous sample
+            }
+            pixels[num_pixels] = k * pixel_per_gc + m;
+            num_pixels += 1;
+        }
+    }
+    return num_pixels;
+
+}
+
+//#############################################################################
+// Error estimate
+//#############################################################################
+
+double adapt_std_err(double sum, double sum_sq, size_t num, size_t num_pop) {
+    /* Parameters
+       ----------
+       sum: sum of sampled values
+       sum_sq: sum of squares of sampled values
+       num: number of sampled values [-]
+       num_pop: size of population [-]
+
+       Returns
+       ----------
+       std_err: standard error of sample mean
+    */
+
+    if (num >= num_pop) {
+        return 0.0;
+    }
+    if (num < ADAPT_SAMPLES_MIN) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double var = (sum_sq - (sum * sum) / (double)num) / (double)(num - 1);
+    var = std::max(var, 0.0);  // round-off
+    double fpc = 1.0 - (double)num / (double)num_pop;
+    return sqrt(fpc * var / (double)num);
+
+}
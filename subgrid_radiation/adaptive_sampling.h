@@ -0,0 +1,43 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef ADAPTIVE_SAMPLING_H
+#define ADAPTIVE_SAMPLING_H
+
+#include <cstddef>
+
+// Adaptive subsampling of the triangles of a grid cell: pixels are sampled
+// on a regular lattice with stride s (pixel (0, 0) of every s x s block of
+// the grid cell -> systematic sample with fixed offset, not randomised;
+// both triangles of a sampled pixel are traced). The mean of the sampled
+// triangles estimates the aggregate of the grid cell. The standard error is
+// estimated as for a simple random sample (terrain that varies periodically
+// with the stride is not detected). If the estimated standard error of this mean exceeds the tolerance,
+// the stride is refined (divided by its smallest prime factor; samples of
+// coarser strides are reused) until the error is within the tolerance or
+// all pixels are traced (stride 1 -> exact aggregate, error 0.0).
+
+// Minimal number of sampled triangles for an estimate of the standard error
+// (smaller samples are always refined)
+#define ADAPT_SAMPLES_MIN 8
+
+// Initial stride (largest divisor of 'pixel_per_gc' not exceeding
+// 'stride_max'; all strides of the refinement then divide 'pixel_per_gc')
+int adapt_stride_init(int pixel_per_gc, int stride_max);
+
+// Refined stride (divided by its smallest prime factor; 1 for stride 1)
+int adapt_stride_refine(int stride);
+
+// Pixels added to sample when refining from 'stride_prev' to 'stride'
+// (stride_prev = 0: initial sample) as local linear indices within grid
+// cell (k * pixel_per_gc + m). 'pixels' must hold pixel_per_gc ^ 2
+// elements. Returns the number of added pixels.
+size_t adapt_level_pixels(int pixel_per_gc, int stride, int stride_prev,
+    int* pixels);
+
+// Standard error of sample mean (sample of 'num' out of 'num_pop' elements;
+// with finite population correction). Returns infinity for samples smaller
+// than ADAPT_SAMPLES_MIN (and 0.0 for the full population).
+double adapt_std_err(double sum, double sum_sq, size_t num, size_t num_pop);
+
+#endif
@@ -93,3 +93,107 @@ def pad_buffer(buffer):
     buffer = np.append(buffer, np.zeros(add_elem, dtype=buffer.dtype))
 
     return buffer
+
+
+# -----------------------------------------------------------------------------
+
+def mpi_comm():
+    """Get MPI communicator (multi-node runs).
+
+    Returns the world communicator of 'mpi4py' if the script is run with more
+    than one MPI rank. Otherwise (single rank or 'mpi4py' not installed), a
+    serial run is assumed.
+
+    Returns
+    -------
+    comm : mpi4py.MPI.Comm or None
+        MPI communicator (None for serial runs)
+    rank : int
+        Rank of process
+    size : int
+        Number of ranks"""
+
+    try:
+        from mpi4py import MPI
+    except ImportError:
+        return None, 0, 1
+    comm = MPI.COMM_WORLD
+    if comm.Get_size() == 1:
+        return None, 0, 1
+
+    return comm, comm.Get_rank(), comm.Get_size()
+
+
+# -----------------------------------------------------------------------------
+
+def partition_rows(mask, num_parts):
+    """Partition grid cell rows into contiguous bands.
+
+    Partition rows of grid cells into contiguous bands with (approximately)
+    the same number of active (non-masked) grid cells. Each band contains at
+    least one row.
+
+    Parameters
+    ----------
+    mask : ndarray of uint8
+        Array (two-dimensional) with grid cells for which output is computed
+        (1) [-]
+    num_parts : int
+        Number of bands (e.g. number of MPI ranks) [-]
+
+    Returns
+    -------
+    bands : list of tuple
+        Bands of grid cell rows (row_beg, row_end) [-]"""
+
+    # Check arguments
+    if mask.ndim != 2:
+        raise ValueError("argument 'mask' must be two-dimensional")
+    if (num_parts < 1) or (num_parts > mask.shape[0]):
+        raise ValueError("number of bands must be in the range [1, number "
+                         + "of grid cell rows]")
+
+    # Cost per row (masked grid cells are cheap but not free)
+    cost = (mask == 1).sum(axis=1).astype(np.float64) + 1.0
+    cost_cum = np.cumsum(cost)
+    bounds = np.searchsorted(cost_cum, cost_cum[-1] / num_parts
+                             * np.arange(1, num_parts), side="left") + 1
+    row_beg = [0]
+    for i in range(num_parts - 1):
+        # ensure at least one row per band
+        row_beg.append(int(min(max(bounds[i], row_beg[-1] + 1),
+                               mask.shape[0] - (num_parts - 1 - i))))
+    row_end = row_beg[1:] + [mask.shape[0]]
+
+    return list(zip(row_beg, row_end))
+
+
+# -----------------------------------------------------------------------------
+
+def dem_row_slices(row_beg, row_end, pixel_per_gc, offset_gc):
+    """Slices of DEM rows for band of grid cell rows.
+
+    Parameters
+    ----------
+    row_beg : int
+        First row of grid cells (inner domain) [-]
+    row_end : int
+        Row of grid cells after last row (inner domain) [-]
+    pixel_per_gc : int
+        Number of subgrid pixels within one grid cell (along one dimension)
+    offset_gc : int
+        Offset number of grid cells
+
+    Returns
+    -------
+    slice_dem : slice
+        Rows of DEM (including halo of 'offset_gc' grid cells)
+    slice_dem_in : slice
+        Rows of inner DEM (relative to DEM including halo)"""
+
+    slice_dem = slice(row_beg * pixel_per_gc,
+                      (row_end + 2 * offset_gc) * pixel_per_gc + 1)
+    slice_dem_in = slice((row_beg + offset_gc) * pixel_per_gc,
+                         (row_end + offset_gc) * pixel_per_gc + 1)
+
+    return slice_dem, slice_dem_in
@@ -0,0 +1,340 @@
+# Description: Benchmark of ray tracing kernels. Runs all kernels of the
+#              modules 'rays' and 'horizon' on synthetic DEMs of several sizes
+#              with several thread counts and scene geometry types and writes
+#              one JSON record per run (JSON Lines). Records of a baseline (e.g. previous release) can
+#              be compared to detect performance regressions. A native
+#              counterpart (without Python overhead) is provided in
+#              'benchmark/bench_kernels.cpp'.
+#
+# Usage: python -m subgrid_radiation.benchmark --sizes 20,40,80
+#            --threads 1,4,0 [--geom_types grid,heightfield]
+#            --output results.jsonl [--baseline base.jsonl]
+#
+# Copyright (c) 2023 ETH Zurich, Christian R. Steger
+# MIT License
+
+# Load modules
+import os
+import sys
+import json
+import time
+import argparse
+import subprocess
+import numpy as np
+from subgrid_radiation import auxiliary
+
+# -----------------------------------------------------------------------------
+# Settings
+# -----------------------------------------------------------------------------
+
+pixel_per_gc = 10  # subgrid pixels per grid cell [-]
+offset_gc = 5  # offset of inner domain [grid cells]
+dx = 100.0  # pixel spacing [metre]
+dist_search = 20.0  # search distance [kilometre]
+hori_azim_num, hori_acc = 72, 1.25
+elev_ang_low_lim = -15.0  # [degree]
+lu_lon = np.linspace(-180.0, 170.0, 36, dtype=np.float64)  # 10 degree
+lu_lat = np.linspace(0.0, 90.0, 10, dtype=np.float64)  # 10 degree
+
+# Kernels (name, ray algorithm)
+kernels = [("sw_dir_cor", ""),
+           ("sw_dir_cor_coherent", ""),
+           ("sw_dir_cor_coherent_rp8", ""),
+           ("sw_dir_cor_stream", ""),
+           ("sky_view_factor", "discrete_sampling"),
+           ("sky_view_factor", "binary_search"),
+           ("sky_view_factor", "binary_search_packet4"),
+           ("sky_view_factor", "binary_search_packet"),
+           ("sky_view_factor", "binary_search_packet16"),
+           ("sky_view_factor", "guess_constant"),
+           ("sky_view_factor_sw_dir_cor", "guess_constant")]
+
+
+# -----------------------------------------------------------------------------
+
+def synthetic_dem(num_gc):
+    """Synthetic Digital Elevation Model (DEM).
+
+    DEM with a 'lowered' hemisphere (as in 'test/*_artificial.py'), scaled
+    with the domain extent, in local ENU coordinates.
+
+    Parameters
+    ----------
+    num_gc : int
+        Number of grid cells per side of inner domain
+
+    Returns
+    -------
+    data : dict
+        Vertex buffers, dimensions, sun positions and mask"""
+
+    dem_dim = (num_gc + 2 * offset_gc) * pixel_per_gc + 1
+    half = (dem_dim - 1) / 2.0 * dx
+    x = np.linspace(-half, half, dem_dim, dtype=np.float32)
+    x, y = np.meshgrid(x, x)
+    radius = 0.4 * half
+    lower = 0.25 * radius
+    with np.errstate(invalid="ignore"):
+        z = np.sqrt(radius ** 2 - x ** 2 - y ** 2) - lower
+    z[np.isnan(z)] = 0.0
+    z[z < 0.0] = 0.0
+    slice_in = (slice(pixel_per_gc * offset_gc, -pixel_per_gc * offset_gc),
+                slice(pixel_per_gc * offset_gc, -pixel_per_gc * offset_gc))
+    r_sun = 20000.0 + 10.0 ** 9
+    lu_lon_2d, lu_lat_2d = np.meshgrid(np.deg2rad(lu_lon), np.deg2rad(lu_lat))
+    sun_pos = np.stack((r_sun * np.cos(lu_lat_2d) * np.cos(lu_lon_2d),
+                        r_sun * np.cos(lu_lat_2d) * np.sin(lu_lon_2d),
+                        r_sun * np.sin(lu_lat_2d)), axis=2)
+    data = {"vert_grid": auxiliary.rearrange_pad_buffer(x, y, z),
+            "dem_dim_0": dem_dim, "dem_dim_1": dem_dim,
+            "vert_grid_in": auxiliary.rearrange_pad_buffer(
+                x[slice_in], y[slice_in], np.zeros_like(z[slice_in])),
+            "dem_dim_in_0": num_gc * pixel_per_gc + 1,
+            "dem_dim_in_1": num_gc * pixel_per_gc + 1,
+            "sun_pos": sun_pos,
+            "mask": np.ones((num_gc, num_gc), dtype=np.uint8)}
+
+    return data
+
+
+# -----------------------------------------------------------------------------
+
+def _reset_peak_rss():
+    """Reset peak resident set size (Linux only)."""
+    try:
+        with open("/proc/self/clear_refs", "w") as file:
+            file.write("5")
+    except OSError:
+        pass
+
+
+def _peak_rss_mb():
+    """Peak resident set size since last reset [MB]."""
+    try:
+        with open("/proc/self/status") as file:
+            for line in file:
+                if line.startswith("VmHWM:"):
+                    return float(line.split()[1]) / 1024.0  # [kB] to [MB]
+    except OSError:
+        pass
+    import resource
+    rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    if sys.platform == "darwin":
+        return rss / (1024.0 ** 2)  # [byte]
+    return rss / 1024.0  # [kB]
+
+
+# -----------------------------------------------------------------------------
+
+def _run_kernel(kernel, ray_algorithm, data, scene):
+    """Run kernel with reused scene and return its statistics."""
+
+    from subgrid_radiation.sun_position_array import rays, horizon
+    args = (data["vert_grid"], data["dem_dim_0"], data["dem_dim_1"],
+            data["vert_grid_in"], data["dem_dim_in_0"], data["dem_dim_in_1"])
+    kwargs = {"mask": data["mask"], "dist_search": dist_search,
+              "scene": scene}
+    if kernel.startswith("sw_dir_cor"):
+        getattr(rays, kernel)(*args, data["sun_pos"], pixel_per_gc,
+                              offset_gc, **kwargs)
+        return rays.kernel_stats()
+    else:
+        kwargs.update({"hori_azim_num": hori_azim_num, "hori_acc": hori_acc,
+                       "ray_algorithm": ray_algorithm,
+                       "elev_ang_low_lim": elev_ang_low_lim})
+        if kernel == "sky_view_factor":
+            horizon.sky_view_factor(*args, pixel_per_gc, offset_gc,
+                                    **kwargs)
+        else:
+            horizon.sky_view_factor_sw_dir_cor(*args, data["sun_pos"],
+                                               pixel_per_gc, offset_gc,
+                                               **kwargs)
+        return horizon.kernel_stats()
+
+
+def _run_scene(data, num_gc, num_threads, repeat, geom_type):
+    """Run all kernels with scene of given geometry type."""
+
+    from subgrid_radiation.sun_position_array import rays
+    records = []
+    scene = rays.Scene()
+    scene.initialise(data["vert_grid"], data["dem_dim_0"],
+                     data["dem_dim_1"], geom_type=geom_type)
+    stats_scene = rays.kernel_stats()
+    for kernel, ray_algorithm in kernels:
+        record = {"kernel": kernel, "ray_algorithm": ray_algorithm,
+                  "geom_type": geom_type,
+                  "num_gc": num_gc, "dem_dim": data["dem_dim_0"],
+                  "threads": num_threads,
+                  "bvh_build_time_s": stats_scene["time_bvh"],
+                  "bvh_memory_mb": stats_scene["mem_bvh"],
+                  "wall_time_s": np.inf, "peak_rss_mb": 0.0}
+        for _ in range(repeat):  # best of 'repeat' runs
+            _reset_peak_rss()
+            t_beg = time.perf_counter()
+            stats = _run_kernel(kernel, ray_algorithm, data, scene)
+            wall_time = time.perf_counter() - t_beg
+            if wall_time < record["wall_time_s"]:
+                record["wall_time_s"] = wall_time
+                record["ray_time_s"] = stats["time_ray"]
+                record["num_rays"] = stats["num_rays"]
+                record["num_rays_culled"] = stats["num_rays_culled"]
+            record["peak_rss_mb"] = max(record["peak_rss_mb"],
+                                        _peak_rss_mb())
+        record["rays_per_s"] = record["num_rays"] / record["ray_time_s"]
+        records.append(record)
+        print(json.dumps(record), flush=True)
+
+    return records
+
+
+def _run_worker(sizes, num_threads, repeat, geom_types):
+    """Run all kernels, sizes and geometry types in current process. The
+    number of threads is set by the parent process via the CPU affinity mask
+    (respected by TBB)."""
+
+    import subgrid_radiation
+    from subgrid_radiation.sun_position_array import rays
+    subgrid_radiation.set_verbosity(0)
+    records = []
+    for num_gc in sizes:
+        data = synthetic_dem(num_gc)
+        for geom_type in geom_types:
+            records.extend(_run_scene(data, num_gc, num_threads, repeat,
+                                      geom_type))
+
+    return records
+
+
+# -----------------------------------------------------------------------------
+
+def run(sizes=(20, 40, 80), threads=(1, 0), repeat=1, geom_types=("grid",)):
+    """Run benchmark.
+
+    Each thread count is run in a separate process whose CPU affinity is
+    restricted to the given number of cores (Linux only; otherwise, all
+    cores are used).
+
+    Parameters
+    ----------
+    sizes : sequence of int
+        Number of grid cells per side of inner domain
+    threads : sequence of int
+        Number of threads (0: all available cores)
+    repeat : int
+        Number of repetitions per kernel (best run is reported)
+    geom_types : sequence of str
+        Geometry types of scene (triangle, quad, grid, heightfield)
+
+    Returns
+    -------
+    records : list of dict
+        Benchmark records (one per kernel, size, thread count and geometry
+        type)"""
+
+    cores = sorted(os.sched_getaffinity(0)) \
+        if hasattr(os, "sched_getaffinity") else list(range(os.cpu_count()))
+    records = []
+    for num_threads in threads:
+        if (num_threads <= 0) or (num_threads > len(cores)):
+            num_threads = len(cores)
+        cpus = set(cores[:num_threads])
+        preexec_fn = (lambda: os.sched_setaffinity(0, cpus)) \
+            if hasattr(os, "sched_setaffinity") else None
+        cmd = [sys.executable, "-m", "subgrid_radiation.benchmark",
+               "--worker", "--sizes", ",".join([str(i) for i in sizes]),
+               "--threads", str(num_threads), "--repeat", str(repeat),
+               "--geom_types", ",".join(geom_types)]
+        proc = subprocess.run(cmd, stdout=subprocess.PIPE, check=True,
+                              text=True, preexec_fn=preexec_fn)
+        records.extend([json.loads(line) for line
+                        in proc.stdout.splitlines() if line.startswith("{")])
+
+    return records
+
+
+def compare(records, records_base, tolerance=0.1):
+    """Compare benchmark records with baseline.
+
+    Parameters
+    ----------
+    records : list of dict
+        Benchmark records
+    records_base : list of dict
+        Benchmark records of baseline
+    tolerance : float
+        Tolerated relative decrease in rays per second [-]
+
+    Returns
+    -------
+    regressions : list of str
+        Description of regressions"""
+
+    def key(r):
+        return r["kernel"], r["ray_algorithm"], r.get("geom_type", "grid"), \
+            r["num_gc"], r["threads"]
+
+    base = {key(r): r for r in records_base}
+    regressions = []
+    for r in records:
+        if key(r) not in base:
+            continue
+        ratio = r["rays_per_s"] / base[key(r)]["rays_per_s"]
+        if ratio < (1.0 - tolerance):
+            regressions.append(
+                "%s %s (geom_type: %s, num_gc: %d, threads: %d): "
+                "rays/s %.3e -> %.3e"
+                % (r["kernel"], r["ray_algorithm"], key(r)[2], r["num_gc"],
+                   r["threads"], base[key(r)]["rays_per_s"],
+                   r["rays_per_s"]))
+
+    return regressions
+
+
+# -----------------------------------------------------------------------------
+
+def main():
+
+    parser = argparse.ArgumentParser(description="Benchmark of ray tracing "
+                                                 "kernels")
+    parser.add_argument("--sizes", default="20,40,80")
+    parser.add_argument("--threads", default="1,0")
+    parser.add_argument("--repeat", type=int, default=1)
+    parser.add_argument("--geom_types", default="grid")
+    parser.add_argument("--output", default=None)
+    parser.add_argument("--baseline", default=None)
+    parser.add_argument("--tolerance", type=float, default=0.1)
+    parser.add_argument("--worker", action="store_true",
+                        help=argparse.SUPPRESS)
+    args = parser.parse_args()
+    sizes = [int(i) for i in args.sizes.split(",")]
+    threads = [int(i) for i in args.threads.split(",")]
+    geom_types = args.geom_types.split(",")
+
+    if args.worker:
+        _run_worker(sizes, threads[0], max(args.repeat, 1), geom_types)
+        return
+
+    records = run(sizes, threads, max(args.repeat, 1), geom_types)
+    if args.output is not None:
+        with open(args.output, "w") as file:
+            for r in records:
+                file.write(json.dumps(r) + "\n")
+        print("Benchmark records written to " + args.output)
+    else:
+        for r in records:
+            print(json.dumps(r))
+    if args.baseline is not None:
+        with open(args.baseline) as file:
+            records_base = [json.loads(line) for line in file
+                            if line.strip()]
+        regressions = compare(records, records_base, args.tolerance)
+        print("Number of regressions: %d" % len(regressions))
+        for i in regressions:
+            print(i)
+        if len(regressions) > 0:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,129 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "cell_schedule.h"
+#include "geometry_core.h"
+#include <algorithm>
+#include <tbb/parallel_for.h>
+
+//#############################################################################
+// Cost estimate
+//#############################################################################
+
+double cell_cost(float* vert_grid, int dem_dim_1, int pixel_per_gc,
+    int offset_gc, size_t i, size_t j) {
+    /* Parameters
+       ----------
+       vert_grid: array with vertices of DEM in ENU coordinates [metre]
+       dem_dim_1: dimension length of DEM in x-direction [-]
+       pixel_per_gc: number of subgrid pixels within one grid cell [-]
+       offset_gc: offset number of grid cells [-]
+       i: index of grid cell in y-direction [-]
+       j: index of grid cell in x-direction [-]
+
+       Returns
+       ----------
+       cost: variance of elevation of DEM vertices within grid cell [m2]
+    */
+
+    size_t k_beg = (i + offset_gc) * pixel_per_gc;
+    size_t m_beg = (j + offset_gc) * pixel_per_gc;
+    double sum = 0.0;
+    double sum_sq = 0.0;
+    for (size_t k = k_beg; k <= (k_beg + pixel_per_gc); k++) {
+        for (size_t m = m_beg; m <= (m_beg + pixel_per_gc); m++) {
+            double elev = (double)vert_grid[lin_ind_2d(dem_dim_1, k, m) * 3
+                + 2];
+            sum += elev;
+            sum_sq += elev * elev;
+        }
+    }
+    double num = (double)((pixel_per_gc + 1) * (pixel_per_gc + 1));
+    return std::max((sum_sq / num) - (sum / num) * (sum / num), 0.0);
+
+}
+
+//#############################################################################
+// Compacted list of active grid cells
+//#############################################################################
+
+struct CellCost {
+    double cost;
+    size_t lin_ind_gc;
+};
+
+size_t* active_cells(uint8_t* mask, size_t num_gc_x, size_t row_beg,
+    size_t row_end, float* vert_grid, int dem_dim_1, int pixel_per_gc,
+    int offset_gc, int cost_order, size_t &num_cells) {
+    /* Parameters
+       ----------
+       mask: array with grid cells for which output is computed (1) [-]
+       num_gc_x: number of grid cells in x-direction [-]
+       row_beg: first row of grid cells [-]
+       row_end: row of grid cells after last row [-]
+       vert_grid: array with vertices of DEM in ENU coordinates [metre]
+       dem_dim_1: dimension length of DEM in x-direction [-]
+       pixel_per_gc: number of subgrid pixels within one grid cell [-]
+       offset_gc: offset number of grid cells [-]
+       cost_order: order cells by decreasing cost estimate (1) or by
+                   tiles (0) [-]
+       num_cells: number of active grid cells [-]
+
+       Returns
+       ----------
+       cells: linear indices of active grid cells
+    */
+
+    num_cells = 0;
+    for (size_t i = row_beg; i < row_end; i++) {
+        for (size_t j = 0; j < num_gc_x; j++) {
+            if (mask[lin_ind_2d(num_gc_x, i, j)] == 1) {
+                num_cells += 1;
+            }
+        }
+    }
+    size_t* cells = new size_t[std::max(num_cells, (size_t)1)];
+
+    // Order by tiles
+    size_t ind = 0;
+    for (size_t i_t = row_beg; i_t < row_end; i_t += CELL_TILE_SIZE) {
+        for (size_t j_t = 0; j_t < num_gc_x; j_t += CELL_TILE_SIZE) {
+            for (size_t i = i_t; i < std::min(i_t + CELL_TILE_SIZE, row_end);
+                i++) {
+                for (size_t j = j_t;
+                    j < std::min(j_t + CELL_TILE_SIZE, num_gc_x); j++) {
+                    size_t lin_ind_gc = lin_ind_2d(num_gc_x, i, j);
+                    if (mask[lin_ind_gc] == 1) {
+                        cells[ind] = lin_ind_gc;
+                        ind += 1;
+                    }
+                }
+            }
+        }
+    }
+
+    // Order by decreasing cost estimate (optional; ties keep tile order)
+    if ((cost_order == 1) && (num_cells > 1)) {
+        CellCost* cell_cost_list = new CellCost[num_cells];
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, num_cells),
+            [&](tbb::blocked_range<size_t> r) {
+            for (size_t ind = r.begin(); ind < r.end(); ++ind) {
+                cell_cost_list[ind].lin_ind_gc = cells[ind];
+                cell_cost_list[ind].cost = cell_cost(vert_grid, dem_dim_1,
+                    pixel_per_gc, offset_gc, cells[ind] / num_gc_x,
+                    cells[ind] % num_gc_x);
+            }
+        });
+        std::stable_sort(cell_cost_list, cell_cost_list + num_cells,
+            [](const CellCost &a, const CellCost &b) {
+            return a.cost > b.cost;
+        });
+        for (size_t ind = 0; ind < num_cells; ind++) {
+            cells[ind] = cell_cost_list[ind].lin_ind_gc;
+        }
+        delete[] cell_cost_list;
+    }
+
+    return cells;
+
+}
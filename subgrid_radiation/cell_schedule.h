@@ -0,0 +1,31 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef CELL_SCHEDULE_H
+#define CELL_SCHEDULE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Scheduling of grid cells: instead of distributing rows of grid cells
+// among threads (unbalanced for partially masked domains, e.g. coastal
+// regions), the active grid cells (mask == 1) are compacted into a list
+// over which the work is distributed dynamically. Cells are ordered by
+// square tiles (-> spatially coherent rays of consecutively processed
+// cells) or by a decreasing cost estimate (-> expensive cells first, the
+// end of the schedule consists of cheap cells that balance the load).
+
+// Side length of tiles [grid cells]
+#define CELL_TILE_SIZE 8
+
+// Compacted list of active grid cells within rows [row_beg, row_end)
+// (linear indices of grid cells; the returned array must be deleted)
+size_t* active_cells(uint8_t* mask, size_t num_gc_x, size_t row_beg,
+    size_t row_end, float* vert_grid, int dem_dim_1, int pixel_per_gc,
+    int offset_gc, int cost_order, size_t &num_cells);
+
+// Cost estimate of grid cell (variance of elevation of DEM vertices) [m2]
+double cell_cost(float* vert_grid, int dem_dim_1, int pixel_per_gc,
+    int offset_gc, size_t i, size_t j);
+
+#endif
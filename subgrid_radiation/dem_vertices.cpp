@@ -0,0 +1,147 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "dem_vertices.h"
+#include "geometry_core.h"
+#include <algorithm>
+#include <functional>
+#include <tbb/parallel_reduce.h>
+#include <tbb/blocked_range.h>
+
+//#############################################################################
+// Vertex buffer layout
+//#############################################################################
+
+size_t vertex_buffer_size(size_t num_vert) {
+    /* Parameters
+       ----------
+       num_vert: number of vertices [-]
+
+       Returns
+       ----------
+       num_elem: number of elements (float) of padded vertex buffer [-]
+    */
+
+    size_t num_elem = num_vert * 3;
+    size_t add_elem = 16;
+    size_t num_bytes = num_elem * sizeof(float);
+    if ((num_bytes % 16) != 0) {
+        add_elem += (16 - (num_bytes % 16)) / sizeof(float);
+    }
+    return num_elem + add_elem;
+
+}
+
+//#############################################################################
+// Fused lon/lat -> ECEF -> ENU transformation
+//#############################################################################
+
+double dem_vertices(const double* lon, const double* lat,
+    const float* elevation, int dim_0, int dim_1, int offset_px,
+    double lon_or, double lat_or, double radius_earth, float* vert_grid,
+    float* vert_grid_in) {
+    /* Parameters
+       ----------
+       lon: array with geographic longitude (dim_0, dim_1) [degree]
+       lat: array with geographic latitude (dim_0, dim_1) [degree]
+       elevation: array with elevation above sphere (dim_0, dim_1) [metre]
+       dim_0: dimension length of DEM in y-direction [-]
+       dim_1: dimension length of DEM in x-direction [-]
+       offset_px: offset of inner domain (number of pixels) [-]
+       lon_or: longitude of origin of ENU coordinate system [degree]
+       lat_or: latitude of origin of ENU coordinate system [degree]
+       radius_earth: radius of Earth [metre]
+       vert_grid: padded vertex buffer of DEM [metre]
+       vert_grid_in: padded vertex buffer of inner domain with 0.0 m
+                     elevation (optional) [metre]
+
+       Returns
+       ----------
+       value_abs_max: maximal absolute ENU coordinate of inner domain
+                      [metre]
+    */
+
+    // Origin of ENU coordinate system
+    double sin_lon_or = sin(deg2rad(lon_or));
+    double cos_lon_or = cos(deg2rad(lon_or));
+    double sin_lat_or = sin(deg2rad(lat_or));
+    double cos_lat_or = cos(deg2rad(lat_or));
+    double x_ecef_or = radius_earth * cos_lat_or * cos_lon_or;
+    double y_ecef_or = radius_earth * cos_lat_or * sin_lon_or;
+    double z_ecef_or = radius_earth * sin_lat_or;
+    // origin in ENU coordinates of rotated frame (-> ECEF -> ENU is applied
+    // as rotation of position minus rotated origin)
+    double or_x = - sin_lon_or * x_ecef_or + cos_lon_or * y_ecef_or;
+    double or_y = - sin_lat_or * cos_lon_or * x_ecef_or
+        - sin_lat_or * sin_lon_or * y_ecef_or + cos_lat_or * z_ecef_or;
+    double or_z = cos_lat_or * cos_lon_or * x_ecef_or
+        + cos_lat_or * sin_lon_or * y_ecef_or + sin_lat_or * z_ecef_or;
+
+    int dim_in_1 = dim_1 - 2 * offset_px;
+    double value_abs_max = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, dim_0), 0.0,
+        [&](tbb::blocked_range<size_t> r, double value_max) {
+
+        for (size_t i = r.begin(); i < r.end(); ++i) {
+            bool row_in = (i >= (size_t)offset_px)
+                && (i < (size_t)(dim_0 - offset_px));
+            for (size_t j = 0; j < (size_t)dim_1; j++) {
+
+                size_t ind = lin_ind_2d(dim_1, i, j);
+                double sin_lon = sin(deg2rad(lon[ind]));
+                double cos_lon = cos(deg2rad(lon[ind]));
+                double sin_lat = sin(deg2rad(lat[ind]));
+                double cos_lat = cos(deg2rad(lat[ind]));
+
+                // Rotated unit vector of position (ECEF -> ENU)
+                double e_x = - sin_lon_or * cos_lat * cos_lon
+                    + cos_lon_or * cos_lat * sin_lon;
+                double e_y = - sin_lat_or * cos_lon_or * cos_lat * cos_lon
+                    - sin_lat_or * sin_lon_or * cos_lat * sin_lon
+                    + cos_lat_or * sin_lat;
+                double e_z = cos_lat_or * cos_lon_or * cos_lat * cos_lon
+                    + cos_lat_or * sin_lon_or * cos_lat * sin_lon
+                    + sin_lat_or * sin_lat;
+
+                // DEM
+                double rad = radius_earth + (double)elevation[ind];
+                vert_grid[ind * 3 + 0] = (float)(rad * e_x - or_x);
+                vert_grid[ind * 3 + 1] = (float)(rad * e_y - or_y);
+                vert_grid[ind * 3 + 2] = (float)(rad * e_z - or_z);
+
+                // Inner domain with 0.0 m elevation
+                if ((vert_grid_in != NULL) && row_in
+                    && (j >= (size_t)offset_px)
+                    && (j < (size_t)(dim_1 - offset_px))) {
+                    size_t ind_in = lin_ind_2d(dim_in_1, i - offset_px,
+                        j - offset_px);
+                    double x = radius_earth * e_x - or_x;
+                    double y = radius_earth * e_y - or_y;
+                    double z = radius_earth * e_z - or_z;
+                    vert_grid_in[ind_in * 3 + 0] = (float)x;
+                    vert_grid_in[ind_in * 3 + 1] = (float)y;
+                    vert_grid_in[ind_in * 3 + 2] = (float)z;
+                    value_max = std::max(value_max, std::max(fabs(x),
+                        std::max(fabs(y), fabs(z))));
+                }
+
+            }
+        }
+        return value_max;
+
+    }, [](double a, double b) { return std::max(a, b); });
+
+    // Padding
+    size_t num_vert = (size_t)dim_0 * (size_t)dim_1;
+    std::fill(vert_grid + num_vert * 3,
+        vert_grid + vertex_buffer_size(num_vert), 0.0);
+    if (vert_grid_in != NULL) {
+        size_t num_vert_in = (size_t)(dim_0 - 2 * offset_px)
+            * (size_t)dim_in_1;
+        std::fill(vert_grid_in + num_vert_in * 3,
+            vert_grid_in + vertex_buffer_size(num_vert_in), 0.0);
+    }
+
+    return value_abs_max;
+
+}
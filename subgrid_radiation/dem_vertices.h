@@ -0,0 +1,27 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef DEM_VERTICES_H
+#define DEM_VERTICES_H
+
+#include <cstddef>
+
+// Direct generation of Embree vertex buffers from geographic DEM data: the
+// longitude/latitude/elevation arrays are read once and the (padded) vertex
+// buffers of the DEM and of the inner '0.0 m surface' are written in a
+// single parallel pass (fused lon/lat -> ECEF -> ENU transformation and
+// buffer layout; no full-size temporary arrays).
+
+// Number of elements of padded vertex buffer (conformal with 16-byte SSE
+// load instructions; identical to 'auxiliary.pad_buffer')
+size_t vertex_buffer_size(size_t num_vert);
+
+// Compute vertex buffers in ENU coordinates [metre]. 'vert_grid_in' covers
+// the inner domain [offset_px, dim - offset_px) in both dimensions and can
+// be NULL. Returns maximal absolute ENU coordinate of inner domain [metre].
+double dem_vertices(const double* lon, const double* lat,
+    const float* elevation, int dim_0, int dim_1, int offset_px,
+    double lon_or, double lat_or, double radius_earth, float* vert_grid,
+    float* vert_grid_in);
+
+#endif
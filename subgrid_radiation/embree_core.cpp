@@ -0,0 +1,442 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "embree_core.h"
+#include "geometry_core.h"
+#include "heightfield.h"
+#include "kernel_stats.h"
+#include <cstdio>
+#include <embree3/rtcore.h>
+#include <math.h>
+#include <chrono>
+#include <iostream>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+//#############################################################################
+// Miscellaneous
+//#############################################################################
+
+// Error function
+void errorFunction(void* /*userPtr*/, enum RTCError error, const char* str) {
+    cerr << "error " << error << ": " << str << endl;
+}
+
+// Memory allocated by Embree per device (counter is passed to memory monitor
+// as 'userPtr'; released with device) [byte]
+static std::map<RTCDevice, std::atomic<long long>*> device_mem_bytes;
+static std::mutex device_mem_mutex;
+
+// Memory monitor function (tracks allocations; never denies them)
+bool memoryMonitor(void* userPtr, ssize_t bytes, bool /*post*/) {
+    *((std::atomic<long long>*)userPtr) += (long long)bytes;
+    return true;
+}
+
+// Initialisation of device and registration of error handler and memory
+// monitor
+RTCDevice initializeDevice() {
+    RTCDevice device = rtcNewDevice(NULL);
+    if (!device) {
+        cerr << "error " << rtcGetDeviceError(NULL)
+            << ": cannot create device" << endl;
+    }
+    rtcSetDeviceErrorFunction(device, errorFunction, NULL);
+    std::atomic<long long>* mem_bytes = new std::atomic<long long>(0);
+    rtcSetDeviceMemoryMonitorFunction(device, memoryMonitor, mem_bytes);
+    std::lock_guard<std::mutex> lock(device_mem_mutex);
+    device_mem_bytes[device] = mem_bytes;
+    return device;
+}
+
+void releaseDevice(RTCDevice device) {
+    rtcReleaseDevice(device);
+    std::lock_guard<std::mutex> lock(device_mem_mutex);
+    auto it = device_mem_bytes.find(device);
+    if (it != device_mem_bytes.end()) {
+        delete it->second;
+        device_mem_bytes.erase(it);
+    }
+}
+
+long long deviceMemory(RTCDevice device) {
+    std::lock_guard<std::mutex> lock(device_mem_mutex);
+    auto it = device_mem_bytes.find(device);
+    return (it != device_mem_bytes.end()) ? it->second->load() : 0;
+}
+
+//#############################################################################
+// Create scene from geometries
+//#############################################################################
+
+//-----------------------------------------------------------------------------
+// Heightfield (user geometry with quadtree; see 'heightfield.h')
+//-----------------------------------------------------------------------------
+
+// Quadtrees of scenes with heightfield geometry (released with scene)
+static std::map<RTCScene, Heightfield*> heightfield_scenes;
+static std::mutex heightfield_mutex;
+
+// Bounding box of heightfield (root node of quadtree)
+static void heightfield_bounds(const struct RTCBoundsFunctionArguments* args) {
+    const Heightfield* hf = (const Heightfield*)args->geometryUserPtr;
+    const float* box = hf->bounds + hf->level_offset[hf->num_levels - 1] * 6;
+    args->bounds_o->lower_x = box[0];
+    args->bounds_o->lower_y = box[1];
+    args->bounds_o->lower_z = box[2];
+    args->bounds_o->upper_x = box[3];
+    args->bounds_o->upper_y = box[4];
+    args->bounds_o->upper_z = box[5];
+}
+
+// Occlusion test of N rays ('tfar' is set to -inf for occluded rays, as for
+// built-in geometries)
+static void heightfield_occluded_n(
+    const struct RTCOccludedFunctionNArguments* args) {
+    const Heightfield* hf = (const Heightfield*)args->geometryUserPtr;
+    RTCRayN* rays = args->ray;
+    unsigned int num = args->N;
+    for (unsigned int i = 0; i < num; i++) {
+        if (args->valid[i] != -1) {
+            continue;  // inactive ray
+        }
+        if (heightfield_occluded(*hf,
+            RTCRayN_org_x(rays, num, i), RTCRayN_org_y(rays, num, i),
+            RTCRayN_org_z(rays, num, i), RTCRayN_dir_x(rays, num, i),
+            RTCRayN_dir_y(rays, num, i), RTCRayN_dir_z(rays, num, i),
+            RTCRayN_tnear(rays, num, i), RTCRayN_tfar(rays, num, i))) {
+            RTCRayN_tfar(rays, num, i)
+                = -std::numeric_limits<float>::infinity();
+        }
+    }
+}
+
+void releaseScene(RTCScene scene) {
+    rtcReleaseScene(scene);
+    std::lock_guard<std::mutex> lock(heightfield_mutex);
+    auto it = heightfield_scenes.find(scene);
+    if (it != heightfield_scenes.end()) {
+        heightfield_release(*(it->second));
+        delete it->second;
+        heightfield_scenes.erase(it);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// Structures for triangle and quad
+struct Triangle { int v0, v1, v2; };
+struct Quad { int v0, v1, v2, v3; };
+// -> above structures must contain 32-bit integers (-> Embree documentation).
+//    Theoretically, these integers should be unsigned but the binary
+//    representation until 2'147'483'647 is identical between signed/unsigned
+//    integer.
+
+// Initialise scene
+RTCScene initializeScene(RTCDevice device, float* vert_grid,
+    int dem_dim_0, int dem_dim_1, char* geom_type, char* build_quality,
+    int compact, int robust) {
+
+    // Scene build options
+    RTCBuildQuality rtc_build_quality;
+    if (strcmp(build_quality, "low") == 0) {
+        rtc_build_quality = RTC_BUILD_QUALITY_LOW;
+    } else if (strcmp(build_quality, "high") == 0) {
+        rtc_build_quality = RTC_BUILD_QUALITY_HIGH;
+    } else {
+        rtc_build_quality = RTC_BUILD_QUALITY_MEDIUM;
+    }
+    int rtc_scene_flags = RTC_SCENE_FLAG_NONE;
+    if (compact) {
+        rtc_scene_flags |= RTC_SCENE_FLAG_COMPACT;
+    }
+    if (robust) {
+        rtc_scene_flags |= RTC_SCENE_FLAG_ROBUST;
+    }
+    kout << "BVH build quality: " << build_quality << " (compact: "
+        << (compact ? "yes" : "no") << ", robust: "
+        << (robust ? "yes" : "no") << ")" << endl;
+
+    // Memory of device before scene, geometry buffers and BVH are allocated
+    long long mem_start = deviceMemory(device);
+
+    RTCScene scene = rtcNewScene(device);
+    rtcSetSceneFlags(scene, (RTCSceneFlags)rtc_scene_flags);
+    rtcSetSceneBuildQuality(scene, rtc_build_quality);
+
+    int num_vert = (dem_dim_0 * dem_dim_1);
+    kout << "DEM dimensions: (" << dem_dim_0 << ", " << dem_dim_1 << ")"
+        << endl;
+    kout << "Number of vertices: " << num_vert << endl;
+
+    RTCGeometryType rtc_geom_type;
+    if (strcmp(geom_type, "triangle") == 0) {
+        rtc_geom_type = RTC_GEOMETRY_TYPE_TRIANGLE;
+    } else if (strcmp(geom_type, "quad") == 0) {
+        rtc_geom_type = RTC_GEOMETRY_TYPE_QUAD;
+    } else if (strcmp(geom_type, "heightfield") == 0) {
+        rtc_geom_type = RTC_GEOMETRY_TYPE_USER;
+    } else {
+        rtc_geom_type = RTC_GEOMETRY_TYPE_GRID;
+    }
+
+    RTCGeometry geom = rtcNewGeometry(device, rtc_geom_type);
+    if (rtc_geom_type != RTC_GEOMETRY_TYPE_USER) {
+        rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0,
+            RTC_FORMAT_FLOAT3, vert_grid, 0, 3*sizeof(float), num_vert);
+    }
+    double time_hf = 0.0;  // build time of quadtree [s]
+    double mem_hf = 0.0;  // memory of quadtree [MB]
+
+    //-------------------------------------------------------------------------
+    // Triangle
+    //-------------------------------------------------------------------------
+    if (strcmp(geom_type, "triangle") == 0) {
+        kout << "Selected geometry type: triangle" << endl;
+        int num_tri = ((dem_dim_0 - 1) * (dem_dim_1 - 1)) * 2;
+        kout << "Number of triangles: " << num_tri << endl;
+        Triangle* triangles = (Triangle*) rtcSetNewGeometryBuffer(geom,
+            RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, sizeof(Triangle),
+            num_tri);
+        int n = 0;
+        for (int i = 0; i < (dem_dim_0 - 1); i++) {
+            for (int j = 0; j < (dem_dim_1 - 1); j++) {
+                triangles[n].v0 = (i * dem_dim_1) + j;
+                triangles[n].v1 = (i * dem_dim_1) + j + 1;
+                triangles[n].v2 = ((i + 1) * dem_dim_1) + j;
+                n++;
+                triangles[n].v0 = (i * dem_dim_1) + j + 1;
+                triangles[n].v1 = ((i + 1) * dem_dim_1) + j + 1;
+                triangles[n].v2 = ((i + 1) * dem_dim_1) + j;
+                n++;
+            }
+        }
+    //-------------------------------------------------------------------------
+    // Quad
+    //-------------------------------------------------------------------------
+    } else if (strcmp(geom_type, "quad") == 0) {
+        kout << "Selected geometry type: quad" << endl;
+        int num_quad = ((dem_dim_0 - 1) * (dem_dim_1 - 1));
+        kout << "Number of quads: " << num_quad << endl;
+        Quad* quads = (Quad*) rtcSetNewGeometryBuffer(geom,
+            RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT4, sizeof(Quad),
+            num_quad);
+        int n = 0;
+        for (int i = 0; i < (dem_dim_0 - 1); i++) {
+            for (int j = 0; j < (dem_dim_1 - 1); j++) {
+                //  identical to grid scene (-> otherwise reverse v0, v1, ...)
+                quads[n].v0 = (i * dem_dim_1) + j;
+                quads[n].v1 = (i * dem_dim_1) + j + 1;
+                quads[n].v2 = ((i + 1) * dem_dim_1) + j + 1;
+                quads[n].v3 = ((i + 1) * dem_dim_1) + j;
+                n++;
+            }
+        }
+    //-------------------------------------------------------------------------
+    // Heightfield
+    //-------------------------------------------------------------------------
+    } else if (strcmp(geom_type, "heightfield") == 0) {
+        kout << "Selected geometry type: heightfield (quadtree)" << endl;
+        auto start_hf = std::chrono::high_resolution_clock::now();
+        Heightfield* hf = new Heightfield(heightfield_build(vert_grid,
+            dem_dim_0, dem_dim_1));
+        auto end_hf = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> time = end_hf - start_hf;
+        time_hf = time.count();
+        mem_hf = (double)heightfield_bytes(*hf) / (1024.0 * 1024.0);
+        kout << "Number of quadtree levels: " << hf->num_levels << endl;
+        // Embree only bounds the whole heightfield (single primitive)
+        rtcSetGeometryUserPrimitiveCount(geom, 1);
+        rtcSetGeometryUserData(geom, hf);
+        rtcSetGeometryBoundsFunction(geom, heightfield_bounds, NULL);
+        rtcSetGeometryOccludedFunction(geom, heightfield_occluded_n);
+        std::lock_guard<std::mutex> lock(heightfield_mutex);
+        heightfield_scenes[scene] = hf;
+    //-------------------------------------------------------------------------
+    // Grid
+    //-------------------------------------------------------------------------
+    } else {
+        kout << "Selected geometry type: grid" << endl;
+        RTCGrid* grid = (RTCGrid*)rtcSetNewGeometryBuffer(geom,
+            RTC_BUFFER_TYPE_GRID, 0, RTC_FORMAT_GRID, sizeof(RTCGrid), 1);
+        grid[0].startVertexID = 0;
+        grid[0].stride        = dem_dim_1;
+        grid[0].width         = dem_dim_1;
+        grid[0].height        = dem_dim_0;
+    }
+    //-------------------------------------------------------------------------
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Commit geometry
+    rtcSetGeometryBuildQuality(geom, rtc_build_quality);
+    rtcCommitGeometry(geom);
+
+    rtcAttachGeometry(scene, geom);
+    rtcReleaseGeometry(geom);
+
+    //-------------------------------------------------------------------------
+
+    // Commit scene
+    rtcCommitScene(scene);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time = end - start;
+    double time_bvh = time.count() + time_hf;
+    kout << "BVH build time: " << time_bvh << " s" << endl;
+    double mem_bvh = (double)(deviceMemory(device) - mem_start)
+        / (1024.0 * 1024.0) + mem_hf;
+    kout << "BVH memory: " << mem_bvh << " MB" << endl;
+    kernel_stats.time_bvh += time_bvh;
+    kernel_stats.mem_bvh += mem_bvh;
+
+    return scene;
+
+}
+
+//#############################################################################
+// Coarse DEM (far-field horizon)
+//#############################################################################
+
+float* coarsen_vert_grid(float* vert_grid, int dem_dim_0, int dem_dim_1,
+    int coarse_fac, int &dem_dim_c_0, int &dem_dim_c_1) {
+    /* Parameters
+       ----------
+       vert_grid: array with vertices of DEM in ENU coordinates [metre]
+       dem_dim_0: dimension length of DEM in y-direction [-]
+       dem_dim_1: dimension length of DEM in x-direction [-]
+       coarse_fac: coarsening factor (along one dimension) [-]
+       dem_dim_c_0: dimension length of coarse DEM in y-direction [-]
+       dem_dim_c_1: dimension length of coarse DEM in x-direction [-]
+
+       Returns
+       ----------
+       vert_grid_c: array with vertices of coarse DEM in ENU coordinates
+                    [metre]
+
+       Notes
+       ----------
+       The last row/column of the fine DEM is always included. Elevations
+       are the maxima within a window of +/- coarse_fac fine vertices. Every
+       fine vertex of a coarse pixel is then covered by the windows of all
+       four corners of this pixel, so that the coarse terrain lies above the
+       fine terrain (far-field horizon is rather over- than
+       underestimated).*/
+
+    dem_dim_c_0 = (dem_dim_0 - 2) / coarse_fac + 2;
+    dem_dim_c_1 = (dem_dim_1 - 2) / coarse_fac + 2;
+    size_t num_vert = (size_t)dem_dim_c_0 * (size_t)dem_dim_c_1;
+    float* vert_grid_c = new float[num_vert * 3 + 16];
+    // padding for shared Embree vertex buffer (16 byte reads)
+    memset(vert_grid_c + num_vert * 3, 0, 16 * sizeof(float));
+    int win = coarse_fac;
+
+    for (int i_c = 0; i_c < dem_dim_c_0; i_c++) {
+        int i = std::min(i_c * coarse_fac, dem_dim_0 - 1);
+        for (int j_c = 0; j_c < dem_dim_c_1; j_c++) {
+            int j = std::min(j_c * coarse_fac, dem_dim_1 - 1);
+            size_t ind = lin_ind_2d(dem_dim_1, i, j) * 3;
+            size_t ind_c = lin_ind_2d(dem_dim_c_1, i_c, j_c) * 3;
+            vert_grid_c[ind_c] = vert_grid[ind];
+            vert_grid_c[ind_c + 1] = vert_grid[ind + 1];
+            float elev_max = vert_grid[ind + 2];
+            for (int k = std::max(i - win, 0);
+                k <= std::min(i + win, dem_dim_0 - 1); k++) {
+                for (int m = std::max(j - win, 0);
+                    m <= std::min(j + win, dem_dim_1 - 1); m++) {
+                    elev_max = std::max(elev_max,
+                        vert_grid[lin_ind_2d(dem_dim_1, k, m) * 3 + 2]);
+                }
+            }
+            vert_grid_c[ind_c + 2] = elev_max;
+        }
+    }
+
+    return vert_grid_c;
+
+}
+
+//#############################################################################
+// Names of horizon detection algorithms (selected once per kernel call)
+//#############################################################################
+
+const char* const hori_alg_names[HORI_ALG_NUM] = {
+    "discrete_sampling", "binary_search", "binary_search_packet4",
+    "binary_search_packet", "binary_search_packet16", "guess_constant"};
+
+const char* const hori_alg_labels[HORI_ALG_NUM] = {
+    "discrete_sampling", "binary search",
+    "binary search (packets of 4 rays)", "binary search (packets of 8 rays)",
+    "binary search (packets of 16 rays)",
+    "guess horizon from previous azimuth direction"};
+
+const int hori_alg_width[HORI_ALG_NUM] = {1, 1, 4, 8, 16, 1};
+
+int hori_alg_index(const char* ray_algorithm) {
+    for (int i = 0; i < HORI_ALG_NUM; i++) {
+        if (strcmp(ray_algorithm, hori_alg_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//#############################################################################
+// Persistent scene
+//#############################################################################
+
+namespace shapes {
+
+CppScene::CppScene() {
+
+    device = initializeDevice();
+    scene = NULL;
+    vert_grid_cl = NULL;
+    dem_dim_0_cl = 0;
+    dem_dim_1_cl = 0;
+
+}
+
+CppScene::~CppScene() {
+
+    // Release resources allocated through Embree
+    if (scene != NULL) {
+        releaseScene(scene);
+    }
+    releaseDevice(device);
+
+}
+
+void CppScene::initialise(
+    float* vert_grid,
+    int dem_dim_0, int dem_dim_1,
+    char* geom_type,
+    char* build_quality,
+    int compact,
+    int robust) {
+
+    KernelScope scope;
+    vert_grid_cl = vert_grid;
+    dem_dim_0_cl = dem_dim_0;
+    dem_dim_1_cl = dem_dim_1;
+
+    auto start_ini = std::chrono::high_resolution_clock::now();
+    if (scene != NULL) {
+        releaseScene(scene);
+    }
+    scene = initializeScene(device, vert_grid, dem_dim_0, dem_dim_1,
+        geom_type, build_quality, compact, robust);
+    auto end_ini = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time = end_ini - start_ini;
+    kout << "Total initialisation time: " << time.count() << " s" << endl;
+    kernel_stats.time_total = time.count();
+
+}
+
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef EMBREE_CORE_H
+#define EMBREE_CORE_H
+
+#include <embree3/rtcore.h>
+#include <cstddef>
+
+// Embree functionality shared by all ray tracing computations (device
+// and scene creation). Compiled once into the core library, which is linked
+// by all extensions. Ray casting and horizon detection algorithms are
+// defined in 'horizon_detect.h'.
+
+#if defined(RTC_NAMESPACE_USE)
+    RTC_NAMESPACE_USE
+#endif
+
+// Error function
+void errorFunction(void* userPtr, enum RTCError error, const char* str);
+
+// Initialisation of device and registration of error handler and memory
+// monitor (memory allocated by Embree is reported after building the BVH)
+RTCDevice initializeDevice();
+
+// Release device (and its memory counter; all scenes of the device must be
+// released before)
+void releaseDevice(RTCDevice device);
+
+// Memory currently allocated by Embree for device [byte]
+long long deviceMemory(RTCDevice device);
+
+// Initialise scene (committed) from DEM vertices (shared buffer). Geometry
+// type: "triangle", "quad", "grid" (Embree BVH) or "heightfield" (quadtree
+// of DEM grid as user geometry; only occlusion queries). Build quality:
+// "low", "medium" or "high"; compact/robust: scene flags (0 or 1)
+RTCScene initializeScene(RTCDevice device, float* vert_grid,
+    int dem_dim_0, int dem_dim_1, char* geom_type, char* build_quality,
+    int compact, int robust);
+
+// Release scene (and quadtree of heightfield geometry)
+void releaseScene(RTCScene scene);
+
+// Coarse DEM for far-field horizon: every 'coarse_fac'-th vertex with
+// maximal elevation of the fine vertices within +/- 'coarse_fac' (returned
+// array contains padding and must be deleted)
+float* coarsen_vert_grid(float* vert_grid, int dem_dim_0, int dem_dim_1,
+    int coarse_fac, int &dem_dim_c_0, int &dem_dim_c_1);
+
+// Horizon detection algorithms (argument 'ray_algorithm'; kernels are
+// specialised at compile time for each algorithm, see 'kernel_variants.h'
+// and 'horizon_detect.h')
+#define HORI_ALG_DISCRETE_SAMPLING 0
+#define HORI_ALG_BINARY_SEARCH 1
+#define HORI_ALG_BINARY_SEARCH_PACKET4 2
+#define HORI_ALG_BINARY_SEARCH_PACKET8 3
+#define HORI_ALG_BINARY_SEARCH_PACKET16 4
+#define HORI_ALG_GUESS_CONSTANT 5
+#define HORI_ALG_NUM 6
+
+// Names (argument 'ray_algorithm'), descriptions and rays per Embree query
+// of algorithms
+extern const char* const hori_alg_names[HORI_ALG_NUM];
+extern const char* const hori_alg_labels[HORI_ALG_NUM];
+extern const int hori_alg_width[HORI_ALG_NUM];
+
+// Index of algorithm (-1: unknown name)
+int hori_alg_index(const char* ray_algorithm);
+
+namespace shapes {
+
+// Committed Embree scene of DEM, which can be reused by multiple
+// computations (functions in 'rays_comp.h' and 'horizon_comp.h') on the same
+// DEM. Vertex data is shared with the scene and must outlive the object.
+class CppScene {
+public:
+    RTCDevice device;
+    RTCScene scene;
+    int dem_dim_0_cl, dem_dim_1_cl;
+    float* vert_grid_cl;
+    CppScene();
+    ~CppScene();
+    void initialise(
+        float* vert_grid,
+        int dem_dim_0, int dem_dim_1,
+        char* geom_type,
+        char* build_quality,
+        int compact,
+        int robust);
+};
+
+}
+
+#endif
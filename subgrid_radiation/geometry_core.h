@@ -0,0 +1,321 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef GEOMETRY_CORE_H
+#define GEOMETRY_CORE_H
+
+#include <math.h>
+#include <cstddef>
+
+// Auxiliary functions shared by all ray tracing computations (unit
+// conversion, array indexing, vector and triangle operations)
+
+// ----------------------------------------------------------------------------
+// Unit conversion
+// ----------------------------------------------------------------------------
+
+// Convert degree to radian
+inline double deg2rad(double ang) {
+    /* Parameters
+       ----------
+       ang: angle [degree]
+
+       Returns
+       ----------
+       ang: angle [radian]
+    */
+    return ((ang / 180.0) * M_PI);
+}
+
+// Convert radian to degree
+inline double rad2deg(double ang) {
+    /* Parameters
+       ----------
+       ang: angle [radian]
+
+       Returns
+       ----------
+       ang: angle [degree]
+    */
+    return ((ang / M_PI) * 180.0);
+}
+
+// ----------------------------------------------------------------------------
+// Compute linear array index from multidimensional subscripts
+// ----------------------------------------------------------------------------
+
+// Linear index from subscripts (2D-array)
+inline size_t lin_ind_2d(size_t dim_1, size_t ind_0, size_t ind_1) {
+    /* Parameters
+       ----------
+       dim_1: second dimension length of two-dimensional array [-]
+       ind_0: first array indices [-]
+       ind_1: second array indices [-]
+
+       Returns
+       ----------
+       ind_lin: linear index of array [-]
+    */
+    return (ind_0 * dim_1 + ind_1);
+}
+
+// Linear index from subscripts (3D-array)
+inline size_t lin_ind_3d(size_t dim_1, size_t dim_2,
+    size_t ind_0, size_t ind_1, size_t ind_2) {
+    /* Parameters
+       ----------
+       dim_1: second dimension length of three-dimensional array [-]
+       dim_2: third dimension length of three-dimensional array [-]
+       ind_0: first array indices [-]
+       ind_1: second array indices [-]
+       ind_2: third array indices [-]
+
+       Returns
+       ----------
+       ind_lin: linear index of array [-]
+    */
+    return (ind_0 * (dim_1 * dim_2) + ind_1 * dim_2 + ind_2);
+}
+
+// Linear index from subscripts (4D-array)
+inline size_t lin_ind_4d(size_t dim_1, size_t dim_2, size_t dim_3,
+    size_t ind_0, size_t ind_1, size_t ind_2, size_t ind_3) {
+    /* Parameters
+       ----------
+       dim_1: second dimension length of four-dimensional array [-]
+       dim_2: third dimension length of four-dimensional array [-]
+       dim_3: fourth dimension length of four-dimensional array [-]
+       ind_0: first array indices [-]
+       ind_1: second array indices [-]
+       ind_2: third array indices [-]
+       ind_3: fourth array indicies [-]
+
+       Returns
+       ----------
+       ind_lin: linear index of array [-]
+    */
+    return (ind_0 * (dim_1 * dim_2 * dim_3) + ind_1 * (dim_2 * dim_3)
+        + ind_2 * dim_3 + ind_3);
+}
+
+
+// ----------------------------------------------------------------------------
+// Vector and matrix operations
+// ----------------------------------------------------------------------------
+
+// Unit vector
+inline void vec_unit(double &v_x, double &v_y, double &v_z) {
+    /* Parameters
+       ----------
+       v_x: x-component of vector [arbitrary]
+       v_y: y-component of vector [arbitrary]
+       v_z: z-component of vector [arbitrary]
+    */
+    double mag = sqrt(v_x * v_x + v_y * v_y + v_z * v_z);
+    v_x = v_x / mag;
+    v_y = v_y / mag;
+    v_z = v_z / mag;
+}
+
+// Cross product
+inline void cross_prod(double a_x, double a_y, double a_z,
+    double b_x, double b_y, double b_z,
+    double &c_x, double &c_y, double &c_z) {
+    /* Parameters
+       ----------
+       a_x: x-component of vector a [arbitrary]
+       a_y: y-component of vector a [arbitrary]
+       a_z: z-component of vector a [arbitrary]
+       b_x: x-component of vector b [arbitrary]
+       b_y: y-component of vector b [arbitrary]
+       b_z: z-component of vector b [arbitrary]
+       c_x: x-component of vector c [arbitrary]
+       c_y: y-component of vector c [arbitrary]
+       c_z: z-component of vector c [arbitrary]
+    */
+    c_x = a_y * b_z - a_z * b_y;
+    c_y = a_z * b_x - a_x * b_z;
+    c_z = a_x * b_y - a_y * b_x;
+}
+
+// Matrix-vector multiplication
+inline void mat_vec_mult(double (&mat)[3][3], double (&vec)[3],
+    double (&vec_res)[3]) {
+    /* Parameters
+       ----------
+       mat: matrix with 3 x 3 elements [arbitrary]
+       vec: vector with 3 elements [arbitrary]
+       vec_res: resulting vector with 3 elements [arbitrary]
+    */
+    vec_res[0] = mat[0][0] * vec[0] + mat[0][1] * vec[1] + mat[0][2] * vec[2];
+    vec_res[1] = mat[1][0] * vec[0] + mat[1][1] * vec[1] + mat[1][2] * vec[2];
+    vec_res[2] = mat[2][0] * vec[0] + mat[2][1] * vec[1] + mat[2][2] * vec[2];
+
+}
+
+// ----------------------------------------------------------------------------
+// Triangle operations
+// ----------------------------------------------------------------------------
+
+// Triangle surface normal and area
+inline void triangle_normal_area(
+    double &vert_0_x, double &vert_0_y, double &vert_0_z,
+    double &vert_1_x, double &vert_1_y, double &vert_1_z,
+    double &vert_2_x, double &vert_2_y, double &vert_2_z,
+    double &norm_x, double &norm_y, double &norm_z,
+    double &area) {
+    /* Parameters
+       ----------
+       vert_0_x: x-component of first triangle vertices [m]
+       vert_0_y: y-component of first triangle vertices [m]
+       vert_0_z: z-component of first triangle vertices [m]
+       vert_1_x: x-component of second triangle vertices [m]
+       vert_1_y: y-component of second triangle vertices [m]
+       vert_1_z: z-component of second triangle vertices [m]
+       vert_2_x: x-component of third triangle vertices [m]
+       vert_2_y: y-component of third triangle vertices [m]
+       vert_2_z: z-component of third triangle vertices [m]
+       norm_x: x-component of triangle surface normal [-]
+       norm_y: y-component of triangle surface normal [-]
+       norm_z: z-component of triangle surface normal [-]
+       area: area of triangle [m2]
+    */
+    double a_x = vert_2_x - vert_1_x;
+    double a_y = vert_2_y - vert_1_y;
+    double a_z = vert_2_z - vert_1_z;
+    double b_x = vert_0_x - vert_1_x;
+    double b_y = vert_0_y - vert_1_y;
+    double b_z = vert_0_z - vert_1_z;
+
+    norm_x = a_y * b_z - a_z * b_y;
+    norm_y = a_z * b_x - a_x * b_z;
+    norm_z = a_x * b_y - a_y * b_x;
+
+    double mag = sqrt(norm_x * norm_x + norm_y * norm_y + norm_z * norm_z);
+    norm_x = norm_x / mag;
+    norm_y = norm_y / mag;
+    norm_z = norm_z / mag;
+
+    area = mag / 2.0;
+}
+
+// Triangle centroid
+inline void triangle_centroid(
+    double &vert_0_x, double &vert_0_y, double &vert_0_z,
+    double &vert_1_x, double &vert_1_y, double &vert_1_z,
+    double &vert_2_x, double &vert_2_y, double &vert_2_z,
+    double &cent_x, double &cent_y, double &cent_z) {
+    /* Parameters
+       ----------
+       vert_0_x: x-component of first triangle vertices [m]
+       vert_0_y: y-component of first triangle vertices [m]
+       vert_0_z: z-component of first triangle vertices [m]
+       vert_1_x: x-component of second triangle vertices [m]
+       vert_1_y: y-component of second triangle vertices [m]
+       vert_1_z: z-component of second triangle vertices [m]
+       vert_2_x: x-component of third triangle vertices [m]
+       vert_2_y: y-component of third triangle vertices [m]
+       vert_2_z: z-component of third triangle vertices [m]
+       cent_x: x-component of triangle centroid [-]
+       cent_y: y-component of triangle centroid [-]
+        cent_z: z-component of triangle centroid [-]
+    */
+    cent_x = (vert_0_x + vert_1_x + vert_2_x) / 3.0;
+    cent_y = (vert_0_y + vert_1_y + vert_2_y) / 3.0;
+    cent_z = (vert_0_z + vert_1_z + vert_2_z) / 3.0;
+}
+
+// Vertices of lower left triangle (within pixel)
+inline void triangle_vert_ll(size_t dim_1, size_t ind_0, size_t ind_1,
+    size_t &ind_tri_0, size_t &ind_tri_1, size_t &ind_tri_2) {
+    /* Parameters
+       ----------
+
+    */
+    ind_tri_0 = (ind_0 * dim_1 + ind_1) * 3;
+    ind_tri_1 = (ind_0 * dim_1 + ind_1 + 1) * 3;
+    ind_tri_2 = ((ind_0 + 1) * dim_1 + ind_1) * 3;
+}
+
+// Vertices of upper right triangle (within pixel)
+inline void triangle_vert_ur(size_t dim_1, size_t ind_0, size_t ind_1,
+    size_t &ind_tri_0, size_t &ind_tri_1, size_t &ind_tri_2) {
+    /* Parameters
+       ----------
+
+    */
+    ind_tri_0 = (ind_0 * dim_1 + ind_1 + 1) * 3;
+    ind_tri_1 = ((ind_0 + 1) * dim_1 + ind_1 + 1) * 3;
+    ind_tri_2 = ((ind_0 + 1) * dim_1 + ind_1) * 3;
+
+}
+
+// Select one of above two functions (n = 0: lower left, n = 1: upper right;
+// inlined into kernels instead of call through function pointer)
+inline void triangle_vert(size_t n, size_t dim_1, size_t ind_0,
+    size_t ind_1, size_t &ind_tri_0, size_t &ind_tri_1, size_t &ind_tri_2) {
+    if (n == 0) {
+        triangle_vert_ll(dim_1, ind_0, ind_1, ind_tri_0, ind_tri_1, ind_tri_2);
+    } else {
+        triangle_vert_ur(dim_1, ind_0, ind_1, ind_tri_0, ind_tri_1, ind_tri_2);
+    }
+}
+
+// Project vertex radially onto sphere with 0.0 m elevation (origin of ENU
+// coordinates on surface of sphere -> centre at (0, 0, -radius_earth))
+inline void vertex_sphere(double radius_earth, double &x, double &y,
+    double &z) {
+    /* Parameters
+       ----------
+       radius_earth: radius of Earth [m]
+       x: x-component of vertex [m]
+       y: y-component of vertex [m]
+       z: z-component of vertex [m]
+    */
+    double z_c = z + radius_earth;
+    double scal = radius_earth / sqrt(x * x + y * y + z_c * z_c);
+    x *= scal;
+    y *= scal;
+    z = z_c * scal - radius_earth;
+}
+
+// Vertices of horizontal ('0.0 m surface') triangle: gathered from inner DEM
+// or, if 'vert_grid_in' is NULL, computed analytically by radial projection
+// of the tilted triangle onto the sphere (-> no inner DEM in memory)
+inline void triangle_vert_hori(float* vert_grid_in, size_t dem_dim_in_1,
+    size_t ind_0, size_t ind_1, size_t n, double radius_earth,
+    double &vert_0_x, double &vert_0_y, double &vert_0_z,
+    double &vert_1_x, double &vert_1_y, double &vert_1_z,
+    double &vert_2_x, double &vert_2_y, double &vert_2_z) {
+    /* Parameters
+       ----------
+       vert_grid_in: vertices of inner DEM with 0.0 m elevation (or NULL) [m]
+       dem_dim_in_1: second dimension length of inner DEM [-]
+       ind_0: first index of pixel in inner DEM [-]
+       ind_1: second index of pixel in inner DEM [-]
+       n: triangle within pixel (0: lower left, 1: upper right) [-]
+       radius_earth: radius of Earth (only used without inner DEM) [m]
+       vert_?_?: vertices of tilted (input) / horizontal (output)
+                 triangle [m]
+    */
+    if (vert_grid_in == NULL) {
+        vertex_sphere(radius_earth, vert_0_x, vert_0_y, vert_0_z);
+        vertex_sphere(radius_earth, vert_1_x, vert_1_y, vert_1_z);
+        vertex_sphere(radius_earth, vert_2_x, vert_2_y, vert_2_z);
+        return;
+    }
+    size_t ind_tri_0, ind_tri_1, ind_tri_2;
+    triangle_vert(n, dem_dim_in_1, ind_0, ind_1,
+        ind_tri_0, ind_tri_1, ind_tri_2);
+    vert_0_x = (double)vert_grid_in[ind_tri_0];
+    vert_0_y = (double)vert_grid_in[ind_tri_0 + 1];
+    vert_0_z = (double)vert_grid_in[ind_tri_0 + 2];
+    vert_1_x = (double)vert_grid_in[ind_tri_1];
+    vert_1_y = (double)vert_grid_in[ind_tri_1 + 1];
+    vert_1_z = (double)vert_grid_in[ind_tri_1 + 2];
+    vert_2_x = (double)vert_grid_in[ind_tri_2];
+    vert_2_y = (double)vert_grid_in[ind_tri_2 + 1];
+    vert_2_z = (double)vert_grid_in[ind_tri_2 + 2];
+}
+
+#endif
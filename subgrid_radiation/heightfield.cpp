@@ -0,0 +1,456 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "heightfield.h"
+#include <algorithm>
+#include <limits>
+#include <tbb/parallel_for.h>
+
+//#############################################################################
+// Quadtree (min/max mip-map)
+//#############################################################################
+
+// Enlarge bounding box (-> conservative with respect to round-off errors of
+// slab test in single precision)
+static void box_pad(float* box) {
+    for (int i = 0; i < 3; i++) {
+        float pad = std::max(fabsf(box[i]), fabsf(box[i + 3])) * 1.0e-6f
+            + 1.0e-3f;
+        box[i] -= pad;
+        box[i + 3] += pad;
+    }
+}
+
+Heightfield heightfield_build(const float* vert_grid, int dem_dim_0,
+    int dem_dim_1) {
+    /* Parameters
+       ----------
+       vert_grid: vertices of DEM (x, y, z) [m]
+       dem_dim_0: dimension length of DEM in y-direction [-]
+       dem_dim_1: dimension length of DEM in x-direction [-]
+
+       Returns
+       ----------
+       hf: quadtree of DEM
+    */
+
+    Heightfield hf;
+    hf.vert_grid = vert_grid;
+    hf.dem_dim_0 = dem_dim_0;
+    hf.dem_dim_1 = dem_dim_1;
+
+    // Number of levels and nodes
+    int dim_0 = dem_dim_0 / 2;  // ceil((dem_dim_0 - 1) / 2)
+    int dim_1 = dem_dim_1 / 2;
+    size_t num_nodes = 0;
+    hf.num_levels = 0;
+    while (true) {
+        hf.level_dim_0[hf.num_levels] = dim_0;
+        hf.level_dim_1[hf.num_levels] = dim_1;
+        hf.level_offset[hf.num_levels] = num_nodes;
+        num_nodes += (size_t)dim_0 * (size_t)dim_1;
+        hf.num_levels += 1;
+        if ((dim_0 == 1) && (dim_1 == 1)) {
+            break;
+        }
+        dim_0 = (dim_0 + 1) / 2;
+        dim_1 = (dim_1 + 1) / 2;
+    }
+    hf.bounds = new float[num_nodes * 6];
+
+    // Level 0 (bounding boxes of vertices of 2 x 2 pixels)
+    tbb::parallel_for(tbb::blocked_range<int>(0, hf.level_dim_0[0]),
+        [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); i++) {
+            for (int j = 0; j < hf.level_dim_1[0]; j++) {
+                float* box = hf.bounds + ((size_t)i * hf.level_dim_1[0] + j)
+                    * 6;
+                for (int k = 0; k < 3; k++) {
+                    box[k] = std::numeric_limits<float>::max();
+                    box[k + 3] = -std::numeric_limits<float>::max();
+                }
+                for (int k = (2 * i); k <= std::min(2 * i + 2,
+                    dem_dim_0 - 1); k++) {
+                    for (int m = (2 * j); m <= std::min(2 * j + 2,
+                        dem_dim_1 - 1); m++) {
+                        const float* vert = vert_grid
+                            + ((size_t)k * dem_dim_1 + m) * 3;
+                        for (int n = 0; n < 3; n++) {
+                            box[n] = std::min(box[n], vert[n]);
+                            box[n + 3] = std::max(box[n + 3], vert[n]);
+                        }
+                    }
+                }
+                box_pad(box);
+            }
+        }
+    });
+
+    // Higher levels (union of bounding boxes of child nodes)
+    for (int level = 1; level < hf.num_levels; level++) {
+        int dim_child_0 = hf.level_dim_0[level - 1];
+        int dim_child_1 = hf.level_dim_1[level - 1];
+        float* box_child = hf.bounds + hf.level_offset[level - 1] * 6;
+        float* box_level = hf.bounds + hf.level_offset[level] * 6;
+        tbb::parallel_for(tbb::blocked_range<int>(0, hf.level_dim_0[level]),
+            [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); i++) {
+                for (int j = 0; j < hf.level_dim_1[level]; j++) {
+                    float* box = box_level
+                        + ((size_t)i * hf.level_dim_1[level] + j) * 6;
+                    for (int k = 0; k < 3; k++) {
+                        box[k] = std::numeric_limits<float>::max();
+                        box[k + 3] = -std::numeric_limits<float>::max();
+                    }
+                    for (int k = (2 * i); k < std::min(2 * i + 2,
+                        dim_child_0); k++) {
+                        for (int m = (2 * j); m < std::min(2 * j + 2,
+                            dim_child_1); m++) {
+                            const float* child = box_child
+                                + ((size_t)k * dim_child_1 + m) * 6;
+                            for (int n = 0; n < 3; n++) {
+                                box[n] = std::min(box[n], child[n]);
+                                box[n + 3] = std::max(box[n + 3],
+                                    child[n + 3]);
+                            }
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    return hf;
+
+}
+
+void heightfield_release(Heightfield &hf) {
+
+    delete[] hf.bounds;
+    hf.bounds = NULL;
+
+}
+
+size_t heightfield_bytes(const Heightfield &hf) {
+
+    size_t num_nodes = hf.level_offset[hf.num_levels - 1]
+        + (size_t)hf.level_dim_0[hf.num_levels - 1]
+        * (size_t)hf.level_dim_1[hf.num_levels - 1];
+    return num_nodes * 6 * sizeof(float);
+
+}
+
+//#############################################################################
+// Horizon bounds
+//#############################################################################
+
+// Azimuth sectors overlapped by interval [azim - half, azim + half] (first
+// sector and number of sectors; periodic)
+static void hf_sector_range(double azim, double half, int hori_azim_num,
+    int &sec_beg, int &sec_num) {
+    if (half >= M_PI) {
+        sec_beg = 0;
+        sec_num = hori_azim_num;
+        return;
+    }
+    double azim_spac = (2.0 * M_PI) / (double)hori_azim_num;
+    half += 1.0e-6;  // round-off errors of azimuth angles
+    int ind_beg = (int)floor((azim - half) / azim_spac);
+    int ind_end = (int)floor((azim + half) / azim_spac);
+    sec_num = std::min(ind_end - ind_beg + 1, hori_azim_num);
+    sec_beg = ((ind_beg % hori_azim_num) + hori_azim_num) % hori_azim_num;
+}
+
+// Upper bound of sine of elevation angle, minimal distance and azimuth
+// interval of bounding box as seen from origin
+static void hf_box_bound(const float* box, const double* org,
+    const double* east, const double* north, const double* up,
+    double &sin_up, double &dist_min, double &azim, double &half,
+    double &rad_hori) {
+    double cent[3], ext[3];
+    for (int i = 0; i < 3; i++) {
+        cent[i] = 0.5 * ((double)box[i] + (double)box[i + 3]) - org[i];
+        ext[i] = 0.5 * ((double)box[i + 3] - (double)box[i]);
+    }
+    double dist_sq = 0.0, cent_sq = 0.0, ext_sq = 0.0;
+    double num_max = 0.0, ext_east = 0.0, ext_north = 0.0;
+    double cent_east = 0.0, cent_north = 0.0;
+    for (int i = 0; i < 3; i++) {
+        double q = std::max(fabs(cent[i]) - ext[i], 0.0);
+        dist_sq += q * q;
+        cent_sq += cent[i] * cent[i];
+        ext_sq += ext[i] * ext[i];
+        num_max += cent[i] * up[i] + fabs(up[i]) * ext[i];
+        cent_east += cent[i] * east[i];
+        cent_north += cent[i] * north[i];
+        ext_east += fabs(east[i]) * ext[i];
+        ext_north += fabs(north[i]) * ext[i];
+    }
+    dist_min = sqrt(dist_sq);
+    // sin(elevation) = dot(p - org, up) / |p - org| <= num_max / distance
+    if (num_max >= 0.0) {
+        sin_up = (dist_min > 0.0) ? std::min(num_max / dist_min, 1.0) : 1.0;
+    } else {
+        double dist_max = sqrt(cent_sq) + sqrt(ext_sq);
+        sin_up = std::max(num_max / dist_max, -1.0);
+    }
+    // Horizontal projection of box is enclosed by disk with radius 'rad_hori'
+    rad_hori = sqrt(ext_east * ext_east + ext_north * ext_north);
+    double dist_hori = sqrt(cent_east * cent_east + cent_north * cent_north);
+    if (dist_hori <= rad_hori) {
+        azim = 0.0;
+        half = M_PI;  // origin within projection -> all azimuth angles
+    } else {
+        azim = atan2(cent_east, cent_north);
+        half = asin(rad_hori / dist_hori);
+    }
+}
+
+// Exact upper bound of sine of elevation angle and azimuth interval of
+// triangle as seen from origin (vertices in local ENU coordinates relative
+// to origin)
+static void hf_triangle_bound(const double (*vert)[3], double &sin_up,
+    double &azim, double &half) {
+
+    // Horizontal projection of triangle contains origin?
+    double cross[3];
+    for (int i = 0; i < 3; i++) {
+        const double* v_0 = vert[i];
+        const double* v_1 = vert[(i + 1) % 3];
+        cross[i] = v_0[0] * v_1[1] - v_0[1] * v_1[0];
+    }
+    bool inside = ((cross[0] >= 0.0) && (cross[1] >= 0.0)
+        && (cross[2] >= 0.0)) || ((cross[0] <= 0.0) && (cross[1] <= 0.0)
+        && (cross[2] <= 0.0));
+    if (inside) {
+        azim = 0.0;
+        half = M_PI;
+        // Triangle above origin -> zenith is occluded
+        double area = cross[0] + cross[1] + cross[2];
+        double height = cross[1] * vert[0][2] + cross[2] * vert[1][2]
+            + cross[0] * vert[2][2];
+        if ((area == 0.0) || (height / area >= 0.0)) {
+            sin_up = 1.0;
+            return;
+        }
+    } else {
+        double cent_east = vert[0][0] + vert[1][0] + vert[2][0];
+        double cent_north = vert[0][1] + vert[1][1] + vert[2][1];
+        double azim_cent = atan2(cent_east, cent_north);
+        double diff_min = 0.0, diff_max = 0.0;
+        for (int i = 0; i < 3; i++) {
+            double diff = atan2(vert[i][0], vert[i][1]) - azim_cent;
+            if (diff > M_PI) {
+                diff -= (2.0 * M_PI);
+            } else if (diff < -M_PI) {
+                diff += (2.0 * M_PI);
+            }
+            diff_min = std::min(diff_min, diff);
+            diff_max = std::max(diff_max, diff);
+        }
+        azim = azim_cent + 0.5 * (diff_min + diff_max);
+        half = 0.5 * (diff_max - diff_min);
+    }
+
+    // Maximum on boundary of spherical triangle (vertices and great-circle
+    // arcs of edges)
+    sin_up = -1.0;
+    for (int i = 0; i < 3; i++) {
+        const double* v = vert[i];
+        double len = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (len == 0.0) {
+            sin_up = 1.0;
+            return;
+        }
+        sin_up = std::max(sin_up, v[2] / len);
+    }
+    for (int i = 0; i < 3; i++) {
+        const double* a = vert[i];
+        const double* b = vert[(i + 1) % 3];
+        double m[3] = {a[1] * b[2] - a[2] * b[1],
+                       a[2] * b[0] - a[0] * b[2],
+                       a[0] * b[1] - a[1] * b[0]};
+        double len = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+        if (len == 0.0) {
+            continue;  // edge in line with origin -> vertices are extremes
+        }
+        for (int j = 0; j < 3; j++) {
+            m[j] /= len;
+        }
+        double s_sq = 1.0 - m[2] * m[2];
+        if (s_sq <= 0.0) {
+            continue;  // horizontal great circle
+        }
+        // Highest point of great circle
+        double s = sqrt(s_sq);
+        double x[3] = {-m[2] * m[0] / s, -m[2] * m[1] / s, s};
+        double ax = m[0] * (a[1] * x[2] - a[2] * x[1])
+            + m[1] * (a[2] * x[0] - a[0] * x[2])
+            + m[2] * (a[0] * x[1] - a[1] * x[0]);
+        double xb = m[0] * (x[1] * b[2] - x[2] * b[1])
+            + m[1] * (x[2] * b[0] - x[0] * b[2])
+            + m[2] * (x[0] * b[1] - x[1] * b[0]);
+        if ((ax >= 0.0) && (xb >= 0.0)) {
+            sin_up = std::max(sin_up, s);  // highest point on arc
+        }
+    }
+
+}
+
+// Raise upper bounds of azimuth sectors
+static void hf_sector_raise(double* bound_sin_up, int hori_azim_num,
+    int sec_beg, int sec_num, double sin_up) {
+    for (int i = 0; i < sec_num; i++) {
+        int ind = (sec_beg + i) % hori_azim_num;
+        bound_sin_up[ind] = std::max(bound_sin_up[ind], sin_up);
+    }
+}
+
+void heightfield_horizon_bound(const Heightfield &hf, const double* org,
+    const double* east, const double* north, const double* up,
+    int hori_azim_num, double dist_search, double* bound_sin_up) {
+    /* Parameters
+       ----------
+       hf: quadtree of DEM
+       org: origin (x, y, z) [m]
+       east: unit vector of local east direction [-]
+       north: unit vector of local north direction [-]
+       up: unit vector of local up direction [-]
+       hori_azim_num: number of azimuth sectors [-]
+       dist_search: search distance [m]
+       bound_sin_up: upper bound of horizon per sector (output; sine of
+                     elevation angle) [-]
+    */
+
+    // Nodes of level 0 closer than 'dist_fac_tri' times their horizontal
+    // radius are bounded by their triangles (bounds of boxes too loose)
+    const double dist_fac_tri = 8.0;
+
+    for (int i = 0; i < hori_azim_num; i++) {
+        bound_sin_up[i] = -1.0;
+    }
+    int num_pix_0 = hf.dem_dim_0 - 1;
+    int num_pix_1 = hf.dem_dim_1 - 1;
+
+    // Stack with nodes (level, index in y-direction, index in x-direction;
+    // closest child node is processed first -> bounds of nearby terrain
+    // prune most distant nodes)
+    int stack_level[HF_STACK_SIZE];
+    int stack_0[HF_STACK_SIZE];
+    int stack_1[HF_STACK_SIZE];
+    int num_stack = 1;
+    stack_level[0] = hf.num_levels - 1;
+    stack_0[0] = 0;
+    stack_1[0] = 0;
+
+    while (num_stack > 0) {
+        num_stack -= 1;
+        int level = stack_level[num_stack];
+        int ind_0 = stack_0[num_stack];
+        int ind_1 = stack_1[num_stack];
+        const float* box = hf.bounds + (hf.level_offset[level]
+            + (size_t)ind_0 * hf.level_dim_1[level] + ind_1) * 6;
+        double sin_up, dist_min, azim, half, rad_hori;
+        hf_box_bound(box, org, east, north, up, sin_up, dist_min, azim,
+            half, rad_hori);
+        if (dist_min > dist_search) {
+            continue;
+        }
+        int sec_beg, sec_num;
+        hf_sector_range(azim, half, hori_azim_num, sec_beg, sec_num);
+        double bound_min = 1.0;
+        for (int i = 0; i < sec_num; i++) {
+            bound_min = std::min(bound_min,
+                bound_sin_up[(sec_beg + i) % hori_azim_num]);
+        }
+        if (sin_up <= bound_min) {
+            continue;  // node can not raise any bound
+        }
+        if ((level > 0) && (sec_num > 2)) {
+            // Push (existing) child nodes in order of decreasing distance
+            int end_0 = hf_min(2 * ind_0 + 2, hf.level_dim_0[level - 1]);
+            int end_1 = hf_min(2 * ind_1 + 2, hf.level_dim_1[level - 1]);
+            const float* box_child = hf.bounds
+                + hf.level_offset[level - 1] * 6;
+            int num_child = 0;
+            int child_0[4], child_1[4];
+            double child_dist[4];
+            for (int k = (2 * ind_0); k < end_0; k++) {
+                for (int m = (2 * ind_1); m < end_1; m++) {
+                    const float* b = box_child
+                        + ((size_t)k * hf.level_dim_1[level - 1] + m) * 6;
+                    double dist = 0.0;
+                    for (int n = 0; n < 3; n++) {
+                        double d = 0.5 * ((double)b[n] + (double)b[n + 3])
+                            - org[n];
+                        dist += d * d;
+                    }
+                    int pos = num_child;
+                    while ((pos > 0) && (child_dist[pos - 1] < dist)) {
+                        child_0[pos] = child_0[pos - 1];
+                        child_1[pos] = child_1[pos - 1];
+                        child_dist[pos] = child_dist[pos - 1];
+                        pos -= 1;
+                    }
+                    child_0[pos] = k;
+                    child_1[pos] = m;
+                    child_dist[pos] = dist;
+                    num_child += 1;
+                }
+            }
+            for (int i = 0; i < num_child; i++) {
+                stack_level[num_stack] = level - 1;
+                stack_0[num_stack] = child_0[i];
+                stack_1[num_stack] = child_1[i];
+                num_stack += 1;
+            }
+            continue;
+        }
+        if ((level > 0) || (dist_min >= dist_fac_tri * rad_hori)) {
+            hf_sector_raise(bound_sin_up, hori_azim_num, sec_beg, sec_num,
+                sin_up);
+            continue;
+        }
+        // Bound triangles of (up to) 2 x 2 pixels
+        int end_0 = hf_min(2 * ind_0 + 2, num_pix_0);
+        int end_1 = hf_min(2 * ind_1 + 2, num_pix_1);
+        for (int k = (2 * ind_0); k < end_0; k++) {
+            for (int m = (2 * ind_1); m < end_1; m++) {
+                // Vertices in local ENU coordinates (00, 01, 10, 11)
+                double vert_loc[4][3];
+                for (int n = 0; n < 4; n++) {
+                    const float* vert = hf.vert_grid
+                        + ((size_t)(k + n / 2) * hf.dem_dim_1 + m + n % 2)
+                        * 3;
+                    double d[3];
+                    for (int p = 0; p < 3; p++) {
+                        d[p] = (double)vert[p] - org[p];
+                    }
+                    vert_loc[n][0] = d[0] * east[0] + d[1] * east[1]
+                        + d[2] * east[2];
+                    vert_loc[n][1] = d[0] * north[0] + d[1] * north[1]
+                        + d[2] * north[2];
+                    vert_loc[n][2] = d[0] * up[0] + d[1] * up[1]
+                        + d[2] * up[2];
+                }
+                // lower left and upper right triangle (see
+                // 'triangle_vert_ll' and 'triangle_vert_ur')
+                const int tri[2][3] = {{0, 1, 2}, {1, 3, 2}};
+                for (int n = 0; n < 2; n++) {
+                    double vert_tri[3][3];
+                    for (int p = 0; p < 3; p++) {
+                        for (int q = 0; q < 3; q++) {
+                            vert_tri[p][q] = vert_loc[tri[n][p]][q];
+                        }
+                    }
+                    hf_triangle_bound(vert_tri, sin_up, azim, half);
+                    hf_sector_range(azim, half, hori_azim_num, sec_beg,
+                        sec_num);
+                    hf_sector_raise(bound_sin_up, hori_azim_num, sec_beg,
+                        sec_num, sin_up);
+                }
+            }
+        }
+    }
+
+}
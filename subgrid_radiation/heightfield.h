@@ -0,0 +1,228 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <cstddef>
+#include <math.h>
+
+// Occlusion test for rays against the triangles of a regular DEM grid
+// without a general BVH: a quadtree (min/max mip-map) of axis-aligned
+// bounding boxes is built over the pixels of the grid in index space. Nodes
+// of level 0 bound blocks of 2 x 2 pixels; every further level halves the
+// number of nodes in both dimensions until a single node remains. The
+// bounding boxes are stored in ENU coordinates (the grid is curved in the
+// global ENU frame -> bounds in x and y are required as well). Traversal is
+// top-down with an explicit stack and terminates at the first intersected
+// triangle (occlusion -> any hit).
+
+// Maximal number of levels (-> supports grids with up to 2 ^ 31 pixels
+// along one dimension)
+#define HF_LEVELS_MAX 31
+
+// Size of traversal stack (at most three siblings are postponed per level)
+#define HF_STACK_SIZE (3 * HF_LEVELS_MAX + 1)
+
+struct Heightfield {
+    const float* vert_grid;  // vertices of DEM (x, y, z) [m]
+    int dem_dim_0;  // dimension length of DEM in y-direction [-]
+    int dem_dim_1;  // dimension length of DEM in x-direction [-]
+    int num_levels;  // number of quadtree levels [-]
+    int level_dim_0[HF_LEVELS_MAX];  // number of nodes in y-direction [-]
+    int level_dim_1[HF_LEVELS_MAX];  // number of nodes in x-direction [-]
+    size_t level_offset[HF_LEVELS_MAX];  // first node of level [-]
+    float* bounds;  // bounding boxes of nodes (x_min, y_min, z_min,
+                    // x_max, y_max, z_max) [m]
+};
+
+// Build quadtree of DEM vertices (vertices are shared, not copied)
+Heightfield heightfield_build(const float* vert_grid, int dem_dim_0,
+    int dem_dim_1);
+
+// Release memory of quadtree
+void heightfield_release(Heightfield &hf);
+
+// Memory occupied by quadtree [byte]
+size_t heightfield_bytes(const Heightfield &hf);
+
+// Guaranteed upper bound of horizon per azimuth sector (sine of elevation
+// angle; sector 'i' covers azimuth angles [i, i + 1) * 2 * pi
+// / hori_azim_num). Distant nodes are bounded by their boxes, pixels close to
+// the origin by their triangles. No ray is traced.
+void heightfield_horizon_bound(const Heightfield &hf, const double* org,
+    const double* east, const double* north, const double* up,
+    int hori_azim_num, double dist_search, double* bound_sin_up);
+
+// ----------------------------------------------------------------------------
+// Traversal
+// ----------------------------------------------------------------------------
+
+// Minimum of two integers
+inline int hf_min(int a, int b) {
+    return (a < b) ? a : b;
+}
+
+// Intersection of ray with bounding box (slab test)
+inline bool hf_box_hit(const float* box, float org_x, float org_y,
+    float org_z, float inv_x, float inv_y, float inv_z, float tnear,
+    float tfar) {
+    /* Parameters
+       ----------
+       box: bounding box (x_min, y_min, z_min, x_max, y_max, z_max) [m]
+       org_?: ray origin [m]
+       inv_?: inverse ray direction [1 / m]
+       tnear: start of ray segment [m]
+       tfar: end of ray segment [m]
+
+       Returns
+       ----------
+       hit: ray segment intersects bounding box
+    */
+    float t_0 = (box[0] - org_x) * inv_x;
+    float t_1 = (box[3] - org_x) * inv_x;
+    tnear = fmaxf(tnear, fminf(t_0, t_1));
+    tfar = fminf(tfar, fmaxf(t_0, t_1));
+    t_0 = (box[1] - org_y) * inv_y;
+    t_1 = (box[4] - org_y) * inv_y;
+    tnear = fmaxf(tnear, fminf(t_0, t_1));
+    tfar = fminf(tfar, fmaxf(t_0, t_1));
+    t_0 = (box[2] - org_z) * inv_z;
+    t_1 = (box[5] - org_z) * inv_z;
+    tnear = fmaxf(tnear, fminf(t_0, t_1));
+    tfar = fminf(tfar, fmaxf(t_0, t_1));
+    return (tnear <= tfar);
+}
+
+// Intersection of ray with triangle (Moeller-Trumbore; edges are included
+// -> rays through shared edges are not missed)
+inline bool hf_triangle_hit(const float* vert_0, const float* vert_1,
+    const float* vert_2, float org_x, float org_y, float org_z,
+    float dir_x, float dir_y, float dir_z, float tnear, float tfar) {
+    /* Parameters
+       ----------
+       vert_?: triangle vertices (x, y, z) [m]
+       org_?: ray origin [m]
+       dir_?: ray direction [-]
+       tnear: start of ray segment [m]
+       tfar: end of ray segment [m]
+
+       Returns
+       ----------
+       hit: ray segment intersects triangle
+    */
+    float e1_x = vert_1[0] - vert_0[0];
+    float e1_y = vert_1[1] - vert_0[1];
+    float e1_z = vert_1[2] - vert_0[2];
+    float e2_x = vert_2[0] - vert_0[0];
+    float e2_y = vert_2[1] - vert_0[1];
+    float e2_z = vert_2[2] - vert_0[2];
+    float p_x = dir_y * e2_z - dir_z * e2_y;
+    float p_y = dir_z * e2_x - dir_x * e2_z;
+    float p_z = dir_x * e2_y - dir_y * e2_x;
+    float det = e1_x * p_x + e1_y * p_y + e1_z * p_z;
+    if (det == 0.0f) {
+        return false;  // ray parallel to triangle
+    }
+    float det_inv = 1.0f / det;
+    float s_x = org_x - vert_0[0];
+    float s_y = org_y - vert_0[1];
+    float s_z = org_z - vert_0[2];
+    float u = (s_x * p_x + s_y * p_y + s_z * p_z) * det_inv;
+    if ((u < 0.0f) || (u > 1.0f)) {
+        return false;
+    }
+    float q_x = s_y * e1_z - s_z * e1_y;
+    float q_y = s_z * e1_x - s_x * e1_z;
+    float q_z = s_x * e1_y - s_y * e1_x;
+    float v = (dir_x * q_x + dir_y * q_y + dir_z * q_z) * det_inv;
+    if ((v < 0.0f) || ((u + v) > 1.0f)) {
+        return false;
+    }
+    float t = (e2_x * q_x + e2_y * q_y + e2_z * q_z) * det_inv;
+    return ((t > tnear) && (t < tfar));
+}
+
+// Test ray for occlusion by DEM
+inline bool heightfield_occluded(const Heightfield &hf, float org_x,
+    float org_y, float org_z, float dir_x, float dir_y, float dir_z,
+    float tnear, float tfar) {
+    /* Parameters
+       ----------
+       hf: quadtree of DEM
+       org_?: ray origin [m]
+       dir_?: ray direction [-]
+       tnear: start of ray segment [m]
+       tfar: end of ray segment [m]
+
+       Returns
+       ----------
+       occluded: ray segment intersects DEM
+    */
+    float inv_x = 1.0f / dir_x;
+    float inv_y = 1.0f / dir_y;
+    float inv_z = 1.0f / dir_z;
+    int num_pix_0 = hf.dem_dim_0 - 1;
+    int num_pix_1 = hf.dem_dim_1 - 1;
+
+    // Stack with nodes (level, index in y-direction, index in x-direction)
+    int stack_level[HF_STACK_SIZE];
+    int stack_0[HF_STACK_SIZE];
+    int stack_1[HF_STACK_SIZE];
+    int num_stack = 1;
+    stack_level[0] = hf.num_levels - 1;
+    stack_0[0] = 0;
+    stack_1[0] = 0;
+
+    while (num_stack > 0) {
+        num_stack -= 1;
+        int level = stack_level[num_stack];
+        int ind_0 = stack_0[num_stack];
+        int ind_1 = stack_1[num_stack];
+        const float* box = hf.bounds + (hf.level_offset[level]
+            + (size_t)ind_0 * hf.level_dim_1[level] + ind_1) * 6;
+        if (!hf_box_hit(box, org_x, org_y, org_z, inv_x, inv_y, inv_z,
+            tnear, tfar)) {
+            continue;
+        }
+        if (level > 0) {
+            // Push (existing) child nodes
+            int end_0 = hf_min(2 * ind_0 + 2, hf.level_dim_0[level - 1]);
+            int end_1 = hf_min(2 * ind_1 + 2, hf.level_dim_1[level - 1]);
+            for (int k = (2 * ind_0); k < end_0; k++) {
+                for (int m = (2 * ind_1); m < end_1; m++) {
+                    stack_level[num_stack] = level - 1;
+                    stack_0[num_stack] = k;
+                    stack_1[num_stack] = m;
+                    num_stack += 1;
+                }
+            }
+            continue;
+        }
+        // Test triangles of (up to) 2 x 2 pixels
+        int end_0 = hf_min(2 * ind_0 + 2, num_pix_0);
+        int end_1 = hf_min(2 * ind_1 + 2, num_pix_1);
+        for (int k = (2 * ind_0); k < end_0; k++) {
+            for (int m = (2 * ind_1); m < end_1; m++) {
+                const float* vert_00 = hf.vert_grid
+                    + ((size_t)k * hf.dem_dim_1 + m) * 3;
+                const float* vert_01 = vert_00 + 3;
+                const float* vert_10 = vert_00 + (size_t)hf.dem_dim_1 * 3;
+                const float* vert_11 = vert_10 + 3;
+                // lower left and upper right triangle (see
+                // 'triangle_vert_ll' and 'triangle_vert_ur')
+                if (hf_triangle_hit(vert_00, vert_01, vert_10,
+                    org_x, org_y, org_z, dir_x, dir_y, dir_z,
+                    tnear, tfar)
+                    || hf_triangle_hit(vert_01, vert_11, vert_10,
+                    org_x, org_y, org_z, dir_x, dir_y, dir_z,
+                    tnear, tfar)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,431 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef HORIZON_DETECT_H
+#define HORIZON_DETECT_H
+
+#include "embree_core.h"
+#include "geometry_core.h"
+#include <embree3/rtcore.h>
+#include <cstddef>
+#include <math.h>
+#include <algorithm>
+
+// Horizon detection algorithms (argument 'ray_algorithm', see 'HORI_ALG_*'
+// in 'embree_core.h'). Defined in the header so that the kernels, which are
+// specialised at compile time for each algorithm (see 'kernel_variants.h'),
+// can inline the selected algorithm and the ray casting function. Rays are
+// traced from 'tnear' (0.0 or near-field radius for far-field horizon) to
+// 'dist_search' [metre].
+
+//#############################################################################
+// Ray casting
+//#############################################################################
+
+// Cast single ray (returns true if ray is occluded)
+inline bool castRay_occluded1(RTCScene scene, float ox, float oy, float oz,
+    float dx, float dy, float dz, float tnear, float dist_search) {
+
+    // Intersect context
+    struct RTCIntersectContext context;
+    rtcInitIntersectContext(&context);
+
+    // Ray structure
+    struct RTCRay ray;
+    ray.org_x = ox;
+    ray.org_y = oy;
+    ray.org_z = oz;
+    ray.dir_x = dx;
+    ray.dir_y = dy;
+    ray.dir_z = dz;
+    ray.tnear = tnear;
+    //ray.tfar = std::numeric_limits<float>::infinity();
+    ray.tfar = dist_search;
+    //ray.mask = -1;
+    //ray.flags = 0;
+
+    // Intersect ray with scene
+    rtcOccluded1(scene, &context, &ray);
+
+    return (ray.tfar < 0.0);
+
+}
+
+//#############################################################################
+// Horizon detection algorithms
+//#############################################################################
+
+//-----------------------------------------------------------------------------
+// Discrete sampling
+//-----------------------------------------------------------------------------
+
+inline void ray_discrete_sampling(float ray_org_x, float ray_org_y,
+    float ray_org_z, size_t azim_num, double /*hori_acc*/, float tnear,
+    float dist_search, double /*elev_ang_low_lim*/,
+    double /*elev_ang_up_lim*/, int elev_num,
+    RTCScene scene, size_t &num_rays, double* horizon,
+    double* azim_sin, double* azim_cos, double* elev_ang,
+    double* elev_cos, double* elev_sin, double (&rot_inv)[3][3]) {
+
+    for (size_t k = 0; k < azim_num; k++) {
+
+        int ind_elev = 0;
+        int ind_elev_prev = 0;
+        bool hit = true;
+        while (hit) {
+
+            ind_elev_prev = ind_elev;
+            ind_elev = std::min(ind_elev + 10, elev_num - 1);
+            double ray[3] = {elev_cos[ind_elev] * azim_sin[k],
+                            elev_cos[ind_elev] * azim_cos[k],
+                            elev_sin[ind_elev]};
+            double ray_rot[3];
+            mat_vec_mult(rot_inv, ray, ray_rot);
+            hit = castRay_occluded1(scene,
+                ray_org_x, ray_org_y, ray_org_z,
+                (float)ray_rot[0], (float)ray_rot[1], (float)ray_rot[2],
+                tnear, dist_search);
+            num_rays += 1;
+
+        }
+        horizon[k] = (elev_ang[ind_elev_prev] + elev_ang[ind_elev]) / 2.0;
+
+    }
+
+}
+
+//-----------------------------------------------------------------------------
+// Binary search
+//-----------------------------------------------------------------------------
+
+inline void ray_binary_search(float ray_org_x, float ray_org_y,
+    float ray_org_z, size_t azim_num, double hori_acc, float tnear,
+    float dist_search, double elev_ang_low_lim, double elev_ang_up_lim,
+    int /*elev_num*/,
+    RTCScene scene, size_t &num_rays, double* horizon,
+    double* azim_sin, double* azim_cos, double* elev_ang,
+    double* elev_cos, double* elev_sin, double (&rot_inv)[3][3]) {
+
+    for (size_t k = 0; k < azim_num; k++) {
+
+        double lim_up = elev_ang_up_lim;
+        double lim_low = elev_ang_low_lim;
+        double elev_samp = (lim_up + lim_low) / 2.0;
+        int ind_elev = ((int)round((elev_samp - elev_ang_low_lim)
+            / (hori_acc / 5.0)));
+
+        while (std::max(lim_up - elev_ang[ind_elev],
+            elev_ang[ind_elev] - lim_low) > hori_acc) {
+
+            double ray[3] = {elev_cos[ind_elev] * azim_sin[k],
+                            elev_cos[ind_elev] * azim_cos[k],
+                            elev_sin[ind_elev]};
+            double ray_rot[3];
+            mat_vec_mult(rot_inv, ray, ray_rot);
+            bool hit = castRay_occluded1(scene,
+                ray_org_x, ray_org_y, ray_org_z,
+                (float)ray_rot[0], (float)ray_rot[1], (float)ray_rot[2],
+                tnear, dist_search);
+            num_rays += 1;
+
+            if (hit) {
+                lim_low = elev_ang[ind_elev];
+            } else {
+                lim_up = elev_ang[ind_elev];
+            }
+            elev_samp = (lim_up + lim_low) / 2.0;
+            ind_elev = ((int)round((elev_samp - elev_ang_low_lim)
+                / (hori_acc / 5.0)));
+
+        }
+        horizon[k] = elev_samp;
+
+    }
+
+}
+
+//-----------------------------------------------------------------------------
+// Binary search (packets of rays; azimuth directions in lockstep)
+//-----------------------------------------------------------------------------
+
+// Cast packet of rays (occluded rays: 'tfar' = -inf)
+inline void castRay_occluded_packet(const int* valid, RTCScene scene,
+    RTCIntersectContext* context, RTCRay4* rays) {
+    rtcOccluded4(valid, scene, context, rays);
+}
+
+inline void castRay_occluded_packet(const int* valid, RTCScene scene,
+    RTCIntersectContext* context, RTCRay8* rays) {
+    rtcOccluded8(valid, scene, context, rays);
+}
+
+inline void castRay_occluded_packet(const int* valid, RTCScene scene,
+    RTCIntersectContext* context, RTCRay16* rays) {
+    rtcOccluded16(valid, scene, context, rays);
+}
+
+// Binary search for 'N' azimuth directions at once: all directions share
+// the ray origin and are refined simultaneously with one ray packet per
+// iteration (lanes with converged horizon are masked). Results are
+// identical to 'ray_binary_search'.
+template <typename RTCRayN, size_t N>
+inline void ray_binary_search_packet(float ray_org_x, float ray_org_y,
+    float ray_org_z, size_t azim_num, double hori_acc, float tnear,
+    float dist_search, double elev_ang_low_lim, double elev_ang_up_lim,
+    int /*elev_num*/, RTCScene scene, size_t &num_rays, double* horizon,
+    double* azim_sin, double* azim_cos, double* elev_ang,
+    double* elev_cos, double* elev_sin, double (&rot_inv)[3][3]) {
+
+    struct RTCIntersectContext context;
+    rtcInitIntersectContext(&context);
+    context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+    RTCRayN rays;
+
+    for (size_t k_beg = 0; k_beg < azim_num; k_beg += N) {
+
+        size_t num_lanes = std::min(N, azim_num - k_beg);
+        double lim_up[N], lim_low[N], elev_samp[N];
+        int ind_elev[N];
+        int valid[N];
+        for (size_t q = 0; q < N; q++) {
+            lim_up[q] = elev_ang_up_lim;
+            lim_low[q] = elev_ang_low_lim;
+            elev_samp[q] = (lim_up[q] + lim_low[q]) / 2.0;
+            ind_elev[q] = ((int)round((elev_samp[q] - elev_ang_low_lim)
+                / (hori_acc / 5.0)));
+            valid[q] = 0;  // 0: invalid
+        }
+
+        size_t num_active = num_lanes;
+        while (num_active > 0) {
+
+            // Set up rays of active lanes
+            num_active = 0;
+            for (size_t q = 0; q < num_lanes; q++) {
+                valid[q] = 0;
+                if (std::max(lim_up[q] - elev_ang[ind_elev[q]],
+                    elev_ang[ind_elev[q]] - lim_low[q]) <= hori_acc) {
+                    continue;  // horizon found
+                }
+                size_t k = k_beg + q;
+                double ray[3] = {elev_cos[ind_elev[q]] * azim_sin[k],
+                                elev_cos[ind_elev[q]] * azim_cos[k],
+                                elev_sin[ind_elev[q]]};
+                double ray_rot[3];
+                mat_vec_mult(rot_inv, ray, ray_rot);
+                rays.org_x[q] = ray_org_x;
+                rays.org_y[q] = ray_org_y;
+                rays.org_z[q] = ray_org_z;
+                rays.dir_x[q] = (float)ray_rot[0];
+                rays.dir_y[q] = (float)ray_rot[1];
+                rays.dir_z[q] = (float)ray_rot[2];
+                rays.tnear[q] = tnear;
+                rays.tfar[q] = dist_search;
+                rays.mask[q] = -1;
+                rays.flags[q] = 0;
+                valid[q] = -1;  // -1: valid
+                num_active += 1;
+            }
+            if (num_active == 0) {
+                break;
+            }
+
+            // Intersect packet with scene
+            castRay_occluded_packet(valid, scene, &context, &rays);
+            num_rays += num_active;
+
+            // Update search intervals
+            for (size_t q = 0; q < num_lanes; q++) {
+                if (valid[q] == 0) {
+                    continue;
+                }
+                if (rays.tfar[q] < 0.0) {
+                    lim_low[q] = elev_ang[ind_elev[q]];
+                } else {
+                    lim_up[q] = elev_ang[ind_elev[q]];
+                }
+                elev_samp[q] = (lim_up[q] + lim_low[q]) / 2.0;
+                ind_elev[q] = ((int)round((elev_samp[q] - elev_ang_low_lim)
+                    / (hori_acc / 5.0)));
+            }
+
+        }
+        for (size_t q = 0; q < num_lanes; q++) {
+            horizon[k_beg + q] = elev_samp[q];
+        }
+
+    }
+
+}
+
+//-----------------------------------------------------------------------------
+// Guess horizon from previous azimuth direction
+//-----------------------------------------------------------------------------
+
+inline void ray_guess_const(float ray_org_x, float ray_org_y,
+    float ray_org_z, size_t azim_num, double hori_acc, float tnear,
+    float dist_search, double elev_ang_low_lim, double elev_ang_up_lim,
+    int elev_num,
+    RTCScene scene, size_t &num_rays, double* horizon,
+    double* azim_sin, double* azim_cos, double* elev_ang,
+    double* elev_cos, double* elev_sin, double (&rot_inv)[3][3]) {
+
+    // ------------------------------------------------------------------------
+    // First azimuth direction (binary search)
+    // ------------------------------------------------------------------------
+
+    double lim_up = elev_ang_up_lim;
+    double lim_low = elev_ang_low_lim;
+    double elev_samp = (lim_up + lim_low) / 2.0;
+    int ind_elev = ((int)round((elev_samp - elev_ang_low_lim)
+        / (hori_acc / 5.0)));
+
+    while (std::max(lim_up - elev_ang[ind_elev],
+        elev_ang[ind_elev] - lim_low) > hori_acc) {
+
+        double ray[3] = {elev_cos[ind_elev] * azim_sin[0],
+                        elev_cos[ind_elev] * azim_cos[0],
+                        elev_sin[ind_elev]};
+        double ray_rot[3];
+        mat_vec_mult(rot_inv, ray, ray_rot);
+        bool hit = castRay_occluded1(scene,
+            ray_org_x, ray_org_y, ray_org_z,
+            (float)ray_rot[0], (float)ray_rot[1], (float)ray_rot[2],
+            tnear, dist_search);
+        num_rays += 1;
+
+        if (hit) {
+            lim_low = elev_ang[ind_elev];
+        } else {
+            lim_up = elev_ang[ind_elev];
+        }
+        elev_samp = (lim_up + lim_low) / 2.0;
+        ind_elev = ((int)round((elev_samp - elev_ang_low_lim)
+            / (hori_acc / 5.0)));
+
+    }
+
+    horizon[0] = elev_samp;
+    int ind_elev_prev_azim = ind_elev;
+
+    // ------------------------------------------------------------------------
+    // Remaining azimuth directions (guess horizon from previous
+    // azimuth direction)
+    // ------------------------------------------------------------------------
+
+    for (size_t k = 1; k < azim_num; k++) {
+
+        // Move upwards
+        ind_elev = std::max(ind_elev_prev_azim - 5, 0);
+        int ind_elev_prev = 0;
+        bool hit = true;
+        int count = 0;
+        while (hit) {
+
+            ind_elev_prev = ind_elev;
+            ind_elev = std::min(ind_elev + 10, elev_num - 1);
+            double ray[3] = {elev_cos[ind_elev] * azim_sin[k],
+                            elev_cos[ind_elev] * azim_cos[k],
+                            elev_sin[ind_elev]};
+            double ray_rot[3];
+            mat_vec_mult(rot_inv, ray, ray_rot);
+            hit = castRay_occluded1(scene,
+                ray_org_x, ray_org_y, ray_org_z,
+                (float)ray_rot[0], (float)ray_rot[1], (float)ray_rot[2],
+                tnear, dist_search);
+            num_rays += 1;
+            count += 1;
+
+        }
+
+        if (count > 1) {
+
+            elev_samp = (elev_ang[ind_elev_prev] + elev_ang[ind_elev]) / 2.0;
+            ind_elev = ((int)round((elev_samp - elev_ang_low_lim)
+                / (hori_acc / 5.0)));
+            horizon[k] = elev_ang[ind_elev];
+            ind_elev_prev_azim = ind_elev;
+            continue;
+
+        }
+
+        // Move downwards
+        ind_elev = std::min(ind_elev_prev_azim + 5, elev_num - 1);
+        hit = false;
+        while (!hit) {
+
+            ind_elev_prev = ind_elev;
+            ind_elev = std::max(ind_elev - 10, 0);
+            double ray[3] = {elev_cos[ind_elev] * azim_sin[k],
+                            elev_cos[ind_elev] * azim_cos[k],
+                            elev_sin[ind_elev]};
+            double ray_rot[3];
+            mat_vec_mult(rot_inv, ray, ray_rot);
+            hit = castRay_occluded1(scene,
+                ray_org_x, ray_org_y, ray_org_z,
+                (float)ray_rot[0], (float)ray_rot[1], (float)ray_rot[2],
+                tnear, dist_search);
+            num_rays += 1;
+
+        }
+
+        elev_samp = (elev_ang[ind_elev_prev] + elev_ang[ind_elev]) / 2.0;
+        ind_elev = ((int)round((elev_samp - elev_ang_low_lim)
+            / (hori_acc / 5.0)));
+        horizon[k] = elev_ang[ind_elev];
+        ind_elev_prev_azim = ind_elev;
+
+    }
+
+}
+
+//-----------------------------------------------------------------------------
+// Algorithm fixed at compile time
+//-----------------------------------------------------------------------------
+
+// Horizon detection with algorithm 'ALG' (the condition is a compile-time
+// constant -> only the selected algorithm is called and inlined)
+template <int ALG>
+inline void horizon_detect(float ray_org_x, float ray_org_y,
+    float ray_org_z, size_t azim_num, double hori_acc, float tnear,
+    float dist_search, double elev_ang_low_lim, double elev_ang_up_lim,
+    int elev_num, RTCScene scene, size_t &num_rays, double* horizon,
+    double* azim_sin, double* azim_cos, double* elev_ang,
+    double* elev_cos, double* elev_sin, double (&rot_inv)[3][3]) {
+    if (ALG == HORI_ALG_DISCRETE_SAMPLING) {
+        ray_discrete_sampling(ray_org_x, ray_org_y, ray_org_z, azim_num,
+            hori_acc, tnear, dist_search, elev_ang_low_lim, elev_ang_up_lim,
+            elev_num, scene, num_rays, horizon, azim_sin, azim_cos, elev_ang,
+            elev_cos, elev_sin, rot_inv);
+    } else if (ALG == HORI_ALG_BINARY_SEARCH_PACKET4) {
+        ray_binary_search_packet<RTCRay4, 4>(ray_org_x, ray_org_y,
+            ray_org_z, azim_num, hori_acc, tnear, dist_search,
+            elev_ang_low_lim, elev_ang_up_lim, elev_num, scene, num_rays,
+            horizon, azim_sin, azim_cos, elev_ang, elev_cos, elev_sin,
+            rot_inv);
+    } else if (ALG == HORI_ALG_BINARY_SEARCH_PACKET8) {
+        ray_binary_search_packet<RTCRay8, 8>(ray_org_x, ray_org_y,
+            ray_org_z, azim_num, hori_acc, tnear, dist_search,
+            elev_ang_low_lim, elev_ang_up_lim, elev_num, scene, num_rays,
+            horizon, azim_sin, azim_cos, elev_ang, elev_cos, elev_sin,
+            rot_inv);
+    } else if (ALG == HORI_ALG_BINARY_SEARCH_PACKET16) {
+        ray_binary_search_packet<RTCRay16, 16>(ray_org_x, ray_org_y,
+            ray_org_z, azim_num, hori_acc, tnear, dist_search,
+            elev_ang_low_lim, elev_ang_up_lim, elev_num, scene, num_rays,
+            horizon, azim_sin, azim_cos, elev_ang, elev_cos, elev_sin,
+            rot_inv);
+    } else if (ALG == HORI_ALG_GUESS_CONSTANT) {
+        ray_guess_const(ray_org_x, ray_org_y, ray_org_z, azim_num,
+            hori_acc, tnear, dist_search, elev_ang_low_lim, elev_ang_up_lim,
+            elev_num, scene, num_rays, horizon, azim_sin, azim_cos, elev_ang,
+            elev_cos, elev_sin, rot_inv);
+    } else {
+        ray_binary_search(ray_org_x, ray_org_y, ray_org_z, azim_num,
+            hori_acc, tnear, dist_search, elev_ang_low_lim, elev_ang_up_lim,
+            elev_num, scene, num_rays, horizon, azim_sin, azim_cos, elev_ang,
+            elev_cos, elev_sin, rot_inv);
+    }
+}
+
+#endif
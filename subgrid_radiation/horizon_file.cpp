@@ -0,0 +1,215 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "horizon_file.h"
+#include <math.h>
+#include <string.h>
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static_assert(sizeof(HorizonFileHeader) == 88,
+    "unexpected padding in header of horizon file");
+
+static const char hori_file_magic[8] = {'S', 'G', 'R', 'H', 'O', 'R', 'I',
+    '\0'};
+
+//#############################################################################
+// Quantisation
+//#############################################################################
+
+void horizon_header_init(HorizonFileHeader &header, int num_gc_y,
+    int num_gc_x, int num_tri_per_gc, int hori_azim_num, int quant,
+    double elev_ang_low_lim, double hori_acc) {
+    /* Parameters
+       ----------
+       header: header of horizon file
+       num_gc_y: number of grid cells in y-direction [-]
+       num_gc_x: number of grid cells in x-direction [-]
+       num_tri_per_gc: number of triangles per grid cell [-]
+       hori_azim_num: number of azimuth sectors [-]
+       quant: quantisation (HORI_QUANT_UINT8 or HORI_QUANT_INT16) [-]
+       elev_ang_low_lim: lower limit for elevation angle search [radian]
+       hori_acc: accuracy of horizon computation [radian]
+    */
+
+    memset(&header, 0, sizeof(HorizonFileHeader));
+    memcpy(header.magic, hori_file_magic, sizeof(hori_file_magic));
+    header.version = HORI_FILE_VERSION;
+    header.quant = quant;
+    header.num_gc_y = num_gc_y;
+    header.num_gc_x = num_gc_x;
+    header.num_tri_per_gc = num_tri_per_gc;
+    header.hori_azim_num = hori_azim_num;
+    header.acc = hori_acc;
+
+    // Quantisation parameters (uint8: range [sine of lower limit, 1.0];
+    // int16: range [-1.0, 1.0])
+    if (quant == HORI_QUANT_INT16) {
+        header.scale = 1.0 / 32767.0;
+        header.offset = 0.0;
+    } else {
+        header.offset = sin(elev_ang_low_lim);
+        header.scale = (1.0 - header.offset) / 255.0;
+    }
+
+    // Section offsets (data starts at page boundary)
+    size_t page_size = 4096;
+    size_t num_gc = (size_t)num_gc_y * (size_t)num_gc_x;
+    header.offset_mask = sizeof(HorizonFileHeader);
+    header.offset_data = ((header.offset_mask + num_gc + page_size - 1)
+        / page_size) * page_size;
+    header.record_size = (size_t)(hori_azim_num + 2) * (size_t)quant;
+    header.chunk_size = header.record_size * (size_t)num_tri_per_gc;
+
+}
+
+void horizon_record_quant(double* horizon, HorizonFileHeader &header,
+    unsigned char* record) {
+    /* Parameters
+       ----------
+       horizon: horizon for all azimuth angles [radian]
+       header: header of horizon file
+       record: record [min, max, horizon] with quantised sine of horizon
+    */
+
+    double val_min = (header.quant == HORI_QUANT_INT16) ? -32767.0 : 0.0;
+    double val_max = (header.quant == HORI_QUANT_INT16) ? 32767.0 : 255.0;
+    double hori_min = val_max;
+    double hori_max = val_min;
+    for (int32_t i = 0; i < header.hori_azim_num; i++) {
+        double val = round((sin(horizon[i]) - header.offset) / header.scale);
+        val = std::max(val_min, std::min(val, val_max));
+        hori_min = std::min(hori_min, val);
+        hori_max = std::max(hori_max, val);
+        if (header.quant == HORI_QUANT_INT16) {
+            ((int16_t*)record)[i + 2] = (int16_t)val;
+        } else {
+            record[i + 2] = (unsigned char)val;
+        }
+    }
+    if (header.quant == HORI_QUANT_INT16) {
+        ((int16_t*)record)[0] = (int16_t)hori_min;
+        ((int16_t*)record)[1] = (int16_t)hori_max;
+    } else {
+        record[0] = (unsigned char)hori_min;
+        record[1] = (unsigned char)hori_max;
+    }
+
+}
+
+//#############################################################################
+// Write horizon file
+//#############################################################################
+
+int horizon_file_create(const char* file, HorizonFileHeader &header,
+    unsigned char* mask) {
+
+    int fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        cerr << "Error: horizon file " << file << " can not be created"
+            << endl;
+        return -1;
+    }
+    size_t num_gc = (size_t)header.num_gc_y * (size_t)header.num_gc_x;
+    size_t file_size = header.offset_data + num_gc * header.chunk_size;
+    bool success = (ftruncate(fd, file_size) == 0)
+        && (pwrite(fd, &header, sizeof(HorizonFileHeader), 0)
+        == (ssize_t)sizeof(HorizonFileHeader))
+        && (pwrite(fd, mask, num_gc, header.offset_mask) == (ssize_t)num_gc);
+    // chunks not written remain holes in the file (filled with zeros)
+    if (!success) {
+        cerr << "Error: writing header of horizon file failed" << endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+
+}
+
+bool horizon_file_write_chunk(int fd, HorizonFileHeader &header,
+    size_t lin_ind_gc, unsigned char* chunk) {
+
+    size_t offset = header.offset_data + lin_ind_gc * header.chunk_size;
+    return (pwrite(fd, chunk, header.chunk_size, offset)
+        == (ssize_t)header.chunk_size);
+
+}
+
+void horizon_file_close(int fd) {
+
+    fsync(fd);
+    close(fd);
+
+}
+
+//#############################################################################
+// Read horizon file
+//#############################################################################
+
+unsigned char* horizon_file_map(const char* file, HorizonFileHeader &header,
+    size_t &map_size) {
+
+    int fd = open(file, O_RDONLY);
+    if (fd == -1) {
+        cerr << "Error: horizon file " << file << " can not be opened"
+            << endl;
+        return NULL;
+    }
+
+    // Check header
+    struct stat file_stat;
+    if ((fstat(fd, &file_stat) != 0)
+        || (pread(fd, &header, sizeof(HorizonFileHeader), 0)
+        != sizeof(HorizonFileHeader))
+        || (memcmp(header.magic, hori_file_magic, sizeof(hori_file_magic))
+        != 0) || (header.version != HORI_FILE_VERSION)) {
+        cerr << "Error: " << file << " is not a valid horizon file" << endl;
+        close(fd);
+        return NULL;
+    }
+    if ((header.num_gc_y < 1) || (header.num_gc_x < 1)
+        || (header.num_tri_per_gc < 1) || (header.hori_azim_num < 1)
+        || ((header.quant != HORI_QUANT_UINT8)
+        && (header.quant != HORI_QUANT_INT16))
+        || (header.offset_mask != sizeof(HorizonFileHeader))
+        || (header.offset_data < header.offset_mask
+        + (uint64_t)header.num_gc_y * (uint64_t)header.num_gc_x)
+        || (header.record_size
+        != (uint64_t)(header.hori_azim_num + 2) * (uint64_t)header.quant)
+        || (header.chunk_size
+        != header.record_size * (uint64_t)header.num_tri_per_gc)) {
+        cerr << "Error: header of horizon file " << file << " is corrupt"
+            << endl;
+        close(fd);
+        return NULL;
+    }
+    size_t num_gc = (size_t)header.num_gc_y * (size_t)header.num_gc_x;
+    map_size = header.offset_data + num_gc * header.chunk_size;
+    if ((size_t)file_stat.st_size < map_size) {
+        cerr << "Error: horizon file " << file << " is truncated" << endl;
+        close(fd);
+        return NULL;
+    }
+
+    // Map file (pages are loaded on demand)
+    void* map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // mapping remains valid
+    if (map == MAP_FAILED) {
+        cerr << "Error: memory-mapping of horizon file failed" << endl;
+        return NULL;
+    }
+    return (unsigned char*)map;
+
+}
+
+void horizon_file_unmap(unsigned char* map, size_t map_size) {
+
+    munmap(map, map_size);
+
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef HORIZON_FILE_H
+#define HORIZON_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Layout of horizon file (all values in native byte order):
+// - header (struct HorizonFileHeader)
+// - mask of grid cells (uint8; num_gc_y * num_gc_x)
+// - data (starts at page boundary): one chunk per grid cell (row-major),
+//   each chunk contains 'num_tri_per_gc' records (same triangle order as
+//   loops over pixels (k, m) and triangles (n)). A record consists of the
+//   minimal and maximal sine of the horizon followed by the sine of the
+//   horizon for all azimuth angles: [min, max, hori_0, ..., hori_(n-1)].
+//   Chunks of masked grid cells are not written (sparse file).
+// Sine of horizon = value * scale + offset. The header additionally stores
+// the accuracy of the horizon detection ('acc'; the horizon in sampled
+// azimuth directions deviates by at most this angle).
+
+// Quantisation of sine of horizon (bytes per value)
+#define HORI_QUANT_UINT8 1
+#define HORI_QUANT_INT16 2
+
+#define HORI_FILE_VERSION 1
+
+struct HorizonFileHeader {
+    char magic[8];
+    int32_t version;
+    int32_t quant;
+    int32_t num_gc_y, num_gc_x;
+    int32_t num_tri_per_gc;
+    int32_t hori_azim_num;
+    double scale, offset;
+    double acc;
+    uint64_t offset_mask;
+    uint64_t offset_data;
+    uint64_t record_size;
+    uint64_t chunk_size;
+};
+
+// Initialise header (quantisation parameters, accuracy and section offsets)
+void horizon_header_init(HorizonFileHeader &header, int num_gc_y,
+    int num_gc_x, int num_tri_per_gc, int hori_azim_num, int quant,
+    double elev_ang_low_lim, double hori_acc);
+
+// Quantise sine of horizon and write record [min, max, horizon]
+void horizon_record_quant(double* horizon, HorizonFileHeader &header,
+    unsigned char* record);
+
+// Sine of horizon from record (ind = 0: min, 1: max, 2 + azimuth index)
+inline double horizon_record_value(const unsigned char* record, size_t ind,
+    int quant, double scale, double offset) {
+    if (quant == HORI_QUANT_INT16) {
+        return (double)((const int16_t*)record)[ind] * scale + offset;
+    } else {
+        return (double)record[ind] * scale + offset;
+    }
+}
+
+// Create file, write header and mask (returns file descriptor; -1: error)
+int horizon_file_create(const char* file, HorizonFileHeader &header,
+    unsigned char* mask);
+
+// Write chunk of grid cell (thread-safe)
+bool horizon_file_write_chunk(int fd, HorizonFileHeader &header,
+    size_t lin_ind_gc, unsigned char* chunk);
+
+// Close file
+void horizon_file_close(int fd);
+
+// Memory-map file read-only (returns base address; NULL: error)
+unsigned char* horizon_file_map(const char* file, HorizonFileHeader &header,
+    size_t &map_size);
+
+// Unmap file
+void horizon_file_unmap(unsigned char* map, size_t map_size);
+
+#endif
@@ -0,0 +1,130 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "kernel_stats.h"
+#include <iostream>
+#include <algorithm>
+#include <tbb/task_arena.h>
+
+using namespace std;
+
+KernelStats kernel_stats;
+KernelLog kout;
+
+// Verbosity of kernels and recording of rays per grid cell
+static std::atomic<int> verbosity(1);
+static std::atomic<bool> stats_cells(false);
+
+// Depth of nested kernel scopes
+static std::atomic<int> scope_depth(0);
+
+// Stream without buffer (sets 'badbit' on output -> discards it)
+static ostream null_stream(NULL);
+
+//#############################################################################
+// Scope of kernel call
+//#############################################################################
+
+KernelScope::KernelScope(size_t num_gc_y, size_t num_gc_x) {
+    outer = (scope_depth.fetch_add(1) == 0);
+    if (!outer) {
+        return;
+    }
+
+    // Reset statistics
+    kernel_stats.time_bvh = 0.0;
+    kernel_stats.mem_bvh = 0.0;
+    kernel_stats.time_ray = 0.0;
+    kernel_stats.time_total = 0.0;
+    kernel_stats.num_rays = 0;
+    kernel_stats.num_rays_culled = 0;
+    kernel_stats.rays_per_azim = 0.0;
+    kernel_stats.num_threads = std::min(
+        (size_t)tbb::this_task_arena::max_concurrency(),
+        (size_t)STATS_THREADS_MAX);
+    for (size_t i = 0; i < STATS_THREADS_MAX; i++) {
+        kernel_stats.rays_thread[i] = 0;
+    }
+    delete[] kernel_stats.rays_gc;
+    kernel_stats.rays_gc = NULL;
+    kernel_stats.num_gc_y = 0;
+    kernel_stats.num_gc_x = 0;
+    if (stats_cells && (num_gc_y * num_gc_x > 0)) {
+        kernel_stats.rays_gc = new size_t[num_gc_y * num_gc_x]();
+        kernel_stats.num_gc_y = num_gc_y;
+        kernel_stats.num_gc_x = num_gc_x;
+    }
+
+}
+
+KernelScope::~KernelScope() {
+    scope_depth.fetch_sub(1);
+}
+
+//#############################################################################
+// Verbosity and output
+//#############################################################################
+
+void set_verbosity(int level) {
+    verbosity = level;
+}
+
+int get_verbosity() {
+    return verbosity;
+}
+
+void set_stats_cells(bool record) {
+    stats_cells = record;
+}
+
+ostream& kernel_log(int level) {
+    return (verbosity >= level) ? cout : null_stream;
+}
+
+//#############################################################################
+// Ray counts
+//#############################################################################
+
+void stats_thread(size_t num_rays, size_t num_rays_culled) {
+    int ind = tbb::this_task_arena::current_thread_index();
+    if ((ind < 0) || (ind >= STATS_THREADS_MAX)) {
+        ind = STATS_THREADS_MAX - 1;
+    }
+    kernel_stats.rays_thread[ind].fetch_add(num_rays,
+        std::memory_order_relaxed);
+    kernel_stats.num_rays_culled.fetch_add(num_rays_culled,
+        std::memory_order_relaxed);
+}
+
+void stats_cell(size_t lin_ind_gc, size_t num_rays) {
+    if ((kernel_stats.rays_gc != NULL) && (scope_depth == 1)) {
+        kernel_stats.rays_gc[lin_ind_gc] = num_rays;
+    }
+}
+
+//#############################################################################
+// Accessors
+//#############################################################################
+
+KernelStatsValues kernel_stats_values() {
+    KernelStatsValues values;
+    values.time_bvh = kernel_stats.time_bvh;
+    values.mem_bvh = kernel_stats.mem_bvh;
+    values.time_ray = kernel_stats.time_ray;
+    values.time_total = kernel_stats.time_total;
+    values.num_rays = kernel_stats.num_rays;
+    values.num_rays_culled = kernel_stats.num_rays_culled.load();
+    values.rays_per_azim = kernel_stats.rays_per_azim;
+    values.num_threads = kernel_stats.num_threads;
+    values.num_gc_y = kernel_stats.num_gc_y;
+    values.num_gc_x = kernel_stats.num_gc_x;
+    return values;
+}
+
+size_t kernel_stats_rays_thread(size_t ind) {
+    return kernel_stats.rays_thread[ind].load();
+}
+
+size_t kernel_stats_rays_gc(size_t lin_ind_gc) {
+    return kernel_stats.rays_gc[lin_ind_gc];
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef KERNEL_STATS_H
+#define KERNEL_STATS_H
+
+#include <cstddef>
+#include <atomic>
+#include <ostream>
+
+// Instrumentation of ray tracing kernels: statistics of the last kernel call
+// (timings, ray counts, per-thread and optional per-grid-cell ray counts)
+// and verbosity of kernel output. Every kernel opens a 'KernelScope', which
+// resets the statistics. Nested scopes (e.g. tiles of an out-of-core
+// computation) accumulate into the statistics of the outermost scope.
+// Regular output is written to 'kout', which discards it if the verbosity
+// is 0; errors are always written to 'cerr'.
+
+// Maximal number of threads with separate ray counts (threads with larger
+// indices are counted in the last slot)
+#define STATS_THREADS_MAX 256
+
+struct KernelStats {
+    double time_bvh;  // BVH build time (0.0 if scene is reused) [s]
+    double mem_bvh;  // memory allocated for BVH [MB]
+    double time_ray;  // ray tracing time [s]
+    double time_total;  // total run time [s]
+    size_t num_rays;  // number of rays shot
+    std::atomic<size_t> num_rays_culled;  // rays not shot (self-shadowing
+                                          // of Earth/triangle)
+    double rays_per_azim;  // average rays per location and azimuth (horizon)
+    size_t num_threads;  // number of thread slots
+    std::atomic<size_t> rays_thread[STATS_THREADS_MAX];  // rays per thread
+    size_t num_gc_y, num_gc_x;  // dimensions of 'rays_gc' (0: not recorded)
+    size_t* rays_gc;  // rays per grid cell (if enabled)
+};
+
+// Statistics of last kernel call
+extern KernelStats kernel_stats;
+
+// Scope of kernel call
+class KernelScope {
+public:
+    KernelScope(size_t num_gc_y = 0, size_t num_gc_x = 0);
+    ~KernelScope();
+    bool outer;  // outermost scope
+};
+
+// Set/get verbosity of kernels (0: silent, 1: settings, timings and ray
+// counts)
+void set_verbosity(int level);
+int get_verbosity();
+
+// Enable/disable recording of rays per grid cell in next kernel calls
+void set_stats_cells(bool record);
+
+// Output stream for messages of given level ('cout' if the verbosity is at
+// least 'level', otherwise a stream discarding the output)
+std::ostream& kernel_log(int level = 1);
+
+// Kernel output of level 1 ('kout << ...'; the verbosity is checked by the
+// first insertion, further insertions are chained to the selected stream)
+struct KernelLog {};
+extern KernelLog kout;
+
+template <typename T>
+inline std::ostream& operator<<(KernelLog& /*log*/, const T& value) {
+    return kernel_log() << value;
+}
+
+inline std::ostream& operator<<(KernelLog& /*log*/,
+    std::ostream& (*manip)(std::ostream&)) {
+    return kernel_log() << manip;
+}
+
+// Add ray counts of thread (called once per parallel task)
+void stats_thread(size_t num_rays, size_t num_rays_culled);
+
+// Set ray count of grid cell (linear index of grid cell; no effect if
+// recording is disabled or within nested scope)
+void stats_cell(size_t lin_ind_gc, size_t num_rays);
+
+// ----------------------------------------------------------------------------
+// Accessors (for Python bindings)
+// ----------------------------------------------------------------------------
+
+// Scalar statistics of last kernel call (plain copy of 'KernelStats'
+// without per-thread and per-grid-cell counts)
+struct KernelStatsValues {
+    double time_bvh;
+    double mem_bvh;
+    double time_ray;
+    double time_total;
+    size_t num_rays;
+    size_t num_rays_culled;
+    double rays_per_azim;
+    size_t num_threads;
+    size_t num_gc_y, num_gc_x;
+};
+KernelStatsValues kernel_stats_values();
+
+// Rays of thread slot 'ind' (< num_threads)
+size_t kernel_stats_rays_thread(size_t ind);
+
+// Rays of grid cell with linear index 'lin_ind_gc' (< num_gc_y * num_gc_x)
+size_t kernel_stats_rays_gc(size_t lin_ind_gc);
+
+#endif
@@ -0,0 +1,127 @@
+# Copyright (c) 2023 ETH Zurich, Christian R. Steger
+# MIT License
+
+# Statistics, verbosity and specialisations of ray tracing kernels (included
+# in every extension module; each module links its own copy of the C++ state
+# -> verbosity and recording of rays per grid cell are set for all modules
+# with 'subgrid_radiation.set_verbosity' and
+# 'subgrid_radiation.set_stats_cells')
+
+# -----------------------------------------------------------------------------
+# Kernel statistics and verbosity
+# -----------------------------------------------------------------------------
+
+cdef extern from "kernel_stats.h":
+    ctypedef struct KernelStatsValues:
+        double time_bvh
+        double mem_bvh
+        double time_ray
+        double time_total
+        size_t num_rays
+        size_t num_rays_culled
+        double rays_per_azim
+        size_t num_threads
+        size_t num_gc_y
+        size_t num_gc_x
+    void cpp_set_verbosity "set_verbosity" (int level)
+    void cpp_set_stats_cells "set_stats_cells" (bint record)
+    KernelStatsValues kernel_stats_values()
+    size_t kernel_stats_rays_thread(size_t ind)
+    size_t kernel_stats_rays_gc(size_t lin_ind_gc)
+
+def _set_verbosity(int level):
+    """Set verbosity of kernels of this module (use
+    'subgrid_radiation.set_verbosity')."""
+
+    cpp_set_verbosity(level)
+
+def _set_stats_cells(bint record):
+    """Enable/disable recording of rays per grid cell for kernels of this
+    module (use 'subgrid_radiation.set_stats_cells')."""
+
+    cpp_set_stats_cells(record)
+
+def kernel_stats():
+    """Return statistics of the last kernel call of this module.
+
+    Returns
+    -------
+    stats : dict
+        Statistics with the keys 'time_bvh' (BVH build time [s]), 'mem_bvh'
+        (memory allocated for BVH [MB]), 'time_ray' (ray tracing time [s]),
+        'time_total' (total run time [s]), 'num_rays' (number of rays shot),
+        'num_rays_culled' (rays not shot due to self-shadowing),
+        'rays_per_azim' (average rays per location and azimuth; horizon
+        computation), 'rays_thread' (rays per thread; ndarray) and 'rays_gc'
+        (rays per grid cell; ndarray of shape (num_gc_y, num_gc_x) or None
+        if not recorded)"""
+
+    cdef size_t i
+    cdef KernelStatsValues stats = kernel_stats_values()
+    rays_thread = np.empty(stats.num_threads, dtype=np.uint64)
+    for i in range(stats.num_threads):
+        rays_thread[i] = kernel_stats_rays_thread(i)
+    rays_gc = None
+    if stats.num_gc_y * stats.num_gc_x > 0:
+        rays_gc = np.empty((stats.num_gc_y, stats.num_gc_x),
+                           dtype=np.uint64)
+        for i in range(stats.num_gc_y * stats.num_gc_x):
+            rays_gc.flat[i] = kernel_stats_rays_gc(i)
+    return {"time_bvh": stats.time_bvh,
+            "mem_bvh": stats.mem_bvh,
+            "time_ray": stats.time_ray,
+            "time_total": stats.time_total,
+            "num_rays": stats.num_rays,
+            "num_rays_culled": stats.num_rays_culled,
+            "rays_per_azim": stats.rays_per_azim,
+            "rays_thread": rays_thread,
+            "rays_gc": rays_gc}
+
+# -----------------------------------------------------------------------------
+# Kernel specialisations
+# -----------------------------------------------------------------------------
+
+cdef extern from "kernel_variants.h":
+    ctypedef struct KernelVariant:
+        const char* kernel
+        const char* ray_algorithm
+        int packet_width
+        const char* refrac_cor
+        const char* precision
+    size_t kernel_variants_num()
+    KernelVariant kernel_variant(size_t ind)
+
+# Horizon detection algorithms (argument 'ray_algorithm'; same order as
+# 'hori_alg_names' in 'embree_core.cpp')
+ray_algorithms = ("discrete_sampling", "binary_search",
+                  "binary_search_packet4", "binary_search_packet",
+                  "binary_search_packet16", "guess_constant")
+
+def kernel_variants():
+    """Return the specialisations of kernels compiled into the package.
+
+    Kernels are specialised at compile time for the horizon detection
+    algorithm, the atmospheric refraction correction and the precision; the
+    specialisation is selected once per kernel call according to the
+    arguments.
+
+    Returns
+    -------
+    variants : list of dict
+        Valid combinations with the keys 'kernel' (module and function),
+        'ray_algorithm' (horizon detection algorithm or None), 'packet_width'
+        (rays per Embree query; 0: no ray tracing), 'refrac_cor' (none,
+        table, exact or None) and 'precision' (float64 or float32)"""
+
+    cdef size_t i
+    cdef KernelVariant var
+    variants = []
+    for i in range(kernel_variants_num()):
+        var = kernel_variant(i)
+        variants.append({
+            "kernel": var.kernel.decode("utf-8"),
+            "ray_algorithm": var.ray_algorithm.decode("utf-8") or None,
+            "packet_width": var.packet_width,
+            "refrac_cor": var.refrac_cor.decode("utf-8") or None,
+            "precision": var.precision.decode("utf-8")})
+    return variants
@@ -0,0 +1,80 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "kernel_variants.h"
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Specialisations of kernels (must match dispatch in kernel functions)
+//-----------------------------------------------------------------------------
+
+static const char* const refrac_names[3] = {"none", "table", "exact"};
+
+static std::vector<KernelVariant> kernel_variants_build() {
+
+    std::vector<KernelVariant> variants;
+
+    // Horizon detection algorithm x precision
+    const char* const hori_kernels[3] = {"horizon.sky_view_factor",
+        "horizon.sky_view_factor_sw_dir_cor",
+        "horizon.sky_view_factor_adaptive"};
+    for (int i = 0; i < 3; i++) {
+        for (int alg = 0; alg < HORI_ALG_NUM; alg++) {
+            variants.push_back({hori_kernels[i], hori_alg_names[alg],
+                hori_alg_width[alg], "", "float64"});
+            if (i < 2) {
+                variants.push_back({hori_kernels[i], hori_alg_names[alg],
+                    hori_alg_width[alg], "", "float32"});
+            }
+        }
+    }
+    for (int alg = 0; alg < HORI_ALG_NUM; alg++) {
+        variants.push_back({"sun_position.Terrain.build_horizon_cache",
+            hori_alg_names[alg], hori_alg_width[alg], "", "float64"});
+    }
+
+    // Refraction correction x precision (lookup table; double precision)
+    variants.push_back({"rays.sw_dir_cor", "", 1, "none", "float64"});
+    variants.push_back({"rays.sw_dir_cor", "", 1, "table", "float64"});
+    variants.push_back({"rays.sw_dir_cor", "", 1, "none", "float32"});
+
+    // Horizon detection algorithm of horizon bounds
+    for (int alg = 0; alg < HORI_ALG_NUM; alg++) {
+        if (alg != HORI_ALG_GUESS_CONSTANT) {
+            variants.push_back({"rays.sw_dir_cor_hori_bound",
+                hori_alg_names[alg], hori_alg_width[alg], "", "float64"});
+        }
+    }
+
+    // Refraction correction (packet width 0: horizon cache, no rays)
+    const char* const terrain_kernels[6] = {"sun_position.Terrain.sw_dir_cor",
+        "sun_position.Terrain.sw_dir_cor_batch",
+        "sun_position.Terrain.sw_dir_cor_horizon",
+        "sun_position.Terrain.sw_dir_cor_incremental",
+        "sun_position.Terrain.sw_dir_cor_coherent",
+        "sun_position.Terrain.sw_dir_cor_coherent_rp8"};
+    const int terrain_width[6] = {1, 1, 0, 1, 1, 8};
+    for (int i = 0; i < 6; i++) {
+        for (int refrac = REFRAC_NONE; refrac <= REFRAC_EXACT; refrac++) {
+            variants.push_back({terrain_kernels[i], "", terrain_width[i],
+                refrac_names[refrac], "float64"});
+        }
+    }
+
+    return variants;
+
+}
+
+static const std::vector<KernelVariant>& kernel_variants() {
+    static const std::vector<KernelVariant> variants
+        = kernel_variants_build();
+    return variants;
+}
+
+size_t kernel_variants_num() {
+    return kernel_variants().size();
+}
+
+KernelVariant kernel_variant(size_t ind) {
+    return kernel_variants()[ind];
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef KERNEL_VARIANTS_H
+#define KERNEL_VARIANTS_H
+
+#include "embree_core.h"
+#include "refraction.h"
+#include <cstddef>
+#include <type_traits>
+
+// Compile-time specialisation of kernels. Settings that are constant during
+// a kernel call (horizon detection algorithm, refraction correction,
+// precision) are template parameters of the kernel bodies, which removes
+// function pointers and per-triangle branches from the inner loops. The
+// public kernel functions select the specialisation once per call with the
+// dispatchers below, which pass the setting as 'std::integral_constant' to a
+// generic lambda ('decltype(arg)::value' is then a constant expression).
+
+template <int V>
+using kernel_const = std::integral_constant<int, V>;
+
+// Flag (0 or 1; e.g. 'use_float32')
+template <typename F>
+inline auto dispatch_flag(int flag, F kernel)
+    -> decltype(kernel(kernel_const<0>())) {
+    if (flag != 0) {
+        return kernel(kernel_const<1>());
+    }
+    return kernel(kernel_const<0>());
+}
+
+// Horizon detection algorithm (index; unknown -> binary search)
+template <typename F>
+inline auto dispatch_hori_alg(int alg, F kernel)
+    -> decltype(kernel(kernel_const<0>())) {
+    switch (alg) {
+        case HORI_ALG_DISCRETE_SAMPLING:
+            return kernel(kernel_const<HORI_ALG_DISCRETE_SAMPLING>());
+        case HORI_ALG_BINARY_SEARCH_PACKET4:
+            return kernel(kernel_const<HORI_ALG_BINARY_SEARCH_PACKET4>());
+        case HORI_ALG_BINARY_SEARCH_PACKET8:
+            return kernel(kernel_const<HORI_ALG_BINARY_SEARCH_PACKET8>());
+        case HORI_ALG_BINARY_SEARCH_PACKET16:
+            return kernel(kernel_const<HORI_ALG_BINARY_SEARCH_PACKET16>());
+        case HORI_ALG_GUESS_CONSTANT:
+            return kernel(kernel_const<HORI_ALG_GUESS_CONSTANT>());
+        default:
+            return kernel(kernel_const<HORI_ALG_BINARY_SEARCH>());
+    }
+}
+
+// Refraction correction (REFRAC_NONE, REFRAC_TABLE or REFRAC_EXACT)
+template <typename F>
+inline auto dispatch_refrac(int refrac_cor, F kernel)
+    -> decltype(kernel(kernel_const<0>())) {
+    switch (refrac_cor) {
+        case REFRAC_TABLE:
+            return kernel(kernel_const<REFRAC_TABLE>());
+        case REFRAC_EXACT:
+            return kernel(kernel_const<REFRAC_EXACT>());
+        default:
+            return kernel(kernel_const<REFRAC_NONE>());
+    }
+}
+
+// Specialisation of kernel that is compiled into the package
+struct KernelVariant {
+    const char* kernel;         // module and function/method
+    const char* ray_algorithm;  // horizon detection ("": none)
+    int packet_width;           // rays per Embree query
+    const char* refrac_cor;     // "none", "table" or "exact" ("": none)
+    const char* precision;      // "float64" or "float32"
+};
+
+// Number of specialisations and specialisation with index 'ind'
+size_t kernel_variants_num();
+KernelVariant kernel_variant(size_t ind);
+
+#endif
@@ -0,0 +1,77 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "lut_encoding.h"
+#include <math.h>
+#include <cstdint>
+#include <algorithm>
+#include <tbb/parallel_for.h>
+
+//#############################################################################
+// Encoding parameters
+//#############################################################################
+
+void lut_encoding_param(int enc, double sw_dir_cor_max, double &scale,
+    double &offset, unsigned int &fill_value) {
+    /* Parameters
+       ----------
+       enc: encoding (LUT_ENC_UINT8 or LUT_ENC_UINT16) [-]
+       sw_dir_cor_max: maximal correction factor [-]
+       scale: scale of encoding [-]
+       offset: offset of encoding [-]
+       fill_value: value representing NaN [-]
+    */
+
+    fill_value = (enc == LUT_ENC_UINT16) ? 65535 : 255;
+    scale = sw_dir_cor_max / (double)(fill_value - 1);
+    offset = 0.0;
+
+}
+
+//#############################################################################
+// Encode lookup table
+//#############################################################################
+
+template <typename T>
+void lut_encode_type(const float* sw_dir_cor, size_t num_elem, double scale,
+    double offset, T fill_value, T* sw_dir_cor_enc) {
+
+    float scale_inv = (float)(1.0 / scale);
+    float offset_f = (float)offset;
+    float val_max = (float)(fill_value - 1);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_elem, 65536),
+        [&](tbb::blocked_range<size_t> r) {
+        for (size_t i = r.begin(); i < r.end(); i++) {
+            if (isnan(sw_dir_cor[i])) {
+                sw_dir_cor_enc[i] = fill_value;
+            } else {
+                float val = roundf((sw_dir_cor[i] - offset_f) * scale_inv);
+                sw_dir_cor_enc[i] = (T)std::max(0.0f, std::min(val,
+                    val_max));
+            }
+        }
+    });
+
+}
+
+void lut_encode(const float* sw_dir_cor, size_t num_elem, int enc,
+    double scale, double offset, void* sw_dir_cor_enc) {
+    /* Parameters
+       ----------
+       sw_dir_cor: lookup table with correction factors [-]
+       num_elem: number of elements [-]
+       enc: encoding (LUT_ENC_UINT8 or LUT_ENC_UINT16) [-]
+       scale: scale of encoding [-]
+       offset: offset of encoding [-]
+       sw_dir_cor_enc: encoded lookup table [-]
+    */
+
+    if (enc == LUT_ENC_UINT16) {
+        lut_encode_type<uint16_t>(sw_dir_cor, num_elem, scale, offset,
+            65535, (uint16_t*)sw_dir_cor_enc);
+    } else {
+        lut_encode_type<uint8_t>(sw_dir_cor, num_elem, scale, offset,
+            255, (uint8_t*)sw_dir_cor_enc);
+    }
+
+}
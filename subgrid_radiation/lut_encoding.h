@@ -0,0 +1,28 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef LUT_ENCODING_H
+#define LUT_ENCODING_H
+
+#include <cstddef>
+
+// Encoding of lookup table with correction factors for direct downward
+// shortwave radiation as unsigned integers. Values are in the range
+// [0.0, sw_dir_cor_max] and are encoded linearly; the largest integer value
+// is reserved for NaN (masked grid cells):
+// sw_dir_cor = value * scale + offset (value != fill_value)
+
+// Encoding types (bytes per value)
+#define LUT_ENC_UINT8 1
+#define LUT_ENC_UINT16 2
+#define LUT_ENC_FLOAT32 4  // not encoded
+
+// Scale, offset and fill value of encoding
+void lut_encoding_param(int enc, double sw_dir_cor_max, double &scale,
+    double &offset, unsigned int &fill_value);
+
+// Encode lookup table (thread-parallel)
+void lut_encode(const float* sw_dir_cor, size_t num_elem, int enc,
+    double scale, double offset, void* sw_dir_cor_enc);
+
+#endif
@@ -0,0 +1,488 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "lut_eval.h"
+#include "lut_encoding.h"
+#include "scratch_arena.h"
+#include <math.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <tbb/parallel_for.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LUT_SIMD_X86
+#endif
+
+using namespace std;
+
+static_assert(sizeof(LutFileHeader) == 88,
+    "unexpected padding in header of lookup table file");
+
+static const char lut_file_magic[8] = {'S', 'G', 'R', 'L', 'U', 'T', '\0',
+    '\0'};
+
+// Maximal size of per-task buffer with interpolated values of a tile of
+// grid cells [float]
+#define LUT_TILE_ELEM 65536
+
+//#############################################################################
+// Header
+//#############################################################################
+
+void lut_header_init(LutFileHeader &header, int num_gc_y, int num_gc_x,
+    int num_lat, int num_lon, int enc, double lat_beg, double lat_spac,
+    double lon_beg, double lon_spac, double sw_dir_cor_max) {
+    /* Parameters
+       ----------
+       header: header of lookup table file
+       num_gc_y: number of grid cells in y-direction [-]
+       num_gc_x: number of grid cells in x-direction [-]
+       num_lat: number of subsolar latitudes [-]
+       num_lon: number of subsolar longitudes [-]
+       enc: encoding (LUT_ENC_UINT8, LUT_ENC_UINT16 or LUT_ENC_FLOAT32) [-]
+       lat_beg: first subsolar latitude [degree]
+       lat_spac: spacing of subsolar latitudes [degree]
+       lon_beg: first subsolar longitude [degree]
+       lon_spac: spacing of subsolar longitudes (num_lon * lon_spac = 360.0)
+                 [degree]
+       sw_dir_cor_max: maximal correction factor (encoded values) [-]
+    */
+
+    memset(&header, 0, sizeof(LutFileHeader));
+    memcpy(header.magic, lut_file_magic, sizeof(lut_file_magic));
+    header.version = LUT_FILE_VERSION;
+    header.enc = enc;
+    header.num_gc_y = num_gc_y;
+    header.num_gc_x = num_gc_x;
+    header.num_lat = num_lat;
+    header.num_lon = num_lon;
+    header.lat_beg = lat_beg;
+    header.lat_spac = lat_spac;
+    header.lon_beg = lon_beg;
+    header.lon_spac = lon_spac;
+    if (enc == LUT_ENC_FLOAT32) {
+        header.scale = 1.0;
+        header.offset = 0.0;
+    } else {
+        unsigned int fill_value;
+        lut_encoding_param(enc, sw_dir_cor_max, header.scale, header.offset,
+            fill_value);
+    }
+
+    // Data starts at page boundary
+    size_t page_size = 4096;
+    header.offset_data = ((sizeof(LutFileHeader) + page_size - 1)
+        / page_size) * page_size;
+
+}
+
+// Size of data section (without padding) [byte]
+static size_t lut_data_size(const LutFileHeader &header) {
+
+    return (size_t)header.num_gc_y * (size_t)header.num_gc_x
+        * (size_t)header.num_lat * (size_t)header.num_lon
+        * (size_t)header.enc;
+
+}
+
+//#############################################################################
+// Write and read lookup table file
+//#############################################################################
+
+bool lut_file_save(const char* file, LutFileHeader &header,
+    const void* data) {
+
+    int fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        cerr << "Error: lookup table file " << file << " can not be created"
+            << endl;
+        return false;
+    }
+    size_t data_size = lut_data_size(header);
+    size_t file_size = header.offset_data + data_size + LUT_FILE_PAD;
+    bool success = (ftruncate(fd, file_size) == 0)
+        && (pwrite(fd, &header, sizeof(LutFileHeader), 0)
+        == sizeof(LutFileHeader));
+    // header gap and padding remain holes in the file (filled with zeros)
+
+    // Write data in chunks (single calls of 'pwrite' are limited in size)
+    size_t chunk_size = (size_t)1 << 30;
+    for (size_t pos = 0; success && (pos < data_size); pos += chunk_size) {
+        size_t size = std::min(chunk_size, data_size - pos);
+        success = (pwrite(fd, (const char*)data + pos, size,
+            header.offset_data + pos) == (ssize_t)size);
+    }
+    if (!success) {
+        cerr << "Error: writing lookup table file failed" << endl;
+    }
+    fsync(fd);
+    close(fd);
+    return success;
+
+}
+
+unsigned char* lut_file_map(const char* file, LutFileHeader &header,
+    size_t &map_size) {
+
+    int fd = open(file, O_RDONLY);
+    if (fd == -1) {
+        cerr << "Error: lookup table file " << file << " can not be opened"
+            << endl;
+        return NULL;
+    }
+
+    // Check header
+    struct stat file_stat;
+    if ((fstat(fd, &file_stat) != 0)
+        || (pread(fd, &header, sizeof(LutFileHeader), 0)
+        != sizeof(LutFileHeader))
+        || (memcmp(header.magic, lut_file_magic, sizeof(lut_file_magic))
+        != 0) || (header.version != LUT_FILE_VERSION)) {
+        cerr << "Error: " << file << " is not a valid lookup table file"
+            << endl;
+        close(fd);
+        return NULL;
+    }
+    map_size = header.offset_data + lut_data_size(header) + LUT_FILE_PAD;
+    if ((size_t)file_stat.st_size < map_size) {
+        cerr << "Error: lookup table file " << file << " is truncated"
+            << endl;
+        close(fd);
+        return NULL;
+    }
+
+    // Map file (pages are loaded on demand)
+    void* map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // mapping remains valid
+    if (map == MAP_FAILED) {
+        cerr << "Error: memory-mapping of lookup table file failed" << endl;
+        return NULL;
+    }
+    return (unsigned char*)map;
+
+}
+
+void lut_file_unmap(unsigned char* map, size_t map_size) {
+
+    munmap(map, map_size);
+
+}
+
+//#############################################################################
+// Bilinear interpolation of one grid cell for all subsolar points
+//#############################################################################
+
+// Offsets of the four surrounding nodes within the table of a grid cell
+// (first digit: latitude, second digit: longitude) and interpolation
+// weights of subsolar points (structure of arrays)
+struct LutNodes {
+    const int32_t* ind_00;
+    const int32_t* ind_01;
+    const int32_t* ind_10;
+    const int32_t* ind_11;
+    const float* w_lat;
+    const float* w_lon;
+};
+
+typedef void (*lut_interp_t)(size_t num, const unsigned char* table,
+    int enc, const LutNodes &nodes, float scale, float offset, float* out);
+
+//-----------------------------------------------------------------------------
+// Scalar (also used for remainder of SIMD loops)
+//-----------------------------------------------------------------------------
+
+template <typename T>
+static void lut_interp_type(size_t ind_beg, size_t num, const T* table,
+    const LutNodes &nodes, float scale, float offset, float* out) {
+
+    for (size_t i = ind_beg; i < num; i++) {
+        float v_00 = (float)table[nodes.ind_00[i]];
+        float v_01 = (float)table[nodes.ind_01[i]];
+        float v_10 = (float)table[nodes.ind_10[i]];
+        float v_11 = (float)table[nodes.ind_11[i]];
+        float v_0 = v_00 + nodes.w_lon[i] * (v_01 - v_00);
+        float v_1 = v_10 + nodes.w_lon[i] * (v_11 - v_10);
+        out[i] = (v_0 + nodes.w_lat[i] * (v_1 - v_0)) * scale + offset;
+    }
+
+}
+
+static void lut_interp_rem(size_t ind_beg, size_t num,
+    const unsigned char* table, int enc, const LutNodes &nodes, float scale,
+    float offset, float* out) {
+
+    if (enc == LUT_ENC_FLOAT32) {
+        lut_interp_type<float>(ind_beg, num, (const float*)table, nodes,
+            scale, offset, out);
+    } else if (enc == LUT_ENC_UINT16) {
+        lut_interp_type<uint16_t>(ind_beg, num, (const uint16_t*)table,
+            nodes, scale, offset, out);
+    } else {
+        lut_interp_type<uint8_t>(ind_beg, num, table, nodes, scale, offset,
+            out);
+    }
+
+}
+
+static void lut_interp_scalar(size_t num, const unsigned char* table,
+    int enc, const LutNodes &nodes, float scale, float offset, float* out) {
+
+    lut_interp_rem(0, num, table, enc, nodes, scale, offset, out);
+
+}
+
+#ifdef LUT_SIMD_X86
+
+// Encoded values are gathered as 32-bit words and masked (little endian;
+// the last values of the table are followed by 'LUT_FILE_PAD' bytes)
+
+//-----------------------------------------------------------------------------
+// AVX2 (8 lanes)
+//-----------------------------------------------------------------------------
+
+__attribute__((target("avx2,fma")))
+static inline __m256 lut_gather_avx2(const unsigned char* table, int enc,
+    const int32_t* ind) {
+
+    __m256i ind_v = _mm256_loadu_si256((const __m256i*)ind);
+    if (enc == LUT_ENC_FLOAT32) {
+        return _mm256_i32gather_ps((const float*)table, ind_v, 4);
+    } else if (enc == LUT_ENC_UINT16) {
+        __m256i val = _mm256_i32gather_epi32((const int*)table, ind_v, 2);
+        return _mm256_cvtepi32_ps(_mm256_and_si256(val,
+            _mm256_set1_epi32(0xFFFF)));
+    } else {
+        __m256i val = _mm256_i32gather_epi32((const int*)table, ind_v, 1);
+        return _mm256_cvtepi32_ps(_mm256_and_si256(val,
+            _mm256_set1_epi32(0xFF)));
+    }
+
+}
+
+__attribute__((target("avx2,fma")))
+static void lut_interp_avx2(size_t num, const unsigned char* table,
+    int enc, const LutNodes &nodes, float scale, float offset, float* out) {
+
+    __m256 scale_v = _mm256_set1_ps(scale);
+    __m256 offset_v = _mm256_set1_ps(offset);
+
+    size_t i = 0;
+    for (; (i + 8) <= num; i += 8) {
+        __m256 v_00 = lut_gather_avx2(table, enc, nodes.ind_00 + i);
+        __m256 v_01 = lut_gather_avx2(table, enc, nodes.ind_01 + i);
+        __m256 v_10 = lut_gather_avx2(table, enc, nodes.ind_10 + i);
+        __m256 v_11 = lut_gather_avx2(table, enc, nodes.ind_11 + i);
+        __m256 w_lon = _mm256_loadu_ps(nodes.w_lon + i);
+        __m256 w_lat = _mm256_loadu_ps(nodes.w_lat + i);
+        __m256 v_0 = _mm256_fmadd_ps(w_lon, _mm256_sub_ps(v_01, v_00), v_00);
+        __m256 v_1 = _mm256_fmadd_ps(w_lon, _mm256_sub_ps(v_11, v_10), v_10);
+        __m256 v = _mm256_fmadd_ps(w_lat, _mm256_sub_ps(v_1, v_0), v_0);
+        _mm256_storeu_ps(out + i, _mm256_fmadd_ps(v, scale_v, offset_v));
+    }
+
+    lut_interp_rem(i, num, table, enc, nodes, scale, offset, out);
+
+}
+
+//-----------------------------------------------------------------------------
+// AVX-512 (16 lanes)
+//-----------------------------------------------------------------------------
+
+__attribute__((target("avx512f")))
+static inline __m512 lut_gather_avx512(const unsigned char* table, int enc,
+    const int32_t* ind) {
+
+    __m512i ind_v = _mm512_loadu_si512((const void*)ind);
+    if (enc == LUT_ENC_FLOAT32) {
+        return _mm512_i32gather_ps(ind_v, (const float*)table, 4);
+    } else if (enc == LUT_ENC_UINT16) {
+        __m512i val = _mm512_i32gather_epi32(ind_v, (const int*)table, 2);
+        return _mm512_cvtepi32_ps(_mm512_and_si512(val,
+            _mm512_set1_epi32(0xFFFF)));
+    } else {
+        __m512i val = _mm512_i32gather_epi32(ind_v, (const int*)table, 1);
+        return _mm512_cvtepi32_ps(_mm512_and_si512(val,
+            _mm512_set1_epi32(0xFF)));
+    }
+
+}
+
+__attribute__((target("avx512f")))
+static void lut_interp_avx512(size_t num, const unsigned char* table,
+    int enc, const LutNodes &nodes, float scale, float offset, float* out) {
+
+    __m512 scale_v = _mm512_set1_ps(scale);
+    __m512 offset_v = _mm512_set1_ps(offset);
+
+    size_t i = 0;
+    for (; (i + 16) <= num; i += 16) {
+        __m512 v_00 = lut_gather_avx512(table, enc, nodes.ind_00 + i);
+        __m512 v_01 = lut_gather_avx512(table, enc, nodes.ind_01 + i);
+        __m512 v_10 = lut_gather_avx512(table, enc, nodes.ind_10 + i);
+        __m512 v_11 = lut_gather_avx512(table, enc, nodes.ind_11 + i);
+        __m512 w_lon = _mm512_loadu_ps(nodes.w_lon + i);
+        __m512 w_lat = _mm512_loadu_ps(nodes.w_lat + i);
+        __m512 v_0 = _mm512_fmadd_ps(w_lon, _mm512_sub_ps(v_01, v_00), v_00);
+        __m512 v_1 = _mm512_fmadd_ps(w_lon, _mm512_sub_ps(v_11, v_10), v_10);
+        __m512 v = _mm512_fmadd_ps(w_lat, _mm512_sub_ps(v_1, v_0), v_0);
+        _mm512_storeu_ps(out + i, _mm512_fmadd_ps(v, scale_v, offset_v));
+    }
+
+    lut_interp_rem(i, num, table, enc, nodes, scale, offset, out);
+
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+// Runtime selection of instruction set
+//-----------------------------------------------------------------------------
+
+struct LutSimdImpl {
+    lut_interp_t function;
+    const char* isa;
+};
+
+static LutSimdImpl lut_simd_select() {
+#if defined(LUT_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return {lut_interp_avx512, "avx512"};
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return {lut_interp_avx2, "avx2"};
+    }
+#endif
+    return {lut_interp_scalar, "scalar"};
+}
+
+static const LutSimdImpl lut_simd_impl = lut_simd_select();
+
+const char* lut_simd_isa() {
+
+    return lut_simd_impl.isa;
+
+}
+
+//#############################################################################
+// Evaluate lookup table
+//#############################################################################
+
+void lut_eval(const LutFileHeader &header, const unsigned char* data,
+    const double* subsol_lat, const double* subsol_lon, size_t num_sun,
+    float* sw_dir_cor, int grain_size) {
+    /* Parameters
+       ----------
+       header: header of lookup table file
+       data: data section of lookup table file
+       subsol_lat: subsolar latitudes [degree]
+       subsol_lon: subsolar longitudes [degree]
+       num_sun: number of subsolar points [-]
+       sw_dir_cor: correction factors (num_sun, num_gc_y, num_gc_x) [-]
+       grain_size: minimal number of grid cells per task [-]
+    */
+
+    size_t num_gc = (size_t)header.num_gc_y * (size_t)header.num_gc_x;
+    int num_lat = header.num_lat;
+    int num_lon = header.num_lon;
+    size_t table_size = (size_t)num_lat * (size_t)num_lon
+        * (size_t)header.enc;
+
+    // Nodes and interpolation weights of subsolar points
+    vector<int32_t> ind(4 * num_sun);
+    vector<float> weight(2 * num_sun);
+    for (size_t i = 0; i < num_sun; i++) {
+
+        // Latitude (clamped to grid)
+        int lat_0 = 0;
+        double w_lat = 0.0;
+        if (num_lat > 1) {
+            double pos = (subsol_lat[i] - header.lat_beg) / header.lat_spac;
+            pos = std::max(0.0, std::min(pos, (double)(num_lat - 1)));
+            lat_0 = std::min((int)floor(pos), num_lat - 2);
+            w_lat = pos - (double)lat_0;
+        }
+        int lat_1 = std::min(lat_0 + 1, num_lat - 1);
+
+        // Longitude (periodic)
+        double pos = fmod((subsol_lon[i] - header.lon_beg) / header.lon_spac,
+            (double)num_lon);
+        if (pos < 0.0) {
+            pos += (double)num_lon;
+        }
+        int lon_0 = (int)floor(pos);
+        double w_lon = pos - (double)lon_0;
+        if (lon_0 >= num_lon) {
+            lon_0 -= num_lon;  // rounding of negative positions
+        }
+        int lon_1 = (lon_0 + 1) % num_lon;
+
+        ind[i] = lat_0 * num_lon + lon_0;
+        ind[num_sun + i] = lat_0 * num_lon + lon_1;
+        ind[2 * num_sun + i] = lat_1 * num_lon + lon_0;
+        ind[3 * num_sun + i] = lat_1 * num_lon + lon_1;
+        weight[i] = (float)w_lat;
+        weight[num_sun + i] = (float)w_lon;
+
+    }
+    LutNodes nodes = {&ind[0], &ind[num_sun], &ind[2 * num_sun],
+        &ind[3 * num_sun], &weight[0], &weight[num_sun]};
+
+    // Fill value of masked grid cells
+    unsigned int fill_value = (header.enc == LUT_ENC_UINT16) ? 65535 : 255;
+
+    // Tiles of grid cells (interpolated values of tile are transposed to
+    // output layout -> contiguous stores)
+    size_t num_tile = std::max((size_t)1, std::min((size_t)64,
+        (size_t)LUT_TILE_ELEM / std::max(num_sun, (size_t)1)));
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_gc, grain_size),
+        [&](tbb::blocked_range<size_t> r) {
+
+    ScratchArena &arena = scratch_arena();
+    arena.begin(scratch_size<float>(num_tile * num_sun));
+    float* buffer = arena.alloc<float>(num_tile * num_sun);
+
+    for (size_t gc_beg = r.begin(); gc_beg < r.end(); gc_beg += num_tile) {
+        size_t gc_end = std::min(gc_beg + num_tile, r.end());
+
+        // Interpolate grid cells of tile
+        for (size_t gc = gc_beg; gc < gc_end; gc++) {
+            const unsigned char* table = data + gc * table_size;
+            float* out = buffer + (gc - gc_beg) * num_sun;
+            bool masked;
+            if (header.enc == LUT_ENC_FLOAT32) {
+                masked = isnan(((const float*)table)[0]);
+            } else if (header.enc == LUT_ENC_UINT16) {
+                masked = (((const uint16_t*)table)[0] == fill_value);
+            } else {
+                masked = (table[0] == fill_value);
+            }
+            if (masked) {
+                std::fill(out, out + num_sun, NAN);
+            } else {
+                lut_simd_impl.function(num_sun, table, header.enc, nodes,
+                    (float)header.scale, (float)header.offset, out);
+            }
+        }
+
+        // Store tile in output array
+        for (size_t i = 0; i < num_sun; i++) {
+            float* out = sw_dir_cor + i * num_gc;
+            for (size_t gc = gc_beg; gc < gc_end; gc++) {
+                out[gc] = buffer[(gc - gc_beg) * num_sun + i];
+            }
+        }
+
+    }
+
+    });
+
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef LUT_EVAL_H
+#define LUT_EVAL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Evaluation of the subsolar lookup table of correction factors for direct
+// downward shortwave radiation (see 'compute_sw_dir_cor.py') for arbitrary
+// subsolar points, i.e. the online counterpart of the ray tracing kernels.
+// Correction factors are bilinearly interpolated between the nodes of the
+// regular subsolar latitude/longitude grid (latitude: clamped to grid;
+// longitude: periodic). Interpolation weights and node offsets are computed
+// once per subsolar point; per grid cell, all subsolar points are then
+// interpolated with explicit SIMD gathers (AVX-512 or AVX2 on x86-64,
+// selected at runtime according to CPU support; scalar otherwise).
+//
+// Layout of lookup table file (all values in native byte order):
+// - header (struct LutFileHeader)
+// - data (starts at page boundary): table (num_gc_y, num_gc_x, num_lat,
+//   num_lon) with values according to 'enc' (see 'lut_encoding.h'),
+//   followed by LUT_FILE_PAD bytes (SIMD gathers of 32-bit words)
+// Correction factor = value * scale + offset (encoded; fill value -> NaN)
+
+#define LUT_FILE_VERSION 1
+
+// Padding at end of data section [byte]
+#define LUT_FILE_PAD 64
+
+struct LutFileHeader {
+    char magic[8];
+    int32_t version;
+    int32_t enc;
+    int32_t num_gc_y, num_gc_x;
+    int32_t num_lat, num_lon;
+    double lat_beg, lat_spac;
+    double lon_beg, lon_spac;
+    double scale, offset;
+    uint64_t offset_data;
+};
+
+// Initialise header (encoding parameters and section offset)
+void lut_header_init(LutFileHeader &header, int num_gc_y, int num_gc_x,
+    int num_lat, int num_lon, int enc, double lat_beg, double lat_spac,
+    double lon_beg, double lon_spac, double sw_dir_cor_max);
+
+// Write lookup table file (returns false on error)
+bool lut_file_save(const char* file, LutFileHeader &header,
+    const void* data);
+
+// Memory-map file read-only (returns base address; NULL: error)
+unsigned char* lut_file_map(const char* file, LutFileHeader &header,
+    size_t &map_size);
+
+// Unmap file
+void lut_file_unmap(unsigned char* map, size_t map_size);
+
+// Interpolate correction factors for subsolar points (output:
+// (num_sun, num_gc_y, num_gc_x); masked grid cells: NaN)
+void lut_eval(const LutFileHeader &header, const unsigned char* data,
+    const double* subsol_lat, const double* subsol_lon, size_t num_sun,
+    float* sw_dir_cor, int grain_size);
+
+// Instruction set used by 'lut_eval' (avx512, avx2, scalar)
+const char* lut_simd_isa();
+
+#endif
@@ -0,0 +1,82 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "refraction.h"
+#include "geometry_core.h"
+
+// Parameters for reference atmosphere
+static const double temperature_ref = 283.15;
+// reference temperature at sea level [K]
+static const double pressure_ref = 101.0;
+// reference pressure at sea level [kPa]
+static const double lapse_rate = 0.0065;  // temperature lapse rate [K m-1]
+static const double g = 9.81;
+// acceleration due to gravity at sea level [m s-2]
+static const double R_d = 287.0;  // gas constant for dry air [J K-1 kg-1]
+
+//#############################################################################
+// Exact computation
+//#############################################################################
+
+double refrac_angle(double elev_ang_true, double elevation) {
+    /* Parameters
+       ----------
+       elev_ang_true: true solar elevation angle [degree]
+       elevation: elevation of triangle [m]
+
+       Returns
+       ----------
+       refrac_cor: refraction correction [degree]
+
+       Reference
+       ----------
+       - Saemundsson, P. (1986). "Astronomical Refraction". Sky and Telescope.
+         72: 70
+       - Meeus, J. (1998): Astronomical Algorithm - Second edition, p. 106*/
+
+    // Temperature and pressure at elevation of triangle
+    double temperature = temperature_ref - (lapse_rate * elevation);
+    double pressure = pressure_ref * pow((temperature / temperature_ref),
+        (g / (R_d * lapse_rate)));
+
+    double lower = -1.0;
+    double upper = 90.0;
+    elev_ang_true = std::max(lower, std::min(elev_ang_true, upper));
+    double refrac_cor = (1.02 / tan(deg2rad(elev_ang_true + 10.3
+        / (elev_ang_true + 5.11))));
+    refrac_cor += 0.0019279;  // set R = 0.0 for h = 90.0 degree
+    refrac_cor *= (pressure / 101.0)
+        * (283.0 / (273.0 + (temperature - 273.15)));
+    return refrac_cor * (1.0 / 60.0);
+
+}
+
+//#############################################################################
+// Lookup table
+//#############################################################################
+
+void refrac_table_build(RefracTable &table) {
+
+    table.sin_min = sin(deg2rad(-1.0));
+    double sin_spac = (1.0 - table.sin_min) / (double)(REFRAC_NUM_SIN - 1);
+    double elev_spac = REFRAC_ELEV_MAX / (double)(REFRAC_NUM_ELEV - 1);
+    table.sin_spac_inv = 1.0 / sin_spac;
+    table.elev_spac_inv = 1.0 / elev_spac;
+    table.data = new double[REFRAC_NUM_ELEV * REFRAC_NUM_SIN];
+    for (size_t i = 0; i < REFRAC_NUM_ELEV; i++) {
+        for (size_t j = 0; j < REFRAC_NUM_SIN; j++) {
+            double elev_sin = std::min(table.sin_min + sin_spac * (double)j,
+                1.0);
+            table.data[i * REFRAC_NUM_SIN + j] = deg2rad(refrac_angle(
+                rad2deg(asin(elev_sin)), elev_spac * (double)i));
+        }
+    }
+
+}
+
+void refrac_table_free(RefracTable &table) {
+
+    delete[] table.data;
+    table.data = NULL;
+
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef REFRACTION_H
+#define REFRACTION_H
+
+#include <cstddef>
+#include <math.h>
+#include <algorithm>
+
+// Atmospheric refraction of the sun position (Saemundsson's formula with
+// temperature and pressure at the elevation of the triangle from a
+// reference atmosphere with constant lapse rate). The refraction correction
+// only depends on the true elevation angle of the sun and the elevation of
+// the triangle: kernels therefore interpolate it bilinearly from a lookup
+// table (sine of true elevation angle x elevation; built once per run) and
+// rotate the sun vector with a small-angle approximation instead of
+// Rodrigues' rotation formula. The exact computation is kept as reference.
+
+// Refraction correction of kernels (argument 'refrac_cor'): none, lookup
+// table (default) or exact computation (reference)
+#define REFRAC_NONE 0
+#define REFRAC_TABLE 1
+#define REFRAC_EXACT 2
+
+// Number of nodes along sine of true elevation angle ([sin(-1 deg), 1])
+#define REFRAC_NUM_SIN 1024
+
+// Number of nodes along elevation ([0, REFRAC_ELEV_MAX]; clamped outside)
+#define REFRAC_NUM_ELEV 101
+
+// Maximal elevation of lookup table [m]
+#define REFRAC_ELEV_MAX 10000.0
+
+// Refraction correction (exact) [degree]
+double refrac_angle(double elev_ang_true, double elevation);
+
+struct RefracTable {
+    double sin_min;  // sine of lower limit of true elevation angle [-]
+    double sin_spac_inv;  // inverse node spacing of sine [-]
+    double elev_spac_inv;  // inverse node spacing of elevation [m-1]
+    double* data;  // refraction correction (REFRAC_NUM_ELEV, REFRAC_NUM_SIN)
+                   // [radian]; NULL if not built
+};
+
+// Build lookup table (allocates 'data')
+void refrac_table_build(RefracTable &table);
+
+// Release lookup table
+void refrac_table_free(RefracTable &table);
+
+// Refraction correction (bilinear interpolation from lookup table) [radian]
+inline double refrac_table_interp(const RefracTable &table, double elev_sin,
+    double elevation) {
+    /* Parameters
+       ----------
+       table: lookup table
+       elev_sin: sine of true elevation angle [-]
+       elevation: elevation of triangle [m]
+
+       Returns
+       ----------
+       refrac_cor: refraction correction [radian]
+    */
+    double x = std::max((elev_sin - table.sin_min) * table.sin_spac_inv,
+        0.0);
+    double y = std::max(elevation * table.elev_spac_inv, 0.0);
+    size_t ind_x = std::min((size_t)x, (size_t)(REFRAC_NUM_SIN - 2));
+    size_t ind_y = std::min((size_t)y, (size_t)(REFRAC_NUM_ELEV - 2));
+    double w_x = std::min(x - (double)ind_x, 1.0);
+    double w_y = std::min(y - (double)ind_y, 1.0);
+    const double* row_0 = table.data + ind_y * REFRAC_NUM_SIN + ind_x;
+    const double* row_1 = row_0 + REFRAC_NUM_SIN;
+    return (row_0[0] + (row_0[1] - row_0[0]) * w_x) * (1.0 - w_y)
+        + (row_1[0] + (row_1[1] - row_1[0]) * w_x) * w_y;
+}
+
+// Correct sun vector for atmospheric refraction (lookup table and
+// small-angle rotation towards horizontal surface normal)
+inline void sun_vec_refrac_table(const RefracTable &table, double elevation,
+    double norm_hori_x, double norm_hori_y, double norm_hori_z,
+    double &sun_x, double &sun_y, double &sun_z, double &dot_prod_hs) {
+    /* Parameters
+       ----------
+       table: lookup table
+       elevation: elevation of triangle [m]
+       norm_hori_x, norm_hori_y, norm_hori_z: horizontal surface normal [-]
+       sun_x, sun_y, sun_z: sun unit vector (updated) [-]
+       dot_prod_hs: dot product between horizontal surface normal and sun
+                    unit vector (updated) [-]
+
+       Notes
+       ----------
+       Rotating the sun vector s by the angle theta within the plane spanned
+       by s and the horizontal surface normal n yields
+       s * cos(theta) + (n - sin(e) * s) / cos(e) * sin(theta), with e being
+       the true elevation angle (sin(e) = dot_prod_hs). The refraction
+       correction is below 0.011 rad, so sin/cos of theta are evaluated with
+       their Taylor series (relative error < 1e-10).*/
+
+    double cos_elev = sqrt(std::max(1.0 - dot_prod_hs * dot_prod_hs, 0.0));
+    if (cos_elev < 1.0e-9) {
+        return;  // sun in zenith -> no refraction
+    }
+    double theta = refrac_table_interp(table, dot_prod_hs, elevation);
+    double theta_sq = theta * theta;
+    double sin_theta = theta * (1.0 - theta_sq / 6.0);
+    double cos_theta = 1.0 - theta_sq / 2.0;
+    double fac_n = sin_theta / cos_elev;
+    double fac_s = cos_theta - fac_n * dot_prod_hs;
+    sun_x = sun_x * fac_s + norm_hori_x * fac_n;
+    sun_y = sun_y * fac_s + norm_hori_y * fac_n;
+    sun_z = sun_z * fac_s + norm_hori_z * fac_n;
+    dot_prod_hs = dot_prod_hs * cos_theta + cos_elev * sin_theta;
+
+}
+
+#endif
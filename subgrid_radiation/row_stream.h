@@ -0,0 +1,85 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef ROW_STREAM_H
+#define ROW_STREAM_H
+
+#include <cstddef>
+#include <algorithm>
+#include <tbb/task_group.h>
+
+// Callback receiving finished block of lookup table (rows [row_beg,
+// row_beg + num_rows) of grid cells; buffer is only valid during call)
+typedef void (*row_callback_t)(int row_beg, int num_rows, float* sw_dir_cor,
+    void* user_data);
+
+// Compute lookup table in blocks of grid cell rows and pass finished blocks
+// to callback function. The next block is computed while the callback
+// processes the current one (double buffering) -> memory is bounded to two
+// blocks.
+template <typename F>
+size_t stream_rows(F compute_rows, size_t num_gc_y, size_t row_size,
+    size_t block_rows, row_callback_t row_callback, void* user_data) {
+    /* Parameters
+       ----------
+       compute_rows: function computing rows [row_beg, row_end) of lookup
+                     table into buffer (returns number of rays)
+       num_gc_y: number of grid cells in y-direction [-]
+       row_size: number of elements per grid cell row [-]
+       block_rows: number of grid cell rows per block [-]
+       row_callback: function receiving finished blocks
+       user_data: pointer passed to callback function
+
+       Returns
+       ----------
+       num_rays: number of rays
+    */
+
+    block_rows = std::max(std::min(block_rows, num_gc_y), (size_t)1);
+    float* buffer[2];
+    buffer[0] = new float[block_rows * row_size];
+    buffer[1] = new float[block_rows * row_size];
+    tbb::task_group tg;
+
+    size_t row_beg = 0;
+    size_t num_rows = std::min(block_rows, num_gc_y);
+    std::fill(buffer[0], buffer[0] + num_rows * row_size, 0.0);
+    size_t num_rays = compute_rows(0, num_rows, buffer[0]);
+    size_t ind_buf = 0;
+    while (row_beg < num_gc_y) {
+
+        // Compute next block (asynchronously)
+        size_t row_beg_next = row_beg + num_rows;
+        size_t num_rows_next = std::min(block_rows,
+            num_gc_y - row_beg_next);
+        size_t num_rays_next = 0;
+        float* buffer_next = buffer[1 - ind_buf];
+        if (num_rows_next > 0) {
+            tg.run([&] {
+                std::fill(buffer_next, buffer_next + num_rows_next
+                    * row_size, 0.0);
+                num_rays_next = compute_rows(row_beg_next,
+                    row_beg_next + num_rows_next, buffer_next);
+            });
+        }
+
+        // Pass current block to callback
+        row_callback((int)row_beg, (int)num_rows, buffer[ind_buf],
+            user_data);
+        tg.wait();
+
+        num_rays += num_rays_next;
+        row_beg = row_beg_next;
+        num_rows = num_rows_next;
+        ind_buf = 1 - ind_buf;
+
+    }
+
+    delete[] buffer[0];
+    delete[] buffer[1];
+
+    return num_rays;
+
+}
+
+#endif
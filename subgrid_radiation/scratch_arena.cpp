@@ -0,0 +1,40 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "scratch_arena.h"
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/cache_aligned_allocator.h>
+
+// Arenas of all threads (created on first use by a thread)
+static tbb::enumerable_thread_specific<ScratchArena> scratch_arenas;
+
+ScratchArena::ScratchArena() : buffer(NULL), cap(0), offset(0) {}
+
+ScratchArena::~ScratchArena() {
+    if (buffer != NULL) {
+        tbb::cache_aligned_allocator<char>().deallocate(buffer, cap);
+    }
+}
+
+void ScratchArena::begin(size_t size) {
+    offset = 0;
+    if (size > cap) {
+        if (buffer != NULL) {
+            tbb::cache_aligned_allocator<char>().deallocate(buffer, cap);
+        }
+        buffer = tbb::cache_aligned_allocator<char>().allocate(size);
+        cap = size;
+    }
+}
+
+ScratchArena& scratch_arena() {
+    return scratch_arenas.local();
+}
+
+size_t scratch_memory() {
+    size_t size = 0;
+    for (const ScratchArena &arena : scratch_arenas) {
+        size += arena.capacity();
+    }
+    return size;
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <cstddef>
+#include <new>
+
+// Per-thread scratch memory of kernels: instead of allocating buffers (e.g.
+// horizon, correction factors of rays, ray packets) per grid cell on the
+// heap or as variable-length arrays on the stack, every thread owns one
+// cache-line aligned arena. At the start of a parallel task, the arena is
+// reset and reserved with the size required by the kernel run (it only
+// grows -> one allocation per thread and run at most); all buffers of the
+// task are then carved from it. Arenas are not reentrant: only one kernel
+// run may use them at a time and parallel tasks must not nest.
+
+// Alignment of buffers (cache line) [byte]
+#define SCRATCH_ALIGN 64
+
+class ScratchArena {
+public:
+    ScratchArena();
+    ~ScratchArena();
+    // Reset arena and ensure capacity of 'size' bytes (invalidates all
+    // previously carved buffers)
+    void begin(size_t size);
+    // Carve cache-line aligned buffer of 'num' elements (uninitialised)
+    template <typename T>
+    T* alloc(size_t num);
+    // Capacity of arena [byte]
+    size_t capacity() const {
+        return cap;
+    }
+private:
+    char* buffer;
+    size_t cap;
+    size_t offset;
+};
+
+// Size of a buffer with 'num' elements of type 'T' in an arena (sum over
+// all buffers of a task -> argument of 'ScratchArena::begin') [byte]
+template <typename T>
+inline size_t scratch_size(size_t num) {
+    return ((num * sizeof(T) + SCRATCH_ALIGN - 1) / SCRATCH_ALIGN)
+        * SCRATCH_ALIGN;
+}
+
+template <typename T>
+T* ScratchArena::alloc(size_t num) {
+    size_t size = scratch_size<T>(num);
+    if ((offset + size) > cap) {
+        throw std::bad_alloc();  // size passed to 'begin' too small
+    }
+    T* ptr = reinterpret_cast<T*>(buffer + offset);
+    offset += size;
+    return ptr;
+}
+
+// Arena of calling thread
+ScratchArena& scratch_arena();
+
+// Total capacity of arenas of all threads [byte]
+size_t scratch_memory();
+
+#endif
@@ -5,15 +5,42 @@ cimport numpy as np
 import numpy as np
 import os
 
+include "kernel_stats.pxi"
+
+# Quantisation of horizon (bytes per value; see 'horizon_file.h')
+hori_quant_types = {"uint8": 1, "int16": 2}
+
+# Refraction correction modes (see 'refraction.h')
+refrac_modes = {"none": 0, "table": 1, "exact": 2}
+
+
+def _refrac_mode(refrac_cor):
+    """Convert argument 'refrac_cor' to refraction mode of kernels (bool or
+    int as before: 0 -> none, non-zero -> exact)."""
+    if isinstance(refrac_cor, str):
+        if refrac_cor not in refrac_modes:
+            raise ValueError("invalid input argument for refrac_cor")
+        return refrac_modes[refrac_cor]
+    return refrac_modes["exact"] if refrac_cor else refrac_modes["none"]
+
 cdef extern from "sun_position_comp.h" namespace "shapes":
     cdef cppclass CppTerrain:
+        int hori_cache_cl
         CppTerrain()
-        void initialise(float*, int, int, float*, int, int,
+        void initialise(float*, int, int, float*, int, int, double,
                         int, int, unsigned char*,
-                        double, char*, double, double)
-        void sw_dir_cor(double*, float*, int)
-        void sw_dir_cor_coherent(double*, float*)
-        void sw_dir_cor_coherent_rp8(double*, float*)
+                        double, char*, double, double, int,
+                        char*, int, int)
+        void build_horizon_cache(int, double, char*, double, int)
+        bint save_horizon_cache(char*)
+        bint load_horizon_cache(char*)
+        size_t sw_dir_cor(double*, float*, int)
+        void sw_dir_cor_batch(double*, int, float*, int)
+        void sw_dir_cor_horizon(double*, float*, int)
+        size_t sw_dir_cor_incremental(double*, float*, int, int)
+        void reset_incremental()
+        void sw_dir_cor_coherent(double*, float*, int)
+        void sw_dir_cor_coherent_rp8(double*, float*, int)
 
 cdef class Terrain:
 
@@ -36,7 +63,12 @@ cdef class Terrain:
                    double dist_search=100.0,
                    str geom_type="grid",
                    double sw_dir_cor_max=25.0,
-                   double ang_max=89.9):
+                   double ang_max=89.9,
+                   bint geom_cache=True,
+                   str build_quality="medium",
+                   bint compact=False,
+                   bint robust=True,
+                   double radius_earth=6371229.0):
         """Initialise Terrain class with Digital Elevation Model (DEM) data.
 
         Parameters
@@ -48,9 +80,12 @@ cdef class Terrain:
             Dimension length of DEM in y-direction
         dem_dim_1 : int
             Dimension length of DEM in x-direction
-        vert_grid_in : ndarray of float
+        vert_grid_in : ndarray of float or None
             Array (one-dimensional) with vertices of inner DEM with 0.0 m
-            elevation in ENU coordinates [metre]
+            elevation in ENU coordinates [metre]. If None, the horizontal
+            triangles are computed analytically (radial projection of DEM
+            triangles onto sphere with radius 'radius_earth'; ENU origin on
+            surface of sphere)
         dem_dim_in_0 : int
             Dimension length of inner DEM in y-direction
         dem_dim_in_1 : int
@@ -66,14 +101,30 @@ cdef class Terrain:
         dist_search : double
             Search distance for topographic shadowing [kilometre]
         geom_type : str
-            Embree geometry type (triangle, quad, grid)
+            Embree geometry type (triangle, quad, grid) or heightfield
         sw_dir_cor_max : double
             Maximal allowed correction factor for direct downward shortwave
             radiation [-]
         ang_max : double
             Maximal angle between sun vector and horizontal surface normal for
             which correction is computed. For larger angles, 'sw_dir_cor' is
-            set to 0.0 [degree]"""
+            set to 0.0 [degree]
+        geom_cache : bool
+            Precompute and store sun position-independent triangle geometry
+            (ray origin, surface normals, surface enlargement factor and
+            elevation) in double precision to speed up repeated calls
+            (results are identical to computation on the fly). Requires 88
+            bytes per triangle; disable if memory is limited.
+        build_quality : str
+            Embree BVH build quality (low, medium, high). Higher quality
+            increases build time but can speed up ray tracing
+        compact : bool
+            Use compact BVH layout (less memory, slightly slower ray tracing)
+        robust : bool
+            Use robust ray-triangle intersection mode (avoids missed
+            intersections at shared edges, slightly slower)
+        radius_earth : double
+            Radius of Earth (only used if 'vert_grid_in' is None) [metre]"""
 
         # Check consistency and validity of input arguments
         if ((dem_dim_0 != (2 * offset_gc * pixel_per_gc) + dem_dim_in_0)
@@ -84,7 +135,10 @@ cdef class Terrain:
                              + "and 'pixel_per_gc'")
         if len(vert_grid) < (dem_dim_0 * dem_dim_1 * 3):
             raise ValueError("array 'vert_grid' has insufficient length")
-        if len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
+        if vert_grid_in is None:
+            if radius_earth <= 0.0:
+                raise ValueError("'radius_earth' must be positive")
+        elif len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
             raise ValueError("array 'vert_grid_in' has insufficient length")
         if pixel_per_gc < 1:
             raise ValueError("value for 'pixel_per_gc' must be larger than 1")
@@ -100,8 +154,10 @@ cdef class Terrain:
             raise TypeError("data type of mask must be 'uint8'")
         if dist_search < 0.1:
             raise ValueError("'dist_search' must be at least 100.0 m")
-        if geom_type not in ("triangle", "quad", "grid"):
+        if geom_type not in ("triangle", "quad", "grid", "heightfield"):
             raise ValueError("invalid input argument for geom_type")
+        if build_quality not in ("low", "medium", "high"):
+            raise ValueError("invalid input argument for build_quality")
         if (sw_dir_cor_max < 2.0) or (sw_dir_cor_max > 100.0):
             raise ValueError(
                 "'sw_dir_cor_max' must be in the range [2.0, 100.0]")
@@ -113,23 +169,116 @@ cdef class Terrain:
             raise ValueError("maximal allowed input length for dem_dim_0 and "
                              "dem_dim_1 is 32'767")
 
+        cdef float* vert_grid_in_ptr = NULL
+        if vert_grid_in is not None:
+            vert_grid_in_ptr = &vert_grid_in[0]
+
         self.thisptr.initialise(&vert_grid[0],
                                 dem_dim_0, dem_dim_1,
-                                &vert_grid_in[0],
+                                vert_grid_in_ptr,
                                 dem_dim_in_0, dem_dim_in_1,
+                                radius_earth,
                                 pixel_per_gc,
                                 offset_gc,
                                 &mask[0, 0],
                                 dist_search,
                                 geom_type.encode("utf-8"),
                                 sw_dir_cor_max,
-                                ang_max)
+                                ang_max,
+                                int(geom_cache),
+                                build_quality.encode("utf-8"),
+                                int(compact),
+                                int(robust))
+
+# -----------------------------------------------------------------------------
+
+    def build_horizon_cache(self, int hori_azim_num=90, double hori_acc=1.0,
+                            str ray_algorithm="guess_constant",
+                            double elev_ang_low_lim=-15.0,
+                            str hori_quant="int16"):
+        """Compute and store the horizon of all triangles. Subsequent calls
+        of 'sw_dir_cor_horizon' derive terrain shadowing from this horizon
+        without ray tracing.
+
+        Parameters
+        ----------
+        hori_azim_num : int
+            Number of azimuth sectors for horizon computation
+        hori_acc : double
+            Accuracy of horizon computation [degree]
+        ray_algorithm : str
+            Algorithm for horizon detection (discrete_sampling, binary_search,
+            binary_search_packet4, binary_search_packet,
+            binary_search_packet16, guess_constant). The packet variants
+            trace 4/8/16 azimuth directions simultaneously (same result as
+            'binary_search')
+        elev_ang_low_lim : double
+            Lower limit for elevation angle search [degree]
+        hori_quant : str
+            Quantisation of sine of horizon (uint8, int16)
+
+        Notes
+        -----
+        With 'int16', the resolution of the horizon is ~0.002 degree close to
+        the horizontal; with 'uint8', it is ~0.3 degree (for
+        'elev_ang_low_lim' = -15.0 degree). The cache requires
+        (hori_azim_num + 2) * (1 or 2) bytes per triangle."""
+
+        # Check consistency and validity of input arguments
+        if hori_azim_num < 1:
+            raise ValueError("value for 'hori_azim_num' must be at least 1")
+        if hori_acc > 10.0:
+            raise ValueError("limit (10 degree) of 'hori_acc' exceeded")
+        if ray_algorithm not in ray_algorithms:
+            raise ValueError("invalid input argument for ray_algorithm")
+        if hori_quant not in hori_quant_types:
+            raise ValueError("invalid input argument for hori_quant")
+
+        self.thisptr.build_horizon_cache(hori_azim_num, hori_acc,
+                                         ray_algorithm.encode("utf-8"),
+                                         elev_ang_low_lim,
+                                         hori_quant_types[hori_quant])
+
+# -----------------------------------------------------------------------------
+
+    def save_horizon_cache(self, str hori_file):
+        """Write horizon cache to file (format of horizon file written by
+        'horizon.sky_view_factor').
+
+        Parameters
+        ----------
+        hori_file : str
+            Path of horizon file"""
+
+        if self.thisptr.hori_cache_cl != 1:
+            raise ValueError("horizon cache is not built (call "
+                             + "'build_horizon_cache' first)")
+        if not self.thisptr.save_horizon_cache(hori_file.encode("utf-8")):
+            raise IOError("writing horizon file '" + hori_file + "' failed")
+
+# -----------------------------------------------------------------------------
+
+    def load_horizon_cache(self, str hori_file):
+        """Memory-map horizon file as horizon cache (no copy; pages are read
+        on demand). The file must have been computed for the same terrain
+        (e.g. with 'horizon.sky_view_factor' or 'save_horizon_cache').
+
+        Parameters
+        ----------
+        hori_file : str
+            Path of horizon file"""
+
+        if not os.path.isfile(hori_file):
+            raise ValueError("file '" + hori_file + "' does not exist")
+        if not self.thisptr.load_horizon_cache(hori_file.encode("utf-8")):
+            raise ValueError("'" + hori_file + "' is not a valid horizon "
+                             + "file for this terrain")
 
 # -----------------------------------------------------------------------------
 
     def sw_dir_cor(self, np.ndarray[np.float64_t, ndim = 1] sun_pos,
                    np.ndarray[np.float32_t, ndim = 2] sw_dir_cor,
-                   bint refrac_cor=False):
+                   refrac_cor=False):
         """Compute subgrid-scale correction factors for direct downward
         shortwave radiation for a specific sun position.
 
@@ -141,8 +290,16 @@ cdef class Terrain:
         sw_dir_cor : ndarray of float
             Array (two-dimensional) with shortwave correction factor (y, x)
             [-]
-        refrac_cor: bool
-            Account for atmospheric refraction
+        refrac_cor: bool, int or str
+            Account for atmospheric refraction. True (non-zero) or "exact"
+            evaluates the refraction formula and rotation per triangle,
+            "table" uses a precomputed lookup table (faster; approximate).
+            False (0) or "none": no correction
+
+        Returns
+        -------
+        num_rays : int
+            Number of rays traced
 
         References
         ----------
@@ -160,13 +317,166 @@ cdef class Terrain:
         # -> ensure that all elements of array 'sw_dir_cor' are 0.0 (crucial
         # because subgrid correction values are iteratively added)
 
-        self.thisptr.sw_dir_cor(&sun_pos[0], &sw_dir_cor[0,0], int(refrac_cor))
+        return self.thisptr.sw_dir_cor(&sun_pos[0], &sw_dir_cor[0,0],
+                                       _refrac_mode(refrac_cor))
+
+# -----------------------------------------------------------------------------
+
+    def sw_dir_cor_batch(self, np.ndarray[np.float64_t, ndim = 2] sun_pos,
+                         np.ndarray[np.float32_t, ndim = 3] sw_dir_cor,
+                         refrac_cor=False):
+        """Compute subgrid-scale correction factors for direct downward
+        shortwave radiation for a batch of sun positions (e.g. all time steps
+        of a day) in a single parallel sweep.
+
+        Parameters
+        ----------
+        sun_pos : ndarray of double
+            Array (two-dimensional) with sun positions in ENU coordinates
+            (num_sun, 3) [metre]
+        sw_dir_cor : ndarray of float
+            Array (three-dimensional) with shortwave correction factor
+            (num_sun, y, x) [-]
+        refrac_cor: bool, int or str
+            Account for atmospheric refraction. True (non-zero) or "exact"
+            evaluates the refraction formula and rotation per triangle,
+            "table" uses a precomputed lookup table (faster; approximate).
+            False (0) or "none": no correction
+
+        References
+        ----------
+        - Mueller, M. D., & Scherer, D. (2005): A Grid- and Subgrid-Scale
+        Radiation Parameterization of Topographic Effects for Mesoscale
+        Weather Forecast Models, Monthly Weather Review, 133(6), 1431-1442."""
+
+        # Check consistency and validity of input arguments
+        if sun_pos.shape[1] != 3:
+            raise ValueError("array 'sun_pos' has incorrect shape")
+        if sw_dir_cor.shape[0] != sun_pos.shape[0]:
+            raise ValueError("first dimension of 'sw_dir_cor' is inconsistent "
+                             + "with number of sun positions")
+        if not sw_dir_cor.flags["C_CONTIGUOUS"]:
+            raise ValueError("array 'sw_dir_cor' is not C-contiguous")
+
+        # Ensure that passed array is contiguous in memory
+        sun_pos = np.ascontiguousarray(sun_pos)
+
+        self.thisptr.sw_dir_cor_batch(&sun_pos[0, 0], sun_pos.shape[0],
+                                      &sw_dir_cor[0, 0, 0],
+                                      _refrac_mode(refrac_cor))
+
+# -----------------------------------------------------------------------------
+
+    def sw_dir_cor_horizon(self, np.ndarray[np.float64_t, ndim = 1] sun_pos,
+                           np.ndarray[np.float32_t, ndim = 2] sw_dir_cor,
+                           refrac_cor=False):
+        """Compute subgrid-scale correction factors for direct downward
+        shortwave radiation for a specific sun position from the horizon
+        cache (no ray tracing; requires 'build_horizon_cache').
+
+        Parameters
+        ----------
+        sun_pos : ndarray of double
+            Array (one-dimensional) with sun position in ENU coordinates
+            (x, y, z) [metre]
+        sw_dir_cor : ndarray of float
+            Array (two-dimensional) with shortwave correction factor (y, x)
+            [-]
+        refrac_cor: bool, int or str
+            Account for atmospheric refraction. True (non-zero) or "exact"
+            evaluates the refraction formula and rotation per triangle,
+            "table" uses a precomputed lookup table (faster; approximate).
+            False (0) or "none": no correction
+
+        References
+        ----------
+        - Mueller, M. D., & Scherer, D. (2005): A Grid- and Subgrid-Scale
+        Radiation Parameterization of Topographic Effects for Mesoscale
+        Weather Forecast Models, Monthly Weather Review, 133(6), 1431-1442."""
+
+        # Check consistency and validity of input arguments
+        if self.thisptr.hori_cache_cl != 1:
+            raise ValueError("horizon cache is not built (call "
+                             + "'build_horizon_cache' first)")
+        if (sun_pos.ndim != 1) or (sun_pos.size != 3):
+            raise ValueError("array 'sun_pos' has incorrect shape")
+        if not sw_dir_cor.flags["C_CONTIGUOUS"]:
+            raise ValueError("array 'sw_dir_cor' is not C-contiguous")
+
+        sw_dir_cor.fill(0.0)
+
+        self.thisptr.sw_dir_cor_horizon(&sun_pos[0], &sw_dir_cor[0,0],
+                                        _refrac_mode(refrac_cor))
+
+# -----------------------------------------------------------------------------
+
+    def sw_dir_cor_incremental(
+            self, np.ndarray[np.float64_t, ndim = 1] sun_pos,
+            np.ndarray[np.float32_t, ndim = 2] sw_dir_cor,
+            refrac_cor=False, int hori_azim_num=90):
+        """Compute subgrid-scale correction factors for direct downward
+        shortwave radiation for a specific sun position with ray tracing of
+        not provably lit triangles only (for repeated calls, e.g. short time
+        steps).
+
+        On the first call, an upper bound of the horizon is computed for
+        every triangle and 'hori_azim_num' azimuth sectors from a quadtree of
+        the DEM (bounding boxes of distant terrain, exact triangles of
+        nearby terrain; no rays). This bound is kept for subsequent calls.
+        Triangles with the sun above the bound of its azimuth sector are lit
+        without ray tracing; all other triangles (shadowed or close to the
+        shadow terminator) are ray traced. The result is identical to
+        'sw_dir_cor'.
+
+        Parameters
+        ----------
+        sun_pos : ndarray of double
+            Array (one-dimensional) with sun position in ENU coordinates
+            (x, y, z) [metre]
+        sw_dir_cor : ndarray of float
+            Array (two-dimensional) with shortwave correction factor (y, x)
+            [-]
+        refrac_cor: bool, int or str
+            Account for atmospheric refraction. True (non-zero) or "exact"
+            evaluates the refraction formula and rotation per triangle,
+            "table" uses a precomputed lookup table (faster; approximate).
+            False (0) or "none": no correction
+        hori_azim_num : int
+            Number of azimuth sectors of horizon bounds (bounds are
+            recomputed if changed). The bounds require hori_azim_num * 4
+            bytes per triangle.
+
+        Returns
+        -------
+        num_rays : int
+            Number of rays traced"""
+
+        # Check consistency and validity of input arguments
+        if (sun_pos.ndim != 1) or (sun_pos.size != 3):
+            raise ValueError("array 'sun_pos' has incorrect shape")
+        if not sw_dir_cor.flags["C_CONTIGUOUS"]:
+            raise ValueError("array 'sw_dir_cor' is not C-contiguous")
+        if hori_azim_num < 4:
+            raise ValueError("value for 'hori_azim_num' must be at least 4")
+
+        sw_dir_cor.fill(0.0)
+
+        return self.thisptr.sw_dir_cor_incremental(
+            &sun_pos[0], &sw_dir_cor[0,0], _refrac_mode(refrac_cor),
+            hori_azim_num)
+
+    def reset_incremental(self):
+        """Discard horizon bounds of 'sw_dir_cor_incremental' (recomputed by
+        next call)."""
+
+        self.thisptr.reset_incremental()
 
 # -----------------------------------------------------------------------------
 
     def sw_dir_cor_coherent(
             self, np.ndarray[np.float64_t, ndim = 1] sun_pos,
-            np.ndarray[np.float32_t, ndim = 2] sw_dir_cor):
+            np.ndarray[np.float32_t, ndim = 2] sw_dir_cor,
+            refrac_cor=False):
         """Compute subgrid-scale correction factors for direct downward
         shortwave radiation for a specific sun position (use coherent rays).
 
@@ -178,6 +488,11 @@ cdef class Terrain:
         sw_dir_cor : ndarray of float
             Array (two-dimensional) with shortwave correction factor (y, x)
             [-]
+        refrac_cor: bool, int or str
+            Account for atmospheric refraction. True (non-zero) or "exact"
+            evaluates the refraction formula and rotation per triangle,
+            "table" uses a precomputed lookup table (faster; approximate).
+            False (0) or "none": no correction
 
         References
         ----------
@@ -193,13 +508,15 @@ cdef class Terrain:
 
         sw_dir_cor.fill(0.0)
 
-        self.thisptr.sw_dir_cor_coherent(&sun_pos[0], &sw_dir_cor[0,0])
+        self.thisptr.sw_dir_cor_coherent(&sun_pos[0], &sw_dir_cor[0,0],
+                                         _refrac_mode(refrac_cor))
 
 # -----------------------------------------------------------------------------
 
     def sw_dir_cor_coherent_rp8(
             self, np.ndarray[np.float64_t, ndim = 1] sun_pos,
-            np.ndarray[np.float32_t, ndim = 2] sw_dir_cor):
+            np.ndarray[np.float32_t, ndim = 2] sw_dir_cor,
+            refrac_cor=False):
         """Compute subgrid-scale correction factors for direct downward
         shortwave radiation for a specific sun position (use coherent rays
         with packages of 8 rays).
@@ -212,6 +529,11 @@ cdef class Terrain:
         sw_dir_cor : ndarray of float
             Array (two-dimensional) with shortwave correction factor (y, x)
             [-]
+        refrac_cor: bool, int or str
+            Account for atmospheric refraction. True (non-zero) or "exact"
+            evaluates the refraction formula and rotation per triangle,
+            "table" uses a precomputed lookup table (faster; approximate).
+            False (0) or "none": no correction
 
         References
         ----------
@@ -227,4 +549,5 @@ cdef class Terrain:
 
         sw_dir_cor.fill(0.0)
 
-        self.thisptr.sw_dir_cor_coherent_rp8(&sun_pos[0], &sw_dir_cor[0,0])
+        self.thisptr.sw_dir_cor_coherent_rp8(&sun_pos[0], &sw_dir_cor[0,0],
+                                             _refrac_mode(refrac_cor))
@@ -4,6 +4,18 @@
 cimport numpy as np
 import numpy as np
 import os
+from subgrid_radiation.sun_position_array.rays import encode_sw_dir_cor, \
+    _encode_rows
+from subgrid_radiation.sun_position_array.rays cimport Scene, RTCScene, \
+    row_callback_t, _row_callback
+
+include "../kernel_stats.pxi"
+
+# Quantisation of horizon (bytes per value; see 'horizon_file.h')
+hori_quant_types = {"uint8": 1, "int16": 2}
+
+cdef extern from "horizon_file.h":
+    int HORI_FILE_VERSION
 
 # -----------------------------------------------------------------------------
 # Compute sky view factor
@@ -15,6 +27,7 @@ cdef extern from "horizon_comp.h":
             int dem_dim_0, int dem_dim_1,
             float* vert_grid_in,
             int dem_dim_in_0, int dem_dim_in_1,
+            double radius_earth,
             double* sky_view_factor,
             double* area_increase_factor,
             double* sky_view_area_factor,
@@ -26,7 +39,18 @@ cdef extern from "horizon_comp.h":
             double hori_acc,
             char* ray_algorithm,
             double elev_ang_low_lim,
-            char* geom_type)
+            char* geom_type,
+            RTCScene scene_ext,
+            char* build_quality,
+            int compact,
+            int robust,
+            int grain_size,
+            int cost_order,
+            int use_float32,
+            double dist_near,
+            int coarse_fac,
+            char* hori_file,
+            int hori_quant)
 
 def sky_view_factor(
         np.ndarray[np.float32_t, ndim = 1] vert_grid,
@@ -41,7 +65,19 @@ def sky_view_factor(
         double hori_acc=1.0,
         str ray_algorithm="guess_constant",
         double elev_ang_low_lim = -15.0,
-        str geom_type="grid"):
+        str geom_type="grid",
+        str hori_file=None,
+        str hori_quant="int16",
+        Scene scene=None,
+        str build_quality="medium",
+        bint compact=False,
+        bint robust=True,
+        int grain_size=1,
+        bint cost_order=False,
+        str precision="float64",
+        double dist_near=0.0,
+        int coarse_fac=8,
+        double radius_earth=6371229.0):
     """Compute the sky view factor.
 
     Parameters
@@ -52,9 +88,11 @@ def sky_view_factor(
         Dimension length of DEM in y-direction
     dem_dim_1 : int
         Dimension length of DEM in x-direction
-    vert_grid_in : ndarray of float
+    vert_grid_in : ndarray of float or None
         Array (one-dimensional) with vertices of inner DEM with 0.0 m elevation
-        in ENU coordinates [metre]
+        in ENU coordinates [metre]. If None, the horizontal triangles are
+        computed analytically (radial projection of DEM triangles onto sphere
+        with radius 'radius_earth'; ENU origin on surface of sphere)
     dem_dim_in_0 : int
         Dimension length of inner DEM in y-direction
     dem_dim_in_1 : int
@@ -75,11 +113,57 @@ def sky_view_factor(
         Accuracy of horizon computation [degree]
     ray_algorithm : str
         Algorithm for horizon detection (discrete_sampling, binary_search,
-        guess_constant)
+        binary_search_packet4, binary_search_packet,
+        binary_search_packet16, guess_constant). The packet variants
+        trace 4/8/16 azimuth directions simultaneously (same result as
+        'binary_search')
     elev_ang_low_lim : double
         Lower limit for elevation angle search [degree]
     geom_type : str
-        Embree geometry type (triangle, quad, grid)
+        Embree geometry type (triangle, quad, grid) or heightfield
+    hori_file : str
+        Path of file to which the quantised horizon of all triangles is
+        written (optional; can be read with 'read_horizon_file' or loaded
+        with 'Terrain.load_horizon_cache')
+    hori_quant : str
+        Quantisation of sine of horizon in 'hori_file' (uint8, int16)
+    scene : Scene, optional
+        Committed scene of 'vert_grid' (see class 'Scene'), which is reused
+        instead of building a new one ('geom_type', 'build_quality',
+        'compact' and 'robust' are then ignored)
+    build_quality : str
+        Embree BVH build quality (low, medium, high). Higher quality increases
+        build time but can speed up ray tracing
+    compact : bool
+        Use compact BVH layout (less memory, slightly slower ray tracing)
+    robust : bool
+        Use robust ray-triangle intersection mode (avoids missed intersections
+        at shared edges, slightly slower)
+    grain_size : int
+        Minimal number of grid cells per task. Active (non-masked) grid cells
+        are compacted into a list, which is distributed dynamically among
+        threads
+    cost_order : bool
+        Process grid cells in order of decreasing cost estimate (variance of
+        elevation) instead of tile-wise (-> better load balancing for
+        heterogeneous terrain)
+    precision : str
+        Floating-point precision of sky view factor integration (float64,
+        float32). With float32, the integration over azimuth directions uses
+        polynomial approximations of sin/cos/atan and SIMD instructions
+        (AVX-512, AVX2 or NEON; selected at runtime). float64 is the
+        reference
+    dist_near : double
+        Radius of near field [kilometre]. If larger than 0.0 (and smaller
+        than 'dist_search'), the horizon is traced on the full-resolution DEM
+        up to 'dist_near' only; beyond, a coarse DEM (every 'coarse_fac'-th
+        vertex with the maximal elevation within +/- 'coarse_fac' fine
+        vertices) is used. The horizon is the maximum of both per azimuth
+        direction
+    coarse_fac : int
+        Coarsening factor of DEM for far field (along one dimension)
+    radius_earth : double
+        Radius of Earth (only used if 'vert_grid_in' is None) [metre]
 
     Returns
     -------
@@ -108,7 +192,10 @@ def sky_view_factor(
                          + " 'dem_dim_in_?', 'offset_gc' and 'pixel_per_gc'")
     if len(vert_grid) < (dem_dim_0 * dem_dim_1 * 3):
         raise ValueError("array 'vert_grid' has insufficient length")
-    if len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
+    if vert_grid_in is None:
+        if radius_earth <= 0.0:
+            raise ValueError("'radius_earth' must be positive")
+    elif len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
         raise ValueError("array 'vert_grid_in' has insufficient length")
     if pixel_per_gc < 1:
         raise ValueError("value for 'pixel_per_gc' must be larger than 1")
@@ -126,11 +213,22 @@ def sky_view_factor(
         raise ValueError("'dist_search' must be at least 100.0 m")
     if hori_acc > 10.0:
         raise ValueError("limit (10 degree) of 'hori_acc' exceeded")
-    if ray_algorithm not in ("discrete_sampling", "binary_search",
-                             "guess_constant"):
+    if ray_algorithm not in ray_algorithms:
         raise ValueError("invalid input argument for ray_algorithm")
-    if geom_type not in ("triangle", "quad", "grid"):
+    if geom_type not in ("triangle", "quad", "grid", "heightfield"):
         raise ValueError("invalid input argument for geom_type")
+    if build_quality not in ("low", "medium", "high"):
+        raise ValueError("invalid input argument for build_quality")
+    if grain_size < 1:
+        raise ValueError("value for 'grain_size' must be at least 1")
+    if hori_quant not in hori_quant_types:
+        raise ValueError("invalid input argument for hori_quant")
+    if dist_near < 0.0:
+        raise ValueError("'dist_near' must be non-negative")
+    if coarse_fac < 2:
+        raise ValueError("value for 'coarse_fac' must be at least 2")
+    if precision not in ("float64", "float32"):
+        raise ValueError("invalid input argument for precision")
 
     # Check size of input geometries
     if (dem_dim_0 > 32767) or (dem_dim_1 > 32767):
@@ -139,11 +237,23 @@ def sky_view_factor(
 
     # Ensure that passed arrays are contiguous in memory
     vert_grid = np.ascontiguousarray(vert_grid)
-    vert_grid_in = np.ascontiguousarray(vert_grid_in)
+    cdef float* vert_grid_in_ptr = NULL
+    if vert_grid_in is not None:
+        vert_grid_in = np.ascontiguousarray(vert_grid_in)
+        vert_grid_in_ptr = &vert_grid_in[0]
+
+    # Reuse committed scene (optional)
+    cdef RTCScene scene_c = NULL
+    if scene is not None:
+        scene_c = scene.get(vert_grid, dem_dim_0, dem_dim_1)
 
     # Convert input strings to bytes
     ray_algorithm_c = ray_algorithm.encode("utf-8")
     geom_type_c = geom_type.encode("utf-8")
+    build_quality_c = build_quality.encode("utf-8")
+    if hori_file is None:
+        hori_file = ""
+    hori_file_c = hori_file.encode("utf-8")
 
     # Allocate array for shortwave correction factors
     cdef int len_in_0 = int((dem_dim_in_0 - 1) / pixel_per_gc)
@@ -161,8 +271,9 @@ def sky_view_factor(
     sky_view_factor_comp(
         &vert_grid[0],
         dem_dim_0, dem_dim_1,
-        &vert_grid_in[0],
+        vert_grid_in_ptr,
         dem_dim_in_0, dem_dim_in_1,
+        radius_earth,
         &sky_view_factor[0,0],
         &area_increase_factor[0, 0],
         &sky_view_area_factor[0, 0],
@@ -174,10 +285,276 @@ def sky_view_factor(
         hori_acc,
         ray_algorithm_c,
         elev_ang_low_lim,
-        geom_type_c)
+        geom_type_c,
+        scene_c,
+        build_quality_c,
+        int(compact),
+        int(robust),
+        grain_size,
+        int(cost_order),
+        int(precision == "float32"),
+        dist_near,
+        coarse_fac,
+        hori_file_c,
+        hori_quant_types[hori_quant])
 
     return sky_view_factor, area_increase_factor, sky_view_area_factor
 
+# -----------------------------------------------------------------------------
+# Compute sky view factor with adaptive subsampling of triangles
+# -----------------------------------------------------------------------------
+
+cdef extern from "horizon_comp.h":
+    void sky_view_factor_comp_adaptive(
+            float* vert_grid,
+            int dem_dim_0, int dem_dim_1,
+            float* vert_grid_in,
+            int dem_dim_in_0, int dem_dim_in_1,
+            double radius_earth,
+            double* sky_view_factor,
+            double* area_increase_factor,
+            double* sky_view_area_factor,
+            double* sky_view_factor_err,
+            int pixel_per_gc,
+            int offset_gc,
+            np.npy_uint8* mask,
+            float dist_search,
+            int hori_azim_num,
+            double hori_acc,
+            char* ray_algorithm,
+            double elev_ang_low_lim,
+            char* geom_type,
+            RTCScene scene_ext,
+            char* build_quality,
+            int compact,
+            int robust,
+            int grain_size,
+            int cost_order,
+            int stride_max,
+            double err_tol)
+
+def sky_view_factor_adaptive(
+        np.ndarray[np.float32_t, ndim = 1] vert_grid,
+        int dem_dim_0, int dem_dim_1,
+        np.ndarray[np.float32_t, ndim = 1] vert_grid_in,
+        int dem_dim_in_0, int dem_dim_in_1,
+        int pixel_per_gc,
+        int offset_gc,
+        np.ndarray[np.uint8_t, ndim = 2] mask=None,
+        float dist_search=100.0,
+        int hori_azim_num=90,
+        double hori_acc=1.0,
+        str ray_algorithm="guess_constant",
+        double elev_ang_low_lim = -15.0,
+        str geom_type="grid",
+        double err_tol=0.005,
+        int stride_max=4,
+        Scene scene=None,
+        str build_quality="medium",
+        bint compact=False,
+        bint robust=True,
+        int grain_size=1,
+        bint cost_order=False,
+        double radius_earth=6371229.0):
+    """Compute the sky view factor from an adaptive subsample of the
+    triangles of each grid cell.
+
+    Parameters
+    ----------
+    vert_grid : ndarray of float
+        Array (one-dimensional) with vertices of DEM in ENU coordinates [metre]
+    dem_dim_0 : int
+        Dimension length of DEM in y-direction
+    dem_dim_1 : int
+        Dimension length of DEM in x-direction
+    vert_grid_in : ndarray of float or None
+        Array (one-dimensional) with vertices of inner DEM with 0.0 m elevation
+        in ENU coordinates [metre]. If None, the horizontal triangles are
+        computed analytically (radial projection of DEM triangles onto sphere
+        with radius 'radius_earth'; ENU origin on surface of sphere)
+    dem_dim_in_0 : int
+        Dimension length of inner DEM in y-direction
+    dem_dim_in_1 : int
+        Dimension length of inner DEM in x-direction
+    pixel_per_gc : int
+        Number of subgrid pixels within one grid cell (along one dimension)
+    offset_gc : int
+        Offset number of grid cells
+    mask : ndarray of uint8
+        Array (two-dimensional) with grid cells for which 'sw_dir_cor' and
+        'sky_view_factor' are computed. Masked (0) grid cells are filled with
+        NaN.
+    dist_search : float
+        Search distance for topographic shadowing [kilometre]
+    hori_azim_num : int
+        Number of azimuth sectors for horizon computation
+    hori_acc : double
+        Accuracy of horizon computation [degree]
+    ray_algorithm : str
+        Algorithm for horizon detection (discrete_sampling, binary_search,
+        binary_search_packet4, binary_search_packet,
+        binary_search_packet16, guess_constant)
+    elev_ang_low_lim : double
+        Lower limit for elevation angle search [degree]
+    geom_type : str
+        Embree geometry type (triangle, quad, grid) or heightfield
+    err_tol : double
+        Tolerance for the estimated standard errors of 'sky_view_factor' and
+        'sky_view_area_factor' of a grid cell [-]. With 0.0, all triangles
+        are traced
+    stride_max : int
+        Maximal stride of initial sample [pixels]. The largest divisor of
+        'pixel_per_gc' not exceeding this value is used
+    scene : Scene, optional
+        Committed scene of 'vert_grid' (see class 'Scene'), which is reused
+        instead of building a new one ('geom_type', 'build_quality',
+        'compact' and 'robust' are then ignored)
+    build_quality : str
+        Embree BVH build quality (low, medium, high). Higher quality increases
+        build time but can speed up ray tracing
+    compact : bool
+        Use compact BVH layout (less memory, slightly slower ray tracing)
+    robust : bool
+        Use robust ray-triangle intersection mode (avoids missed intersections
+        at shared edges, slightly slower)
+    grain_size : int
+        Minimal number of grid cells per task. Active (non-masked) grid cells
+        are compacted into a list, which is distributed dynamically among
+        threads
+    cost_order : bool
+        Process grid cells in order of decreasing cost estimate (variance of
+        elevation) instead of tile-wise (-> better load balancing for
+        heterogeneous terrain)
+    radius_earth : double
+        Radius of Earth (only used if 'vert_grid_in' is None) [metre]
+
+    Returns
+    -------
+    sky_view_factor : ndarray of double
+        Array (two-dimensional) with sky view factor (y, x) [-]
+    area_increase_factor : ndarray of double
+        Array (two-dimensional) with surface area increase factor
+        (due to sloped terrain; computed from all triangles) [-]
+    sky_view_area_factor : ndarray of double
+        Array (two-dimensional) with 'sky_view_factor' divided by
+        'area_increase_factor' [-]
+    sky_view_factor_err : ndarray of double
+        Array (two-dimensional) with estimated standard error (maximum of
+        the errors of 'sky_view_factor' and 'sky_view_area_factor'; 0.0 for
+        grid cells in which all triangles are traced) (y, x) [-]
+
+    Notes
+    -----
+    See 'rays.sw_dir_cor_adaptive' for the sampling scheme. Far-field
+    horizons from a coarse DEM and output of a horizon file (which requires
+    the horizon of all triangles) are not supported."""
+
+	# Check consistency and validity of input arguments
+    if ((dem_dim_0 != (2 * offset_gc * pixel_per_gc) + dem_dim_in_0)
+            or (dem_dim_1 != (2 * offset_gc * pixel_per_gc) + dem_dim_in_1)):
+        raise ValueError("Inconsistency between input arguments 'dem_dim_?',"
+                         + " 'dem_dim_in_?', 'offset_gc' and 'pixel_per_gc'")
+    if len(vert_grid) < (dem_dim_0 * dem_dim_1 * 3):
+        raise ValueError("array 'vert_grid' has insufficient length")
+    if vert_grid_in is None:
+        if radius_earth <= 0.0:
+            raise ValueError("'radius_earth' must be positive")
+    elif len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
+        raise ValueError("array 'vert_grid_in' has insufficient length")
+    if pixel_per_gc < 1:
+        raise ValueError("value for 'pixel_per_gc' must be larger than 1")
+    if offset_gc < 0:
+        raise ValueError("value for 'offset_gc' must be larger than 0")
+    num_gc_y = int((dem_dim_0 - 1) / pixel_per_gc) - 2 * offset_gc
+    num_gc_x = int((dem_dim_1 - 1) / pixel_per_gc) - 2 * offset_gc
+    if mask is None:
+        mask = np.ones((num_gc_y, num_gc_x), dtype=np.uint8)
+    if (mask.shape[0] != num_gc_y) or (mask.shape[1] != num_gc_x):
+        raise ValueError("shape of mask is inconsistent with other input")
+    if mask.dtype != "uint8":
+        raise TypeError("data type of mask must be 'uint8'")
+    if dist_search < 0.1:
+        raise ValueError("'dist_search' must be at least 100.0 m")
+    if hori_acc > 10.0:
+        raise ValueError("limit (10 degree) of 'hori_acc' exceeded")
+    if ray_algorithm not in ray_algorithms:
+        raise ValueError("invalid input argument for ray_algorithm")
+    if geom_type not in ("triangle", "quad", "grid", "heightfield"):
+        raise ValueError("invalid input argument for geom_type")
+    if build_quality not in ("low", "medium", "high"):
+        raise ValueError("invalid input argument for build_quality")
+    if grain_size < 1:
+        raise ValueError("value for 'grain_size' must be at least 1")
+    if err_tol < 0.0:
+        raise ValueError("'err_tol' must be non-negative")
+    if stride_max < 1:
+        raise ValueError("value for 'stride_max' must be at least 1")
+
+    # Check size of input geometries
+    if (dem_dim_0 > 32767) or (dem_dim_1 > 32767):
+        raise ValueError("maximal allowed input length for dem_dim_0 and "
+                         "dem_dim_1 is 32'767")
+
+    # Ensure that passed arrays are contiguous in memory
+    vert_grid = np.ascontiguousarray(vert_grid)
+    cdef float* vert_grid_in_ptr = NULL
+    if vert_grid_in is not None:
+        vert_grid_in = np.ascontiguousarray(vert_grid_in)
+        vert_grid_in_ptr = &vert_grid_in[0]
+
+    # Reuse committed scene (optional)
+    cdef RTCScene scene_c = NULL
+    if scene is not None:
+        scene_c = scene.get(vert_grid, dem_dim_0, dem_dim_1)
+
+    # Convert input strings to bytes
+    ray_algorithm_c = ray_algorithm.encode("utf-8")
+    geom_type_c = geom_type.encode("utf-8")
+    build_quality_c = build_quality.encode("utf-8")
+
+    # Allocate output arrays (all elements are set by C++ code)
+    cdef int len_in_0 = int((dem_dim_in_0 - 1) / pixel_per_gc)
+    cdef int len_in_1 = int((dem_dim_in_1 - 1) / pixel_per_gc)
+    cdef np.ndarray[np.float64_t, ndim = 2, mode = "c"] \
+        sky_view_factor = np.empty((len_in_0, len_in_1), dtype=np.float64)
+    cdef np.ndarray[np.float64_t, ndim = 2, mode = "c"] \
+        area_increase_factor = np.empty((len_in_0, len_in_1), dtype=np.float64)
+    cdef np.ndarray[np.float64_t, ndim = 2, mode = "c"] \
+        sky_view_area_factor = np.empty((len_in_0, len_in_1), dtype=np.float64)
+    cdef np.ndarray[np.float64_t, ndim = 2, mode = "c"] \
+        sky_view_factor_err = np.empty((len_in_0, len_in_1), dtype=np.float64)
+
+    sky_view_factor_comp_adaptive(
+        &vert_grid[0],
+        dem_dim_0, dem_dim_1,
+        vert_grid_in_ptr,
+        dem_dim_in_0, dem_dim_in_1,
+        radius_earth,
+        &sky_view_factor[0, 0],
+        &area_increase_factor[0, 0],
+        &sky_view_area_factor[0, 0],
+        &sky_view_factor_err[0, 0],
+        pixel_per_gc,
+        offset_gc,
+        &mask[0, 0],
+        dist_search,
+        hori_azim_num,
+        hori_acc,
+        ray_algorithm_c,
+        elev_ang_low_lim,
+        geom_type_c,
+        scene_c,
+        build_quality_c,
+        int(compact),
+        int(robust),
+        grain_size,
+        int(cost_order),
+        stride_max,
+        err_tol)
+
+    return (sky_view_factor, area_increase_factor, sky_view_area_factor,
+            sky_view_factor_err)
+
 # -----------------------------------------------------------------------------
 # Compute sky view factor and SW_dir correction factor
 # -----------------------------------------------------------------------------
@@ -188,6 +565,7 @@ cdef extern from "horizon_comp.h":
             int dem_dim_0, int dem_dim_1,
             float* vert_grid_in,
             int dem_dim_in_0, int dem_dim_in_1,
+            double radius_earth,
             double* sun_pos,
             int dim_sun_0, int dim_sun_1,
             float* sw_dir_cor,
@@ -203,8 +581,20 @@ cdef extern from "horizon_comp.h":
             char* ray_algorithm,
             double elev_ang_low_lim,
             char* geom_type,
+            RTCScene scene_ext,
+            char* build_quality,
+            int compact,
+            int robust,
+            int grain_size,
+            int cost_order,
+            int use_float32,
+            double dist_near,
+            int coarse_fac,
             double sw_dir_cor_max,
-            double ang_max)
+            double ang_max,
+            int block_rows,
+            row_callback_t row_callback,
+            void* user_data)
 
 def sky_view_factor_sw_dir_cor(
         np.ndarray[np.float32_t, ndim = 1] vert_grid,
@@ -222,7 +612,20 @@ def sky_view_factor_sw_dir_cor(
         double elev_ang_low_lim = -15.0,
         str geom_type="grid",
         double sw_dir_cor_max=25.0,
-        double ang_max=89.9):
+        double ang_max=89.9,
+        row_callback=None,
+        int block_rows=1,
+        str out_type="float32",
+        Scene scene=None,
+        str build_quality="medium",
+        bint compact=False,
+        bint robust=True,
+        int grain_size=1,
+        bint cost_order=False,
+        str precision="float64",
+        double dist_near=0.0,
+        int coarse_fac=8,
+        double radius_earth=6371229.0):
     """Compute subsolar lookup table of subgrid-scale correction factors
     for direct downward shortwave radiation. Additionally, the sky view factor
     is computed.
@@ -235,9 +638,11 @@ def sky_view_factor_sw_dir_cor(
         Dimension length of DEM in y-direction
     dem_dim_1 : int
         Dimension length of DEM in x-direction
-    vert_grid_in : ndarray of float
+    vert_grid_in : ndarray of float or None
         Array (one-dimensional) with vertices of inner DEM with 0.0 m elevation
-        in ENU coordinates [metre]
+        in ENU coordinates [metre]. If None, the horizontal triangles are
+        computed analytically (radial projection of DEM triangles onto sphere
+        with radius 'radius_earth'; ENU origin on surface of sphere)
     dem_dim_in_0 : int
         Dimension length of inner DEM in y-direction
     dem_dim_in_1 : int
@@ -261,11 +666,14 @@ def sky_view_factor_sw_dir_cor(
         Accuracy of horizon computation [degree]
     ray_algorithm : str
         Algorithm for horizon detection (discrete_sampling, binary_search,
-        guess_constant)
+        binary_search_packet4, binary_search_packet,
+        binary_search_packet16, guess_constant). The packet variants
+        trace 4/8/16 azimuth directions simultaneously (same result as
+        'binary_search')
     elev_ang_low_lim : double
         Lower limit for elevation angle search [degree]
     geom_type : str
-        Embree geometry type (triangle, quad, grid)
+        Embree geometry type (triangle, quad, grid) or heightfield
     sw_dir_cor_max : double
         Maximal allowed correction factor for direct downward shortwave
         radiation [-]
@@ -273,12 +681,64 @@ def sky_view_factor_sw_dir_cor(
         Maximal angle between sun vector and horizontal surface normal for
         which correction is computed. For larger angles, 'sw_dir_cor' is set
         to 0.0 [degree]
+    row_callback : callable, optional
+        Function called as row_callback(row_beg, sw_dir_cor_rows) for
+        finished blocks of grid cell rows (in ascending order). The array
+        'sw_dir_cor_rows' (num_rows, x, dim_sun_0, dim_sun_1) with
+        num_rows <= block_rows is only valid during the call and must be
+        copied or written to disk. If provided, no full lookup table is
+        allocated (the sky view factor related quantities are still returned
+        as full arrays)
+    block_rows : int
+        Number of grid cell rows per block passed to 'row_callback'
+    out_type : str
+        Data type of 'sw_dir_cor' (float32, uint16, uint8). Unsigned integer
+        output is encoded with the parameters from
+        'rays.encoding_parameters()' (also applies to blocks passed to
+        'row_callback')
+    scene : Scene, optional
+        Committed scene of 'vert_grid' (see class 'Scene'), which is reused
+        instead of building a new one ('geom_type', 'build_quality',
+        'compact' and 'robust' are then ignored)
+    build_quality : str
+        Embree BVH build quality (low, medium, high). Higher quality increases
+        build time but can speed up ray tracing
+    compact : bool
+        Use compact BVH layout (less memory, slightly slower ray tracing)
+    robust : bool
+        Use robust ray-triangle intersection mode (avoids missed intersections
+        at shared edges, slightly slower)
+    grain_size : int
+        Minimal number of grid cells per task. Active (non-masked) grid cells
+        are compacted into a list, which is distributed dynamically among
+        threads
+    cost_order : bool
+        Process grid cells in order of decreasing cost estimate (variance of
+        elevation) instead of tile-wise (-> better load balancing for
+        heterogeneous terrain)
+    precision : str
+        Floating-point precision of sun vectors, correction factors and sky
+        view factor integration (float64, float32). With float32, the former
+        are computed for all sun positions of a triangle at once and the
+        latter over all azimuth directions with SIMD instructions (AVX-512,
+        AVX2 or NEON; selected at runtime). float64 is the reference
+    dist_near : double
+        Radius of near field [kilometre]. If larger than 0.0 (and smaller
+        than 'dist_search'), the horizon is traced on the full-resolution DEM
+        up to 'dist_near' only; beyond, a coarse DEM (every 'coarse_fac'-th
+        vertex with the maximal elevation within +/- 'coarse_fac' fine
+        vertices) is used. The horizon is the maximum of both per azimuth
+        direction
+    coarse_fac : int
+        Coarsening factor of DEM for far field (along one dimension)
+    radius_earth : double
+        Radius of Earth (only used if 'vert_grid_in' is None) [metre]
 
     Returns
     -------
-    sw_dir_cor : ndarray of float
+    sw_dir_cor : ndarray of float/uint16/uint8 or None
         Array (four-dimensional) with shortwave correction factor
-        (y, x, dim_sun_0, dim_sun_1) [-]
+        (y, x, dim_sun_0, dim_sun_1) [-]; None if 'row_callback' is provided
     sky_view_factor : ndarray of double
         Array (two-dimensional) with sky view factor (y, x) [-]
     area_increase_factor : ndarray of double
@@ -307,7 +767,10 @@ def sky_view_factor_sw_dir_cor(
                          + " 'dem_dim_in_?', 'offset_gc' and 'pixel_per_gc'")
     if len(vert_grid) < (dem_dim_0 * dem_dim_1 * 3):
         raise ValueError("array 'vert_grid' has insufficient length")
-    if len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
+    if vert_grid_in is None:
+        if radius_earth <= 0.0:
+            raise ValueError("'radius_earth' must be positive")
+    elif len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
         raise ValueError("array 'vert_grid_in' has insufficient length")
     if pixel_per_gc < 1:
         raise ValueError("value for 'pixel_per_gc' must be larger than 1")
@@ -325,15 +788,30 @@ def sky_view_factor_sw_dir_cor(
         raise ValueError("'dist_search' must be at least 100.0 m")
     if hori_acc > 10.0:
         raise ValueError("limit (10 degree) of 'hori_acc' exceeded")
-    if ray_algorithm not in ("discrete_sampling", "binary_search",
-                             "guess_constant"):
+    if ray_algorithm not in ray_algorithms:
         raise ValueError("invalid input argument for ray_algorithm")
-    if geom_type not in ("triangle", "quad", "grid"):
+    if geom_type not in ("triangle", "quad", "grid", "heightfield"):
         raise ValueError("invalid input argument for geom_type")
+    if build_quality not in ("low", "medium", "high"):
+        raise ValueError("invalid input argument for build_quality")
+    if grain_size < 1:
+        raise ValueError("value for 'grain_size' must be at least 1")
     if (sw_dir_cor_max < 2.0) or (sw_dir_cor_max > 100.0):
         raise ValueError("'sw_dir_cor_max' must be in the range [2.0, 100.0]")
     if (ang_max < 89.0) or (ang_max >= 90.0):
         raise ValueError("'ang_max' must be in the range [89.0, <90.0]")
+    if (row_callback is not None) and (not callable(row_callback)):
+        raise TypeError("'row_callback' must be callable")
+    if block_rows < 1:
+        raise ValueError("value for 'block_rows' must be at least 1")
+    if out_type not in ("float32", "uint16", "uint8"):
+        raise ValueError("invalid input argument for out_type")
+    if precision not in ("float64", "float32"):
+        raise ValueError("invalid input argument for precision")
+    if dist_near < 0.0:
+        raise ValueError("'dist_near' must be non-negative")
+    if coarse_fac < 2:
+        raise ValueError("value for 'coarse_fac' must be at least 2")
 
     # Check size of input geometries
     if (dem_dim_0 > 32767) or (dem_dim_1 > 32767):
@@ -342,24 +820,45 @@ def sky_view_factor_sw_dir_cor(
 
     # Ensure that passed arrays are contiguous in memory
     vert_grid = np.ascontiguousarray(vert_grid)
-    vert_grid_in = np.ascontiguousarray(vert_grid_in)
+    cdef float* vert_grid_in_ptr = NULL
+    if vert_grid_in is not None:
+        vert_grid_in = np.ascontiguousarray(vert_grid_in)
+        vert_grid_in_ptr = &vert_grid_in[0]
     sun_pos = np.ascontiguousarray(sun_pos)
 
+    # Reuse committed scene (optional)
+    cdef RTCScene scene_c = NULL
+    if scene is not None:
+        scene_c = scene.get(vert_grid, dem_dim_0, dem_dim_1)
+
     # Convert input strings to bytes
     ray_algorithm_c = ray_algorithm.encode("utf-8")
     geom_type_c = geom_type.encode("utf-8")
+    build_quality_c = build_quality.encode("utf-8")
 
     # Allocate array for shortwave correction factors
     cdef int len_in_0 = int((dem_dim_in_0 - 1) / pixel_per_gc)
     cdef int len_in_1 = int((dem_dim_in_1 - 1) / pixel_per_gc)
     cdef int dim_sun_0 = sun_pos.shape[0]
     cdef int dim_sun_1 = sun_pos.shape[1]
-    cdef np.ndarray[np.float32_t, ndim = 4, mode = "c"] \
+    cdef np.ndarray[np.float32_t, ndim = 4, mode = "c"] sw_dir_cor = None
+    cdef float* sw_dir_cor_ptr = NULL
+    cdef row_callback_t callback_c = NULL
+    context = None
+    if row_callback is None:
         sw_dir_cor = np.empty((len_in_0, len_in_1, dim_sun_0, dim_sun_1),
                               dtype=np.float32)
-    sw_dir_cor.fill(0.0)
-    # -> ensure that all elements of array 'sw_dir_cor' are 0.0 (crucial
-    # because subgrid correction values are iteratively added) -> probably no longer needed with horizon...
+        sw_dir_cor.fill(0.0)
+        # -> ensure that all elements of array 'sw_dir_cor' are 0.0 (crucial
+        # because subgrid correction values are iteratively added)
+        sw_dir_cor_ptr = &sw_dir_cor[0, 0, 0, 0]
+    else:
+        # blocks are computed in buffers allocated by C++ code
+        if out_type != "float32":
+            row_callback = _encode_rows(row_callback, out_type,
+                                        sw_dir_cor_max)
+        context = [row_callback, (len_in_1, dim_sun_0, dim_sun_1), None]
+        callback_c = _row_callback
     cdef np.ndarray[np.float64_t, ndim = 2, mode = "c"] \
         sky_view_factor = np.empty((len_in_0, len_in_1), dtype=np.float64)
     sky_view_factor.fill(0.0)  # accumulated over pixels
@@ -373,11 +872,12 @@ def sky_view_factor_sw_dir_cor(
     sky_view_factor_sw_dir_cor_comp(
         &vert_grid[0],
         dem_dim_0, dem_dim_1,
-        &vert_grid_in[0],
+        vert_grid_in_ptr,
         dem_dim_in_0, dem_dim_in_1,
+        radius_earth,
         &sun_pos[0,0,0],
         dim_sun_0, dim_sun_1,
-        &sw_dir_cor[0,0,0,0],
+        sw_dir_cor_ptr,
         &sky_view_factor[0,0],
         &area_increase_factor[0, 0],
         &sky_view_area_factor[0, 0],
@@ -390,8 +890,105 @@ def sky_view_factor_sw_dir_cor(
         ray_algorithm_c,
         elev_ang_low_lim,
         geom_type_c,
+        scene_c,
+        build_quality_c,
+        int(compact),
+        int(robust),
+        grain_size,
+        int(cost_order),
+        int(precision == "float32"),
+        dist_near,
+        coarse_fac,
         sw_dir_cor_max,
-        ang_max)
+        ang_max,
+        block_rows,
+        callback_c,
+        <void*>context)
+
+    # Re-raise exception from callback function
+    if (context is not None) and (context[2] is not None):
+        raise context[2]
+
+    # Encode lookup table (optional)
+    if (sw_dir_cor is not None) and (out_type != "float32"):
+        return encode_sw_dir_cor(sw_dir_cor, out_type, sw_dir_cor_max), \
+            sky_view_factor, area_increase_factor, sky_view_area_factor
 
     return sw_dir_cor, sky_view_factor, \
         area_increase_factor, sky_view_area_factor
+
+# -----------------------------------------------------------------------------
+# Read horizon file
+# -----------------------------------------------------------------------------
+
+def read_horizon_file(str hori_file):
+    """Memory-map file with quantised horizon (written by 'sky_view_factor'
+    or 'Terrain.save_horizon_cache') without loading its content.
+
+    Parameters
+    ----------
+    hori_file : str
+        Path of horizon file
+
+    Returns
+    -------
+    hori_data : numpy.memmap of uint8 or int16
+        Array (four-dimensional) with quantised sine of horizon (y, x,
+        triangle, 2 + hori_azim_num). The last dimension contains the minimal
+        and maximal value followed by the values for all azimuth angles.
+        Triangles are ordered by pixel (y, x) and triangle within pixel
+        (lower left, upper right). Values of masked grid cells are 0.
+    mask : numpy.memmap of uint8
+        Array (two-dimensional) with grid cells for which the horizon was
+        computed (y, x)
+    scale : float
+        Scale factor (sine of horizon = hori_data * scale + offset)
+    offset : float
+        Offset (sine of horizon = hori_data * scale + offset)"""
+
+    dtype_header = np.dtype([("magic", "S8"), ("version", np.int32),
+                             ("quant", np.int32), ("num_gc_y", np.int32),
+                             ("num_gc_x", np.int32),
+                             ("num_tri_per_gc", np.int32),
+                             ("hori_azim_num", np.int32),
+                             ("scale", np.float64), ("offset", np.float64),
+                             ("acc", np.float64),
+                             ("offset_mask", np.uint64),
+                             ("offset_data", np.uint64),
+                             ("record_size", np.uint64),
+                             ("chunk_size", np.uint64)])
+    header = np.fromfile(hori_file, dtype=dtype_header, count=1)
+    if (header.size != 1) or (header["magic"][0] != b"SGRHORI") \
+            or (header["version"][0] != HORI_FILE_VERSION):
+        raise ValueError("'" + hori_file + "' is not a valid horizon file")
+    header = header[0]
+
+    # Check consistency of header and file size
+    shape_gc = (int(header["num_gc_y"]), int(header["num_gc_x"]))
+    num_tri_per_gc = int(header["num_tri_per_gc"])
+    hori_azim_num = int(header["hori_azim_num"])
+    quant = int(header["quant"])
+    if (min(shape_gc + (num_tri_per_gc, hori_azim_num)) < 1) \
+            or (quant not in hori_quant_types.values()) \
+            or (int(header["offset_mask"]) != dtype_header.itemsize) \
+            or (int(header["offset_data"])
+                < (int(header["offset_mask"]) + shape_gc[0] * shape_gc[1])) \
+            or (int(header["record_size"]) != (hori_azim_num + 2) * quant) \
+            or (int(header["chunk_size"])
+                != int(header["record_size"]) * num_tri_per_gc):
+        raise ValueError("header of horizon file '" + hori_file
+                         + "' is corrupt")
+    size_req = int(header["offset_data"]) \
+        + shape_gc[0] * shape_gc[1] * int(header["chunk_size"])
+    if os.path.getsize(hori_file) < size_req:
+        raise ValueError("horizon file '" + hori_file + "' is truncated")
+
+    mask = np.memmap(hori_file, dtype=np.uint8, mode="r",
+                     offset=int(header["offset_mask"]), shape=shape_gc)
+    dtype_data = {1: np.uint8, 2: np.int16}[quant]
+    hori_data = np.memmap(hori_file, dtype=dtype_data, mode="r",
+                          offset=int(header["offset_data"]),
+                          shape=shape_gc + (num_tri_per_gc,
+                                            hori_azim_num + 2))
+
+    return hori_data, mask, float(header["scale"]), float(header["offset"])
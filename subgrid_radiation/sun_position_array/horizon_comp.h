@@ -1,14 +1,19 @@
 // Copyright (c) 2023 ETH Zurich, Christian R. Steger
 // MIT License
 
-#ifndef TESTLIB_H
-#define TESTLIB_H
+#ifndef HORIZON_COMP_H
+#define HORIZON_COMP_H
+
+#include "row_stream.h"
+#include <embree3/rtcore.h>
+#include <cstdint>
 
 void sky_view_factor_comp(
     float* vert_grid,
     int dem_dim_0, int dem_dim_1,
     float* vert_grid_in,
     int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
     double* sky_view_factor,
     double* area_increase_factor,
     double* sky_view_area_factor,
@@ -20,13 +25,25 @@ void sky_view_factor_comp(
     double hori_acc,
     char* ray_algorithm,
     double elev_ang_low_lim,
-    char* geom_type);
+    char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    int use_float32,
+    double dist_near,
+    int coarse_fac,
+    char* hori_file,
+    int hori_quant);
 
 void sky_view_factor_sw_dir_cor_comp(
     float* vert_grid,
     int dem_dim_0, int dem_dim_1,
     float* vert_grid_in,
     int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
     double* sun_pos,
     int dim_sun_0, int dim_sun_1,
     float* sw_dir_cor,
@@ -42,7 +59,47 @@ void sky_view_factor_sw_dir_cor_comp(
     char* ray_algorithm,
     double elev_ang_low_lim,
     char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    int use_float32,
+    double dist_near,
+    int coarse_fac,
     double sw_dir_cor_max,
-    double ang_max);
+    double ang_max,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data);
+
+void sky_view_factor_comp_adaptive(
+    float* vert_grid,
+    int dem_dim_0, int dem_dim_1,
+    float* vert_grid_in,
+    int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
+    double* sky_view_factor,
+    double* area_increase_factor,
+    double* sky_view_area_factor,
+    double* sky_view_factor_err,
+    int pixel_per_gc,
+    int offset_gc,
+    uint8_t* mask,
+    float dist_search,
+    int hori_azim_num,
+    double hori_acc,
+    char* ray_algorithm,
+    double elev_ang_low_lim,
+    char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    int stride_max,
+    double err_tol);
 
 #endif
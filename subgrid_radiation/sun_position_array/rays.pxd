@@ -0,0 +1,28 @@
+# Copyright (c) 2023 ETH Zurich, Christian R. Steger
+# MIT License
+
+cdef extern from "embree3/rtcore.h":
+    ctypedef void* RTCScene
+
+cdef extern from "embree_core.h" namespace "shapes":
+    cdef cppclass CppScene:
+        RTCScene scene
+        int dem_dim_0_cl, dem_dim_1_cl
+        CppScene()
+        void initialise(float*, int, int, char*, char*, int, int)
+
+cdef class Scene:
+
+    cdef CppScene *thisptr
+    cdef readonly object vert_grid
+    cdef readonly str geom_type
+
+    cdef RTCScene get(self, vert_grid, int dem_dim_0, int dem_dim_1) \
+        except? NULL
+
+cdef extern from "row_stream.h":
+    ctypedef void (*row_callback_t)(int row_beg, int num_rows,
+                                    float* sw_dir_cor, void* user_data)
+
+cdef void _row_callback(int row_beg, int num_rows, float* sw_dir_cor,
+                        void* user_data) noexcept with gil
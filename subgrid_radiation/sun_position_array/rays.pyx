@@ -5,6 +5,425 @@ cimport numpy as np
 import numpy as np
 import os
 
+include "../kernel_stats.pxi"
+
+# -----------------------------------------------------------------------------
+# Block-wise output of lookup table
+# -----------------------------------------------------------------------------
+
+# (callback type declared in 'rays.pxd'; also used by 'horizon')
+cdef void _row_callback(int row_beg, int num_rows, float* sw_dir_cor,
+                        void* user_data) noexcept with gil:
+    """Pass block of lookup table (buffer of C++ code) to Python function.
+    Exceptions are stored in the context and remaining blocks are skipped."""
+
+    context = <object>user_data
+    if context[2] is not None:
+        return
+    cdef int len_in_1 = context[1][0]
+    cdef int dim_sun_0 = context[1][1]
+    cdef int dim_sun_1 = context[1][2]
+    cdef float[:, :, :, ::1] sw_dir_cor_rows = \
+        <float[:num_rows, :len_in_1, :dim_sun_0, :dim_sun_1]> sw_dir_cor
+    try:
+        context[0](row_beg, np.asarray(sw_dir_cor_rows))
+    except BaseException as err:
+        context[2] = err
+
+# -----------------------------------------------------------------------------
+# Encoding of lookup table
+# -----------------------------------------------------------------------------
+
+lut_enc_types = {"uint8": 1, "uint16": 2}
+
+cdef extern from "lut_encoding.h":
+    void lut_encoding_param(int enc, double sw_dir_cor_max, double &scale,
+                            double &offset, unsigned int &fill_value)
+    void lut_encode(const float* sw_dir_cor, size_t num_elem, int enc,
+                    double scale, double offset, void* sw_dir_cor_enc)
+
+def encoding_parameters(str out_type, double sw_dir_cor_max=25.0):
+    """Return parameters of the unsigned integer encoding of the lookup table.
+
+    Parameters
+    ----------
+    out_type : str
+        Data type of encoded lookup table (uint8, uint16)
+    sw_dir_cor_max : double
+        Maximal allowed correction factor for direct downward shortwave
+        radiation [-]
+
+    Returns
+    -------
+    scale : float
+        Scale of encoding (sw_dir_cor = value * scale + offset) [-]
+    offset : float
+        Offset of encoding [-]
+    fill_value : int
+        Value representing NaN (masked grid cells)"""
+
+    if out_type not in lut_enc_types:
+        raise ValueError("invalid input argument for out_type")
+    cdef double scale, offset
+    cdef unsigned int fill_value
+    lut_encoding_param(lut_enc_types[out_type], sw_dir_cor_max, scale,
+                       offset, fill_value)
+    return scale, offset, fill_value
+
+def encode_sw_dir_cor(np.ndarray sw_dir_cor, str out_type,
+                      double sw_dir_cor_max=25.0):
+    """Encode lookup table of correction factors as unsigned integers.
+
+    Parameters
+    ----------
+    sw_dir_cor : ndarray of float
+        Array with shortwave correction factor [-]
+    out_type : str
+        Data type of encoded lookup table (uint8, uint16)
+    sw_dir_cor_max : double
+        Maximal allowed correction factor for direct downward shortwave
+        radiation [-]
+
+    Returns
+    -------
+    sw_dir_cor_enc : ndarray of uint8/uint16
+        Array with encoded shortwave correction factor (NaN is represented
+        by fill value of encoding)"""
+
+    if sw_dir_cor.dtype != "float32":
+        raise TypeError("data type of sw_dir_cor must be 'float32'")
+    scale, offset, fill_value = encoding_parameters(out_type, sw_dir_cor_max)
+    sw_dir_cor = np.ascontiguousarray(sw_dir_cor)
+    cdef np.ndarray sw_dir_cor_enc = np.empty_like(sw_dir_cor, dtype=out_type)
+    if sw_dir_cor.size > 0:
+        lut_encode(<float*>sw_dir_cor.data, sw_dir_cor.size,
+                   lut_enc_types[out_type], scale, offset,
+                   <void*>sw_dir_cor_enc.data)
+    return sw_dir_cor_enc
+
+def decode_sw_dir_cor(sw_dir_cor_enc, double sw_dir_cor_max=25.0):
+    """Decode lookup table of correction factors from unsigned integers.
+
+    Parameters
+    ----------
+    sw_dir_cor_enc : ndarray of uint8/uint16
+        Array with encoded shortwave correction factor
+    sw_dir_cor_max : double
+        Maximal allowed correction factor for direct downward shortwave
+        radiation (applied for encoding) [-]
+
+    Returns
+    -------
+    sw_dir_cor : ndarray of float
+        Array with shortwave correction factor (masked grid cells: NaN) [-]"""
+
+    scale, offset, fill_value \
+        = encoding_parameters(str(sw_dir_cor_enc.dtype), sw_dir_cor_max)
+    sw_dir_cor = sw_dir_cor_enc.astype(np.float32) * np.float32(scale) \
+        + np.float32(offset)
+    sw_dir_cor[sw_dir_cor_enc == fill_value] = np.nan
+    return sw_dir_cor
+
+def _encode_rows(row_callback, str out_type, double sw_dir_cor_max):
+    """Wrap callback function to pass encoded blocks of lookup table."""
+
+    def row_callback_enc(row_beg, sw_dir_cor_rows):
+        row_callback(row_beg, encode_sw_dir_cor(sw_dir_cor_rows, out_type,
+                                                sw_dir_cor_max))
+    return row_callback_enc
+
+def _encode_tiles(tile_writer, str out_type, double sw_dir_cor_max):
+    """Wrap callback function to pass encoded tiles of lookup table."""
+
+    def tile_writer_enc(gc_y_beg, gc_x_beg, sw_dir_cor_tile):
+        tile_writer(gc_y_beg, gc_x_beg,
+                    encode_sw_dir_cor(sw_dir_cor_tile, out_type,
+                                      sw_dir_cor_max))
+    return tile_writer_enc
+
+def _check_refrac(refrac_cor, str kernel):
+    """Raise error if atmospheric refraction is requested for a kernel (or
+    setting) without refraction correction."""
+
+    if refrac_cor:
+        raise ValueError("'refrac_cor' is not supported by " + kernel
+                         + " (use 'sw_dir_cor' with precision 'float64' "
+                         "or 'sw_dir_cor_tiled')")
+
+# -----------------------------------------------------------------------------
+# Evaluation of lookup table
+# -----------------------------------------------------------------------------
+
+# Data types of lookup table file (bytes per value; see 'lut_eval.h')
+lut_file_types = {"uint8": 1, "uint16": 2, "float32": 4}
+
+cdef extern from "lut_eval.h":
+    cdef struct LutFileHeader:
+        int enc
+        int num_gc_y, num_gc_x
+        int num_lat, num_lon
+        double lat_beg, lat_spac
+        double lon_beg, lon_spac
+        double scale, offset
+        unsigned long long offset_data
+    void lut_header_init(LutFileHeader &header, int num_gc_y, int num_gc_x,
+                         int num_lat, int num_lon, int enc, double lat_beg,
+                         double lat_spac, double lon_beg, double lon_spac,
+                         double sw_dir_cor_max)
+    bint lut_file_save(const char* file, LutFileHeader &header,
+                       const void* data)
+    unsigned char* lut_file_map(const char* file, LutFileHeader &header,
+                                size_t &map_size)
+    void lut_file_unmap(unsigned char* map, size_t map_size)
+    void lut_eval(const LutFileHeader &header, const unsigned char* data,
+                  const double* subsol_lat, const double* subsol_lon,
+                  size_t num_sun, float* sw_dir_cor, int grain_size) nogil
+
+def _grid_spacing(np.ndarray coord, str name):
+    """Return first value and spacing of regular grid of subsolar points."""
+
+    if coord.size == 1:
+        return float(coord[0]), 1.0
+    spac = (coord[-1] - coord[0]) / (coord.size - 1)
+    if (spac <= 0.0) or (np.abs(np.diff(coord) - spac).max() > 1e-4 * spac):
+        raise ValueError("'" + name + "' must be regularly spaced and "
+                         + "increasing")
+    return float(coord[0]), float(spac)
+
+def save_lookup_table(str file, np.ndarray sw_dir_cor,
+                      np.ndarray subsol_lat, np.ndarray subsol_lon,
+                      double sw_dir_cor_max=25.0):
+    """Write subsolar lookup table to file that can be memory-mapped by
+    'LookupTable' (e.g. the variable 'f_cor' of the NetCDF file written by
+    'compute_sw_dir_cor.py', read without automatic scaling).
+
+    Parameters
+    ----------
+    file : str
+        Path of lookup table file
+    sw_dir_cor : ndarray of float/uint16/uint8
+        Array (four-dimensional) with shortwave correction factor
+        (y, x, subsolar_lat, subsolar_lon) [-]; unsigned integers are
+        encoded with the parameters from 'encoding_parameters()'
+    subsol_lat : ndarray of double
+        Array (one-dimensional) with regularly spaced subsolar latitudes
+        [degree]
+    subsol_lon : ndarray of double
+        Array (one-dimensional) with regularly spaced subsolar longitudes
+        covering the full circle (e.g. -180.0, -174.0, ..., 174.0) [degree]
+    sw_dir_cor_max : double
+        Maximal allowed correction factor for direct downward shortwave
+        radiation (applied for encoding) [-]"""
+
+    # Check consistency and validity of input arguments
+    if sw_dir_cor.ndim != 4:
+        raise ValueError("array 'sw_dir_cor' must be four-dimensional")
+    if str(sw_dir_cor.dtype) not in lut_file_types:
+        raise TypeError("data type of sw_dir_cor must be 'float32', "
+                        + "'uint16' or 'uint8'")
+    if ((subsol_lat.ndim != 1) or (subsol_lon.ndim != 1)
+            or (sw_dir_cor.shape[2] != subsol_lat.size)
+            or (sw_dir_cor.shape[3] != subsol_lon.size)):
+        raise ValueError("shape of 'sw_dir_cor' is inconsistent with "
+                         + "'subsol_lat' and 'subsol_lon'")
+    lat_beg, lat_spac = _grid_spacing(subsol_lat, "subsol_lat")
+    lon_beg, lon_spac = _grid_spacing(subsol_lon, "subsol_lon")
+    if subsol_lon.size == 1:
+        lon_spac = 360.0
+    if abs(lon_spac * subsol_lon.size - 360.0) > 1e-4:
+        raise ValueError("'subsol_lon' must cover the full circle")
+
+    sw_dir_cor = np.ascontiguousarray(sw_dir_cor)
+    cdef LutFileHeader header
+    lut_header_init(header, sw_dir_cor.shape[0], sw_dir_cor.shape[1],
+                    subsol_lat.size, subsol_lon.size,
+                    lut_file_types[str(sw_dir_cor.dtype)], lat_beg, lat_spac,
+                    lon_beg, lon_spac, sw_dir_cor_max)
+    if not lut_file_save(file.encode("utf-8"), header,
+                         <const void*>sw_dir_cor.data):
+        raise IOError("writing lookup table file '" + file + "' failed")
+
+cdef class LookupTable:
+    """Memory-mapped subsolar lookup table (written by 'save_lookup_table')
+    that is evaluated for arbitrary subsolar points by bilinear
+    interpolation (periodic in longitude) without ray tracing. Pages of the
+    file are read on demand and shared between processes."""
+
+    cdef LutFileHeader header
+    cdef unsigned char* lut_map
+    cdef size_t map_size
+
+    def __cinit__(self, str file):
+        """Memory-map lookup table file.
+
+        Parameters
+        ----------
+        file : str
+            Path of lookup table file"""
+
+        self.lut_map = NULL
+        if not os.path.isfile(file):
+            raise ValueError("file '" + file + "' does not exist")
+        self.lut_map = lut_file_map(file.encode("utf-8"), self.header,
+                                    self.map_size)
+        if self.lut_map == NULL:
+            raise ValueError("'" + file + "' is not a valid lookup table "
+                             + "file")
+
+    def __dealloc__(self):
+        if self.lut_map != NULL:
+            lut_file_unmap(self.lut_map, self.map_size)
+
+    @property
+    def shape(self):
+        """Shape of lookup table (y, x, subsolar_lat, subsolar_lon)."""
+        return (self.header.num_gc_y, self.header.num_gc_x,
+                self.header.num_lat, self.header.num_lon)
+
+    @property
+    def subsolar_lat(self):
+        """Subsolar latitudes of lookup table [degree]."""
+        return self.header.lat_beg + self.header.lat_spac \
+            * np.arange(self.header.num_lat)
+
+    @property
+    def subsolar_lon(self):
+        """Subsolar longitudes of lookup table [degree]."""
+        return self.header.lon_beg + self.header.lon_spac \
+            * np.arange(self.header.num_lon)
+
+    def sw_dir_cor(self, subsol_lat, subsol_lon, int grain_size=16):
+        """Interpolate subgrid-scale correction factors for direct downward
+        shortwave radiation for a batch of subsolar points (e.g. computed
+        for all time steps of a simulation). Latitudes outside of the
+        lookup table are clamped to its range.
+
+        Parameters
+        ----------
+        subsol_lat : ndarray of double
+            Array (one-dimensional) with subsolar latitudes [degree]
+        subsol_lon : ndarray of double
+            Array (one-dimensional) with subsolar longitudes [degree]
+        grain_size : int
+            Minimal number of grid cells per task
+
+        Returns
+        -------
+        sw_dir_cor : ndarray of float
+            Array (three-dimensional) with shortwave correction factor
+            (num_sun, y, x) [-]; masked grid cells are NaN"""
+
+        # Check consistency and validity of input arguments
+        cdef np.ndarray[np.float64_t, ndim = 1] lat \
+            = np.ascontiguousarray(subsol_lat, dtype=np.float64).ravel()
+        cdef np.ndarray[np.float64_t, ndim = 1] lon \
+            = np.ascontiguousarray(subsol_lon, dtype=np.float64).ravel()
+        if lat.size != lon.size:
+            raise ValueError("'subsol_lat' and 'subsol_lon' have "
+                             + "inconsistent sizes")
+        if not (np.all(np.isfinite(lat)) and np.all(np.isfinite(lon))):
+            raise ValueError("subsolar points must be finite")
+        if grain_size < 1:
+            raise ValueError("value for 'grain_size' must be at least 1")
+
+        cdef np.ndarray[np.float32_t, ndim = 3, mode = "c"] sw_dir_cor \
+            = np.empty((lat.size, self.header.num_gc_y,
+                        self.header.num_gc_x), dtype=np.float32)
+        cdef size_t num_sun = lat.size
+        if (num_sun == 0) or (sw_dir_cor.size == 0):
+            return sw_dir_cor
+        with nogil:
+            lut_eval(self.header, self.lut_map + self.header.offset_data,
+                     &lat[0], &lon[0], num_sun, &sw_dir_cor[0, 0, 0],
+                     grain_size)
+        return sw_dir_cor
+
+# -----------------------------------------------------------------------------
+# Persistent scene
+# -----------------------------------------------------------------------------
+
+cdef class Scene:
+    """Committed Embree scene (BVH) of a Digital Elevation Model (DEM). The
+    scene can be passed to the functions of the modules 'rays' and 'horizon'
+    to avoid rebuilding the BVH for multiple computations on the same DEM."""
+
+    def __cinit__(self):
+        self.thisptr = new CppScene()
+        self.vert_grid = None
+        self.geom_type = None
+
+    def __dealloc__(self):
+        del self.thisptr
+
+    def initialise(self,
+                   np.ndarray[np.float32_t, ndim = 1] vert_grid,
+                   int dem_dim_0, int dem_dim_1,
+                   str geom_type="grid",
+                   str build_quality="medium",
+                   bint compact=False,
+                   bint robust=True):
+        """Build and commit scene from Digital Elevation Model (DEM) data.
+
+        Parameters
+        ----------
+        vert_grid : ndarray of float
+            Array (one-dimensional) with vertices of DEM in ENU coordinates
+            [metre]. The array is shared with the scene; the same array must
+            be passed to the functions reusing the scene.
+        dem_dim_0 : int
+            Dimension length of DEM in y-direction
+        dem_dim_1 : int
+            Dimension length of DEM in x-direction
+        geom_type : str
+            Embree geometry type (triangle, quad, grid) or heightfield
+        build_quality : str
+            Embree BVH build quality (low, medium, high). Higher quality
+            increases build time but can speed up ray tracing
+        compact : bool
+            Use compact BVH layout (less memory, slightly slower ray tracing)
+        robust : bool
+            Use robust ray-triangle intersection mode (avoids missed
+            intersections at shared edges, slightly slower)"""
+
+        # Check consistency and validity of input arguments
+        if len(vert_grid) < (dem_dim_0 * dem_dim_1 * 3):
+            raise ValueError("array 'vert_grid' has insufficient length")
+        if geom_type not in ("triangle", "quad", "grid", "heightfield"):
+            raise ValueError("invalid input argument for geom_type")
+        if build_quality not in ("low", "medium", "high"):
+            raise ValueError("invalid input argument for build_quality")
+
+        # Check size of input geometries
+        if (dem_dim_0 > 32767) or (dem_dim_1 > 32767):
+            raise ValueError("maximal allowed input length for dem_dim_0 and "
+                             "dem_dim_1 is 32'767")
+
+        # Ensure that passed array is contiguous in memory (and keep reference
+        # because vertex buffer is shared with Embree)
+        vert_grid = np.ascontiguousarray(vert_grid)
+        self.vert_grid = vert_grid
+        self.geom_type = geom_type
+
+        # Convert input strings to bytes
+        geom_type_c = geom_type.encode("utf-8")
+        build_quality_c = build_quality.encode("utf-8")
+
+        self.thisptr.initialise(&vert_grid[0], dem_dim_0, dem_dim_1,
+                                geom_type_c, build_quality_c,
+                                int(compact), int(robust))
+
+    cdef RTCScene get(self, vert_grid, int dem_dim_0, int dem_dim_1) \
+            except? NULL:
+        """Return committed scene after checking consistency with DEM."""
+
+        if self.vert_grid is None:
+            raise ValueError("scene is not initialised")
+        if ((vert_grid.ctypes.data != self.vert_grid.ctypes.data)
+                or (dem_dim_0 != self.thisptr.dem_dim_0_cl)
+                or (dem_dim_1 != self.thisptr.dem_dim_1_cl)):
+            raise ValueError("'scene' was not built from 'vert_grid'")
+        return self.thisptr.scene
+
 # -----------------------------------------------------------------------------
 # Default
 # -----------------------------------------------------------------------------
@@ -15,6 +434,7 @@ cdef extern from "rays_comp.h":
             int dem_dim_0, int dem_dim_1,
             float* vert_grid_in,
             int dem_dim_in_0, int dem_dim_in_1,
+            double radius_earth,
             double* sun_pos,
             int dim_sun_0, int dim_sun_1,
             float* sw_dir_cor,
@@ -23,8 +443,19 @@ cdef extern from "rays_comp.h":
             np.npy_uint8 * mask,
             double dist_search,
             char* geom_type,
+            RTCScene scene_ext,
+            char* build_quality,
+            int compact,
+            int robust,
+            int grain_size,
+            int cost_order,
+            int use_float32,
+            int refrac_cor,
             double sw_dir_cor_max,
-            double ang_max)
+            double ang_max,
+            int block_rows,
+            row_callback_t row_callback,
+            void* user_data)
 
 def sw_dir_cor(
         np.ndarray[np.float32_t, ndim = 1] vert_grid,
@@ -38,7 +469,19 @@ def sw_dir_cor(
         double dist_search=100.0,
         str geom_type="grid",
         double sw_dir_cor_max=25.0,
-        double ang_max=89.9):
+        double ang_max=89.9,
+        row_callback=None,
+        int block_rows=1,
+        str out_type="float32",
+        Scene scene=None,
+        str build_quality="medium",
+        bint compact=False,
+        bint robust=True,
+        int grain_size=1,
+        bint cost_order=False,
+        str precision="float64",
+        bint refrac_cor=False,
+        double radius_earth=6371229.0):
     """Compute subsolar lookup table of subgrid-scale correction factors
     for direct downward shortwave radiation.
 
@@ -50,9 +493,11 @@ def sw_dir_cor(
         Dimension length of DEM in y-direction
     dem_dim_1 : int
         Dimension length of DEM in x-direction
-    vert_grid_in : ndarray of float
+    vert_grid_in : ndarray of float or None
         Array (one-dimensional) with vertices of inner DEM with 0.0 m elevation
-        in ENU coordinates [metre]
+        in ENU coordinates [metre]. If None, the horizontal triangles are
+        computed analytically (radial projection of DEM triangles onto sphere
+        with radius 'radius_earth'; ENU origin on surface of sphere)
     dem_dim_in_0 : int
         Dimension length of inner DEM in y-direction
     dem_dim_in_1 : int
@@ -71,7 +516,7 @@ def sw_dir_cor(
     dist_search : double
         Search distance for topographic shadowing [kilometre]
     geom_type : str
-        Embree geometry type (triangle, quad, grid)
+        Embree geometry type (triangle, quad, grid) or heightfield
     sw_dir_cor_max : double
         Maximal allowed correction factor for direct downward shortwave
         radiation [-]
@@ -79,12 +524,57 @@ def sw_dir_cor(
         Maximal angle between sun vector and horizontal surface normal for
         which correction is computed. For larger angles, 'sw_dir_cor' is set
         to 0.0 [degree]
+    row_callback : callable, optional
+        Function called as row_callback(row_beg, sw_dir_cor_rows) for
+        finished blocks of grid cell rows (in ascending order). The array
+        'sw_dir_cor_rows' (num_rows, x, dim_sun_0, dim_sun_1) with
+        num_rows <= block_rows is only valid during the call and must be
+        copied or written to disk. If provided, no full lookup table is
+        allocated.
+    block_rows : int
+        Number of grid cell rows per block passed to 'row_callback'
+    out_type : str
+        Data type of output (float32, uint16, uint8). Correction factors are
+        accumulated in float32; for unsigned integer output, they are
+        encoded with the parameters from 'encoding_parameters()' (also
+        applies to blocks passed to 'row_callback')
+    scene : Scene, optional
+        Committed scene of 'vert_grid' (see class 'Scene'), which is reused
+        instead of building a new one ('geom_type', 'build_quality',
+        'compact' and 'robust' are then ignored)
+    build_quality : str
+        Embree BVH build quality (low, medium, high). Higher quality increases
+        build time but can speed up ray tracing
+    compact : bool
+        Use compact BVH layout (less memory, slightly slower ray tracing)
+    robust : bool
+        Use robust ray-triangle intersection mode (avoids missed intersections
+        at shared edges, slightly slower)
+    grain_size : int
+        Minimal number of grid cells per task. Active (non-masked) grid cells
+        are compacted into a list, which is distributed dynamically among
+        threads
+    cost_order : bool
+        Process grid cells in order of decreasing cost estimate (variance of
+        elevation) instead of tile-wise (-> better load balancing for
+        heterogeneous terrain)
+    precision : str
+        Floating-point precision of sun vectors and correction factors
+        (float64, float32). With float32, these are computed for all sun
+        positions of a triangle at once with SIMD instructions (AVX-512,
+        AVX2 or NEON; selected at runtime). float64 is the reference
+    refrac_cor : bool
+        Account for atmospheric refraction (precomputed lookup table of
+        refraction angles). Only supported with precision 'float64'
+        (otherwise True raises a ValueError)
+    radius_earth : double
+        Radius of Earth (only used if 'vert_grid_in' is None) [metre]
 
     Returns
     -------
-    sw_dir_cor : ndarray of float
+    sw_dir_cor : ndarray of float/uint16/uint8 or None
         Array (four-dimensional) with shortwave correction factor
-        (y, x, dim_sun_0, dim_sun_1) [-]
+        (y, x, dim_sun_0, dim_sun_1) [-]; None if 'row_callback' is provided
 
     References
     ----------
@@ -99,7 +589,10 @@ def sw_dir_cor(
                          + " 'dem_dim_in_?', 'offset_gc' and 'pixel_per_gc'")
     if len(vert_grid) < (dem_dim_0 * dem_dim_1 * 3):
         raise ValueError("array 'vert_grid' has insufficient length")
-    if len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
+    if vert_grid_in is None:
+        if radius_earth <= 0.0:
+            raise ValueError("'radius_earth' must be positive")
+    elif len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
         raise ValueError("array 'vert_grid_in' has insufficient length")
     if pixel_per_gc < 1:
         raise ValueError("value for 'pixel_per_gc' must be larger than 1")
@@ -115,12 +608,26 @@ def sw_dir_cor(
         raise TypeError("data type of mask must be 'uint8'")
     if dist_search < 0.1:
         raise ValueError("'dist_search' must be at least 100.0 m")
-    if geom_type not in ("triangle", "quad", "grid"):
+    if geom_type not in ("triangle", "quad", "grid", "heightfield"):
         raise ValueError("invalid input argument for geom_type")
+    if build_quality not in ("low", "medium", "high"):
+        raise ValueError("invalid input argument for build_quality")
+    if grain_size < 1:
+        raise ValueError("value for 'grain_size' must be at least 1")
     if (sw_dir_cor_max < 2.0) or (sw_dir_cor_max > 100.0):
         raise ValueError("'sw_dir_cor_max' must be in the range [2.0, 100.0]")
     if (ang_max < 89.0) or (ang_max >= 90.0):
         raise ValueError("'ang_max' must be in the range [89.0, <90.0]")
+    if (row_callback is not None) and (not callable(row_callback)):
+        raise TypeError("'row_callback' must be callable")
+    if block_rows < 1:
+        raise ValueError("value for 'block_rows' must be at least 1")
+    if out_type not in ("float32", "uint16", "uint8"):
+        raise ValueError("invalid input argument for out_type")
+    if precision not in ("float64", "float32"):
+        raise ValueError("invalid input argument for precision")
+    if precision != "float64":
+        _check_refrac(refrac_cor, "precision '" + precision + "'")
 
     # Check size of input geometries
     if (dem_dim_0 > 32767) or (dem_dim_1 > 32767):
@@ -129,39 +636,80 @@ def sw_dir_cor(
 
     # Ensure that passed arrays are contiguous in memory
     vert_grid = np.ascontiguousarray(vert_grid)
-    vert_grid_in = np.ascontiguousarray(vert_grid_in)
+    cdef float* vert_grid_in_ptr = NULL
+    if vert_grid_in is not None:
+        vert_grid_in = np.ascontiguousarray(vert_grid_in)
+        vert_grid_in_ptr = &vert_grid_in[0]
     sun_pos = np.ascontiguousarray(sun_pos)
 
+    # Reuse committed scene (optional)
+    cdef RTCScene scene_c = NULL
+    if scene is not None:
+        scene_c = scene.get(vert_grid, dem_dim_0, dem_dim_1)
+
     # Convert input strings to bytes
     geom_type_c = geom_type.encode("utf-8")
+    build_quality_c = build_quality.encode("utf-8")
 
     # Allocate array for shortwave correction factors
     cdef int len_in_0 = int((dem_dim_in_0 - 1) / pixel_per_gc)
     cdef int len_in_1 = int((dem_dim_in_1 - 1) / pixel_per_gc)
     cdef int dim_sun_0 = sun_pos.shape[0]
     cdef int dim_sun_1 = sun_pos.shape[1]
-    cdef np.ndarray[np.float32_t, ndim = 4, mode = "c"] \
+    cdef np.ndarray[np.float32_t, ndim = 4, mode = "c"] sw_dir_cor = None
+    cdef float* sw_dir_cor_ptr = NULL
+    cdef row_callback_t callback_c = NULL
+    context = None
+    if row_callback is None:
         sw_dir_cor = np.empty((len_in_0, len_in_1, dim_sun_0, dim_sun_1),
                               dtype=np.float32)
-    sw_dir_cor.fill(0.0)
-    # -> ensure that all elements of array 'sw_dir_cor' are 0.0 (crucial
-    # because subgrid correction values are iteratively added)
+        sw_dir_cor.fill(0.0)
+        # -> ensure that all elements of array 'sw_dir_cor' are 0.0
+        # (crucial because subgrid correction values are iteratively added)
+        sw_dir_cor_ptr = &sw_dir_cor[0, 0, 0, 0]
+    else:
+        # blocks are computed in buffers allocated by C++ code
+        if out_type != "float32":
+            row_callback = _encode_rows(row_callback, out_type,
+                                        sw_dir_cor_max)
+        context = [row_callback, (len_in_1, dim_sun_0, dim_sun_1), None]
+        callback_c = _row_callback
 
     sw_dir_cor_comp(
         &vert_grid[0],
         dem_dim_0, dem_dim_1,
-        &vert_grid_in[0],
+        vert_grid_in_ptr,
         dem_dim_in_0, dem_dim_in_1,
+        radius_earth,
         &sun_pos[0,0,0],
         dim_sun_0, dim_sun_1,
-        &sw_dir_cor[0,0,0,0],
+        sw_dir_cor_ptr,
         pixel_per_gc,
         offset_gc,
         &mask[0, 0],
         dist_search,
         geom_type_c,
+        scene_c,
+        build_quality_c,
+        int(compact),
+        int(robust),
+        grain_size,
+        int(cost_order),
+        int(precision == "float32"),
+        int(refrac_cor),
         sw_dir_cor_max,
-        ang_max)
+        ang_max,
+        block_rows,
+        callback_c,
+        <void*>context)
+
+    # Re-raise exception from callback function
+    if (context is not None) and (context[2] is not None):
+        raise context[2]
+
+    # Encode lookup table (optional)
+    if (sw_dir_cor is not None) and (out_type != "float32"):
+        return encode_sw_dir_cor(sw_dir_cor, out_type, sw_dir_cor_max)
 
     return sw_dir_cor
 
@@ -175,6 +723,7 @@ cdef extern from "rays_comp.h":
             int dem_dim_0, int dem_dim_1,
             float* vert_grid_in,
             int dem_dim_in_0, int dem_dim_in_1,
+            double radius_earth,
             double* sun_pos,
             int dim_sun_0, int dim_sun_1,
             float* sw_dir_cor,
@@ -183,8 +732,17 @@ cdef extern from "rays_comp.h":
             np.npy_uint8 * mask,
             double dist_search,
             char* geom_type,
+            RTCScene scene_ext,
+            char* build_quality,
+            int compact,
+            int robust,
+            int grain_size,
+            int cost_order,
             double sw_dir_cor_max,
-            double ang_max)
+            double ang_max,
+            int block_rows,
+            row_callback_t row_callback,
+            void* user_data)
 
 def sw_dir_cor_coherent(
         np.ndarray[np.float32_t, ndim = 1] vert_grid,
@@ -198,7 +756,18 @@ def sw_dir_cor_coherent(
         double dist_search=100.0,
         str geom_type="grid",
         double sw_dir_cor_max=25.0,
-        double ang_max=89.9):
+        double ang_max=89.9,
+        row_callback=None,
+        int block_rows=1,
+        str out_type="float32",
+        Scene scene=None,
+        str build_quality="medium",
+        bint compact=False,
+        bint robust=True,
+        int grain_size=1,
+        bint cost_order=False,
+        double radius_earth=6371229.0,
+        bint refrac_cor=False):
     """Compute subsolar lookup table of subgrid-scale correction factors
     for direct downward shortwave radiation (use coherent rays).
 
@@ -210,9 +779,11 @@ def sw_dir_cor_coherent(
         Dimension length of DEM in y-direction
     dem_dim_1 : int
         Dimension length of DEM in x-direction
-    vert_grid_in : ndarray of float
+    vert_grid_in : ndarray of float or None
         Array (one-dimensional) with vertices of inner DEM with 0.0 m elevation
-        in ENU coordinates [metre]
+        in ENU coordinates [metre]. If None, the horizontal triangles are
+        computed analytically (radial projection of DEM triangles onto sphere
+        with radius 'radius_earth'; ENU origin on surface of sphere)
     dem_dim_in_0 : int
         Dimension length of inner DEM in y-direction
     dem_dim_in_1 : int
@@ -231,7 +802,7 @@ def sw_dir_cor_coherent(
     dist_search : double
         Search distance for topographic shadowing [kilometre]
     geom_type : str
-        Embree geometry type (triangle, quad, grid)
+        Embree geometry type (triangle, quad, grid) or heightfield
     sw_dir_cor_max : double
         Maximal allowed correction factor for direct downward shortwave
         radiation [-]
@@ -239,12 +810,52 @@ def sw_dir_cor_coherent(
         Maximal angle between sun vector and horizontal surface normal for
         which correction is computed. For larger angles, 'sw_dir_cor' is set
         to 0.0 [degree]
+    row_callback : callable, optional
+        Function called as row_callback(row_beg, sw_dir_cor_rows) for
+        finished blocks of grid cell rows (in ascending order). The array
+        'sw_dir_cor_rows' (num_rows, x, dim_sun_0, dim_sun_1) with
+        num_rows <= block_rows is only valid during the call and must be
+        copied or written to disk. If provided, no full lookup table is
+        allocated.
+    block_rows : int
+        Number of grid cell rows per block passed to 'row_callback'
+    out_type : str
+        Data type of output (float32, uint16, uint8). Correction factors are
+        accumulated in float32; for unsigned integer output, they are
+        encoded with the parameters from 'encoding_parameters()' (also
+        applies to blocks passed to 'row_callback')
+    scene : Scene, optional
+        Committed scene of 'vert_grid' (see class 'Scene'), which is reused
+        instead of building a new one ('geom_type', 'build_quality',
+        'compact' and 'robust' are then ignored)
+    build_quality : str
+        Embree BVH build quality (low, medium, high). Higher quality increases
+        build time but can speed up ray tracing
+    compact : bool
+        Use compact BVH layout (less memory, slightly slower ray tracing)
+    robust : bool
+        Use robust ray-triangle intersection mode (avoids missed intersections
+        at shared edges, slightly slower)
+    grain_size : int
+        Minimal number of grid cells per task. Active (non-masked) grid cells
+        are compacted into a list, which is distributed dynamically among
+        threads
+    cost_order : bool
+        Process grid cells in order of decreasing cost estimate (variance of
+        elevation) instead of tile-wise (-> better load balancing for
+        heterogeneous terrain)
+    radius_earth : double
+        Radius of Earth (only used if 'vert_grid_in' is None) [metre]
 
+    refrac_cor : bool
+        Account for atmospheric refraction. Not supported by this kernel
+        (True raises a ValueError); use 'sw_dir_cor' (precision 'float64')
+        or 'sw_dir_cor_tiled'
     Returns
     -------
-    sw_dir_cor : ndarray of float
+    sw_dir_cor : ndarray of float/uint16/uint8 or None
         Array (four-dimensional) with shortwave correction factor
-        (y, x, dim_sun_0, dim_sun_1) [-]
+        (y, x, dim_sun_0, dim_sun_1) [-]; None if 'row_callback' is provided
 
     References
     ----------
@@ -259,7 +870,10 @@ def sw_dir_cor_coherent(
                          + " 'dem_dim_in_?', 'offset_gc' and 'pixel_per_gc'")
     if len(vert_grid) < (dem_dim_0 * dem_dim_1 * 3):
         raise ValueError("array 'vert_grid' has insufficient length")
-    if len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
+    if vert_grid_in is None:
+        if radius_earth <= 0.0:
+            raise ValueError("'radius_earth' must be positive")
+    elif len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
         raise ValueError("array 'vert_grid_in' has insufficient length")
     if pixel_per_gc < 1:
         raise ValueError("value for 'pixel_per_gc' must be larger than 1")
@@ -275,12 +889,23 @@ def sw_dir_cor_coherent(
         raise TypeError("data type of mask must be 'uint8'")
     if dist_search < 0.1:
         raise ValueError("'dist_search' must be at least 100.0 m")
-    if geom_type not in ("triangle", "quad", "grid"):
+    if geom_type not in ("triangle", "quad", "grid", "heightfield"):
         raise ValueError("invalid input argument for geom_type")
+    if build_quality not in ("low", "medium", "high"):
+        raise ValueError("invalid input argument for build_quality")
+    if grain_size < 1:
+        raise ValueError("value for 'grain_size' must be at least 1")
     if (sw_dir_cor_max < 2.0) or (sw_dir_cor_max > 100.0):
         raise ValueError("'sw_dir_cor_max' must be in the range [2.0, 100.0]")
     if (ang_max < 89.0) or (ang_max >= 90.0):
         raise ValueError("'ang_max' must be in the range [89.0, <90.0]")
+    if (row_callback is not None) and (not callable(row_callback)):
+        raise TypeError("'row_callback' must be callable")
+    if block_rows < 1:
+        raise ValueError("value for 'block_rows' must be at least 1")
+    if out_type not in ("float32", "uint16", "uint8"):
+        raise ValueError("invalid input argument for out_type")
+    _check_refrac(refrac_cor, "'sw_dir_cor_coherent'")
 
     # Check size of input geometries
     if (dem_dim_0 > 32767) or (dem_dim_1 > 32767):
@@ -289,37 +914,76 @@ def sw_dir_cor_coherent(
 
     # Ensure that passed arrays are contiguous in memory
     vert_grid = np.ascontiguousarray(vert_grid)
-    vert_grid_in = np.ascontiguousarray(vert_grid_in)
+    cdef float* vert_grid_in_ptr = NULL
+    if vert_grid_in is not None:
+        vert_grid_in = np.ascontiguousarray(vert_grid_in)
+        vert_grid_in_ptr = &vert_grid_in[0]
     sun_pos = np.ascontiguousarray(sun_pos)
 
+    # Reuse committed scene (optional)
+    cdef RTCScene scene_c = NULL
+    if scene is not None:
+        scene_c = scene.get(vert_grid, dem_dim_0, dem_dim_1)
+
     # Convert input strings to bytes
     geom_type_c = geom_type.encode("utf-8")
+    build_quality_c = build_quality.encode("utf-8")
 
     # Allocate array for shortwave correction factors
     cdef int len_in_0 = int((dem_dim_in_0 - 1) / pixel_per_gc)
     cdef int len_in_1 = int((dem_dim_in_1 - 1) / pixel_per_gc)
     cdef int dim_sun_0 = sun_pos.shape[0]
     cdef int dim_sun_1 = sun_pos.shape[1]
-    cdef np.ndarray[np.float32_t, ndim = 4, mode = "c"] \
+    cdef np.ndarray[np.float32_t, ndim = 4, mode = "c"] sw_dir_cor = None
+    cdef float* sw_dir_cor_ptr = NULL
+    cdef row_callback_t callback_c = NULL
+    context = None
+    if row_callback is None:
         sw_dir_cor = np.empty((len_in_0, len_in_1, dim_sun_0, dim_sun_1),
                               dtype=np.float32)
-    sw_dir_cor.fill(0.0)
+        sw_dir_cor.fill(0.0)
+        sw_dir_cor_ptr = &sw_dir_cor[0, 0, 0, 0]
+    else:
+        # blocks are computed in buffers allocated by C++ code
+        if out_type != "float32":
+            row_callback = _encode_rows(row_callback, out_type,
+                                        sw_dir_cor_max)
+        context = [row_callback, (len_in_1, dim_sun_0, dim_sun_1), None]
+        callback_c = _row_callback
 
     sw_dir_cor_comp_coherent(
         &vert_grid[0],
         dem_dim_0, dem_dim_1,
-        &vert_grid_in[0],
+        vert_grid_in_ptr,
         dem_dim_in_0, dem_dim_in_1,
+        radius_earth,
         &sun_pos[0,0,0],
         dim_sun_0, dim_sun_1,
-        &sw_dir_cor[0,0,0,0],
+        sw_dir_cor_ptr,
         pixel_per_gc,
         offset_gc,
         &mask[0, 0],
         dist_search,
         geom_type_c,
+        scene_c,
+        build_quality_c,
+        int(compact),
+        int(robust),
+        grain_size,
+        int(cost_order),
         sw_dir_cor_max,
-        ang_max)
+        ang_max,
+        block_rows,
+        callback_c,
+        <void*>context)
+
+    # Re-raise exception from callback function
+    if (context is not None) and (context[2] is not None):
+        raise context[2]
+
+    # Encode lookup table (optional)
+    if (sw_dir_cor is not None) and (out_type != "float32"):
+        return encode_sw_dir_cor(sw_dir_cor, out_type, sw_dir_cor_max)
 
     return sw_dir_cor
 
@@ -333,6 +997,7 @@ cdef extern from "rays_comp.h":
             int dem_dim_0, int dem_dim_1,
             float* vert_grid_in,
             int dem_dim_in_0, int dem_dim_in_1,
+            double radius_earth,
             double* sun_pos,
             int dim_sun_0, int dim_sun_1,
             float* sw_dir_cor,
@@ -341,8 +1006,17 @@ cdef extern from "rays_comp.h":
             np.npy_uint8 * mask,
             double dist_search,
             char* geom_type,
+            RTCScene scene_ext,
+            char* build_quality,
+            int compact,
+            int robust,
+            int grain_size,
+            int cost_order,
             double sw_dir_cor_max,
-            double ang_max)
+            double ang_max,
+            int block_rows,
+            row_callback_t row_callback,
+            void* user_data)
 
 def sw_dir_cor_coherent_rp8(
         np.ndarray[np.float32_t, ndim = 1] vert_grid,
@@ -356,7 +1030,18 @@ def sw_dir_cor_coherent_rp8(
         double dist_search=100.0,
         str geom_type="grid",
         double sw_dir_cor_max=25.0,
-        double ang_max=89.9):
+        double ang_max=89.9,
+        row_callback=None,
+        int block_rows=1,
+        str out_type="float32",
+        Scene scene=None,
+        str build_quality="medium",
+        bint compact=False,
+        bint robust=True,
+        int grain_size=1,
+        bint cost_order=False,
+        double radius_earth=6371229.0,
+        bint refrac_cor=False):
     """Compute subsolar lookup table of subgrid-scale correction factors
     for direct downward shortwave radiation (use coherent rays with packages
     of 8 rays).
@@ -369,9 +1054,11 @@ def sw_dir_cor_coherent_rp8(
         Dimension length of DEM in y-direction
     dem_dim_1 : int
         Dimension length of DEM in x-direction
-    vert_grid_in : ndarray of float
+    vert_grid_in : ndarray of float or None
         Array (one-dimensional) with vertices of inner DEM with 0.0 m elevation
-        in ENU coordinates [metre]
+        in ENU coordinates [metre]. If None, the horizontal triangles are
+        computed analytically (radial projection of DEM triangles onto sphere
+        with radius 'radius_earth'; ENU origin on surface of sphere)
     dem_dim_in_0 : int
         Dimension length of inner DEM in y-direction
     dem_dim_in_1 : int
@@ -390,7 +1077,7 @@ def sw_dir_cor_coherent_rp8(
     dist_search : double
         Search distance for topographic shadowing [kilometre]
     geom_type : str
-        Embree geometry type (triangle, quad, grid)
+        Embree geometry type (triangle, quad, grid) or heightfield
     sw_dir_cor_max : double
         Maximal allowed correction factor for direct downward shortwave
         radiation [-]
@@ -398,12 +1085,52 @@ def sw_dir_cor_coherent_rp8(
         Maximal angle between sun vector and horizontal surface normal for
         which correction is computed. For larger angles, 'sw_dir_cor' is set
         to 0.0 [degree]
+    row_callback : callable, optional
+        Function called as row_callback(row_beg, sw_dir_cor_rows) for
+        finished blocks of grid cell rows (in ascending order). The array
+        'sw_dir_cor_rows' (num_rows, x, dim_sun_0, dim_sun_1) with
+        num_rows <= block_rows is only valid during the call and must be
+        copied or written to disk. If provided, no full lookup table is
+        allocated.
+    block_rows : int
+        Number of grid cell rows per block passed to 'row_callback'
+    out_type : str
+        Data type of output (float32, uint16, uint8). Correction factors are
+        accumulated in float32; for unsigned integer output, they are
+        encoded with the parameters from 'encoding_parameters()' (also
+        applies to blocks passed to 'row_callback')
+    scene : Scene, optional
+        Committed scene of 'vert_grid' (see class 'Scene'), which is reused
+        instead of building a new one ('geom_type', 'build_quality',
+        'compact' and 'robust' are then ignored)
+    build_quality : str
+        Embree BVH build quality (low, medium, high). Higher quality increases
+        build time but can speed up ray tracing
+    compact : bool
+        Use compact BVH layout (less memory, slightly slower ray tracing)
+    robust : bool
+        Use robust ray-triangle intersection mode (avoids missed intersections
+        at shared edges, slightly slower)
+    grain_size : int
+        Minimal number of grid cells per task. Active (non-masked) grid cells
+        are compacted into a list, which is distributed dynamically among
+        threads
+    cost_order : bool
+        Process grid cells in order of decreasing cost estimate (variance of
+        elevation) instead of tile-wise (-> better load balancing for
+        heterogeneous terrain)
+    radius_earth : double
+        Radius of Earth (only used if 'vert_grid_in' is None) [metre]
 
+    refrac_cor : bool
+        Account for atmospheric refraction. Not supported by this kernel
+        (True raises a ValueError); use 'sw_dir_cor' (precision 'float64')
+        or 'sw_dir_cor_tiled'
     Returns
     -------
-    sw_dir_cor : ndarray of float
+    sw_dir_cor : ndarray of float/uint16/uint8 or None
         Array (four-dimensional) with shortwave correction factor
-        (y, x, dim_sun_0, dim_sun_1) [-]
+        (y, x, dim_sun_0, dim_sun_1) [-]; None if 'row_callback' is provided
 
     References
     ----------
@@ -418,7 +1145,10 @@ def sw_dir_cor_coherent_rp8(
                          + " 'dem_dim_in_?', 'offset_gc' and 'pixel_per_gc'")
     if len(vert_grid) < (dem_dim_0 * dem_dim_1 * 3):
         raise ValueError("array 'vert_grid' has insufficient length")
-    if len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
+    if vert_grid_in is None:
+        if radius_earth <= 0.0:
+            raise ValueError("'radius_earth' must be positive")
+    elif len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
         raise ValueError("array 'vert_grid_in' has insufficient length")
     if pixel_per_gc < 1:
         raise ValueError("value for 'pixel_per_gc' must be larger than 1")
@@ -437,12 +1167,23 @@ def sw_dir_cor_coherent_rp8(
         raise TypeError("data type of mask must be 'uint8'")
     if dist_search < 0.1:
         raise ValueError("'dist_search' must be at least 100.0 m")
-    if geom_type not in ("triangle", "quad", "grid"):
+    if geom_type not in ("triangle", "quad", "grid", "heightfield"):
         raise ValueError("invalid input argument for geom_type")
+    if build_quality not in ("low", "medium", "high"):
+        raise ValueError("invalid input argument for build_quality")
+    if grain_size < 1:
+        raise ValueError("value for 'grain_size' must be at least 1")
     if (sw_dir_cor_max < 2.0) or (sw_dir_cor_max > 100.0):
         raise ValueError("'sw_dir_cor_max' must be in the range [2.0, 100.0]")
     if (ang_max < 89.0) or (ang_max >= 90.0):
         raise ValueError("'ang_max' must be in the range [89.0, <90.0]")
+    if (row_callback is not None) and (not callable(row_callback)):
+        raise TypeError("'row_callback' must be callable")
+    if block_rows < 1:
+        raise ValueError("value for 'block_rows' must be at least 1")
+    if out_type not in ("float32", "uint16", "uint8"):
+        raise ValueError("invalid input argument for out_type")
+    _check_refrac(refrac_cor, "'sw_dir_cor_coherent_rp8'")
 
     # Check size of input geometries
     if (dem_dim_0 > 32767) or (dem_dim_1 > 32767):
@@ -451,38 +1192,1269 @@ def sw_dir_cor_coherent_rp8(
 
     # Ensure that passed arrays are contiguous in memory
     vert_grid = np.ascontiguousarray(vert_grid)
-    vert_grid_in = np.ascontiguousarray(vert_grid_in)
+    cdef float* vert_grid_in_ptr = NULL
+    if vert_grid_in is not None:
+        vert_grid_in = np.ascontiguousarray(vert_grid_in)
+        vert_grid_in_ptr = &vert_grid_in[0]
     sun_pos = np.ascontiguousarray(sun_pos)
 
+    # Reuse committed scene (optional)
+    cdef RTCScene scene_c = NULL
+    if scene is not None:
+        scene_c = scene.get(vert_grid, dem_dim_0, dem_dim_1)
+
     # Convert input strings to bytes
     geom_type_c = geom_type.encode("utf-8")
+    build_quality_c = build_quality.encode("utf-8")
 
     # Allocate array for shortwave correction factors
     cdef int len_in_0 = int((dem_dim_in_0 - 1) / pixel_per_gc)
     cdef int len_in_1 = int((dem_dim_in_1 - 1) / pixel_per_gc)
     cdef int dim_sun_0 = sun_pos.shape[0]
     cdef int dim_sun_1 = sun_pos.shape[1]
-    cdef np.ndarray[np.float32_t, ndim = 4, mode = "c"] \
+    cdef np.ndarray[np.float32_t, ndim = 4, mode = "c"] sw_dir_cor = None
+    cdef float* sw_dir_cor_ptr = NULL
+    cdef row_callback_t callback_c = NULL
+    context = None
+    if row_callback is None:
         sw_dir_cor = np.empty((len_in_0, len_in_1, dim_sun_0, dim_sun_1),
                               dtype=np.float32)
-    sw_dir_cor.fill(0.0)
-    # -> ensure that all elements of array 'sw_dir_cor' are 0.0 (crucial
-    # because subgrid correction values are iteratively added)
+        sw_dir_cor.fill(0.0)
+        # -> ensure that all elements of array 'sw_dir_cor' are 0.0
+        # (crucial because subgrid correction values are iteratively added)
+        sw_dir_cor_ptr = &sw_dir_cor[0, 0, 0, 0]
+    else:
+        # blocks are computed in buffers allocated by C++ code
+        if out_type != "float32":
+            row_callback = _encode_rows(row_callback, out_type,
+                                        sw_dir_cor_max)
+        context = [row_callback, (len_in_1, dim_sun_0, dim_sun_1), None]
+        callback_c = _row_callback
 
     sw_dir_cor_comp_coherent_rp8(
         &vert_grid[0],
         dem_dim_0, dem_dim_1,
-        &vert_grid_in[0],
+        vert_grid_in_ptr,
+        dem_dim_in_0, dem_dim_in_1,
+        radius_earth,
+        &sun_pos[0,0,0],
+        dim_sun_0, dim_sun_1,
+        sw_dir_cor_ptr,
+        pixel_per_gc,
+        offset_gc,
+        &mask[0, 0],
+        dist_search,
+        geom_type_c,
+        scene_c,
+        build_quality_c,
+        int(compact),
+        int(robust),
+        grain_size,
+        int(cost_order),
+        sw_dir_cor_max,
+        ang_max,
+        block_rows,
+        callback_c,
+        <void*>context)
+
+    # Re-raise exception from callback function
+    if (context is not None) and (context[2] is not None):
+        raise context[2]
+
+    # Encode lookup table (optional)
+    if (sw_dir_cor is not None) and (out_type != "float32"):
+        return encode_sw_dir_cor(sw_dir_cor, out_type, sw_dir_cor_max)
+
+    return sw_dir_cor
+
+# -----------------------------------------------------------------------------
+# Use coherent rays (streams of rays from multiple grid cells)
+# -----------------------------------------------------------------------------
+
+cdef extern from "rays_comp.h":
+    void sw_dir_cor_comp_stream(
+            float* vert_grid,
+            int dem_dim_0, int dem_dim_1,
+            float* vert_grid_in,
+            int dem_dim_in_0, int dem_dim_in_1,
+            double radius_earth,
+            double* sun_pos,
+            int dim_sun_0, int dim_sun_1,
+            float* sw_dir_cor,
+            int pixel_per_gc,
+            int offset_gc,
+            np.npy_uint8 * mask,
+            double dist_search,
+            char* geom_type,
+            RTCScene scene_ext,
+            char* build_quality,
+            int compact,
+            int robust,
+            int grain_size,
+            int cost_order,
+            double sw_dir_cor_max,
+            double ang_max,
+            int batch_size,
+            int block_rows,
+            row_callback_t row_callback,
+            void* user_data)
+
+def sw_dir_cor_stream(
+        np.ndarray[np.float32_t, ndim = 1] vert_grid,
+        int dem_dim_0, int dem_dim_1,
+        np.ndarray[np.float32_t, ndim = 1] vert_grid_in,
+        int dem_dim_in_0, int dem_dim_in_1,
+        np.ndarray[np.float64_t, ndim = 3] sun_pos,
+        int pixel_per_gc,
+        int offset_gc,
+        np.ndarray[np.uint8_t, ndim = 2] mask=None,
+        double dist_search=100.0,
+        str geom_type="grid",
+        double sw_dir_cor_max=25.0,
+        double ang_max=89.9,
+        int batch_size=4096,
+        row_callback=None,
+        int block_rows=1,
+        str out_type="float32",
+        Scene scene=None,
+        str build_quality="medium",
+        bint compact=False,
+        bint robust=True,
+        int grain_size=1,
+        bint cost_order=False,
+        double radius_earth=6371229.0,
+        bint refrac_cor=False):
+    """Compute subsolar lookup table of subgrid-scale correction factors
+    for direct downward shortwave radiation (use coherent rays, which are
+    gathered from multiple grid cells into per-thread streams).
+
+    Parameters
+    ----------
+    vert_grid : ndarray of float
+        Array (one-dimensional) with vertices of DEM in ENU coordinates [metre]
+    dem_dim_0 : int
+        Dimension length of DEM in y-direction
+    dem_dim_1 : int
+        Dimension length of DEM in x-direction
+    vert_grid_in : ndarray of float or None
+        Array (one-dimensional) with vertices of inner DEM with 0.0 m elevation
+        in ENU coordinates [metre]. If None, the horizontal triangles are
+        computed analytically (radial projection of DEM triangles onto sphere
+        with radius 'radius_earth'; ENU origin on surface of sphere)
+    dem_dim_in_0 : int
+        Dimension length of inner DEM in y-direction
+    dem_dim_in_1 : int
+        Dimension length of inner DEM in x-direction
+    sun_pos : ndarray of double
+        Array (three-dimensional) with sun positions in ENU coordinates
+        (dim_sun_0, dim_sun_1, 3) [metre]
+    pixel_per_gc : int
+        Number of subgrid pixels within one grid cell (along one dimension)
+    offset_gc : int
+        Offset number of grid cells
+    mask : ndarray of uint8
+        Array (two-dimensional) with grid cells for which 'sw_dir_cor' and
+        'sky_view_factor' are computed. Masked (0) grid cells are filled with
+        NaN.
+    dist_search : double
+        Search distance for topographic shadowing [kilometre]
+    geom_type : str
+        Embree geometry type (triangle, quad, grid) or heightfield
+    sw_dir_cor_max : double
+        Maximal allowed correction factor for direct downward shortwave
+        radiation [-]
+    ang_max : double
+        Maximal angle between sun vector and horizontal surface normal for
+        which correction is computed. For larger angles, 'sw_dir_cor' is set
+        to 0.0 [degree]
+    batch_size : int
+        Number of rays per stream, which are traced together (rays that
+        pass the self-shadowing checks are buffered per thread and traced
+        once the stream is full). Works for any 'pixel_per_gc' value
+    row_callback : callable, optional
+        Function called as row_callback(row_beg, sw_dir_cor_rows) for
+        finished blocks of grid cell rows (in ascending order). The array
+        'sw_dir_cor_rows' (num_rows, x, dim_sun_0, dim_sun_1) with
+        num_rows <= block_rows is only valid during the call and must be
+        copied or written to disk. If provided, no full lookup table is
+        allocated.
+    block_rows : int
+        Number of grid cell rows per block passed to 'row_callback'
+    out_type : str
+        Data type of output (float32, uint16, uint8). Correction factors are
+        accumulated in float32; for unsigned integer output, they are
+        encoded with the parameters from 'encoding_parameters()' (also
+        applies to blocks passed to 'row_callback')
+    scene : Scene, optional
+        Committed scene of 'vert_grid' (see class 'Scene'), which is reused
+        instead of building a new one ('geom_type', 'build_quality',
+        'compact' and 'robust' are then ignored)
+    build_quality : str
+        Embree BVH build quality (low, medium, high). Higher quality increases
+        build time but can speed up ray tracing
+    compact : bool
+        Use compact BVH layout (less memory, slightly slower ray tracing)
+    robust : bool
+        Use robust ray-triangle intersection mode (avoids missed intersections
+        at shared edges, slightly slower)
+    grain_size : int
+        Minimal number of grid cells per task. Active (non-masked) grid cells
+        are compacted into a list, which is distributed dynamically among
+        threads
+    cost_order : bool
+        Process grid cells in order of decreasing cost estimate (variance of
+        elevation) instead of tile-wise (-> better load balancing for
+        heterogeneous terrain)
+    radius_earth : double
+        Radius of Earth (only used if 'vert_grid_in' is None) [metre]
+
+    refrac_cor : bool
+        Account for atmospheric refraction. Not supported by this kernel
+        (True raises a ValueError); use 'sw_dir_cor' (precision 'float64')
+        or 'sw_dir_cor_tiled'
+    Returns
+    -------
+    sw_dir_cor : ndarray of float/uint16/uint8 or None
+        Array (four-dimensional) with shortwave correction factor
+        (y, x, dim_sun_0, dim_sun_1) [-]; None if 'row_callback' is provided
+
+    References
+    ----------
+    - Mueller, M. D., & Scherer, D. (2005): A Grid- and Subgrid-Scale
+    Radiation Parameterization of Topographic Effects for Mesoscale
+    Weather Forecast Models, Monthly Weather Review, 133(6), 1431-1442."""
+
+	# Check consistency and validity of input arguments
+    if ((dem_dim_0 != (2 * offset_gc * pixel_per_gc) + dem_dim_in_0)
+            or (dem_dim_1 != (2 * offset_gc * pixel_per_gc) + dem_dim_in_1)):
+        raise ValueError("Inconsistency between input arguments 'dem_dim_?',"
+                         + " 'dem_dim_in_?', 'offset_gc' and 'pixel_per_gc'")
+    if len(vert_grid) < (dem_dim_0 * dem_dim_1 * 3):
+        raise ValueError("array 'vert_grid' has insufficient length")
+    if vert_grid_in is None:
+        if radius_earth <= 0.0:
+            raise ValueError("'radius_earth' must be positive")
+    elif len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
+        raise ValueError("array 'vert_grid_in' has insufficient length")
+    if pixel_per_gc < 1:
+        raise ValueError("value for 'pixel_per_gc' must be larger than 1")
+    if offset_gc < 0:
+        raise ValueError("value for 'offset_gc' must be larger than 0")
+    num_gc_y = int((dem_dim_0 - 1) / pixel_per_gc) - 2 * offset_gc
+    num_gc_x = int((dem_dim_1 - 1) / pixel_per_gc) - 2 * offset_gc
+    if mask is None:
+        mask = np.ones((num_gc_y, num_gc_x), dtype=np.uint8)
+    if (mask.shape[0] != num_gc_y) or (mask.shape[1] != num_gc_x):
+        raise ValueError("shape of mask is inconsistent with other input")
+    if mask.dtype != "uint8":
+        raise TypeError("data type of mask must be 'uint8'")
+    if dist_search < 0.1:
+        raise ValueError("'dist_search' must be at least 100.0 m")
+    if geom_type not in ("triangle", "quad", "grid", "heightfield"):
+        raise ValueError("invalid input argument for geom_type")
+    if build_quality not in ("low", "medium", "high"):
+        raise ValueError("invalid input argument for build_quality")
+    if grain_size < 1:
+        raise ValueError("value for 'grain_size' must be at least 1")
+    if (sw_dir_cor_max < 2.0) or (sw_dir_cor_max > 100.0):
+        raise ValueError("'sw_dir_cor_max' must be in the range [2.0, 100.0]")
+    if (ang_max < 89.0) or (ang_max >= 90.0):
+        raise ValueError("'ang_max' must be in the range [89.0, <90.0]")
+    if batch_size < 1:
+        raise ValueError("value for 'batch_size' must be at least 1")
+    if (row_callback is not None) and (not callable(row_callback)):
+        raise TypeError("'row_callback' must be callable")
+    if block_rows < 1:
+        raise ValueError("value for 'block_rows' must be at least 1")
+    if out_type not in ("float32", "uint16", "uint8"):
+        raise ValueError("invalid input argument for out_type")
+    _check_refrac(refrac_cor, "'sw_dir_cor_stream'")
+
+    # Check size of input geometries
+    if (dem_dim_0 > 32767) or (dem_dim_1 > 32767):
+        raise ValueError("maximal allowed input length for dem_dim_0 and "
+                         "dem_dim_1 is 32'767")
+
+    # Ensure that passed arrays are contiguous in memory
+    vert_grid = np.ascontiguousarray(vert_grid)
+    cdef float* vert_grid_in_ptr = NULL
+    if vert_grid_in is not None:
+        vert_grid_in = np.ascontiguousarray(vert_grid_in)
+        vert_grid_in_ptr = &vert_grid_in[0]
+    sun_pos = np.ascontiguousarray(sun_pos)
+
+    # Reuse committed scene (optional)
+    cdef RTCScene scene_c = NULL
+    if scene is not None:
+        scene_c = scene.get(vert_grid, dem_dim_0, dem_dim_1)
+
+    # Convert input strings to bytes
+    geom_type_c = geom_type.encode("utf-8")
+    build_quality_c = build_quality.encode("utf-8")
+
+    # Allocate array for shortwave correction factors
+    cdef int len_in_0 = int((dem_dim_in_0 - 1) / pixel_per_gc)
+    cdef int len_in_1 = int((dem_dim_in_1 - 1) / pixel_per_gc)
+    cdef int dim_sun_0 = sun_pos.shape[0]
+    cdef int dim_sun_1 = sun_pos.shape[1]
+    cdef np.ndarray[np.float32_t, ndim = 4, mode = "c"] sw_dir_cor = None
+    cdef float* sw_dir_cor_ptr = NULL
+    cdef row_callback_t callback_c = NULL
+    context = None
+    if row_callback is None:
+        sw_dir_cor = np.empty((len_in_0, len_in_1, dim_sun_0, dim_sun_1),
+                              dtype=np.float32)
+        sw_dir_cor.fill(0.0)
+        # -> ensure that all elements of array 'sw_dir_cor' are 0.0
+        # (crucial because subgrid correction values are iteratively added)
+        sw_dir_cor_ptr = &sw_dir_cor[0, 0, 0, 0]
+    else:
+        # blocks are computed in buffers allocated by C++ code
+        if out_type != "float32":
+            row_callback = _encode_rows(row_callback, out_type,
+                                        sw_dir_cor_max)
+        context = [row_callback, (len_in_1, dim_sun_0, dim_sun_1), None]
+        callback_c = _row_callback
+
+    sw_dir_cor_comp_stream(
+        &vert_grid[0],
+        dem_dim_0, dem_dim_1,
+        vert_grid_in_ptr,
         dem_dim_in_0, dem_dim_in_1,
+        radius_earth,
         &sun_pos[0,0,0],
         dim_sun_0, dim_sun_1,
-        &sw_dir_cor[0,0,0,0],
+        sw_dir_cor_ptr,
         pixel_per_gc,
         offset_gc,
         &mask[0, 0],
         dist_search,
         geom_type_c,
+        scene_c,
+        build_quality_c,
+        int(compact),
+        int(robust),
+        grain_size,
+        int(cost_order),
         sw_dir_cor_max,
-        ang_max)
+        ang_max,
+        batch_size,
+        block_rows,
+        callback_c,
+        <void*>context)
+
+    # Re-raise exception from callback function
+    if (context is not None) and (context[2] is not None):
+        raise context[2]
+
+    # Encode lookup table (optional)
+    if (sw_dir_cor is not None) and (out_type != "float32"):
+        return encode_sw_dir_cor(sw_dir_cor, out_type, sw_dir_cor_max)
+
+    return sw_dir_cor
+
+# -----------------------------------------------------------------------------
+# Adaptive subsampling of triangles (error-controlled)
+# -----------------------------------------------------------------------------
+
+cdef extern from "rays_comp.h":
+    void sw_dir_cor_comp_adaptive(
+            float* vert_grid,
+            int dem_dim_0, int dem_dim_1,
+            float* vert_grid_in,
+            int dem_dim_in_0, int dem_dim_in_1,
+            double radius_earth,
+            double* sun_pos,
+            int dim_sun_0, int dim_sun_1,
+            float* sw_dir_cor,
+            float* sw_dir_cor_err,
+            int pixel_per_gc,
+            int offset_gc,
+            np.npy_uint8 * mask,
+            double dist_search,
+            char* geom_type,
+            RTCScene scene_ext,
+            char* build_quality,
+            int compact,
+            int robust,
+            int grain_size,
+            int cost_order,
+            double sw_dir_cor_max,
+            double ang_max,
+            int stride_max,
+            double err_tol)
+
+def sw_dir_cor_adaptive(
+        np.ndarray[np.float32_t, ndim = 1] vert_grid,
+        int dem_dim_0, int dem_dim_1,
+        np.ndarray[np.float32_t, ndim = 1] vert_grid_in,
+        int dem_dim_in_0, int dem_dim_in_1,
+        np.ndarray[np.float64_t, ndim = 3] sun_pos,
+        int pixel_per_gc,
+        int offset_gc,
+        np.ndarray[np.uint8_t, ndim = 2] mask=None,
+        double dist_search=100.0,
+        str geom_type="grid",
+        double sw_dir_cor_max=25.0,
+        double ang_max=89.9,
+        double err_tol=0.01,
+        int stride_max=4,
+        str out_type="float32",
+        Scene scene=None,
+        str build_quality="medium",
+        bint compact=False,
+        bint robust=True,
+        int grain_size=1,
+        bint cost_order=False,
+        double radius_earth=6371229.0,
+        bint refrac_cor=False):
+    """Compute subsolar lookup table of subgrid-scale correction factors
+    for direct downward shortwave radiation from an adaptive subsample of
+    the triangles of each grid cell.
+
+    Parameters
+    ----------
+    vert_grid : ndarray of float
+        Array (one-dimensional) with vertices of DEM in ENU coordinates [metre]
+    dem_dim_0 : int
+        Dimension length of DEM in y-direction
+    dem_dim_1 : int
+        Dimension length of DEM in x-direction
+    vert_grid_in : ndarray of float or None
+        Array (one-dimensional) with vertices of inner DEM with 0.0 m elevation
+        in ENU coordinates [metre]. If None, the horizontal triangles are
+        computed analytically (radial projection of DEM triangles onto sphere
+        with radius 'radius_earth'; ENU origin on surface of sphere)
+    dem_dim_in_0 : int
+        Dimension length of inner DEM in y-direction
+    dem_dim_in_1 : int
+        Dimension length of inner DEM in x-direction
+    sun_pos : ndarray of double
+        Array (three-dimensional) with sun positions in ENU coordinates
+        (dim_sun_0, dim_sun_1, 3) [metre]
+    pixel_per_gc : int
+        Number of subgrid pixels within one grid cell (along one dimension)
+    offset_gc : int
+        Offset number of grid cells
+    mask : ndarray of uint8
+        Array (two-dimensional) with grid cells for which 'sw_dir_cor' and
+        'sky_view_factor' are computed. Masked (0) grid cells are filled with
+        NaN.
+    dist_search : double
+        Search distance for topographic shadowing [kilometre]
+    geom_type : str
+        Embree geometry type (triangle, quad, grid) or heightfield
+    sw_dir_cor_max : double
+        Maximal allowed correction factor for direct downward shortwave
+        radiation [-]
+    ang_max : double
+        Maximal angle between sun vector and horizontal surface normal for
+        which correction is computed. For larger angles, 'sw_dir_cor' is set
+        to 0.0 [degree]
+    err_tol : double
+        Tolerance for the estimated standard error of the correction factor
+        of a grid cell (maximum over all sun positions) [-]. With 0.0, all
+        triangles are traced
+    stride_max : int
+        Maximal stride of initial sample [pixels]. The largest divisor of
+        'pixel_per_gc' not exceeding this value is used
+    out_type : str
+        Data type of output (float32, uint16, uint8). For unsigned integer
+        output, correction factors are encoded with the parameters from
+        'encoding_parameters()'
+    scene : Scene, optional
+        Committed scene of 'vert_grid' (see class 'Scene'), which is reused
+        instead of building a new one ('geom_type', 'build_quality',
+        'compact' and 'robust' are then ignored)
+    build_quality : str
+        Embree BVH build quality (low, medium, high). Higher quality increases
+        build time but can speed up ray tracing
+    compact : bool
+        Use compact BVH layout (less memory, slightly slower ray tracing)
+    robust : bool
+        Use robust ray-triangle intersection mode (avoids missed intersections
+        at shared edges, slightly slower)
+    grain_size : int
+        Minimal number of grid cells per task. Active (non-masked) grid cells
+        are compacted into a list, which is distributed dynamically among
+        threads
+    cost_order : bool
+        Process grid cells in order of decreasing cost estimate (variance of
+        elevation) instead of tile-wise (-> better load balancing for
+        heterogeneous terrain)
+    radius_earth : double
+        Radius of Earth (only used if 'vert_grid_in' is None) [metre]
+
+    refrac_cor : bool
+        Account for atmospheric refraction. Not supported by this kernel
+        (True raises a ValueError); use 'sw_dir_cor' (precision 'float64')
+        or 'sw_dir_cor_tiled'
+    Returns
+    -------
+    sw_dir_cor : ndarray of float/uint16/uint8
+        Array (four-dimensional) with shortwave correction factor
+        (y, x, dim_sun_0, dim_sun_1) [-]
+    sw_dir_cor_err : ndarray of float
+        Array (two-dimensional) with estimated standard error of
+        'sw_dir_cor' (maximum over all sun positions; 0.0 for grid cells
+        in which all triangles are traced) (y, x) [-]
+
+    Notes
+    -----
+    Pixels of a grid cell are first sampled on a regular lattice (the first
+    pixel of every 'stride' x 'stride' block; systematic sample). The stride
+    is refined (samples are reused) until the estimated standard error is
+    below 'err_tol' or all pixels are traced. The error estimate treats the
+    systematic sample as a simple random sample: it is conservative for
+    smooth terrain, but terrain varying periodically with the stride is
+    not detected."""
+
+	# Check consistency and validity of input arguments
+    if ((dem_dim_0 != (2 * offset_gc * pixel_per_gc) + dem_dim_in_0)
+            or (dem_dim_1 != (2 * offset_gc * pixel_per_gc) + dem_dim_in_1)):
+        raise ValueError("Inconsistency between input arguments 'dem_dim_?',"
+                         + " 'dem_dim_in_?', 'offset_gc' and 'pixel_per_gc'")
+    if len(vert_grid) < (dem_dim_0 * dem_dim_1 * 3):
+        raise ValueError("array 'vert_grid' has insufficient length")
+    if vert_grid_in is None:
+        if radius_earth <= 0.0:
+            raise ValueError("'radius_earth' must be positive")
+    elif len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
+        raise ValueError("array 'vert_grid_in' has insufficient length")
+    if pixel_per_gc < 1:
+        raise ValueError("value for 'pixel_per_gc' must be larger than 1")
+    if offset_gc < 0:
+        raise ValueError("value for 'offset_gc' must be larger than 0")
+    num_gc_y = int((dem_dim_0 - 1) / pixel_per_gc) - 2 * offset_gc
+    num_gc_x = int((dem_dim_1 - 1) / pixel_per_gc) - 2 * offset_gc
+    if mask is None:
+        mask = np.ones((num_gc_y, num_gc_x), dtype=np.uint8)
+    if (mask.shape[0] != num_gc_y) or (mask.shape[1] != num_gc_x):
+        raise ValueError("shape of mask is inconsistent with other input")
+    if mask.dtype != "uint8":
+        raise TypeError("data type of mask must be 'uint8'")
+    if dist_search < 0.1:
+        raise ValueError("'dist_search' must be at least 100.0 m")
+    if geom_type not in ("triangle", "quad", "grid", "heightfield"):
+        raise ValueError("invalid input argument for geom_type")
+    if build_quality not in ("low", "medium", "high"):
+        raise ValueError("invalid input argument for build_quality")
+    if grain_size < 1:
+        raise ValueError("value for 'grain_size' must be at least 1")
+    if (sw_dir_cor_max < 2.0) or (sw_dir_cor_max > 100.0):
+        raise ValueError("'sw_dir_cor_max' must be in the range [2.0, 100.0]")
+    if (ang_max < 89.0) or (ang_max >= 90.0):
+        raise ValueError("'ang_max' must be in the range [89.0, <90.0]")
+    if err_tol < 0.0:
+        raise ValueError("'err_tol' must be non-negative")
+    if stride_max < 1:
+        raise ValueError("value for 'stride_max' must be at least 1")
+    if out_type not in ("float32", "uint16", "uint8"):
+        raise ValueError("invalid input argument for out_type")
+    _check_refrac(refrac_cor, "'sw_dir_cor_adaptive'")
+
+    # Check size of input geometries
+    if (dem_dim_0 > 32767) or (dem_dim_1 > 32767):
+        raise ValueError("maximal allowed input length for dem_dim_0 and "
+                         "dem_dim_1 is 32'767")
+
+    # Ensure that passed arrays are contiguous in memory
+    vert_grid = np.ascontiguousarray(vert_grid)
+    cdef float* vert_grid_in_ptr = NULL
+    if vert_grid_in is not None:
+        vert_grid_in = np.ascontiguousarray(vert_grid_in)
+        vert_grid_in_ptr = &vert_grid_in[0]
+    sun_pos = np.ascontiguousarray(sun_pos)
+
+    # Reuse committed scene (optional)
+    cdef RTCScene scene_c = NULL
+    if scene is not None:
+        scene_c = scene.get(vert_grid, dem_dim_0, dem_dim_1)
+
+    # Convert input strings to bytes
+    geom_type_c = geom_type.encode("utf-8")
+    build_quality_c = build_quality.encode("utf-8")
+
+    # Allocate arrays for shortwave correction factors and their errors
+    # (all elements are set by C++ code)
+    cdef int len_in_0 = int((dem_dim_in_0 - 1) / pixel_per_gc)
+    cdef int len_in_1 = int((dem_dim_in_1 - 1) / pixel_per_gc)
+    cdef int dim_sun_0 = sun_pos.shape[0]
+    cdef int dim_sun_1 = sun_pos.shape[1]
+    cdef np.ndarray[np.float32_t, ndim = 4, mode = "c"] \
+        sw_dir_cor = np.empty((len_in_0, len_in_1, dim_sun_0, dim_sun_1),
+                              dtype=np.float32)
+    cdef np.ndarray[np.float32_t, ndim = 2, mode = "c"] \
+        sw_dir_cor_err = np.empty((len_in_0, len_in_1), dtype=np.float32)
+
+    sw_dir_cor_comp_adaptive(
+        &vert_grid[0],
+        dem_dim_0, dem_dim_1,
+        vert_grid_in_ptr,
+        dem_dim_in_0, dem_dim_in_1,
+        radius_earth,
+        &sun_pos[0,0,0],
+        dim_sun_0, dim_sun_1,
+        &sw_dir_cor[0, 0, 0, 0],
+        &sw_dir_cor_err[0, 0],
+        pixel_per_gc,
+        offset_gc,
+        &mask[0, 0],
+        dist_search,
+        geom_type_c,
+        scene_c,
+        build_quality_c,
+        int(compact),
+        int(robust),
+        grain_size,
+        int(cost_order),
+        sw_dir_cor_max,
+        ang_max,
+        stride_max,
+        err_tol)
+
+    # Encode lookup table (optional)
+    if out_type != "float32":
+        return (encode_sw_dir_cor(sw_dir_cor, out_type, sw_dir_cor_max),
+                sw_dir_cor_err)
+
+    return sw_dir_cor, sw_dir_cor_err
+
+# -----------------------------------------------------------------------------
+# Classification of sun positions with horizon bounds
+# -----------------------------------------------------------------------------
+
+cdef extern from "rays_comp.h":
+    void sw_dir_cor_comp_hori_bound(
+            float* vert_grid,
+            int dem_dim_0, int dem_dim_1,
+            float* vert_grid_in,
+            int dem_dim_in_0, int dem_dim_in_1,
+            double radius_earth,
+            double* sun_pos,
+            int dim_sun_0, int dim_sun_1,
+            float* sw_dir_cor,
+            int pixel_per_gc,
+            int offset_gc,
+            np.npy_uint8 * mask,
+            double dist_search,
+            char* geom_type,
+            RTCScene scene_ext,
+            char* build_quality,
+            int compact,
+            int robust,
+            int grain_size,
+            int cost_order,
+            double sw_dir_cor_max,
+            double ang_max,
+            int hori_azim_num,
+            double hori_acc,
+            char* ray_algorithm,
+            double elev_ang_low_lim,
+            double bound_margin,
+            int approx_shadow,
+            int block_rows,
+            row_callback_t row_callback,
+            void* user_data)
+
+def sw_dir_cor_hori_bound(
+        np.ndarray[np.float32_t, ndim = 1] vert_grid,
+        int dem_dim_0, int dem_dim_1,
+        np.ndarray[np.float32_t, ndim = 1] vert_grid_in,
+        int dem_dim_in_0, int dem_dim_in_1,
+        np.ndarray[np.float64_t, ndim = 3] sun_pos,
+        int pixel_per_gc,
+        int offset_gc,
+        np.ndarray[np.uint8_t, ndim = 2] mask=None,
+        double dist_search=100.0,
+        str geom_type="grid",
+        double sw_dir_cor_max=25.0,
+        double ang_max=89.9,
+        int hori_azim_num=16,
+        double hori_acc=0.25,
+        str ray_algorithm="binary_search",
+        double elev_ang_low_lim=-15.0,
+        double bound_margin=2.0,
+        bint approx_shadow=False,
+        row_callback=None,
+        int block_rows=1,
+        str out_type="float32",
+        Scene scene=None,
+        str build_quality="medium",
+        bint compact=False,
+        bint robust=True,
+        int grain_size=1,
+        bint cost_order=False,
+        double radius_earth=6371229.0,
+        bint refrac_cor=False):
+    """Compute subsolar lookup table of subgrid-scale correction factors
+    for direct downward shortwave radiation (sun positions are classified
+    with horizon bounds; only ambiguous sun positions are ray traced).
+
+    For every triangle, an upper bound of the horizon is computed for
+    'hori_azim_num' azimuth sectors from a quadtree of the DEM (bounding
+    boxes of distant terrain, exact triangles of nearby terrain; no rays).
+    This bound is guaranteed: sun positions above it are lit and are not
+    ray traced, the result is identical to 'sw_dir_cor'. All other sun
+    positions are ray traced.
+
+    With 'approx_shadow', a coarse horizon is additionally ray traced in the
+    'hori_azim_num' azimuth directions and sun positions below the minimum of
+    the two horizon elevations enclosing their azimuth sector (minus
+    'bound_margin') are classified as shadowed without ray tracing. This
+    lower bound is approximate: terrain features narrower than an azimuth
+    sector, which are lower than the traced horizon by more than
+    'bound_margin', are misclassified as shadowed.
+
+    Parameters
+    ----------
+    vert_grid : ndarray of float
+        Array (one-dimensional) with vertices of DEM in ENU coordinates [metre]
+    dem_dim_0 : int
+        Dimension length of DEM in y-direction
+    dem_dim_1 : int
+        Dimension length of DEM in x-direction
+    vert_grid_in : ndarray of float or None
+        Array (one-dimensional) with vertices of inner DEM with 0.0 m elevation
+        in ENU coordinates [metre]. If None, the horizontal triangles are
+        computed analytically (radial projection of DEM triangles onto sphere
+        with radius 'radius_earth'; ENU origin on surface of sphere)
+    dem_dim_in_0 : int
+        Dimension length of inner DEM in y-direction
+    dem_dim_in_1 : int
+        Dimension length of inner DEM in x-direction
+    sun_pos : ndarray of double
+        Array (three-dimensional) with sun positions in ENU coordinates
+        (dim_sun_0, dim_sun_1, 3) [metre]
+    pixel_per_gc : int
+        Number of subgrid pixels within one grid cell (along one dimension)
+    offset_gc : int
+        Offset number of grid cells
+    mask : ndarray of uint8
+        Array (two-dimensional) with grid cells for which 'sw_dir_cor' and
+        'sky_view_factor' are computed. Masked (0) grid cells are filled with
+        NaN.
+    dist_search : double
+        Search distance for topographic shadowing [kilometre]
+    geom_type : str
+        Embree geometry type (triangle, quad, grid) or heightfield
+    sw_dir_cor_max : double
+        Maximal allowed correction factor for direct downward shortwave
+        radiation [-]
+    ang_max : double
+        Maximal angle between sun vector and horizontal surface normal for
+        which correction is computed. For larger angles, 'sw_dir_cor' is set
+        to 0.0 [degree]
+    hori_azim_num : int
+        Number of azimuth sectors of horizon bounds
+    hori_acc : double
+        Accuracy of traced horizon (only with 'approx_shadow') [degree]
+    ray_algorithm : str
+        Algorithm for traced horizon (discrete_sampling, binary_search,
+        binary_search_packet4, binary_search_packet, binary_search_packet16;
+        only with 'approx_shadow')
+    elev_ang_low_lim : double
+        Lower limit for elevation angle search of traced horizon (only with
+        'approx_shadow') [degree]
+    bound_margin : double
+        Margin subtracted from traced horizon (must be at least 'hori_acc';
+        only with 'approx_shadow') [degree]
+    approx_shadow : bool
+        Classify sun positions below the traced horizon as shadowed
+        (approximate, see above)
+    row_callback : callable, optional
+        Function called as row_callback(row_beg, sw_dir_cor_rows) for
+        finished blocks of grid cell rows (in ascending order). The array
+        'sw_dir_cor_rows' (num_rows, x, dim_sun_0, dim_sun_1) with
+        num_rows <= block_rows is only valid during the call and must be
+        copied or written to disk. If provided, no full lookup table is
+        allocated.
+    block_rows : int
+        Number of grid cell rows per block passed to 'row_callback'
+    out_type : str
+        Data type of output (float32, uint16, uint8). Correction factors are
+        accumulated in float32; for unsigned integer output, they are
+        encoded with the parameters from 'encoding_parameters()' (also
+        applies to blocks passed to 'row_callback')
+    scene : Scene, optional
+        Committed scene of 'vert_grid' (see class 'Scene'), which is reused
+        instead of building a new one ('geom_type', 'build_quality',
+        'compact' and 'robust' are then ignored)
+    build_quality : str
+        Embree BVH build quality (low, medium, high). Higher quality increases
+        build time but can speed up ray tracing
+    compact : bool
+        Use compact BVH layout (less memory, slightly slower ray tracing)
+    robust : bool
+        Use robust ray-triangle intersection mode (avoids missed intersections
+        at shared edges, slightly slower)
+    grain_size : int
+        Minimal number of grid cells per task. Active (non-masked) grid cells
+        are compacted into a list, which is distributed dynamically among
+        threads
+    cost_order : bool
+        Process grid cells in order of decreasing cost estimate (variance of
+        elevation) instead of tile-wise (-> better load balancing for
+        heterogeneous terrain)
+    radius_earth : double
+        Radius of Earth (only used if 'vert_grid_in' is None) [metre]
+
+    refrac_cor : bool
+        Account for atmospheric refraction. Not supported by this kernel
+        (True raises a ValueError); use 'sw_dir_cor' (precision 'float64')
+        or 'sw_dir_cor_tiled'
+    Returns
+    -------
+    sw_dir_cor : ndarray of float/uint16/uint8 or None
+        Array (four-dimensional) with shortwave correction factor
+        (y, x, dim_sun_0, dim_sun_1) [-]; None if 'row_callback' is provided
+
+    References
+    ----------
+    - Mueller, M. D., & Scherer, D. (2005): A Grid- and Subgrid-Scale
+    Radiation Parameterization of Topographic Effects for Mesoscale
+    Weather Forecast Models, Monthly Weather Review, 133(6), 1431-1442."""
+
+	# Check consistency and validity of input arguments
+    if ((dem_dim_0 != (2 * offset_gc * pixel_per_gc) + dem_dim_in_0)
+            or (dem_dim_1 != (2 * offset_gc * pixel_per_gc) + dem_dim_in_1)):
+        raise ValueError("Inconsistency between input arguments 'dem_dim_?',"
+                         + " 'dem_dim_in_?', 'offset_gc' and 'pixel_per_gc'")
+    if len(vert_grid) < (dem_dim_0 * dem_dim_1 * 3):
+        raise ValueError("array 'vert_grid' has insufficient length")
+    if vert_grid_in is None:
+        if radius_earth <= 0.0:
+            raise ValueError("'radius_earth' must be positive")
+    elif len(vert_grid_in) < (dem_dim_in_0 * dem_dim_in_1 * 3):
+        raise ValueError("array 'vert_grid_in' has insufficient length")
+    if pixel_per_gc < 1:
+        raise ValueError("value for 'pixel_per_gc' must be larger than 1")
+    if offset_gc < 0:
+        raise ValueError("value for 'offset_gc' must be larger than 0")
+    num_gc_y = int((dem_dim_0 - 1) / pixel_per_gc) - 2 * offset_gc
+    num_gc_x = int((dem_dim_1 - 1) / pixel_per_gc) - 2 * offset_gc
+    if mask is None:
+        mask = np.ones((num_gc_y, num_gc_x), dtype=np.uint8)
+    if (mask.shape[0] != num_gc_y) or (mask.shape[1] != num_gc_x):
+        raise ValueError("shape of mask is inconsistent with other input")
+    if mask.dtype != "uint8":
+        raise TypeError("data type of mask must be 'uint8'")
+    if dist_search < 0.1:
+        raise ValueError("'dist_search' must be at least 100.0 m")
+    if geom_type not in ("triangle", "quad", "grid", "heightfield"):
+        raise ValueError("invalid input argument for geom_type")
+    if build_quality not in ("low", "medium", "high"):
+        raise ValueError("invalid input argument for build_quality")
+    if grain_size < 1:
+        raise ValueError("value for 'grain_size' must be at least 1")
+    if (sw_dir_cor_max < 2.0) or (sw_dir_cor_max > 100.0):
+        raise ValueError("'sw_dir_cor_max' must be in the range [2.0, 100.0]")
+    if (ang_max < 89.0) or (ang_max >= 90.0):
+        raise ValueError("'ang_max' must be in the range [89.0, <90.0]")
+    if hori_azim_num < 4:
+        raise ValueError("value for 'hori_azim_num' must be at least 4")
+    if (hori_acc < 0.05) or (hori_acc > 10.0):
+        raise ValueError("'hori_acc' must be in the range [0.05, 10.0]")
+    if (ray_algorithm not in ray_algorithms) \
+            or (ray_algorithm == "guess_constant"):
+        raise ValueError("invalid input argument for ray_algorithm")
+    if (elev_ang_low_lim < -85.0) or (elev_ang_low_lim > 0.0):
+        raise ValueError("'elev_ang_low_lim' must be in the range "
+                         "[-85.0, 0.0]")
+    if approx_shadow and (bound_margin < hori_acc):
+        raise ValueError("'bound_margin' must be at least 'hori_acc'")
+    if (row_callback is not None) and (not callable(row_callback)):
+        raise TypeError("'row_callback' must be callable")
+    if block_rows < 1:
+        raise ValueError("value for 'block_rows' must be at least 1")
+    if out_type not in ("float32", "uint16", "uint8"):
+        raise ValueError("invalid input argument for out_type")
+    _check_refrac(refrac_cor, "'sw_dir_cor_hori_bound'")
+
+    # Check size of input geometries
+    if (dem_dim_0 > 32767) or (dem_dim_1 > 32767):
+        raise ValueError("maximal allowed input length for dem_dim_0 and "
+                         "dem_dim_1 is 32'767")
+
+    # Ensure that passed arrays are contiguous in memory
+    vert_grid = np.ascontiguousarray(vert_grid)
+    cdef float* vert_grid_in_ptr = NULL
+    if vert_grid_in is not None:
+        vert_grid_in = np.ascontiguousarray(vert_grid_in)
+        vert_grid_in_ptr = &vert_grid_in[0]
+    sun_pos = np.ascontiguousarray(sun_pos)
+
+    # Reuse committed scene (optional)
+    cdef RTCScene scene_c = NULL
+    if scene is not None:
+        scene_c = scene.get(vert_grid, dem_dim_0, dem_dim_1)
+
+    # Convert input strings to bytes
+    geom_type_c = geom_type.encode("utf-8")
+    build_quality_c = build_quality.encode("utf-8")
+    ray_algorithm_c = ray_algorithm.encode("utf-8")
+
+    # Allocate array for shortwave correction factors
+    cdef int len_in_0 = int((dem_dim_in_0 - 1) / pixel_per_gc)
+    cdef int len_in_1 = int((dem_dim_in_1 - 1) / pixel_per_gc)
+    cdef int dim_sun_0 = sun_pos.shape[0]
+    cdef int dim_sun_1 = sun_pos.shape[1]
+    cdef np.ndarray[np.float32_t, ndim = 4, mode = "c"] sw_dir_cor = None
+    cdef float* sw_dir_cor_ptr = NULL
+    cdef row_callback_t callback_c = NULL
+    context = None
+    if row_callback is None:
+        sw_dir_cor = np.empty((len_in_0, len_in_1, dim_sun_0, dim_sun_1),
+                              dtype=np.float32)
+        sw_dir_cor.fill(0.0)
+        sw_dir_cor_ptr = &sw_dir_cor[0, 0, 0, 0]
+    else:
+        # blocks are computed in buffers allocated by C++ code
+        if out_type != "float32":
+            row_callback = _encode_rows(row_callback, out_type,
+                                        sw_dir_cor_max)
+        context = [row_callback, (len_in_1, dim_sun_0, dim_sun_1), None]
+        callback_c = _row_callback
+
+    sw_dir_cor_comp_hori_bound(
+        &vert_grid[0],
+        dem_dim_0, dem_dim_1,
+        vert_grid_in_ptr,
+        dem_dim_in_0, dem_dim_in_1,
+        radius_earth,
+        &sun_pos[0,0,0],
+        dim_sun_0, dim_sun_1,
+        sw_dir_cor_ptr,
+        pixel_per_gc,
+        offset_gc,
+        &mask[0, 0],
+        dist_search,
+        geom_type_c,
+        scene_c,
+        build_quality_c,
+        int(compact),
+        int(robust),
+        grain_size,
+        int(cost_order),
+        sw_dir_cor_max,
+        ang_max,
+        hori_azim_num,
+        hori_acc,
+        ray_algorithm_c,
+        elev_ang_low_lim,
+        bound_margin,
+        int(approx_shadow),
+        block_rows,
+        callback_c,
+        <void*>context)
+
+    # Re-raise exception from callback function
+    if (context is not None) and (context[2] is not None):
+        raise context[2]
+
+    # Encode lookup table (optional)
+    if (sw_dir_cor is not None) and (out_type != "float32"):
+        return encode_sw_dir_cor(sw_dir_cor, out_type, sw_dir_cor_max)
+
+    return sw_dir_cor
+
+# -----------------------------------------------------------------------------
+# Out-of-core tiling
+# -----------------------------------------------------------------------------
+
+cdef extern from "rays_comp.h":
+    ctypedef int (*tile_load_t)(int gc_y_beg, int gc_y_end, int gc_x_beg,
+                                int gc_x_end, float* vert_grid,
+                                float* vert_grid_in, double* sun_pos,
+                                void* user_data)
+    ctypedef void (*tile_store_t)(int gc_y_beg, int gc_y_end, int gc_x_beg,
+                                  int gc_x_end, float* sw_dir_cor,
+                                  void* user_data)
+    void sw_dir_cor_comp_tiled(
+            int num_gc_y, int num_gc_x,
+            double radius_earth,
+            int dim_sun_0, int dim_sun_1,
+            float* sw_dir_cor,
+            int pixel_per_gc,
+            int offset_gc,
+            np.npy_uint8 * mask,
+            double dist_search,
+            char* geom_type,
+            char* build_quality,
+            int compact,
+            int robust,
+            int grain_size,
+            int cost_order,
+            int refrac_cor,
+            double sw_dir_cor_max,
+            double ang_max,
+            double mem_budget,
+            tile_load_t tile_load_cb,
+            tile_store_t tile_store_cb,
+            void* user_data)
+
+cdef int _tile_load(int gc_y_beg, int gc_y_end, int gc_x_beg, int gc_x_end,
+                    float* vert_grid, float* vert_grid_in, double* sun_pos,
+                    void* user_data) noexcept with gil:
+    """Copy DEM data of tile from Python function into buffers of C++ code.
+    Exceptions are stored in the context and abort the computation."""
+
+    context = <object>user_data
+    if context[3] is not None:
+        return 1
+    cdef int pixel_per_gc = context[2][0]
+    cdef int offset_gc = context[2][1]
+    cdef int num_sun = context[2][2] * context[2][3]
+    cdef int dem_dim_in_0 = (gc_y_end - gc_y_beg) * pixel_per_gc + 1
+    cdef int dem_dim_in_1 = (gc_x_end - gc_x_beg) * pixel_per_gc + 1
+    cdef int dem_dim_0 = dem_dim_in_0 + 2 * offset_gc * pixel_per_gc
+    cdef int dem_dim_1 = dem_dim_in_1 + 2 * offset_gc * pixel_per_gc
+    cdef float[::1] vert_grid_buf = \
+        <float[:(dem_dim_0 * dem_dim_1 * 3)]> vert_grid
+    cdef float[::1] vert_grid_in_buf = None
+    if vert_grid_in != NULL:
+        # (NULL -> horizontal triangles are computed analytically)
+        vert_grid_in_buf = \
+            <float[:(dem_dim_in_0 * dem_dim_in_1 * 3)]> vert_grid_in
+    cdef double[::1] sun_pos_buf = <double[:(num_sun * 3)]> sun_pos
+    try:
+        vert_grid_t, vert_grid_in_t, sun_pos_t \
+            = context[0](gc_y_beg, gc_y_end, gc_x_beg, gc_x_end)
+        vert_grid_t = np.asarray(vert_grid_t, dtype=np.float32).ravel()
+        sun_pos_t = np.asarray(sun_pos_t, dtype=np.float64).ravel()
+        if len(vert_grid_t) < (dem_dim_0 * dem_dim_1 * 3):
+            raise ValueError("array 'vert_grid' of tile has insufficient "
+                             + "length")
+        if len(sun_pos_t) != (num_sun * 3):
+            raise ValueError("shape of 'sun_pos' of tile is inconsistent "
+                             + "with 'dim_sun_0' and 'dim_sun_1'")
+        np.asarray(vert_grid_buf)[:] \
+            = vert_grid_t[:(dem_dim_0 * dem_dim_1 * 3)]
+        if vert_grid_in != NULL:
+            vert_grid_in_t = np.asarray(vert_grid_in_t,
+                                        dtype=np.float32).ravel()
+            if len(vert_grid_in_t) < (dem_dim_in_0 * dem_dim_in_1 * 3):
+                raise ValueError("array 'vert_grid_in' of tile has "
+                                 + "insufficient length")
+            np.asarray(vert_grid_in_buf)[:] \
+                = vert_grid_in_t[:(dem_dim_in_0 * dem_dim_in_1 * 3)]
+        np.asarray(sun_pos_buf)[:] = sun_pos_t
+    except BaseException as err:
+        context[3] = err
+        return 1
+    return 0
+
+cdef void _tile_store(int gc_y_beg, int gc_y_end, int gc_x_beg, int gc_x_end,
+                      float* sw_dir_cor, void* user_data) noexcept with gil:
+    """Pass lookup table of tile (buffer of C++ code) to Python function.
+    Exceptions are stored in the context and remaining tiles are skipped."""
+
+    context = <object>user_data
+    if (context[3] is not None) or (context[1] is None):
+        return
+    cdef int dim_sun_0 = context[2][2]
+    cdef int dim_sun_1 = context[2][3]
+    cdef float[:, :, :, ::1] sw_dir_cor_tile = \
+        <float[:(gc_y_end - gc_y_beg), :(gc_x_end - gc_x_beg), :dim_sun_0,
+        :dim_sun_1]> sw_dir_cor
+    try:
+        context[1](gc_y_beg, gc_x_beg, np.asarray(sw_dir_cor_tile))
+    except BaseException as err:
+        context[3] = err
+
+def sw_dir_cor_tiled(
+        tile_loader,
+        int num_gc_y, int num_gc_x,
+        int dim_sun_0, int dim_sun_1,
+        int pixel_per_gc,
+        int offset_gc,
+        np.ndarray[np.uint8_t, ndim = 2] mask=None,
+        double dist_search=100.0,
+        str geom_type="grid",
+        double sw_dir_cor_max=25.0,
+        double ang_max=89.9,
+        double mem_budget=4.0,
+        tile_writer=None,
+        str out_type="float32",
+        str build_quality="medium",
+        bint compact=False,
+        bint robust=True,
+        int grain_size=1,
+        bint cost_order=False,
+        radius_earth=None,
+        bint refrac_cor=False):
+    """Compute subsolar lookup table of subgrid-scale correction factors
+    for direct downward shortwave radiation tile-wise (out-of-core). The
+    domain is split into square tiles (each with a halo of 'offset_gc' grid
+    cells) that fit into the memory budget. DEM data is loaded tile by tile;
+    the next tile is loaded and its scene built while the current tile is
+    traced.
+
+    Parameters
+    ----------
+    tile_loader : callable
+        Function called as tile_loader(gc_y_beg, gc_y_end, gc_x_beg,
+        gc_x_end) returning the tuple (vert_grid, vert_grid_in, sun_pos) of
+        the tile with the grid cells [gc_y_beg, gc_y_end) x [gc_x_beg,
+        gc_x_end) of the inner domain. 'vert_grid' contains the vertices of
+        the tile DEM including the halo, 'vert_grid_in' the vertices of the
+        inner tile DEM with 0.0 m elevation and 'sun_pos' (dim_sun_0,
+        dim_sun_1, 3) the sun positions (all in ENU coordinates of the tile)
+        [metre]. 'vert_grid_in' is ignored (can be None) if 'radius_earth'
+        is provided
+    num_gc_y : int
+        Number of grid cells of inner domain in y-direction
+    num_gc_x : int
+        Number of grid cells of inner domain in x-direction
+    dim_sun_0 : int
+        Number of sun positions along first dimension
+    dim_sun_1 : int
+        Number of sun positions along second dimension
+    pixel_per_gc : int
+        Number of subgrid pixels within one grid cell (along one dimension)
+    offset_gc : int
+        Offset number of grid cells (halo of tiles)
+    mask : ndarray of uint8
+        Array (two-dimensional) with grid cells for which 'sw_dir_cor' is
+        computed. Masked (0) grid cells are filled with NaN.
+    dist_search : double
+        Search distance for topographic shadowing [kilometre]. Terrain
+        outside of the halo of a tile is ignored
+    geom_type : str
+        Embree geometry type (triangle, quad, grid) or heightfield
+    sw_dir_cor_max : double
+        Maximal allowed correction factor for direct downward shortwave
+        radiation [-]
+    ang_max : double
+        Maximal angle between sun vector and horizontal surface normal for
+        which correction is computed. For larger angles, 'sw_dir_cor' is set
+        to 0.0 [degree]
+    mem_budget : double
+        Memory budget for DEM data, BVH and output of (two) tiles [GB]
+    tile_writer : callable, optional
+        Function called as tile_writer(gc_y_beg, gc_x_beg, sw_dir_cor_tile)
+        for finished tiles. The array 'sw_dir_cor_tile' (y, x, dim_sun_0,
+        dim_sun_1) is only valid during the call and must be copied or
+        written to disk. If provided, no full lookup table is allocated.
+    out_type : str
+        Data type of output (float32, uint16, uint8). Correction factors are
+        accumulated in float32; for unsigned integer output, they are
+        encoded with the parameters from 'encoding_parameters()' (also
+        applies to tiles passed to 'tile_writer')
+    build_quality : str
+        Embree BVH build quality (low, medium, high)
+    compact : bool
+        Use compact BVH layout (less memory, slightly slower ray tracing)
+    robust : bool
+        Use robust ray-triangle intersection mode
+    grain_size : int
+        Minimal number of grid cells per task
+    cost_order : bool
+        Process grid cells in order of decreasing cost estimate
+    radius_earth : double, optional
+        Radius of Earth [metre]. If provided, the horizontal triangles are
+        computed analytically (radial projection of DEM triangles onto
+        sphere; ENU origin of tiles on surface of sphere) and no inner DEM
+        is loaded
+    refrac_cor : bool
+        Account for atmospheric refraction (precomputed lookup table of
+        refraction angles)
+
+    Returns
+    -------
+    sw_dir_cor : ndarray of float/uint16/uint8 or None
+        Array (four-dimensional) with shortwave correction factor
+        (y, x, dim_sun_0, dim_sun_1) [-]; None if 'tile_writer' is provided"""
+
+	# Check consistency and validity of input arguments
+    if not callable(tile_loader):
+        raise TypeError("'tile_loader' must be callable")
+    if (tile_writer is not None) and (not callable(tile_writer)):
+        raise TypeError("'tile_writer' must be callable")
+    if (num_gc_y < 1) or (num_gc_x < 1):
+        raise ValueError("values for 'num_gc_y' and 'num_gc_x' must be at "
+                         + "least 1")
+    if (dim_sun_0 < 1) or (dim_sun_1 < 1):
+        raise ValueError("values for 'dim_sun_0' and 'dim_sun_1' must be at "
+                         + "least 1")
+    if pixel_per_gc < 1:
+        raise ValueError("value for 'pixel_per_gc' must be larger than 1")
+    if offset_gc < 0:
+        raise ValueError("value for 'offset_gc' must be larger than 0")
+    if mask is None:
+        mask = np.ones((num_gc_y, num_gc_x), dtype=np.uint8)
+    if (mask.shape[0] != num_gc_y) or (mask.shape[1] != num_gc_x):
+        raise ValueError("shape of mask is inconsistent with other input")
+    if mask.dtype != "uint8":
+        raise TypeError("data type of mask must be 'uint8'")
+    if dist_search < 0.1:
+        raise ValueError("'dist_search' must be at least 100.0 m")
+    if geom_type not in ("triangle", "quad", "grid", "heightfield"):
+        raise ValueError("invalid input argument for geom_type")
+    if build_quality not in ("low", "medium", "high"):
+        raise ValueError("invalid input argument for build_quality")
+    if grain_size < 1:
+        raise ValueError("value for 'grain_size' must be at least 1")
+    if (sw_dir_cor_max < 2.0) or (sw_dir_cor_max > 100.0):
+        raise ValueError("'sw_dir_cor_max' must be in the range [2.0, 100.0]")
+    if (ang_max < 89.0) or (ang_max >= 90.0):
+        raise ValueError("'ang_max' must be in the range [89.0, <90.0]")
+    if mem_budget <= 0.0:
+        raise ValueError("value for 'mem_budget' must be positive")
+    if out_type not in ("float32", "uint16", "uint8"):
+        raise ValueError("invalid input argument for out_type")
+    if (radius_earth is not None) and (radius_earth <= 0.0):
+        raise ValueError("'radius_earth' must be positive")
+
+    # Ensure that passed arrays are contiguous in memory
+    mask = np.ascontiguousarray(mask)
+
+    # Convert input strings to bytes
+    geom_type_c = geom_type.encode("utf-8")
+    build_quality_c = build_quality.encode("utf-8")
+
+    # Allocate array for shortwave correction factors
+    cdef np.ndarray[np.float32_t, ndim = 4, mode = "c"] sw_dir_cor = None
+    cdef float* sw_dir_cor_ptr = NULL
+    if tile_writer is None:
+        sw_dir_cor = np.empty((num_gc_y, num_gc_x, dim_sun_0, dim_sun_1),
+                              dtype=np.float32)
+        sw_dir_cor.fill(0.0)
+        sw_dir_cor_ptr = &sw_dir_cor[0, 0, 0, 0]
+    elif out_type != "float32":
+        tile_writer = _encode_tiles(tile_writer, out_type, sw_dir_cor_max)
+    context = [tile_loader, tile_writer,
+               (pixel_per_gc, offset_gc, dim_sun_0, dim_sun_1), None]
+
+    sw_dir_cor_comp_tiled(
+        num_gc_y, num_gc_x,
+        (0.0 if radius_earth is None else radius_earth),
+        dim_sun_0, dim_sun_1,
+        sw_dir_cor_ptr,
+        pixel_per_gc,
+        offset_gc,
+        &mask[0, 0],
+        dist_search,
+        geom_type_c,
+        build_quality_c,
+        int(compact),
+        int(robust),
+        grain_size,
+        int(cost_order),
+        int(refrac_cor),
+        sw_dir_cor_max,
+        ang_max,
+        mem_budget,
+        _tile_load,
+        _tile_store,
+        <void*>context)
+
+    # Re-raise exception from callback function
+    if context[3] is not None:
+        raise context[3]
+
+    # Encode lookup table (optional)
+    if (sw_dir_cor is not None) and (out_type != "float32"):
+        return encode_sw_dir_cor(sw_dir_cor, out_type, sw_dir_cor_max)
 
     return sw_dir_cor
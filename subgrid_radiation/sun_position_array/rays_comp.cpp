@@ -1,6 +1,18 @@
 // Copyright (c) 2023 ETH Zurich, Christian R. Steger
 // MIT License
 
+#include "rays_comp.h"
+#include "embree_core.h"
+#include "horizon_detect.h"
+#include "geometry_core.h"
+#include "cell_schedule.h"
+#include "adaptive_sampling.h"
+#include "sun_simd.h"
+#include "scratch_arena.h"
+#include "refraction.h"
+#include "kernel_stats.h"
+#include "kernel_variants.h"
+#include "heightfield.h"
 #include <cstdio>
 #include <embree3/rtcore.h>
 #include <stdio.h>
@@ -11,361 +23,111 @@
 #include <chrono>
 #include <iostream>
 #include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_reduce.h>
+#include <tbb/task_group.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/cache_aligned_allocator.h>
 #include <sstream>
 #include <iomanip>
 
 using namespace std;
 
 //#############################################################################
-// Auxiliary functions
+// Per-thread ray streams
 //#############################################################################
 
-// ----------------------------------------------------------------------------
-// Unit conversion
-// ----------------------------------------------------------------------------
-
-// Convert degree to radian
-inline double deg2rad(double ang) {
-    /* Parameters
-       ----------
-       ang: angle [degree]
-
-       Returns
-       ----------
-       ang: angle [radian]
-    */
-    return ((ang / 180.0) * M_PI);
-}
-
-// Convert radian to degree
-inline double rad2deg(double ang) {
-    /* Parameters
-       ----------
-       ang: angle [radian]
-
-       Returns
-       ----------
-       ang: angle [degree]
-    */
-    return ((ang / M_PI) * 180.0);
-}
-
-// ----------------------------------------------------------------------------
-// Compute linear array index from multidimensional subscripts
-// ----------------------------------------------------------------------------
-
-// Linear index from subscripts (2D-array)
-inline size_t lin_ind_2d(size_t dim_1, size_t ind_0, size_t ind_1) {
-    /* Parameters
-       ----------
-       dim_1: second dimension length of two-dimensional array [-]
-       ind_0: first array indices [-]
-       ind_1: second array indices [-]
-
-       Returns
-       ----------
-       ind_lin: linear index of array [-]
-    */
-    return (ind_0 * dim_1 + ind_1);
-}
-
-// Linear index from subscripts (3D-array)
-inline size_t lin_ind_3d(size_t dim_1, size_t dim_2,
-    size_t ind_0, size_t ind_1, size_t ind_2) {
-    /* Parameters
-       ----------
-       dim_1: second dimension length of three-dimensional array [-]
-       dim_2: third dimension length of three-dimensional array [-]
-       ind_0: first array indices [-]
-       ind_1: second array indices [-]
-       ind_2: third array indices [-]
-
-       Returns
-       ----------
-       ind_lin: linear index of array [-]
-    */
-    return (ind_0 * (dim_1 * dim_2) + ind_1 * dim_2 + ind_2);
-}
-
-// Linear index from subscripts (4D-array)
-inline size_t lin_ind_4d(size_t dim_1, size_t dim_2, size_t dim_3,
-    size_t ind_0, size_t ind_1, size_t ind_2, size_t ind_3) {
-    /* Parameters
-       ----------
-       dim_1: second dimension length of four-dimensional array [-]
-       dim_2: third dimension length of four-dimensional array [-]
-       dim_3: fourth dimension length of four-dimensional array [-]
-       ind_0: first array indices [-]
-       ind_1: second array indices [-]
-       ind_2: third array indices [-]
-       ind_3: fourth array indicies [-]
-
-       Returns
-       ----------
-       ind_lin: linear index of array [-]
-    */
-    return (ind_0 * (dim_1 * dim_2 * dim_3) + ind_1 * (dim_2 * dim_3)
-        + ind_2 * dim_3 + ind_3);
-}
-
-// ----------------------------------------------------------------------------
-// Vector and matrix operations
-// ----------------------------------------------------------------------------
-
-// Unit vector
-inline void vec_unit(double &v_x, double &v_y, double &v_z) {
-    /* Parameters
-       ----------
-       v_x: x-component of vector [arbitrary]
-       v_y: y-component of vector [arbitrary]
-       v_z: z-component of vector [arbitrary]
-    */
-    double mag = sqrt(v_x * v_x + v_y * v_y + v_z * v_z);
-    v_x = v_x / mag;
-    v_y = v_y / mag;
-    v_z = v_z / mag;
-}
-
-// ----------------------------------------------------------------------------
-// Triangle operations
-// ----------------------------------------------------------------------------
-
-// Triangle surface normal and area
-inline void triangle_normal_area(
-    double &vert_0_x, double &vert_0_y, double &vert_0_z,
-    double &vert_1_x, double &vert_1_y, double &vert_1_z,
-    double &vert_2_x, double &vert_2_y, double &vert_2_z,
-    double &norm_x, double &norm_y, double &norm_z,
-    double &area) {
-    /* Parameters
-       ----------
-       vert_0_x: x-component of first triangle vertices [m]
-       vert_0_y: y-component of first triangle vertices [m]
-       vert_0_z: z-component of first triangle vertices [m]
-       vert_1_x: x-component of second triangle vertices [m]
-       vert_1_y: y-component of second triangle vertices [m]
-       vert_1_z: z-component of second triangle vertices [m]
-       vert_2_x: x-component of third triangle vertices [m]
-       vert_2_y: y-component of third triangle vertices [m]
-       vert_2_z: z-component of third triangle vertices [m]
-       norm_x: x-component of triangle surface normal [-]
-       norm_y: y-component of triangle surface normal [-]
-       norm_z: z-component of triangle surface normal [-]
-       area: area of triangle [m2]
-    */
-    double a_x = vert_2_x - vert_1_x;
-    double a_y = vert_2_y - vert_1_y;
-    double a_z = vert_2_z - vert_1_z;
-    double b_x = vert_0_x - vert_1_x;
-    double b_y = vert_0_y - vert_1_y;
-    double b_z = vert_0_z - vert_1_z;
-
-    norm_x = a_y * b_z - a_z * b_y;
-    norm_y = a_z * b_x - a_x * b_z;
-    norm_z = a_x * b_y - a_y * b_x;
-
-    double mag = sqrt(norm_x * norm_x + norm_y * norm_y + norm_z * norm_z);
-    norm_x = norm_x / mag;
-    norm_y = norm_y / mag;
-    norm_z = norm_z / mag;
-
-    area = mag / 2.0;
-}
-
-// Triangle centroid
-inline void triangle_centroid(
-    double &vert_0_x, double &vert_0_y, double &vert_0_z,
-    double &vert_1_x, double &vert_1_y, double &vert_1_z,
-    double &vert_2_x, double &vert_2_y, double &vert_2_z,
-    double &cent_x, double &cent_y, double &cent_z) {
-    /* Parameters
-       ----------
-       vert_0_x: x-component of first triangle vertices [m]
-       vert_0_y: y-component of first triangle vertices [m]
-       vert_0_z: z-component of first triangle vertices [m]
-       vert_1_x: x-component of second triangle vertices [m]
-       vert_1_y: y-component of second triangle vertices [m]
-       vert_1_z: z-component of second triangle vertices [m]
-       vert_2_x: x-component of third triangle vertices [m]
-       vert_2_y: y-component of third triangle vertices [m]
-       vert_2_z: z-component of third triangle vertices [m]
-       cent_x: x-component of triangle centroid [-]
-       cent_y: y-component of triangle centroid [-]
-        cent_z: z-component of triangle centroid [-]
-    */
-    cent_x = (vert_0_x + vert_1_x + vert_2_x) / 3.0;
-    cent_y = (vert_0_y + vert_1_y + vert_2_y) / 3.0;
-    cent_z = (vert_0_z + vert_1_z + vert_2_z) / 3.0;
-}
-
-// Vertices of lower left triangle (within pixel)
-inline void triangle_vert_ll(size_t dim_1, size_t ind_0, size_t ind_1,
-    size_t &ind_tri_0, size_t &ind_tri_1, size_t &ind_tri_2) {
-    /* Parameters
-       ----------
-
-    */
-    ind_tri_0 = (ind_0 * dim_1 + ind_1) * 3;
-    ind_tri_1 = (ind_0 * dim_1 + ind_1 + 1) * 3;
-    ind_tri_2 = ((ind_0 + 1) * dim_1 + ind_1) * 3;
-}
-
-// Vertices of upper right triangle (within pixel)
-inline void triangle_vert_ur(size_t dim_1, size_t ind_0, size_t ind_1,
-    size_t &ind_tri_0, size_t &ind_tri_1, size_t &ind_tri_2) {
-    /* Parameters
-       ----------
-
-    */
-    ind_tri_0 = (ind_0 * dim_1 + ind_1 + 1) * 3;
-    ind_tri_1 = ((ind_0 + 1) * dim_1 + ind_1 + 1) * 3;
-    ind_tri_2 = ((ind_0 + 1) * dim_1 + ind_1) * 3;
-
-}
-
-// Store above two functions in array
-void (*func_ptr[2])(size_t dim_1, size_t ind_0, size_t ind_1,
-    size_t &ind_tri_0, size_t &ind_tri_1, size_t &ind_tri_2)
-    = {triangle_vert_ll, triangle_vert_ur};
-
-//#############################################################################
-// Miscellaneous
-//#############################################################################
-
-// Namespace
-#if defined(RTC_NAMESPACE_USE)
-    RTC_NAMESPACE_USE
-#endif
-
-// Error function
-void errorFunction(void* userPtr, enum RTCError error, const char* str) {
-    printf("error %d: %s\n", error, str);
-}
-
-// Initialisation of device and registration of error handler
-RTCDevice initializeDevice() {
-    RTCDevice device = rtcNewDevice(NULL);
-    if (!device) {
-        printf("error %d: cannot create device\n", rtcGetDeviceError(NULL));
-    }
-    rtcSetDeviceErrorFunction(device, errorFunction, NULL);
-    return device;
-}
-
-//#############################################################################
-// Create scene from geometries
-//#############################################################################
-
-// Structures for triangle and quad
-struct Triangle { int v0, v1, v2; };
-struct Quad { int v0, v1, v2, v3; };
-// -> above structures must contain 32-bit integers (-> Embree documentation).
-//    Theoretically, these integers should be unsigned but the binary
-//    representation until 2'147'483'647 is identical between signed/unsigned
-//    integer.
-
-// Initialise scene
-RTCScene initializeScene(RTCDevice device, float* vert_grid,
-    int dem_dim_0, int dem_dim_1, char* geom_type) {
-
-    RTCScene scene = rtcNewScene(device);
-    rtcSetSceneFlags(scene, RTC_SCENE_FLAG_ROBUST);
-
-    int num_vert = (dem_dim_0 * dem_dim_1);
-    printf("DEM dimensions: (%d, %d) \n", dem_dim_0, dem_dim_1);
-    printf("Number of vertices: %d \n", num_vert);
-
-    RTCGeometryType rtc_geom_type;
-    if (strcmp(geom_type, "triangle") == 0) {
-        rtc_geom_type = RTC_GEOMETRY_TYPE_TRIANGLE;
-    } else if (strcmp(geom_type, "quad") == 0) {
-        rtc_geom_type = RTC_GEOMETRY_TYPE_QUAD;
-    } else {
-        rtc_geom_type = RTC_GEOMETRY_TYPE_GRID;
+// Buffers of one thread for streamed rays (gathered from multiple grid
+// cells) and for the triangle geometry of the currently processed grid cell.
+// Buffers are cache-aligned and reused across grid cells and calls (they
+// only grow).
+struct RayStream {
+    RTCRay* rays;
+    float* sw_dir_cor_ray;  // correction factor if ray is not occluded
+    size_t* ind_lin_cor;  // linear index of ray's element in lookup table
+    size_t num_rays;  // number of buffered rays
+    size_t capacity;  // maximal number of buffered rays
+    double* tri_geom;  // per triangle: ray origin, normals (tilted,
+    // horizontal) and surface enlargement factor
+    size_t capacity_tri;  // maximal number of triangles
+    RayStream() : rays(NULL), sw_dir_cor_ray(NULL), ind_lin_cor(NULL),
+        num_rays(0), capacity(0), tri_geom(NULL), capacity_tri(0) {}
+    ~RayStream() {
+        free_buffers();
     }
-
-    RTCGeometry geom = rtcNewGeometry(device, rtc_geom_type);
-    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0,
-        RTC_FORMAT_FLOAT3, vert_grid, 0, 3*sizeof(float), num_vert);
-
-    //-------------------------------------------------------------------------
-    // Triangle
-    //-------------------------------------------------------------------------
-    if (strcmp(geom_type, "triangle") == 0) {
-        cout << "Selected geometry type: triangle" << endl;
-        int num_tri = ((dem_dim_0 - 1) * (dem_dim_1 - 1)) * 2;
-        printf("Number of triangles: %d \n", num_tri);
-        Triangle* triangles = (Triangle*) rtcSetNewGeometryBuffer(geom,
-            RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, sizeof(Triangle),
-            num_tri);
-        int n = 0;
-        for (int i = 0; i < (dem_dim_0 - 1); i++) {
-            for (int j = 0; j < (dem_dim_1 - 1); j++) {
-                triangles[n].v0 = (i * dem_dim_1) + j;
-                triangles[n].v1 = (i * dem_dim_1) + j + 1;
-                triangles[n].v2 = ((i + 1) * dem_dim_1) + j;
-                n++;
-                triangles[n].v0 = (i * dem_dim_1) + j + 1;
-                triangles[n].v1 = ((i + 1) * dem_dim_1) + j + 1;
-                triangles[n].v2 = ((i + 1) * dem_dim_1) + j;
-                n++;
-            }
+    void free_buffers() {
+        if (rays != NULL) {
+            tbb::cache_aligned_allocator<RTCRay>().deallocate(rays,
+                capacity);
+            tbb::cache_aligned_allocator<float>().deallocate(sw_dir_cor_ray,
+                capacity);
+            tbb::cache_aligned_allocator<size_t>().deallocate(ind_lin_cor,
+                capacity);
+            tbb::cache_aligned_allocator<double>().deallocate(tri_geom,
+                capacity_tri * 10);
         }
-    //-------------------------------------------------------------------------
-    // Quad
-    //-------------------------------------------------------------------------
-    } else if (strcmp(geom_type, "quad") == 0) {
-        cout << "Selected geometry type: quad" << endl;
-        int num_quad = ((dem_dim_0 - 1) * (dem_dim_1 - 1));
-        printf("Number of quads: %d \n", num_quad);
-        Quad* quads = (Quad*) rtcSetNewGeometryBuffer(geom,
-            RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT4, sizeof(Quad),
-            num_quad);
-        int n = 0;
-        for (int i = 0; i < (dem_dim_0 - 1); i++) {
-            for (int j = 0; j < (dem_dim_1 - 1); j++) {
-                //  identical to grid scene (-> otherwise reverse v0, v1, ...)
-                quads[n].v0 = (i * dem_dim_1) + j;
-                quads[n].v1 = (i * dem_dim_1) + j + 1;
-                quads[n].v2 = ((i + 1) * dem_dim_1) + j + 1;
-                quads[n].v3 = ((i + 1) * dem_dim_1) + j;
-                n++;
-            }
+        rays = NULL;
+        sw_dir_cor_ray = NULL;
+        ind_lin_cor = NULL;
+        tri_geom = NULL;
+    }
+    // Enlarge buffers (only called for empty streams)
+    void reserve(size_t batch_size, size_t num_tri) {
+        if ((batch_size > capacity) || (num_tri > capacity_tri)) {
+            free_buffers();
+            capacity = std::max(batch_size, capacity);
+            capacity_tri = std::max(num_tri, capacity_tri);
+            rays = tbb::cache_aligned_allocator<RTCRay>().allocate(
+                capacity);
+            sw_dir_cor_ray = tbb::cache_aligned_allocator<float>()
+                .allocate(capacity);
+            ind_lin_cor = tbb::cache_aligned_allocator<size_t>().allocate(
+                capacity);
+            tri_geom = tbb::cache_aligned_allocator<double>().allocate(
+                capacity_tri * 10);
         }
-    //-------------------------------------------------------------------------
-    // Grid
-    //-------------------------------------------------------------------------
-    } else {
-        cout << "Selected geometry type: grid" << endl;
-        RTCGrid* grid = (RTCGrid*)rtcSetNewGeometryBuffer(geom,
-            RTC_BUFFER_TYPE_GRID, 0, RTC_FORMAT_GRID, sizeof(RTCGrid), 1);
-        grid[0].startVertexID = 0;
-        grid[0].stride        = dem_dim_1;
-        grid[0].width         = dem_dim_1;
-        grid[0].height        = dem_dim_0;
     }
-    //-------------------------------------------------------------------------
-
-    auto start = std::chrono::high_resolution_clock::now();
-
-    // Commit geometry
-    rtcCommitGeometry(geom);
+};
 
-    rtcAttachGeometry(scene, geom);
-    rtcReleaseGeometry(geom);
+// Ray streams of all threads (not reentrant: one computation at a time)
+static tbb::enumerable_thread_specific<RayStream> ray_streams;
 
-    //-------------------------------------------------------------------------
+// Trace buffered rays and add correction factors of unoccluded rays to
+// lookup table ('sw_dir_cor_rows'; rays of a grid cell are only buffered by
+// the thread processing this cell -> no race condition). Returns number of
+// traced rays.
+size_t flush_ray_stream(RayStream &stream, RTCScene scene,
+    float* sw_dir_cor_rows) {
 
-    // Commit scene
-    rtcCommitScene(scene);
+    if (stream.num_rays == 0) {
+        return 0;
+    }
 
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> time = end - start;
-    cout << "BVH build time: " << time.count() << " s" << endl;
+    struct RTCIntersectContext context;
+    rtcInitIntersectContext(&context);
+    context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+
+    // Intersect rays with scene
+    rtcOccluded1M(scene, &context, stream.rays, stream.num_rays,
+        sizeof(RTCRay));
+
+    // Scatter correction factors to lookup table (in order of buffering ->
+    // same order of summation as in default method)
+    for (size_t q = 0; q < stream.num_rays; q++) {
+        if (stream.rays[q].tfar > 0.0) {
+            // no intersection -> 'tfar' is not updated; otherwise
+            // 'tfar' = -inf
+            sw_dir_cor_rows[stream.ind_lin_cor[q]]
+                = sw_dir_cor_rows[stream.ind_lin_cor[q]]
+                + stream.sw_dir_cor_ray[q];
+        }  // else: sw_dir_cor += 0.0
+    }
 
-    return scene;
+    size_t num_rays = stream.num_rays;
+    stream.num_rays = 0;
+    return num_rays;
 
 }
 
@@ -377,11 +139,13 @@ RTCScene initializeScene(RTCDevice device, float* vert_grid,
 // Default
 //-----------------------------------------------------------------------------
 
-void sw_dir_cor_comp(
+template <int REFRAC, int USE_FLOAT32>
+static void sw_dir_cor_comp_spec(
     float* vert_grid,
     int dem_dim_0, int dem_dim_1,
     float* vert_grid_in,
     int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
     double* sun_pos,
     int dim_sun_0, int dim_sun_1,
     float* sw_dir_cor,
@@ -390,12 +154,24 @@ void sw_dir_cor_comp(
     uint8_t* mask,
     double dist_search,
     char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
     double sw_dir_cor_max,
-    double ang_max) {
+    double ang_max,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data) {
 
-    cout << "--------------------------------------------------------" << endl;
-    cout << "Compute lookup table with default method" << endl;
-    cout << "--------------------------------------------------------" << endl;
+    KernelScope scope((dem_dim_in_0 - 1) / pixel_per_gc,
+        (dem_dim_in_1 - 1) / pixel_per_gc);
+
+    kout << "--------------------------------------------------------" << endl;
+    kout << "Compute lookup table with default method" << endl;
+    kout << "--------------------------------------------------------" << endl;
 
     // Hard-coded settings
     double ray_org_elev = 0.1;
@@ -405,242 +181,438 @@ void sw_dir_cor_comp(
     // Number of grid cells
     int num_gc_y = (dem_dim_in_0 - 1) / pixel_per_gc;
     int num_gc_x = (dem_dim_in_1 - 1) / pixel_per_gc;
-    cout << "Number of grid cells in y-direction: " << num_gc_y
+    kout << "Number of grid cells in y-direction: " << num_gc_y
         << endl;
-    cout << "Number of grid cells in x-direction: " << num_gc_x << endl;
+    kout << "Number of grid cells in x-direction: " << num_gc_x << endl;
 
     // Number of triangles
     int num_tri = (dem_dim_in_0 - 1) * (dem_dim_in_1 - 1) * 2;
-    cout << "Number of triangles: " << num_tri << endl;
+    kout << "Number of triangles: " << num_tri << endl;
 
     // Unit conversion(s)
     double dot_prod_min = cos(deg2rad(ang_max));
     dist_search *= 1000.0;  // [kilometre] to [metre]
-    cout << "Search distance: " << dist_search << " m" << endl;
+    kout << "Search distance: " << dist_search << " m" << endl;
+
+    kout << "ang_max: " << ang_max << " degree" << endl;
+    kout << "sw_dir_cor_max: " << sw_dir_cor_max  << endl;
+
+    // Sun positions as structure of arrays (single precision path)
+    size_t num_sun = (size_t)dim_sun_0 * (size_t)dim_sun_1;
+    float* sun_x_soa = NULL;
+    float* sun_y_soa = NULL;
+    float* sun_z_soa = NULL;
+    if (USE_FLOAT32 == 1) {
+        sun_x_soa = new float[num_sun];
+        sun_y_soa = new float[num_sun];
+        sun_z_soa = new float[num_sun];
+        sun_pos_soa(sun_pos, num_sun, sun_x_soa, sun_y_soa, sun_z_soa);
+        kout << "Precision of sun vectors: float32 (" << sun_simd_isa()
+            << ")" << endl;
+    } else {
+        kout << "Precision of sun vectors: float64" << endl;
+    }
 
-    cout << "ang_max: " << ang_max << " degree" << endl;
-    cout << "sw_dir_cor_max: " << sw_dir_cor_max  << endl;
+    // Lookup table for atmospheric refraction (double precision path)
+    RefracTable refrac_table;
+    refrac_table.data = NULL;
+    if (REFRAC != REFRAC_NONE) {
+        refrac_table_build(refrac_table);
+        kout << "Account for atmospheric refraction (lookup table)" << endl;
+    }
 
     // Initialisation
     auto start_ini = std::chrono::high_resolution_clock::now();
-    RTCDevice device = initializeDevice();
-    RTCScene scene = initializeScene(device, vert_grid, dem_dim_0, dem_dim_1,
-        geom_type);
+    RTCDevice device = NULL;
+    RTCScene scene = scene_ext;
+    if (scene_ext == NULL) {
+        device = initializeDevice();
+        scene = initializeScene(device, vert_grid, dem_dim_0, dem_dim_1,
+            geom_type, build_quality, compact, robust);
+    } else {
+        kout << "Reuse committed scene" << endl;
+    }
     auto end_ini = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> time = end_ini - start_ini;
-    cout << "Total initialisation time: " << time.count() << " s" << endl;
+    kout << "Total initialisation time: " << time.count() << " s" << endl;
 
     //-------------------------------------------------------------------------
 
     auto start_ray = std::chrono::high_resolution_clock::now();
     size_t num_rays = 0;
+    size_t row_size = num_gc_x * dim_sun_0 * dim_sun_1;
 
-    num_rays += tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, num_gc_y), 0.0,
+    // Compute rows [row_beg, row_end) of lookup table ('sw_dir_cor_rows'
+    // only holds these rows)
+    auto compute_rows = [&](size_t row_beg, size_t row_end,
+        float* sw_dir_cor_rows) {
+
+    // Fill masked grid cells with NaN
+    for (size_t i = row_beg; i < row_end; i++) {
+        for (size_t j = 0; j < (size_t)num_gc_x; j++) {
+            size_t lin_ind_gc = lin_ind_2d(num_gc_x, i, j);
+            if (mask[lin_ind_gc] != 1) {
+                size_t ind_lin = lin_ind_4d(num_gc_x, dim_sun_0, dim_sun_1,
+                    i - row_beg, j, 0, 0);
+                for (size_t k = 0; k < (size_t)(dim_sun_0 * dim_sun_1) ; k++) {
+                    sw_dir_cor_rows[ind_lin + k] = NAN;
+                }
+            }
+        }
+    }
+
+    // Compacted list of active grid cells
+    size_t num_cells;
+    size_t* cells = active_cells(mask, num_gc_x, row_beg, row_end,
+        vert_grid, dem_dim_1, pixel_per_gc, offset_gc, cost_order,
+        num_cells);
+
+    size_t num_rays_rows = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_cells, grain_size), 0.0,
         [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
 
-    // Loop through 2D-field of grid cells
-    //for (size_t i = 0; i < num_gc_y; i++) {  // serial
-    for (size_t i=r.begin(); i<r.end(); ++i) {  // parallel
-        for (size_t j = 0; j < num_gc_x; j++) {
+    size_t num_rays_beg = num_rays;
+    size_t num_culled = 0;
+
+    // Scratch buffers for single precision path (reused for all grid cells
+    // of task)
+    float *dir_x = NULL, *dir_y = NULL, *dir_z = NULL, *cor_f32 = NULL;
+    if (USE_FLOAT32 == 1) {
+        ScratchArena &arena = scratch_arena();
+        arena.begin(4 * scratch_size<float>(num_sun));
+        dir_x = arena.alloc<float>(num_sun);
+        dir_y = arena.alloc<float>(num_sun);
+        dir_z = arena.alloc<float>(num_sun);
+        cor_f32 = arena.alloc<float>(num_sun);
+    }
 
-            size_t lin_ind_gc = lin_ind_2d(num_gc_x, i, j);
-            if (mask[lin_ind_gc] == 1) {
+    // Loop through active grid cells
+    //for (size_t ind = 0; ind < num_cells; ind++) {  // serial
+    for (size_t ind = r.begin(); ind < r.end(); ++ind) {  // parallel
 
-            // Loop through 2D-field of DEM pixels
-            for (size_t k = (i * pixel_per_gc);
-                k < ((i * pixel_per_gc) + pixel_per_gc); k++) {
-                for (size_t m = (j * pixel_per_gc);
-                    m < ((j * pixel_per_gc) + pixel_per_gc); m++) {
+        size_t i = cells[ind] / num_gc_x;
+        size_t j = cells[ind] % num_gc_x;
+        size_t num_rays_cell = num_rays;
 
-                    // Loop through two triangles per pixel
-                    for (size_t n = 0; n < 2; n++) {
 
-                        //-----------------------------------------------------
-                        // Tilted triangle
-                        //-----------------------------------------------------
+        // Loop through 2D-field of DEM pixels
+        for (size_t k = (i * pixel_per_gc);
+            k < ((i * pixel_per_gc) + pixel_per_gc); k++) {
+            for (size_t m = (j * pixel_per_gc);
+                m < ((j * pixel_per_gc) + pixel_per_gc); m++) {
 
-                        size_t ind_tri_0, ind_tri_1, ind_tri_2;
-                        func_ptr[n](dem_dim_1,
-                            k + (pixel_per_gc * offset_gc),
-                            m + (pixel_per_gc * offset_gc),
-                            ind_tri_0, ind_tri_1, ind_tri_2);
-
-                        double vert_0_x = (double)vert_grid[ind_tri_0];
-                        double vert_0_y = (double)vert_grid[ind_tri_0 + 1];
-                        double vert_0_z = (double)vert_grid[ind_tri_0 + 2];
-                        double vert_1_x = (double)vert_grid[ind_tri_1];
-                        double vert_1_y = (double)vert_grid[ind_tri_1 + 1];
-                        double vert_1_z = (double)vert_grid[ind_tri_1 + 2];
-                        double vert_2_x = (double)vert_grid[ind_tri_2];
-                        double vert_2_y = (double)vert_grid[ind_tri_2 + 1];
-                        double vert_2_z = (double)vert_grid[ind_tri_2 + 2];
-
-                        double cent_x, cent_y, cent_z;
-                        triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            cent_x, cent_y, cent_z);
+                // Loop through two triangles per pixel
+                for (size_t n = 0; n < 2; n++) {
 
-                        double norm_tilt_x, norm_tilt_y, norm_tilt_z, area_tilt;
-                        triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            norm_tilt_x, norm_tilt_y, norm_tilt_z,
-                            area_tilt);
+                    //---------------------------------------------------------
+                    // Tilted triangle
+                    //---------------------------------------------------------
 
-                        // Ray origin
-                        double ray_org_x = (cent_x
-                            + norm_tilt_x * ray_org_elev);
-                        double ray_org_y = (cent_y
-                            + norm_tilt_y * ray_org_elev);
-                        double ray_org_z = (cent_z
-                            + norm_tilt_z * ray_org_elev);
+                    size_t ind_tri_0, ind_tri_1, ind_tri_2;
+                    triangle_vert(n, dem_dim_1,
+                        k + (pixel_per_gc * offset_gc),
+                        m + (pixel_per_gc * offset_gc),
+                        ind_tri_0, ind_tri_1, ind_tri_2);
+
+                    double vert_0_x = (double)vert_grid[ind_tri_0];
+                    double vert_0_y = (double)vert_grid[ind_tri_0 + 1];
+                    double vert_0_z = (double)vert_grid[ind_tri_0 + 2];
+                    double vert_1_x = (double)vert_grid[ind_tri_1];
+                    double vert_1_y = (double)vert_grid[ind_tri_1 + 1];
+                    double vert_1_z = (double)vert_grid[ind_tri_1 + 2];
+                    double vert_2_x = (double)vert_grid[ind_tri_2];
+                    double vert_2_y = (double)vert_grid[ind_tri_2 + 1];
+                    double vert_2_z = (double)vert_grid[ind_tri_2 + 2];
+
+                    double cent_x, cent_y, cent_z;
+                    triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        cent_x, cent_y, cent_z);
+
+                    double norm_tilt_x, norm_tilt_y, norm_tilt_z, area_tilt;
+                    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        norm_tilt_x, norm_tilt_y, norm_tilt_z,
+                        area_tilt);
+
+                    // Ray origin
+                    double ray_org_x = (cent_x
+                        + norm_tilt_x * ray_org_elev);
+                    double ray_org_y = (cent_y
+                        + norm_tilt_y * ray_org_elev);
+                    double ray_org_z = (cent_z
+                        + norm_tilt_z * ray_org_elev);
 
-                        //-----------------------------------------------------
-                        // Horizontal triangle
-                        //-----------------------------------------------------
+                    //---------------------------------------------------------
+                    // Horizontal triangle
+                    //---------------------------------------------------------
 
-                        func_ptr[n](dem_dim_in_1, k, m,
-                            ind_tri_0, ind_tri_1, ind_tri_2);
-
-                        vert_0_x = (double)vert_grid_in[ind_tri_0];
-                        vert_0_y = (double)vert_grid_in[ind_tri_0 + 1];
-                        vert_0_z = (double)vert_grid_in[ind_tri_0 + 2];
-                        vert_1_x = (double)vert_grid_in[ind_tri_1];
-                        vert_1_y = (double)vert_grid_in[ind_tri_1 + 1];
-                        vert_1_z = (double)vert_grid_in[ind_tri_1 + 2];
-                        vert_2_x = (double)vert_grid_in[ind_tri_2];
-                        vert_2_y = (double)vert_grid_in[ind_tri_2 + 1];
-                        vert_2_z = (double)vert_grid_in[ind_tri_2 + 2];
-
-                        double norm_hori_x, norm_hori_y, norm_hori_z, area_hori;
-                        triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                    triangle_vert_hori(vert_grid_in, dem_dim_in_1,
+                        k, m, n, radius_earth,
+                        vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z);
+
+                    double norm_hori_x, norm_hori_y, norm_hori_z, area_hori;
+                    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        norm_hori_x, norm_hori_y, norm_hori_z,
+                        area_hori);
+
+                    double surf_enl_fac = area_tilt / area_hori;
+
+                    // Elevation (distance between centroid of DEM triangle
+                    // and 'base triangle'; required for atmospheric
+                    // refraction)
+                    double elevation = 0.0;
+                    if (REFRAC != REFRAC_NONE) {
+                        double cent_base_x, cent_base_y, cent_base_z;
+                        triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
                             vert_1_x, vert_1_y, vert_1_z,
                             vert_2_x, vert_2_y, vert_2_z,
-                            norm_hori_x, norm_hori_y, norm_hori_z,
-                            area_hori);
+                            cent_base_x, cent_base_y, cent_base_z);
+                        elevation = sqrt(pow(cent_x - cent_base_x, 2)
+                            + pow(cent_y - cent_base_y, 2)
+                            + pow(cent_z - cent_base_z, 2));
+                    }
 
-                        double surf_enl_fac = area_tilt / area_hori;
+                    //---------------------------------------------------------
+                    // Single precision: sun vectors and correction factors
+                    // for all sun positions at once (SIMD)
+                    //---------------------------------------------------------
 
-                        //-----------------------------------------------------
-                        // Loop through sun positions and compute correction
-                        // factors
-                        //-----------------------------------------------------
+                    if (USE_FLOAT32 == 1) {
+                        sun_vec_cor_f32(num_sun, sun_x_soa, sun_y_soa,
+                            sun_z_soa, (float)ray_org_x, (float)ray_org_y,
+                            (float)ray_org_z, (float)norm_hori_x,
+                            (float)norm_hori_y, (float)norm_hori_z,
+                            (float)norm_tilt_x, (float)norm_tilt_y,
+                            (float)norm_tilt_z, (float)surf_enl_fac,
+                            (float)dot_prod_min, (float)sw_dir_cor_max,
+                            dir_x, dir_y, dir_z, cor_f32);
+                        size_t ind_lin_cor_gc = lin_ind_4d(num_gc_x,
+                            dim_sun_0, dim_sun_1, i - row_beg, j, 0, 0);
+                        for (size_t o = 0; o < num_sun; o++) {
+                            if (cor_f32[o] == 0.0f) {
+                                num_culled += 1;
+                                continue;  // self-shadowing
+                            }
+                            struct RTCIntersectContext context;
+                            rtcInitIntersectContext(&context);
+                            struct RTCRay ray;
+                            ray.org_x = (float)ray_org_x;
+                            ray.org_y = (float)ray_org_y;
+                            ray.org_z = (float)ray_org_z;
+                            ray.dir_x = dir_x[o];
+                            ray.dir_y = dir_y[o];
+                            ray.dir_z = dir_z[o];
+                            ray.tnear = 0.0;
+                            ray.tfar = (float)dist_search;
+                            rtcOccluded1(scene, &context, &ray);
+                            if (ray.tfar > 0.0) {
+                                sw_dir_cor_rows[ind_lin_cor_gc + o] +=
+                                    cor_f32[o];
+                            }
+                            num_rays += 1;
+                        }
+                        continue;  // skip double precision (reference)
+                    }
+
+                    //---------------------------------------------------------
+                    // Loop through sun positions and compute correction
+                    // factors
+                    //---------------------------------------------------------
 
-                        size_t ind_lin_sun, ind_lin_cor;
-                        for (size_t o = 0; o < dim_sun_0; o++) {
-                            for (size_t p = 0; p < dim_sun_1; p++) {
-
-                                ind_lin_sun = lin_ind_3d(dim_sun_1, 3,
-                                    o, p, 0);
-                                ind_lin_cor = lin_ind_4d(num_gc_x,
-                                    dim_sun_0, dim_sun_1, i, j, o, p);
-
-                                // Compute sun unit vector
-                                double sun_x = (sun_pos[ind_lin_sun]
-                                    - ray_org_x);
-                                double sun_y = (sun_pos[ind_lin_sun + 1]
-                                    - ray_org_y);
-                                double sun_z = (sun_pos[ind_lin_sun + 2]
-                                    - ray_org_z);
-                                vec_unit(sun_x, sun_y, sun_z);
-
-                                // Check for self-shadowing (Earth)
-                                double dot_prod_hs = (norm_hori_x * sun_x
-                                    + norm_hori_y * sun_y
-                                    + norm_hori_z * sun_z);
-                                if (dot_prod_hs <= dot_prod_min) {
-                                    continue;  // sw_dir_cor += 0.0
-                                }
-
-                                // Check for self-shadowing (triangle)
-                                double dot_prod_ts = norm_tilt_x * sun_x
-                                    + norm_tilt_y * sun_y
-                                    + norm_tilt_z * sun_z;
-                                if (dot_prod_ts <= 0.0) {
-                                    continue;  // sw_dir_cor += 0.0
-                                }
-
-                                // Intersect context
-                                struct RTCIntersectContext context;
-                                rtcInitIntersectContext(&context);
-
-                                // Ray structure
-                                struct RTCRay ray;
-                                ray.org_x = (float)ray_org_x;
-                                ray.org_y = (float)ray_org_y;
-                                ray.org_z = (float)ray_org_z;
-                                ray.dir_x = (float)sun_x;
-                                ray.dir_y = (float)sun_y;
-                                ray.dir_z = (float)sun_z;
-                                ray.tnear = 0.0;
-                                ray.tfar = (float)dist_search;
-                                // std::numeric_limits<float>::infinity();
-
-                                // Intersect ray with scene
-                                rtcOccluded1(scene, &context, &ray);
-                                if (ray.tfar > 0.0) {
-                                    // no intersection -> 'tfar' is not
-                                    // updated; otherwise 'tfar' = -inf
-                                    sw_dir_cor[ind_lin_cor] =
-                                        sw_dir_cor[ind_lin_cor]
-                                        + (float)(std::min(((dot_prod_ts
-                                        / dot_prod_hs) * surf_enl_fac),
-                                        sw_dir_cor_max));
-                                }  // else: sw_dir_cor += 0.0
-                                num_rays += 1;
+                    size_t ind_lin_sun, ind_lin_cor;
+                    for (size_t o = 0; o < (size_t)dim_sun_0; o++) {
+                        for (size_t p = 0; p < (size_t)dim_sun_1; p++) {
+
+                            ind_lin_sun = lin_ind_3d(dim_sun_1, 3,
+                                o, p, 0);
+                            ind_lin_cor = lin_ind_4d(num_gc_x,
+                                dim_sun_0, dim_sun_1, i - row_beg, j,
+                                o, p);
+
+                            // Compute sun unit vector
+                            double sun_x = (sun_pos[ind_lin_sun]
+                                - ray_org_x);
+                            double sun_y = (sun_pos[ind_lin_sun + 1]
+                                - ray_org_y);
+                            double sun_z = (sun_pos[ind_lin_sun + 2]
+                                - ray_org_z);
+                            vec_unit(sun_x, sun_y, sun_z);
+
+                            // Consider atmospheric refraction (optional)
+                            double dot_prod_hs = (norm_hori_x * sun_x
+                                + norm_hori_y * sun_y
+                                + norm_hori_z * sun_z);
+                            if (REFRAC != REFRAC_NONE) {
+                                sun_vec_refrac_table(refrac_table, elevation,
+                                    norm_hori_x, norm_hori_y, norm_hori_z,
+                                    sun_x, sun_y, sun_z, dot_prod_hs);
+                            }
 
+                            // Check for self-shadowing (Earth)
+                            if (dot_prod_hs <= dot_prod_min) {
+                                num_culled += 1;
+                                continue;  // sw_dir_cor += 0.0
                             }
-                        }
 
-                    }
+                            // Check for self-shadowing (triangle)
+                            double dot_prod_ts = norm_tilt_x * sun_x
+                                + norm_tilt_y * sun_y
+                                + norm_tilt_z * sun_z;
+                            if (dot_prod_ts <= 0.0) {
+                                num_culled += 1;
+                                continue;  // sw_dir_cor += 0.0
+                            }
 
-                }
-            }
+                            // Intersect context
+                            struct RTCIntersectContext context;
+                            rtcInitIntersectContext(&context);
 
-            } else {
+                            // Ray structure
+                            struct RTCRay ray;
+                            ray.org_x = (float)ray_org_x;
+                            ray.org_y = (float)ray_org_y;
+                            ray.org_z = (float)ray_org_z;
+                            ray.dir_x = (float)sun_x;
+                            ray.dir_y = (float)sun_y;
+                            ray.dir_z = (float)sun_z;
+                            ray.tnear = 0.0;
+                            ray.tfar = (float)dist_search;
+                            // std::numeric_limits<float>::infinity();
+
+                            // Intersect ray with scene
+                            rtcOccluded1(scene, &context, &ray);
+                            if (ray.tfar > 0.0) {
+                                // no intersection -> 'tfar' is not
+                                // updated; otherwise 'tfar' = -inf
+                                sw_dir_cor_rows[ind_lin_cor] =
+                                    sw_dir_cor_rows[ind_lin_cor]
+                                    + (float)(std::min(((dot_prod_ts
+                                    / dot_prod_hs) * surf_enl_fac),
+                                    sw_dir_cor_max));
+                            }  // else: sw_dir_cor += 0.0
+                            num_rays += 1;
+
+                        }
+                    }
 
-                size_t ind_lin = lin_ind_4d(num_gc_x, dim_sun_0, dim_sun_1,
-                    i, j, 0, 0);
-                for (size_t k = 0; k < (dim_sun_0 * dim_sun_1) ; k++) {
-                    sw_dir_cor[ind_lin + k] = NAN;
                 }
 
             }
-
         }
+
+        stats_cell(cells[ind], num_rays - num_rays_cell);
+
     }
 
+    stats_thread(num_rays - num_rays_beg, num_culled);
     return num_rays;  // parallel
     }, std::plus<size_t>());  // parallel
 
-    auto end_ray = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> time_ray = (end_ray - start_ray);
-    cout << "Ray tracing time: " << time_ray.count() << " s" << endl;
-    cout << "Number of rays shot: " << num_rays << endl;
-    double frac_ray = (double)num_rays /
-        ((double)num_tri * (double)dim_sun_0 * (double)dim_sun_1);
-    cout << "Fraction of rays required: " << frac_ray << endl;
+    delete[] cells;
 
     // Divide accumulated values by number of triangles within grid cell
     float num_tri_per_gc = pixel_per_gc * pixel_per_gc * 2.0;
-    size_t num_elem = (num_gc_y * num_gc_x * dim_sun_0 * dim_sun_1);
+    size_t num_elem = (row_end - row_beg) * row_size;
     for (size_t i = 0; i < num_elem; i++) {
-        sw_dir_cor[i] /= num_tri_per_gc;
+        sw_dir_cor_rows[i] /= num_tri_per_gc;
+    }
+
+    return num_rays_rows;
+    };
+
+    if (row_callback == NULL) {
+        num_rays = compute_rows(0, num_gc_y, sw_dir_cor);
+    } else {
+        num_rays = stream_rows(compute_rows, num_gc_y, row_size,
+            (size_t)block_rows, row_callback, user_data);
+    }
+
+    auto end_ray = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time_ray = (end_ray - start_ray);
+    kout << "Ray tracing time: " << time_ray.count() << " s" << endl;
+    kout << "Number of rays shot: " << num_rays << endl;
+    double frac_ray = (double)num_rays /
+        ((double)num_tri * (double)dim_sun_0 * (double)dim_sun_1);
+    kout << "Fraction of rays required: " << frac_ray << endl;
+    kernel_stats.time_ray += time_ray.count();
+    kernel_stats.num_rays += num_rays;
+
+    if (USE_FLOAT32 == 1) {
+        delete[] sun_x_soa;
+        delete[] sun_y_soa;
+        delete[] sun_z_soa;
     }
+    refrac_table_free(refrac_table);
 
-    // Release resources allocated through Embree
-    rtcReleaseScene(scene);
-    rtcReleaseDevice(device);
+    // Release resources allocated through Embree (if not reused)
+    if (scene_ext == NULL) {
+        releaseScene(scene);
+        releaseDevice(device);
+    }
 
     auto end_tot = std::chrono::high_resolution_clock::now();
     time = end_tot - start_ini;
-    cout << "Total run time: " << time.count() << " s" << endl;
+    kout << "Total run time: " << time.count() << " s" << endl;
+    kernel_stats.time_total += time.count();
 
     //-------------------------------------------------------------------------
 
-    cout << "--------------------------------------------------------" << endl;
+    kout << "--------------------------------------------------------" << endl;
+
+}
+
+void sw_dir_cor_comp(
+    float* vert_grid,
+    int dem_dim_0, int dem_dim_1,
+    float* vert_grid_in,
+    int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
+    double* sun_pos,
+    int dim_sun_0, int dim_sun_1,
+    float* sw_dir_cor,
+    int pixel_per_gc,
+    int offset_gc,
+    uint8_t* mask,
+    double dist_search,
+    char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    int use_float32,
+    int refrac_cor,
+    double sw_dir_cor_max,
+    double ang_max,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data) {
+
+    // Single dispatch to kernel specialised for precision and refraction
+    // correction (lookup table; double precision only)
+    dispatch_flag(use_float32, [&](auto f32) {
+        dispatch_flag((refrac_cor != REFRAC_NONE) && (use_float32 == 0),
+            [&](auto refrac) {
+            constexpr int USE_FLOAT32 = decltype(f32)::value;
+            constexpr int REFRAC = (decltype(refrac)::value == 1)
+                ? REFRAC_TABLE : REFRAC_NONE;
+            sw_dir_cor_comp_spec<REFRAC, USE_FLOAT32>(vert_grid, dem_dim_0,
+                dem_dim_1, vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+                radius_earth, sun_pos, dim_sun_0, dim_sun_1, sw_dir_cor,
+                pixel_per_gc, offset_gc, mask, dist_search, geom_type,
+                scene_ext, build_quality, compact, robust, grain_size,
+                cost_order, sw_dir_cor_max, ang_max, block_rows, row_callback,
+                user_data);
+        });
+    });
 
 }
 
@@ -653,6 +625,7 @@ void sw_dir_cor_comp_coherent(
     int dem_dim_0, int dem_dim_1,
     float* vert_grid_in,
     int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
     double* sun_pos,
     int dim_sun_0, int dim_sun_1,
     float* sw_dir_cor,
@@ -661,12 +634,24 @@ void sw_dir_cor_comp_coherent(
     uint8_t* mask,
     double dist_search,
     char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
     double sw_dir_cor_max,
-    double ang_max) {
+    double ang_max,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data) {
+
+    KernelScope scope((dem_dim_in_0 - 1) / pixel_per_gc,
+        (dem_dim_in_1 - 1) / pixel_per_gc);
 
-    cout << "--------------------------------------------------------" << endl;
-    cout << "Compute lookup table with coherent rays" << endl;
-    cout << "--------------------------------------------------------" << endl;
+    kout << "--------------------------------------------------------" << endl;
+    kout << "Compute lookup table with coherent rays" << endl;
+    kout << "--------------------------------------------------------" << endl;
 
     // Hard-coded settings
     double ray_org_elev = 0.1;
@@ -676,308 +661,348 @@ void sw_dir_cor_comp_coherent(
     // Number of grid cells
     int num_gc_y = (dem_dim_in_0 - 1) / pixel_per_gc;
     int num_gc_x = (dem_dim_in_1 - 1) / pixel_per_gc;
-    cout << "Number of grid cells in y-direction: " << num_gc_y
+    kout << "Number of grid cells in y-direction: " << num_gc_y
         << endl;
-    cout << "Number of grid cells in x-direction: " << num_gc_x << endl;
+    kout << "Number of grid cells in x-direction: " << num_gc_x << endl;
 
     // Number of triangles
     int num_tri = (dem_dim_in_0 - 1) * (dem_dim_in_1 - 1) * 2;
-    cout << "Number of triangles: " << num_tri << endl;
+    kout << "Number of triangles: " << num_tri << endl;
     int num_tri_per_gc = pixel_per_gc * pixel_per_gc * 2;
 
     // Unit conversion(s)
     double dot_prod_min = cos(deg2rad(ang_max));
     dist_search *= 1000.0;  // [kilometre] to [metre]
-    cout << "Search distance: " << dist_search << " m" << endl;
+    kout << "Search distance: " << dist_search << " m" << endl;
 
-    cout << "ang_max: " << ang_max << " degree" << endl;
-    cout << "sw_dir_cor_max: " << sw_dir_cor_max  << endl;
+    kout << "ang_max: " << ang_max << " degree" << endl;
+    kout << "sw_dir_cor_max: " << sw_dir_cor_max  << endl;
 
     // Initialisation
     auto start_ini = std::chrono::high_resolution_clock::now();
-    RTCDevice device = initializeDevice();
-    RTCScene scene = initializeScene(device, vert_grid, dem_dim_0, dem_dim_1,
-        geom_type);
+    RTCDevice device = NULL;
+    RTCScene scene = scene_ext;
+    if (scene_ext == NULL) {
+        device = initializeDevice();
+        scene = initializeScene(device, vert_grid, dem_dim_0, dem_dim_1,
+            geom_type, build_quality, compact, robust);
+    } else {
+        kout << "Reuse committed scene" << endl;
+    }
     auto end_ini = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> time = end_ini - start_ini;
-    cout << "Total initialisation time: " << time.count() << " s" << endl;
+    kout << "Total initialisation time: " << time.count() << " s" << endl;
 
     //-------------------------------------------------------------------------
 
     auto start_ray = std::chrono::high_resolution_clock::now();
     size_t num_rays = 0;
+    size_t row_size = num_gc_x * dim_sun_0 * dim_sun_1;
 
-    num_rays += tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, num_gc_y), 0.0,
-        [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
-
-    // Loop through 2D-field of grid cells
-    //for (size_t i = 0; i < num_gc_y; i++) {  // serial
-    for (size_t i=r.begin(); i<r.end(); ++i) {  // parallel
-        for (size_t j = 0; j < num_gc_x; j++) {
+    // Compute rows [row_beg, row_end) of lookup table ('sw_dir_cor_rows'
+    // only holds these rows)
+    auto compute_rows = [&](size_t row_beg, size_t row_end,
+        float* sw_dir_cor_rows) {
 
+    // Fill masked grid cells with NaN
+    for (size_t i = row_beg; i < row_end; i++) {
+        for (size_t j = 0; j < (size_t)num_gc_x; j++) {
             size_t lin_ind_gc = lin_ind_2d(num_gc_x, i, j);
-            if (mask[lin_ind_gc] == 1) {
-
-            double* norm_tilt = new double[num_tri_per_gc * 3];
-            double* ray_org = new double[num_tri_per_gc * 3];
-            double* norm_hori = new double[num_tri_per_gc * 3];
-            double* surf_enl_fac = new double[num_tri_per_gc];
-            float* sw_dir_cor_ray = new float[num_tri_per_gc];
+            if (mask[lin_ind_gc] != 1) {
+                size_t ind_lin = lin_ind_4d(num_gc_x, dim_sun_0, dim_sun_1,
+                    i - row_beg, j, 0, 0);
+                for (size_t k = 0; k < (size_t)(dim_sun_0 * dim_sun_1) ; k++) {
+                    sw_dir_cor_rows[ind_lin + k] = NAN;
+                }
+            }
+        }
+    }
 
-            // Compute triangle's centroid, surface normal and area
-            size_t ind_incr_3 = 0;
-            size_t ind_incr_1 = 0;
-            for (size_t k = (i * pixel_per_gc);
-                k < ((i * pixel_per_gc) + pixel_per_gc); k++) {
-                for (size_t m = (j * pixel_per_gc);
-                    m < ((j * pixel_per_gc) + pixel_per_gc); m++) {
+    // Compacted list of active grid cells
+    size_t num_cells;
+    size_t* cells = active_cells(mask, num_gc_x, row_beg, row_end,
+        vert_grid, dem_dim_1, pixel_per_gc, offset_gc, cost_order,
+        num_cells);
 
-                    // Loop through two triangles per pixel
-                    for (size_t n = 0; n < 2; n++) {
+    size_t num_rays_rows = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_cells, grain_size), 0.0,
+        [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
 
-                        //-----------------------------------------------------
-                        // Tilted triangle
-                        //-----------------------------------------------------
+    size_t num_rays_beg = num_rays;
+    size_t num_culled = 0;
+
+    // Scratch buffers (triangle geometry and rays of grid cell; reused for
+    // all grid cells of task)
+    ScratchArena &arena = scratch_arena();
+    arena.begin(3 * scratch_size<double>(num_tri_per_gc * 3)
+        + scratch_size<double>(num_tri_per_gc)
+        + scratch_size<float>(num_tri_per_gc)
+        + scratch_size<RTCRay>(num_tri_per_gc));
+    double* norm_tilt = arena.alloc<double>(num_tri_per_gc * 3);
+    double* ray_org = arena.alloc<double>(num_tri_per_gc * 3);
+    double* norm_hori = arena.alloc<double>(num_tri_per_gc * 3);
+    double* surf_enl_fac = arena.alloc<double>(num_tri_per_gc);
+    float* sw_dir_cor_ray = arena.alloc<float>(num_tri_per_gc);
+    RTCRay* rays = arena.alloc<RTCRay>(num_tri_per_gc);
+
+    // Loop through active grid cells
+    //for (size_t ind = 0; ind < num_cells; ind++) {  // serial
+    for (size_t ind = r.begin(); ind < r.end(); ++ind) {  // parallel
+
+        size_t i = cells[ind] / num_gc_x;
+        size_t j = cells[ind] % num_gc_x;
+        size_t num_rays_cell = num_rays;
+
+
+        // Compute triangle's centroid, surface normal and area
+        size_t ind_incr_3 = 0;
+        size_t ind_incr_1 = 0;
+        for (size_t k = (i * pixel_per_gc);
+            k < ((i * pixel_per_gc) + pixel_per_gc); k++) {
+            for (size_t m = (j * pixel_per_gc);
+                m < ((j * pixel_per_gc) + pixel_per_gc); m++) {
+
+                // Loop through two triangles per pixel
+                for (size_t n = 0; n < 2; n++) {
 
-                        size_t ind_tri_0, ind_tri_1, ind_tri_2;
-                        func_ptr[n](dem_dim_1,
-                            k + (pixel_per_gc * offset_gc),
-                            m + (pixel_per_gc * offset_gc),
-                            ind_tri_0, ind_tri_1, ind_tri_2);
-
-                        double vert_0_x = (double)vert_grid[ind_tri_0];
-                        double vert_0_y = (double)vert_grid[ind_tri_0 + 1];
-                        double vert_0_z = (double)vert_grid[ind_tri_0 + 2];
-                        double vert_1_x = (double)vert_grid[ind_tri_1];
-                        double vert_1_y = (double)vert_grid[ind_tri_1 + 1];
-                        double vert_1_z = (double)vert_grid[ind_tri_1 + 2];
-                        double vert_2_x = (double)vert_grid[ind_tri_2];
-                        double vert_2_y = (double)vert_grid[ind_tri_2 + 1];
-                        double vert_2_z = (double)vert_grid[ind_tri_2 + 2];
-
-                        double cent_x, cent_y, cent_z;
-                        triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            cent_x, cent_y, cent_z);
+                    //---------------------------------------------------------
+                    // Tilted triangle
+                    //---------------------------------------------------------
 
-                        double norm_tilt_x, norm_tilt_y, norm_tilt_z, area_tilt;
-                        triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            norm_tilt_x, norm_tilt_y, norm_tilt_z,
-                            area_tilt);
-                        norm_tilt[ind_incr_3] = norm_tilt_x;
-                        norm_tilt[ind_incr_3 + 1] = norm_tilt_y;
-                        norm_tilt[ind_incr_3 + 2] = norm_tilt_z;
-
-                        // Ray origin
-                        ray_org[ind_incr_3] = (cent_x
-                            + norm_tilt_x * ray_org_elev);
-                        ray_org[ind_incr_3 + 1] = (cent_y
-                            + norm_tilt_y * ray_org_elev);
-                        ray_org[ind_incr_3 + 2] = (cent_z
-                            + norm_tilt_z * ray_org_elev);
+                    size_t ind_tri_0, ind_tri_1, ind_tri_2;
+                    triangle_vert(n, dem_dim_1,
+                        k + (pixel_per_gc * offset_gc),
+                        m + (pixel_per_gc * offset_gc),
+                        ind_tri_0, ind_tri_1, ind_tri_2);
+
+                    double vert_0_x = (double)vert_grid[ind_tri_0];
+                    double vert_0_y = (double)vert_grid[ind_tri_0 + 1];
+                    double vert_0_z = (double)vert_grid[ind_tri_0 + 2];
+                    double vert_1_x = (double)vert_grid[ind_tri_1];
+                    double vert_1_y = (double)vert_grid[ind_tri_1 + 1];
+                    double vert_1_z = (double)vert_grid[ind_tri_1 + 2];
+                    double vert_2_x = (double)vert_grid[ind_tri_2];
+                    double vert_2_y = (double)vert_grid[ind_tri_2 + 1];
+                    double vert_2_z = (double)vert_grid[ind_tri_2 + 2];
+
+                    double cent_x, cent_y, cent_z;
+                    triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        cent_x, cent_y, cent_z);
+
+                    double norm_tilt_x, norm_tilt_y, norm_tilt_z, area_tilt;
+                    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        norm_tilt_x, norm_tilt_y, norm_tilt_z,
+                        area_tilt);
+                    norm_tilt[ind_incr_3] = norm_tilt_x;
+                    norm_tilt[ind_incr_3 + 1] = norm_tilt_y;
+                    norm_tilt[ind_incr_3 + 2] = norm_tilt_z;
+
+                    // Ray origin
+                    ray_org[ind_incr_3] = (cent_x
+                        + norm_tilt_x * ray_org_elev);
+                    ray_org[ind_incr_3 + 1] = (cent_y
+                        + norm_tilt_y * ray_org_elev);
+                    ray_org[ind_incr_3 + 2] = (cent_z
+                        + norm_tilt_z * ray_org_elev);
 
-                        //-----------------------------------------------------
-                        // Horizontal triangle
-                        //-----------------------------------------------------
+                    //---------------------------------------------------------
+                    // Horizontal triangle
+                    //---------------------------------------------------------
 
-                        func_ptr[n](dem_dim_in_1, k, m,
-                            ind_tri_0, ind_tri_1, ind_tri_2);
-
-                        vert_0_x = (double)vert_grid_in[ind_tri_0];
-                        vert_0_y = (double)vert_grid_in[ind_tri_0 + 1];
-                        vert_0_z = (double)vert_grid_in[ind_tri_0 + 2];
-                        vert_1_x = (double)vert_grid_in[ind_tri_1];
-                        vert_1_y = (double)vert_grid_in[ind_tri_1 + 1];
-                        vert_1_z = (double)vert_grid_in[ind_tri_1 + 2];
-                        vert_2_x = (double)vert_grid_in[ind_tri_2];
-                        vert_2_y = (double)vert_grid_in[ind_tri_2 + 1];
-                        vert_2_z = (double)vert_grid_in[ind_tri_2 + 2];
-
-                        double norm_hori_x, norm_hori_y, norm_hori_z,
-                            area_hori;
-                        triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            norm_hori_x, norm_hori_y, norm_hori_z,
-                            area_hori);
-                        norm_hori[ind_incr_3] = norm_hori_x;
-                        norm_hori[ind_incr_3 + 1] = norm_hori_y;
-                        norm_hori[ind_incr_3 + 2] = norm_hori_z;
+                    triangle_vert_hori(vert_grid_in, dem_dim_in_1,
+                        k, m, n, radius_earth,
+                        vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z);
 
-                        surf_enl_fac[ind_incr_1] = area_tilt / area_hori;
+                    double norm_hori_x, norm_hori_y, norm_hori_z,
+                        area_hori;
+                    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        norm_hori_x, norm_hori_y, norm_hori_z,
+                        area_hori);
+                    norm_hori[ind_incr_3] = norm_hori_x;
+                    norm_hori[ind_incr_3 + 1] = norm_hori_y;
+                    norm_hori[ind_incr_3 + 2] = norm_hori_z;
 
-                        ind_incr_3 = ind_incr_3 + 3;
-                        ind_incr_1 = ind_incr_1 + 1;
+                    surf_enl_fac[ind_incr_1] = area_tilt / area_hori;
 
-                    }
+                    ind_incr_3 = ind_incr_3 + 3;
+                    ind_incr_1 = ind_incr_1 + 1;
 
                 }
-            }
-
-            //-----------------------------------------------------------------
-            // Loop through sun positions and compute correction factors
-            //-----------------------------------------------------------------
-
-            RTCRay rays[num_tri_per_gc];
-
-            size_t ind_lin_sun;
-            for (size_t o = 0; o < dim_sun_0; o++) {
-                for (size_t p = 0; p < dim_sun_1; p++) {
-
-                    ind_lin_sun = lin_ind_3d(dim_sun_1, 3, o, p, 0);
-
-                    //---------------------------------------------------------
-                    // Compute correction factors (I)
-                    //---------------------------------------------------------
 
-                    ind_incr_3 = 0;
-                    ind_incr_1 = 0;
-                    unsigned int num_rays_gc = 0;
-                    for (size_t k = (i * pixel_per_gc);
-                        k < ((i * pixel_per_gc) + pixel_per_gc); k++) {
-                        for (size_t m = (j * pixel_per_gc);
-                            m < ((j * pixel_per_gc) + pixel_per_gc); m++) {
-
-                            // Loop through two triangles per pixel
-                            for (size_t n = 0; n < 2; n++) {
-
-                                // Compute sun unit vector
-                                double sun_x = (sun_pos[ind_lin_sun]
-                                    - ray_org[ind_incr_3]);
-                                double sun_y = (sun_pos[ind_lin_sun + 1]
-                                    - ray_org[ind_incr_3 + 1]);
-                                double sun_z = (sun_pos[ind_lin_sun + 2]
-                                    - ray_org[ind_incr_3 + 2]);
-                                vec_unit(sun_x, sun_y, sun_z);
-
-                                // Check for self-shadowing (Earth)
-                                double dot_prod_hs
-                                    = (norm_hori[ind_incr_3] * sun_x
-                                    + norm_hori[ind_incr_3 + 1] * sun_y
-                                    + norm_hori[ind_incr_3 + 2] * sun_z);
-                                if (dot_prod_hs <= dot_prod_min) {
-                                    ind_incr_3 = ind_incr_3 + 3;
-                                    ind_incr_1 = ind_incr_1 + 1;
-                                    continue;  // sw_dir_cor += 0.0
-                                }
-
-                                // Check for self-shadowing (triangle)
-                                double dot_prod_ts
-                                    = norm_tilt[ind_incr_3] * sun_x
-                                    + norm_tilt[ind_incr_3 + 1] * sun_y
-                                    + norm_tilt[ind_incr_3 + 2] * sun_z;
-                                if (dot_prod_ts <= 0.0) {
-                                    ind_incr_3 = ind_incr_3 + 3;
-                                    ind_incr_1 = ind_incr_1 + 1;
-                                    continue;  // sw_dir_cor += 0.0
-                                }
-
-                                // Add ray
-                                rays[num_rays_gc].org_x
-                                    = (float)ray_org[ind_incr_3];
-                                rays[num_rays_gc].org_y
-                                    = (float)ray_org[ind_incr_3 + 1];
-                                rays[num_rays_gc].org_z
-                                    = (float)ray_org[ind_incr_3 + 2];
-                                rays[num_rays_gc].dir_x = (float)sun_x;
-                                rays[num_rays_gc].dir_y = (float)sun_y;
-                                rays[num_rays_gc].dir_z = (float)sun_z;
-                                rays[num_rays_gc].tnear = 0.0;
-                                rays[num_rays_gc].tfar = (float)dist_search;
-                                // std::numeric_limits<float>::infinity();
-                                rays[num_rays_gc].id = num_rays_gc;
-
-                                sw_dir_cor_ray[num_rays_gc] =
-                                    (float)(std::min(((dot_prod_ts
-                                    / dot_prod_hs)
-                                    * surf_enl_fac[ind_incr_1]),
-                                    sw_dir_cor_max));
-                                num_rays_gc = num_rays_gc + 1;
+            }
+        }
 
+        //---------------------------------------------------------------------
+        // Loop through sun positions and compute correction factors
+        //---------------------------------------------------------------------
+
+        size_t ind_lin_sun;
+        for (size_t o = 0; o < (size_t)dim_sun_0; o++) {
+            for (size_t p = 0; p < (size_t)dim_sun_1; p++) {
+
+                ind_lin_sun = lin_ind_3d(dim_sun_1, 3, o, p, 0);
+
+                //-------------------------------------------------------------
+                // Compute correction factors (I)
+                //-------------------------------------------------------------
+
+                ind_incr_3 = 0;
+                ind_incr_1 = 0;
+                unsigned int num_rays_gc = 0;
+                for (size_t k = (i * pixel_per_gc);
+                    k < ((i * pixel_per_gc) + pixel_per_gc); k++) {
+                    for (size_t m = (j * pixel_per_gc);
+                        m < ((j * pixel_per_gc) + pixel_per_gc); m++) {
+
+                        // Loop through two triangles per pixel
+                        for (size_t n = 0; n < 2; n++) {
+
+                            // Compute sun unit vector
+                            double sun_x = (sun_pos[ind_lin_sun]
+                                - ray_org[ind_incr_3]);
+                            double sun_y = (sun_pos[ind_lin_sun + 1]
+                                - ray_org[ind_incr_3 + 1]);
+                            double sun_z = (sun_pos[ind_lin_sun + 2]
+                                - ray_org[ind_incr_3 + 2]);
+                            vec_unit(sun_x, sun_y, sun_z);
+
+                            // Check for self-shadowing (Earth)
+                            double dot_prod_hs
+                                = (norm_hori[ind_incr_3] * sun_x
+                                + norm_hori[ind_incr_3 + 1] * sun_y
+                                + norm_hori[ind_incr_3 + 2] * sun_z);
+                            if (dot_prod_hs <= dot_prod_min) {
                                 ind_incr_3 = ind_incr_3 + 3;
                                 ind_incr_1 = ind_incr_1 + 1;
-
+                                num_culled += 1;
+                                continue;  // sw_dir_cor += 0.0
                             }
 
-                        }
-                    }
-
-                    //---------------------------------------------------------
-                    // Compute correction factors (II)
-                    //---------------------------------------------------------
+                            // Check for self-shadowing (triangle)
+                            double dot_prod_ts
+                                = norm_tilt[ind_incr_3] * sun_x
+                                + norm_tilt[ind_incr_3 + 1] * sun_y
+                                + norm_tilt[ind_incr_3 + 2] * sun_z;
+                            if (dot_prod_ts <= 0.0) {
+                                ind_incr_3 = ind_incr_3 + 3;
+                                ind_incr_1 = ind_incr_1 + 1;
+                                num_culled += 1;
+                                continue;  // sw_dir_cor += 0.0
+                            }
 
-                    struct RTCIntersectContext context;
-                    rtcInitIntersectContext(&context);
-                    context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+                            // Add ray
+                            rays[num_rays_gc].org_x
+                                = (float)ray_org[ind_incr_3];
+                            rays[num_rays_gc].org_y
+                                = (float)ray_org[ind_incr_3 + 1];
+                            rays[num_rays_gc].org_z
+                                = (float)ray_org[ind_incr_3 + 2];
+                            rays[num_rays_gc].dir_x = (float)sun_x;
+                            rays[num_rays_gc].dir_y = (float)sun_y;
+                            rays[num_rays_gc].dir_z = (float)sun_z;
+                            rays[num_rays_gc].tnear = 0.0;
+                            rays[num_rays_gc].tfar = (float)dist_search;
+                            // std::numeric_limits<float>::infinity();
+                            rays[num_rays_gc].id = num_rays_gc;
+
+                            sw_dir_cor_ray[num_rays_gc] =
+                                (float)(std::min(((dot_prod_ts
+                                / dot_prod_hs)
+                                * surf_enl_fac[ind_incr_1]),
+                                sw_dir_cor_max));
+                            num_rays_gc = num_rays_gc + 1;
+
+                            ind_incr_3 = ind_incr_3 + 3;
+                            ind_incr_1 = ind_incr_1 + 1;
 
-                    // Intersect rays with scene
-                    rtcOccluded1M(scene, &context,(RTCRay*)rays, num_rays_gc,
-                        sizeof(RTCRay));
-                    num_rays += num_rays_gc;
+                        }
 
-                    float sw_dir_cor_agg = 0.0;
-                    for (size_t k = 0; k < num_rays_gc; k++) {
-                        if (rays[k].tfar > 0.0) {
-                            // no intersection -> 'tfar' is not updated;
-                            // otherwise 'tfar' = -inf
-                            sw_dir_cor_agg = sw_dir_cor_agg
-                                + sw_dir_cor_ray[rays[k].id];
-                        }  // else: sw_dir_cor += 0.0
                     }
-
-                    size_t ind_lin_cor = lin_ind_4d(num_gc_x,
-                        dim_sun_0, dim_sun_1, i, j, o, p);
-                    sw_dir_cor[ind_lin_cor] = sw_dir_cor_agg 
-                        / (float)num_tri_per_gc;
-
                 }
-            }
-
-            delete[] norm_tilt;
-            delete[] ray_org;
-            delete[] norm_hori;
-            delete[] surf_enl_fac;
-            delete[] sw_dir_cor_ray;
 
-            } else {
-
-                size_t ind_lin = lin_ind_4d(num_gc_x, dim_sun_0, dim_sun_1,
-                    i, j, 0, 0);
-                for (size_t k = 0; k < (dim_sun_0 * dim_sun_1) ; k++) {
-                    sw_dir_cor[ind_lin + k] = NAN;
+                //-------------------------------------------------------------
+                // Compute correction factors (II)
+                //-------------------------------------------------------------
+
+                struct RTCIntersectContext context;
+                rtcInitIntersectContext(&context);
+                context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+
+                // Intersect rays with scene
+                rtcOccluded1M(scene, &context,(RTCRay*)rays, num_rays_gc,
+                    sizeof(RTCRay));
+                num_rays += num_rays_gc;
+
+                float sw_dir_cor_agg = 0.0;
+                for (size_t k = 0; k < num_rays_gc; k++) {
+                    if (rays[k].tfar > 0.0) {
+                        // no intersection -> 'tfar' is not updated;
+                        // otherwise 'tfar' = -inf
+                        sw_dir_cor_agg = sw_dir_cor_agg
+                            + sw_dir_cor_ray[rays[k].id];
+                    }  // else: sw_dir_cor += 0.0
                 }
 
-            }
+                size_t ind_lin_cor = lin_ind_4d(num_gc_x,
+                    dim_sun_0, dim_sun_1, i - row_beg, j, o, p);
+                sw_dir_cor_rows[ind_lin_cor] = sw_dir_cor_agg
+                    / (float)num_tri_per_gc;
 
+            }
         }
+
+        stats_cell(cells[ind], num_rays - num_rays_cell);
+
     }
 
+    stats_thread(num_rays - num_rays_beg, num_culled);
     return num_rays;  // parallel
     }, std::plus<size_t>());  // parallel
 
+    delete[] cells;
+
+    return num_rays_rows;
+    };
+
+    if (row_callback == NULL) {
+        num_rays = compute_rows(0, num_gc_y, sw_dir_cor);
+    } else {
+        num_rays = stream_rows(compute_rows, num_gc_y, row_size,
+            (size_t)block_rows, row_callback, user_data);
+    }
+
     auto end_ray = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> time_ray = (end_ray - start_ray);
-    cout << "Ray tracing time: " << time_ray.count() << " s" << endl;
-    cout << "Number of rays shot: " << num_rays << endl;
+    kout << "Ray tracing time: " << time_ray.count() << " s" << endl;
+    kout << "Number of rays shot: " << num_rays << endl;
     double frac_ray = (double)num_rays /
         ((double)num_tri * (double)dim_sun_0 * (double)dim_sun_1);
-    cout << "Fraction of rays required: " << frac_ray << endl;
-
-    // Release resources allocated through Embree
-    rtcReleaseScene(scene);
-    rtcReleaseDevice(device);
+    kout << "Fraction of rays required: " << frac_ray << endl;
+    kernel_stats.time_ray += time_ray.count();
+    kernel_stats.num_rays += num_rays;
+
+    // Release resources allocated through Embree (if not reused)
+    if (scene_ext == NULL) {
+        releaseScene(scene);
+        releaseDevice(device);
+    }
 
     auto end_tot = std::chrono::high_resolution_clock::now();
     time = end_tot - start_ini;
-    cout << "Total run time: " << time.count() << " s" << endl;
+    kout << "Total run time: " << time.count() << " s" << endl;
+    kernel_stats.time_total += time.count();
 
     //-------------------------------------------------------------------------
 
-    cout << "--------------------------------------------------------" << endl;
+    kout << "--------------------------------------------------------" << endl;
 
 }
 
@@ -990,6 +1015,7 @@ void sw_dir_cor_comp_coherent_rp8(
     int dem_dim_0, int dem_dim_1,
     float* vert_grid_in,
     int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
     double* sun_pos,
     int dim_sun_0, int dim_sun_1,
     float* sw_dir_cor,
@@ -998,13 +1024,25 @@ void sw_dir_cor_comp_coherent_rp8(
     uint8_t* mask,
     double dist_search,
     char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
     double sw_dir_cor_max,
-    double ang_max) {
+    double ang_max,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data) {
+
+    KernelScope scope((dem_dim_in_0 - 1) / pixel_per_gc,
+        (dem_dim_in_1 - 1) / pixel_per_gc);
 
-    cout << "--------------------------------------------------------" << endl;
-    cout << "Compute lookup table with coherent rays" << endl;
-    cout << "(packages with 8 rays)" << endl;
-    cout << "--------------------------------------------------------" << endl;
+    kout << "--------------------------------------------------------" << endl;
+    kout << "Compute lookup table with coherent rays" << endl;
+    kout << "(packages with 8 rays)" << endl;
+    kout << "--------------------------------------------------------" << endl;
 
     // Hard-coded settings
     double ray_org_elev = 0.1;
@@ -1014,315 +1052,1850 @@ void sw_dir_cor_comp_coherent_rp8(
     // Number of grid cells
     int num_gc_y = (dem_dim_in_0 - 1) / pixel_per_gc;
     int num_gc_x = (dem_dim_in_1 - 1) / pixel_per_gc;
-    cout << "Number of grid cells in y-direction: " << num_gc_y
+    kout << "Number of grid cells in y-direction: " << num_gc_y
         << endl;
-    cout << "Number of grid cells in x-direction: " << num_gc_x << endl;
+    kout << "Number of grid cells in x-direction: " << num_gc_x << endl;
 
     // Number of triangles
     int num_tri = (dem_dim_in_0 - 1) * (dem_dim_in_1 - 1) * 2;
-    cout << "Number of triangles: " << num_tri << endl;
+    kout << "Number of triangles: " << num_tri << endl;
 
     // Unit conversion(s)
     double dot_prod_min = cos(deg2rad(ang_max));
     dist_search *= 1000.0;  // [kilometre] to [metre]
-    cout << "Search distance: " << dist_search << " m" << endl;
+    kout << "Search distance: " << dist_search << " m" << endl;
 
-    cout << "ang_max: " << ang_max << " degree" << endl;
-    cout << "sw_dir_cor_max: " << sw_dir_cor_max  << endl;
+    kout << "ang_max: " << ang_max << " degree" << endl;
+    kout << "sw_dir_cor_max: " << sw_dir_cor_max  << endl;
 
     // Initialisation
     auto start_ini = std::chrono::high_resolution_clock::now();
-    RTCDevice device = initializeDevice();
-    RTCScene scene = initializeScene(device, vert_grid, dem_dim_0, dem_dim_1,
-        geom_type);
+    RTCDevice device = NULL;
+    RTCScene scene = scene_ext;
+    if (scene_ext == NULL) {
+        device = initializeDevice();
+        scene = initializeScene(device, vert_grid, dem_dim_0, dem_dim_1,
+            geom_type, build_quality, compact, robust);
+    } else {
+        kout << "Reuse committed scene" << endl;
+    }
     auto end_ini = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> time = end_ini - start_ini;
-    cout << "Total initialisation time: " << time.count() << " s" << endl;
+    kout << "Total initialisation time: " << time.count() << " s" << endl;
 
     //-------------------------------------------------------------------------
 
     auto start_ray = std::chrono::high_resolution_clock::now();
     size_t num_rays = 0;
+    size_t row_size = num_gc_x * dim_sun_0 * dim_sun_1;
 
-    num_rays += tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, num_gc_y), 0.0,
-        [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
-
-    // Loop through 2D-field of grid cells
-    //for (size_t i = 0; i < num_gc_y; i++) {  // serial
-    for (size_t i=r.begin(); i<r.end(); ++i) {  // parallel
-        for (size_t j = 0; j < num_gc_x; j++) {
+    // Compute rows [row_beg, row_end) of lookup table ('sw_dir_cor_rows'
+    // only holds these rows)
+    auto compute_rows = [&](size_t row_beg, size_t row_end,
+        float* sw_dir_cor_rows) {
 
+    // Fill masked grid cells with NaN
+    for (size_t i = row_beg; i < row_end; i++) {
+        for (size_t j = 0; j < (size_t)num_gc_x; j++) {
             size_t lin_ind_gc = lin_ind_2d(num_gc_x, i, j);
-            if (mask[lin_ind_gc] == 1) {
+            if (mask[lin_ind_gc] != 1) {
+                size_t ind_lin = lin_ind_4d(num_gc_x, dim_sun_0, dim_sun_1,
+                    i - row_beg, j, 0, 0);
+                for (size_t k = 0; k < (size_t)(dim_sun_0 * dim_sun_1) ; k++) {
+                    sw_dir_cor_rows[ind_lin + k] = NAN;
+                }
+            }
+        }
+    }
 
-            double* norm_tilt = new double[8 * 3];
-            double* ray_org = new double[8 * 3];
-            double* norm_hori = new double[8 * 3];
-            double* surf_enl_fac = new double[8];
-            float* sw_dir_cor_ray = new float[8];
-            RTCRay8 ray8;
+    // Compacted list of active grid cells
+    size_t num_cells;
+    size_t* cells = active_cells(mask, num_gc_x, row_beg, row_end,
+        vert_grid, dem_dim_1, pixel_per_gc, offset_gc, cost_order,
+        num_cells);
 
-            // Loop through pixels within grid cell (-> process by blocks of 4)
-            for (size_t k = (i * pixel_per_gc);
-                k < ((i * pixel_per_gc) + pixel_per_gc); k += 2) {
-                for (size_t m = (j * pixel_per_gc);
-                    m < ((j * pixel_per_gc) + pixel_per_gc); m += 2) {
+    size_t num_rays_rows = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_cells, grain_size), 0.0,
+        [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
 
-                    size_t ind_incr_3 = 0;
-                    size_t ind_incr_1 = 0;
-                    for (size_t k_block = k; k_block < (k + 2); k_block++) {
-                    for (size_t m_block = m; m_block < (m + 2); m_block++) {
+    size_t num_rays_beg = num_rays;
+    size_t num_culled = 0;
 
-                    // Loop through two triangles per pixel
-                    for (size_t n = 0; n < 2; n++) {
+    // Scratch buffers (triangle geometry and ray packet of block of 4
+    // pixels; reused for all grid cells of task)
+    ScratchArena &arena = scratch_arena();
+    arena.begin(3 * scratch_size<double>(8 * 3) + scratch_size<double>(8)
+        + scratch_size<float>(8) + scratch_size<RTCRay8>(1));
+    double* norm_tilt = arena.alloc<double>(8 * 3);
+    double* ray_org = arena.alloc<double>(8 * 3);
+    double* norm_hori = arena.alloc<double>(8 * 3);
+    double* surf_enl_fac = arena.alloc<double>(8);
+    float* sw_dir_cor_ray = arena.alloc<float>(8);
+    RTCRay8 &ray8 = *arena.alloc<RTCRay8>(1);
 
-                        //-----------------------------------------------------
-                        // Tilted triangle
-                        //-----------------------------------------------------
+    // Loop through active grid cells
+    //for (size_t ind = 0; ind < num_cells; ind++) {  // serial
+    for (size_t ind = r.begin(); ind < r.end(); ++ind) {  // parallel
 
-                        size_t ind_tri_0, ind_tri_1, ind_tri_2;
-                        func_ptr[n](dem_dim_1,
-                            k_block + (pixel_per_gc * offset_gc),
-                            m_block + (pixel_per_gc * offset_gc),
-                            ind_tri_0, ind_tri_1, ind_tri_2);
-
-                        double vert_0_x = (double)vert_grid[ind_tri_0];
-                        double vert_0_y = (double)vert_grid[ind_tri_0 + 1];
-                        double vert_0_z = (double)vert_grid[ind_tri_0 + 2];
-                        double vert_1_x = (double)vert_grid[ind_tri_1];
-                        double vert_1_y = (double)vert_grid[ind_tri_1 + 1];
-                        double vert_1_z = (double)vert_grid[ind_tri_1 + 2];
-                        double vert_2_x = (double)vert_grid[ind_tri_2];
-                        double vert_2_y = (double)vert_grid[ind_tri_2 + 1];
-                        double vert_2_z = (double)vert_grid[ind_tri_2 + 2];
-
-                        double cent_x, cent_y, cent_z;
-                        triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            cent_x, cent_y, cent_z);
+        size_t i = cells[ind] / num_gc_x;
+        size_t j = cells[ind] % num_gc_x;
+        size_t num_rays_cell = num_rays;
 
-                        double norm_tilt_x, norm_tilt_y, norm_tilt_z,
-                            area_tilt;
-                        triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            norm_tilt_x, norm_tilt_y, norm_tilt_z,
-                            area_tilt);
-                        norm_tilt[ind_incr_3] = norm_tilt_x;
-                        norm_tilt[ind_incr_3 + 1] = norm_tilt_y;
-                        norm_tilt[ind_incr_3 + 2] = norm_tilt_z;
-
-                        // Ray origin
-                        ray_org[ind_incr_3] = (cent_x
-                            + norm_tilt_x * ray_org_elev);
-                        ray_org[ind_incr_3 + 1] = (cent_y
-                            + norm_tilt_y * ray_org_elev);
-                        ray_org[ind_incr_3 + 2] = (cent_z
-                            + norm_tilt_z * ray_org_elev);
 
-                        //-----------------------------------------------------
-                        // Horizontal triangle
-                        //-----------------------------------------------------
+        // Loop through pixels within grid cell (-> process by blocks of 4)
+        for (size_t k = (i * pixel_per_gc);
+            k < ((i * pixel_per_gc) + pixel_per_gc); k += 2) {
+            for (size_t m = (j * pixel_per_gc);
+                m < ((j * pixel_per_gc) + pixel_per_gc); m += 2) {
 
-                        func_ptr[n](dem_dim_in_1, k_block, m_block,
-                            ind_tri_0, ind_tri_1, ind_tri_2);
-
-                        vert_0_x = (double)vert_grid_in[ind_tri_0];
-                        vert_0_y = (double)vert_grid_in[ind_tri_0 + 1];
-                        vert_0_z = (double)vert_grid_in[ind_tri_0 + 2];
-                        vert_1_x = (double)vert_grid_in[ind_tri_1];
-                        vert_1_y = (double)vert_grid_in[ind_tri_1 + 1];
-                        vert_1_z = (double)vert_grid_in[ind_tri_1 + 2];
-                        vert_2_x = (double)vert_grid_in[ind_tri_2];
-                        vert_2_y = (double)vert_grid_in[ind_tri_2 + 1];
-                        vert_2_z = (double)vert_grid_in[ind_tri_2 + 2];
-
-                        double norm_hori_x, norm_hori_y, norm_hori_z,
-                            area_hori;
-                        triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            norm_hori_x, norm_hori_y, norm_hori_z,
-                            area_hori);
-                        norm_hori[ind_incr_3] = norm_hori_x;
-                        norm_hori[ind_incr_3 + 1] = norm_hori_y;
-                        norm_hori[ind_incr_3 + 2] = norm_hori_z;
+                size_t ind_incr_3 = 0;
+                size_t ind_incr_1 = 0;
+                for (size_t k_block = k; k_block < (k + 2); k_block++) {
+                for (size_t m_block = m; m_block < (m + 2); m_block++) {
 
-                        surf_enl_fac[ind_incr_1] = area_tilt / area_hori;
+                // Loop through two triangles per pixel
+                for (size_t n = 0; n < 2; n++) {
 
-                        ind_incr_3 = ind_incr_3 + 3;
-                        ind_incr_1 = ind_incr_1 + 1;
+                    //---------------------------------------------------------
+                    // Tilted triangle
+                    //---------------------------------------------------------
 
-                    }
-
-                    }
-                    }
+                    size_t ind_tri_0, ind_tri_1, ind_tri_2;
+                    triangle_vert(n, dem_dim_1,
+                        k_block + (pixel_per_gc * offset_gc),
+                        m_block + (pixel_per_gc * offset_gc),
+                        ind_tri_0, ind_tri_1, ind_tri_2);
+
+                    double vert_0_x = (double)vert_grid[ind_tri_0];
+                    double vert_0_y = (double)vert_grid[ind_tri_0 + 1];
+                    double vert_0_z = (double)vert_grid[ind_tri_0 + 2];
+                    double vert_1_x = (double)vert_grid[ind_tri_1];
+                    double vert_1_y = (double)vert_grid[ind_tri_1 + 1];
+                    double vert_1_z = (double)vert_grid[ind_tri_1 + 2];
+                    double vert_2_x = (double)vert_grid[ind_tri_2];
+                    double vert_2_y = (double)vert_grid[ind_tri_2 + 1];
+                    double vert_2_z = (double)vert_grid[ind_tri_2 + 2];
+
+                    double cent_x, cent_y, cent_z;
+                    triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        cent_x, cent_y, cent_z);
+
+                    double norm_tilt_x, norm_tilt_y, norm_tilt_z,
+                        area_tilt;
+                    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        norm_tilt_x, norm_tilt_y, norm_tilt_z,
+                        area_tilt);
+                    norm_tilt[ind_incr_3] = norm_tilt_x;
+                    norm_tilt[ind_incr_3 + 1] = norm_tilt_y;
+                    norm_tilt[ind_incr_3 + 2] = norm_tilt_z;
+
+                    // Ray origin
+                    ray_org[ind_incr_3] = (cent_x
+                        + norm_tilt_x * ray_org_elev);
+                    ray_org[ind_incr_3 + 1] = (cent_y
+                        + norm_tilt_y * ray_org_elev);
+                    ray_org[ind_incr_3 + 2] = (cent_z
+                        + norm_tilt_z * ray_org_elev);
 
                     //---------------------------------------------------------
-                    // Loop through sun positions and compute correction
-                    // factors
+                    // Horizontal triangle
                     //---------------------------------------------------------
 
-                    for (size_t o = 0; o < dim_sun_0; o++) {
-                        for (size_t p = 0; p < dim_sun_1; p++) {
-
-                            ind_incr_3 = 0;
-                            ind_incr_1 = 0;
-                            unsigned int num_rays_gc = 0;
-                            int valid8[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-                            // 0: invalid
-
-                            size_t ind_lin_sun
-                                = lin_ind_3d(dim_sun_1, 3, o, p, 0);
-
-                            //-------------------------------------------------
-                            // Compute correction factors (I)
-                            //-------------------------------------------------
-
-                            for (size_t q = 0; q < 8; q++) {
-
-                                // Compute sun unit vector
-                                double sun_x = (sun_pos[ind_lin_sun]
-                                    - ray_org[ind_incr_3]);
-                                double sun_y = (sun_pos[ind_lin_sun + 1]
-                                    - ray_org[ind_incr_3 + 1]);
-                                double sun_z = (sun_pos[ind_lin_sun + 2]
-                                    - ray_org[ind_incr_3 + 2]);
-                                vec_unit(sun_x, sun_y, sun_z);
-
-                                // Check for self-shadowing (Earth)
-                                double dot_prod_hs
-                                    = (norm_hori[ind_incr_3] * sun_x
-                                    + norm_hori[ind_incr_3 + 1] * sun_y
-                                    + norm_hori[ind_incr_3 + 2] * sun_z);
-                                if (dot_prod_hs <= dot_prod_min) {
-                                    ind_incr_3 = ind_incr_3 + 3;
-                                    ind_incr_1 = ind_incr_1 + 1;
-                                    continue;  // sw_dir_cor += 0.0
-                                }
-
-                                // Check for self-shadowing (triangle)
-                                double dot_prod_ts
-                                    = norm_tilt[ind_incr_3] * sun_x
-                                    + norm_tilt[ind_incr_3 + 1] * sun_y
-                                    + norm_tilt[ind_incr_3 + 2] * sun_z;
-                                if (dot_prod_ts <= 0.0) {
-                                    ind_incr_3 = ind_incr_3 + 3;
-                                    ind_incr_1 = ind_incr_1 + 1;
-                                    continue;  // sw_dir_cor += 0.0
-                                }
-
-                                // Add ray
-                                ray8.org_x[num_rays_gc]
-                                    = (float)ray_org[ind_incr_3];
-                                ray8.org_y[num_rays_gc]
-                                    = (float)ray_org[ind_incr_3 + 1];
-                                ray8.org_z[num_rays_gc]
-                                    = (float)ray_org[ind_incr_3 + 2];
-                                ray8.tnear[num_rays_gc] = 0.0;
-                                ray8.dir_x[num_rays_gc] = (float)sun_x;
-                                ray8.dir_y[num_rays_gc] = (float)sun_y;
-                                ray8.dir_z[num_rays_gc] = (float)sun_z;
-                                ray8.tfar[num_rays_gc] = (float)dist_search;
-                                // std::numeric_limits<float>::infinity();
-                                ray8.id[num_rays_gc] = num_rays_gc;
-                                valid8[num_rays_gc] = -1; // -1: valid
-
-                                sw_dir_cor_ray[num_rays_gc] =
-                                    (float)(std::min(((dot_prod_ts
-                                    / dot_prod_hs)
-                                    * surf_enl_fac[ind_incr_1]),
-                                    sw_dir_cor_max));
-                                num_rays_gc = num_rays_gc + 1;
+                    triangle_vert_hori(vert_grid_in, dem_dim_in_1,
+                        k_block, m_block, n, radius_earth,
+                        vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z);
+
+                    double norm_hori_x, norm_hori_y, norm_hori_z,
+                        area_hori;
+                    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        norm_hori_x, norm_hori_y, norm_hori_z,
+                        area_hori);
+                    norm_hori[ind_incr_3] = norm_hori_x;
+                    norm_hori[ind_incr_3 + 1] = norm_hori_y;
+                    norm_hori[ind_incr_3 + 2] = norm_hori_z;
+
+                    surf_enl_fac[ind_incr_1] = area_tilt / area_hori;
+
+                    ind_incr_3 = ind_incr_3 + 3;
+                    ind_incr_1 = ind_incr_1 + 1;
+
+                }
+
+                }
+                }
+
+                //-------------------------------------------------------------
+                // Loop through sun positions and compute correction
+                // factors
+                //-------------------------------------------------------------
+
+                for (size_t o = 0; o < (size_t)dim_sun_0; o++) {
+                    for (size_t p = 0; p < (size_t)dim_sun_1; p++) {
 
+                        ind_incr_3 = 0;
+                        ind_incr_1 = 0;
+                        unsigned int num_rays_gc = 0;
+                        int valid8[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+                        // 0: invalid
+
+                        size_t ind_lin_sun
+                            = lin_ind_3d(dim_sun_1, 3, o, p, 0);
+
+                        //-----------------------------------------------------
+                        // Compute correction factors (I)
+                        //-----------------------------------------------------
+
+                        for (size_t q = 0; q < 8; q++) {
+
+                            // Compute sun unit vector
+                            double sun_x = (sun_pos[ind_lin_sun]
+                                - ray_org[ind_incr_3]);
+                            double sun_y = (sun_pos[ind_lin_sun + 1]
+                                - ray_org[ind_incr_3 + 1]);
+                            double sun_z = (sun_pos[ind_lin_sun + 2]
+                                - ray_org[ind_incr_3 + 2]);
+                            vec_unit(sun_x, sun_y, sun_z);
+
+                            // Check for self-shadowing (Earth)
+                            double dot_prod_hs
+                                = (norm_hori[ind_incr_3] * sun_x
+                                + norm_hori[ind_incr_3 + 1] * sun_y
+                                + norm_hori[ind_incr_3 + 2] * sun_z);
+                            if (dot_prod_hs <= dot_prod_min) {
                                 ind_incr_3 = ind_incr_3 + 3;
                                 ind_incr_1 = ind_incr_1 + 1;
+                                num_culled += 1;
+                                continue;  // sw_dir_cor += 0.0
+                            }
 
+                            // Check for self-shadowing (triangle)
+                            double dot_prod_ts
+                                = norm_tilt[ind_incr_3] * sun_x
+                                + norm_tilt[ind_incr_3 + 1] * sun_y
+                                + norm_tilt[ind_incr_3 + 2] * sun_z;
+                            if (dot_prod_ts <= 0.0) {
+                                ind_incr_3 = ind_incr_3 + 3;
+                                ind_incr_1 = ind_incr_1 + 1;
+                                num_culled += 1;
+                                continue;  // sw_dir_cor += 0.0
                             }
 
-                            //-------------------------------------------------
-                            // Compute correction factors (II)
-                            //-------------------------------------------------
+                            // Add ray
+                            ray8.org_x[num_rays_gc]
+                                = (float)ray_org[ind_incr_3];
+                            ray8.org_y[num_rays_gc]
+                                = (float)ray_org[ind_incr_3 + 1];
+                            ray8.org_z[num_rays_gc]
+                                = (float)ray_org[ind_incr_3 + 2];
+                            ray8.tnear[num_rays_gc] = 0.0;
+                            ray8.dir_x[num_rays_gc] = (float)sun_x;
+                            ray8.dir_y[num_rays_gc] = (float)sun_y;
+                            ray8.dir_z[num_rays_gc] = (float)sun_z;
+                            ray8.tfar[num_rays_gc] = (float)dist_search;
+                            // std::numeric_limits<float>::infinity();
+                            ray8.id[num_rays_gc] = num_rays_gc;
+                            valid8[num_rays_gc] = -1; // -1: valid
+
+                            sw_dir_cor_ray[num_rays_gc] =
+                                (float)(std::min(((dot_prod_ts
+                                / dot_prod_hs)
+                                * surf_enl_fac[ind_incr_1]),
+                                sw_dir_cor_max));
+                            num_rays_gc = num_rays_gc + 1;
+
+                            ind_incr_3 = ind_incr_3 + 3;
+                            ind_incr_1 = ind_incr_1 + 1;
 
-                            struct RTCIntersectContext context;
-                            rtcInitIntersectContext(&context);
-                            context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
-
-                            // Intersect rays with scene
-                            rtcOccluded8(valid8, scene, &context,
-                                (RTCRay8*)&ray8);
-                            num_rays += num_rays_gc;
-
-                            float sw_dir_cor_agg = 0.0;
-                            for (size_t n = 0; n < num_rays_gc; n++) {
-                                if (ray8.tfar[n] > 0.0) {
-                                // no intersection -> 'tfar' is not updated;
-                                // otherwise 'tfar' = -inf
-                                sw_dir_cor_agg = sw_dir_cor_agg
-                                    + sw_dir_cor_ray[n];
-                                }  // else: sw_dir_cor += 0.0
-                            }
+                        }
+
+                        //-----------------------------------------------------
+                        // Compute correction factors (II)
+                        //-----------------------------------------------------
+
+                        struct RTCIntersectContext context;
+                        rtcInitIntersectContext(&context);
+                        context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
 
-                            size_t ind_lin_cor = lin_ind_4d(num_gc_x,
-                                dim_sun_0, dim_sun_1, i, j, o, p);
-                            sw_dir_cor[ind_lin_cor] = sw_dir_cor[ind_lin_cor]
-                                + sw_dir_cor_agg;
+                        // Intersect rays with scene
+                        rtcOccluded8(valid8, scene, &context,
+                            (RTCRay8*)&ray8);
+                        num_rays += num_rays_gc;
 
+                        float sw_dir_cor_agg = 0.0;
+                        for (size_t n = 0; n < num_rays_gc; n++) {
+                            if (ray8.tfar[n] > 0.0) {
+                            // no intersection -> 'tfar' is not updated;
+                            // otherwise 'tfar' = -inf
+                            sw_dir_cor_agg = sw_dir_cor_agg
+                                + sw_dir_cor_ray[n];
+                            }  // else: sw_dir_cor += 0.0
                         }
+
+                        size_t ind_lin_cor = lin_ind_4d(num_gc_x,
+                            dim_sun_0, dim_sun_1, i - row_beg, j,
+                            o, p);
+                        sw_dir_cor_rows[ind_lin_cor]
+                            = sw_dir_cor_rows[ind_lin_cor]
+                            + sw_dir_cor_agg;
+
                     }
+                }
+
+            }
+        }
+
+        stats_cell(cells[ind], num_rays - num_rays_cell);
+
+    }
+
+    stats_thread(num_rays - num_rays_beg, num_culled);
+    return num_rays;  // parallel
+    }, std::plus<size_t>());  // parallel
+
+    delete[] cells;
+
+    // Divide accumulated values by number of triangles within grid cell
+    float num_tri_per_gc = pixel_per_gc * pixel_per_gc * 2.0;
+    size_t num_elem = (row_end - row_beg) * row_size;
+    for (size_t i = 0; i < num_elem; i++) {
+        sw_dir_cor_rows[i] /= num_tri_per_gc;
+    }
+
+    return num_rays_rows;
+    };
+
+    if (row_callback == NULL) {
+        num_rays = compute_rows(0, num_gc_y, sw_dir_cor);
+    } else {
+        num_rays = stream_rows(compute_rows, num_gc_y, row_size,
+            (size_t)block_rows, row_callback, user_data);
+    }
+
+    auto end_ray = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time_ray = (end_ray - start_ray);
+    kout << "Ray tracing time: " << time_ray.count() << " s" << endl;
+    kout << "Number of rays shot: " << num_rays << endl;
+    double frac_ray = (double)num_rays /
+        ((double)num_tri * (double)dim_sun_0 * (double)dim_sun_1);
+    kout << "Fraction of rays required: " << frac_ray << endl;
+    kernel_stats.time_ray += time_ray.count();
+    kernel_stats.num_rays += num_rays;
+
+    // Release resources allocated through Embree (if not reused)
+    if (scene_ext == NULL) {
+        releaseScene(scene);
+        releaseDevice(device);
+    }
 
+    auto end_tot = std::chrono::high_resolution_clock::now();
+    time = end_tot - start_ini;
+    kout << "Total run time: " << time.count() << " s" << endl;
+    kernel_stats.time_total += time.count();
+
+    //-------------------------------------------------------------------------
+
+    kout << "--------------------------------------------------------" << endl;
+
+}
+
+//-----------------------------------------------------------------------------
+// Use coherent rays (streams of rays from multiple grid cells)
+//-----------------------------------------------------------------------------
+
+void sw_dir_cor_comp_stream(
+    float* vert_grid,
+    int dem_dim_0, int dem_dim_1,
+    float* vert_grid_in,
+    int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
+    double* sun_pos,
+    int dim_sun_0, int dim_sun_1,
+    float* sw_dir_cor,
+    int pixel_per_gc,
+    int offset_gc,
+    uint8_t* mask,
+    double dist_search,
+    char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    double sw_dir_cor_max,
+    double ang_max,
+    int batch_size,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data) {
+
+    KernelScope scope((dem_dim_in_0 - 1) / pixel_per_gc,
+        (dem_dim_in_1 - 1) / pixel_per_gc);
+
+    kout << "--------------------------------------------------------" << endl;
+    kout << "Compute lookup table with coherent rays" << endl;
+    kout << "(streams with " << batch_size << " rays)" << endl;
+    kout << "--------------------------------------------------------" << endl;
+
+    // Hard-coded settings
+    double ray_org_elev = 0.1;
+    // value to elevate ray origin (-> avoids potential issue with numerical
+    // imprecision / truncation) [m]
+
+    // Number of grid cells
+    int num_gc_y = (dem_dim_in_0 - 1) / pixel_per_gc;
+    int num_gc_x = (dem_dim_in_1 - 1) / pixel_per_gc;
+    kout << "Number of grid cells in y-direction: " << num_gc_y
+        << endl;
+    kout << "Number of grid cells in x-direction: " << num_gc_x << endl;
+
+    // Number of triangles
+    int num_tri = (dem_dim_in_0 - 1) * (dem_dim_in_1 - 1) * 2;
+    kout << "Number of triangles: " << num_tri << endl;
+    int num_tri_per_gc = pixel_per_gc * pixel_per_gc * 2;
+
+    // Unit conversion(s)
+    double dot_prod_min = cos(deg2rad(ang_max));
+    dist_search *= 1000.0;  // [kilometre] to [metre]
+    kout << "Search distance: " << dist_search << " m" << endl;
+
+    kout << "ang_max: " << ang_max << " degree" << endl;
+    kout << "sw_dir_cor_max: " << sw_dir_cor_max  << endl;
+
+    // Initialisation
+    auto start_ini = std::chrono::high_resolution_clock::now();
+    RTCDevice device = NULL;
+    RTCScene scene = scene_ext;
+    if (scene_ext == NULL) {
+        device = initializeDevice();
+        scene = initializeScene(device, vert_grid, dem_dim_0, dem_dim_1,
+            geom_type, build_quality, compact, robust);
+    } else {
+        kout << "Reuse committed scene" << endl;
+    }
+    auto end_ini = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time = end_ini - start_ini;
+    kout << "Total initialisation time: " << time.count() << " s" << endl;
+
+    //-------------------------------------------------------------------------
+
+    auto start_ray = std::chrono::high_resolution_clock::now();
+    size_t num_rays = 0;
+    size_t row_size = num_gc_x * dim_sun_0 * dim_sun_1;
+
+    // Compute rows [row_beg, row_end) of lookup table ('sw_dir_cor_rows'
+    // only holds these rows)
+    auto compute_rows = [&](size_t row_beg, size_t row_end,
+        float* sw_dir_cor_rows) {
+
+    // Fill masked grid cells with NaN
+    for (size_t i = row_beg; i < row_end; i++) {
+        for (size_t j = 0; j < (size_t)num_gc_x; j++) {
+            size_t lin_ind_gc = lin_ind_2d(num_gc_x, i, j);
+            if (mask[lin_ind_gc] != 1) {
+                size_t ind_lin = lin_ind_4d(num_gc_x, dim_sun_0, dim_sun_1,
+                    i - row_beg, j, 0, 0);
+                for (size_t k = 0; k < (size_t)(dim_sun_0 * dim_sun_1) ; k++) {
+                    sw_dir_cor_rows[ind_lin + k] = NAN;
                 }
             }
+        }
+    }
+
+    // Compacted list of active grid cells
+    size_t num_cells;
+    size_t* cells = active_cells(mask, num_gc_x, row_beg, row_end,
+        vert_grid, dem_dim_1, pixel_per_gc, offset_gc, cost_order,
+        num_cells);
+
+    // Reset ray streams of all threads
+    for (RayStream &stream : ray_streams) {
+        stream.num_rays = 0;
+    }
+
+    size_t num_rays_rows = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_cells, grain_size), 0.0,
+        [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
+
+    size_t num_queued = 0;  // rays added to stream
+    size_t num_culled = 0;
+
+    RayStream &stream = ray_streams.local();
+    if (stream.num_rays == 0) {
+        stream.reserve(batch_size, num_tri_per_gc);
+    }  // buffers have required size if stream contains rays
+
+    // Loop through active grid cells
+    //for (size_t ind = 0; ind < num_cells; ind++) {  // serial
+    for (size_t ind = r.begin(); ind < r.end(); ++ind) {  // parallel
+
+        size_t i = cells[ind] / num_gc_x;
+        size_t j = cells[ind] % num_gc_x;
+        size_t num_culled_cell = num_culled;
+
+        // Compute triangle's centroid, surface normal and area
+        double* tri_geom = stream.tri_geom;
+        for (size_t k = (i * pixel_per_gc);
+            k < ((i * pixel_per_gc) + pixel_per_gc); k++) {
+            for (size_t m = (j * pixel_per_gc);
+                m < ((j * pixel_per_gc) + pixel_per_gc); m++) {
+
+                // Loop through two triangles per pixel
+                for (size_t n = 0; n < 2; n++) {
+
+                    //---------------------------------------------------------
+                    // Tilted triangle
+                    //---------------------------------------------------------
+
+                    size_t ind_tri_0, ind_tri_1, ind_tri_2;
+                    triangle_vert(n, dem_dim_1,
+                        k + (pixel_per_gc * offset_gc),
+                        m + (pixel_per_gc * offset_gc),
+                        ind_tri_0, ind_tri_1, ind_tri_2);
+
+                    double vert_0_x = (double)vert_grid[ind_tri_0];
+                    double vert_0_y = (double)vert_grid[ind_tri_0 + 1];
+                    double vert_0_z = (double)vert_grid[ind_tri_0 + 2];
+                    double vert_1_x = (double)vert_grid[ind_tri_1];
+                    double vert_1_y = (double)vert_grid[ind_tri_1 + 1];
+                    double vert_1_z = (double)vert_grid[ind_tri_1 + 2];
+                    double vert_2_x = (double)vert_grid[ind_tri_2];
+                    double vert_2_y = (double)vert_grid[ind_tri_2 + 1];
+                    double vert_2_z = (double)vert_grid[ind_tri_2 + 2];
+
+                    double cent_x, cent_y, cent_z;
+                    triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        cent_x, cent_y, cent_z);
+
+                    double norm_tilt_x, norm_tilt_y, norm_tilt_z, area_tilt;
+                    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        norm_tilt_x, norm_tilt_y, norm_tilt_z,
+                        area_tilt);
+
+                    // Ray origin
+                    tri_geom[0] = (cent_x + norm_tilt_x * ray_org_elev);
+                    tri_geom[1] = (cent_y + norm_tilt_y * ray_org_elev);
+                    tri_geom[2] = (cent_z + norm_tilt_z * ray_org_elev);
+                    tri_geom[3] = norm_tilt_x;
+                    tri_geom[4] = norm_tilt_y;
+                    tri_geom[5] = norm_tilt_z;
+
+                    //---------------------------------------------------------
+                    // Horizontal triangle
+                    //---------------------------------------------------------
+
+                    triangle_vert_hori(vert_grid_in, dem_dim_in_1,
+                        k, m, n, radius_earth,
+                        vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z);
+
+                    double norm_hori_x, norm_hori_y, norm_hori_z, area_hori;
+                    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        norm_hori_x, norm_hori_y, norm_hori_z,
+                        area_hori);
+                    tri_geom[6] = norm_hori_x;
+                    tri_geom[7] = norm_hori_y;
+                    tri_geom[8] = norm_hori_z;
+
+                    tri_geom[9] = area_tilt / area_hori;
+
+                    tri_geom += 10;
+
+                }
+
+            }
+        }
+
+        //---------------------------------------------------------------------
+        // Loop through sun positions and add rays to stream
+        //---------------------------------------------------------------------
+
+        for (size_t o = 0; o < (size_t)dim_sun_0; o++) {
+            for (size_t p = 0; p < (size_t)dim_sun_1; p++) {
+
+                size_t ind_lin_sun = lin_ind_3d(dim_sun_1, 3, o, p, 0);
+                size_t ind_lin_cor = lin_ind_4d(num_gc_x, dim_sun_0,
+                    dim_sun_1, i - row_beg, j, o, p);
+
+                tri_geom = stream.tri_geom;
+                for (size_t q = 0; q < (size_t)num_tri_per_gc; q++) {
+
+                    // Compute sun unit vector
+                    double sun_x = (sun_pos[ind_lin_sun] - tri_geom[0]);
+                    double sun_y = (sun_pos[ind_lin_sun + 1] - tri_geom[1]);
+                    double sun_z = (sun_pos[ind_lin_sun + 2] - tri_geom[2]);
+                    vec_unit(sun_x, sun_y, sun_z);
+
+                    // Check for self-shadowing (Earth)
+                    double dot_prod_hs = (tri_geom[6] * sun_x
+                        + tri_geom[7] * sun_y
+                        + tri_geom[8] * sun_z);
+                    if (dot_prod_hs <= dot_prod_min) {
+                        tri_geom += 10;
+                        num_culled += 1;
+                        continue;  // sw_dir_cor += 0.0
+                    }
+
+                    // Check for self-shadowing (triangle)
+                    double dot_prod_ts = tri_geom[3] * sun_x
+                        + tri_geom[4] * sun_y
+                        + tri_geom[5] * sun_z;
+                    if (dot_prod_ts <= 0.0) {
+                        tri_geom += 10;
+                        num_culled += 1;
+                        continue;  // sw_dir_cor += 0.0
+                    }
+
+                    // Add ray
+                    RTCRay &ray = stream.rays[stream.num_rays];
+                    ray.org_x = (float)tri_geom[0];
+                    ray.org_y = (float)tri_geom[1];
+                    ray.org_z = (float)tri_geom[2];
+                    ray.dir_x = (float)sun_x;
+                    ray.dir_y = (float)sun_y;
+                    ray.dir_z = (float)sun_z;
+                    ray.tnear = 0.0;
+                    ray.tfar = (float)dist_search;
+                    // std::numeric_limits<float>::infinity();
+                    ray.mask = -1;
+                    ray.flags = 0;
+                    stream.sw_dir_cor_ray[stream.num_rays] =
+                        (float)(std::min(((dot_prod_ts / dot_prod_hs)
+                        * tri_geom[9]), sw_dir_cor_max));
+                    stream.ind_lin_cor[stream.num_rays] = ind_lin_cor;
+                    stream.num_rays += 1;
+
+                    // Trace rays if stream is full
+                    if (stream.num_rays == (size_t)batch_size) {
+                        num_rays += flush_ray_stream(stream, scene,
+                            sw_dir_cor_rows);
+                    }
+
+                    tri_geom += 10;
+
+                }
+
+            }
+        }
+
+        // Rays are traced in batches (-> count rays added to stream)
+        size_t num_rays_add = (size_t)num_tri_per_gc * dim_sun_0
+            * dim_sun_1 - (num_culled - num_culled_cell);
+        stats_cell(cells[ind], num_rays_add);
+        num_queued += num_rays_add;
+
+    }
+
+    stats_thread(num_queued, num_culled);
+    return num_rays;  // parallel
+    }, std::plus<size_t>());  // parallel
+
+    // Trace remaining rays of all streams
+    for (RayStream &stream : ray_streams) {
+        num_rays_rows += flush_ray_stream(stream, scene, sw_dir_cor_rows);
+    }
+
+    delete[] cells;
+
+    // Divide accumulated values by number of triangles within grid cell
+    size_t num_elem = (row_end - row_beg) * row_size;
+    for (size_t i = 0; i < num_elem; i++) {
+        sw_dir_cor_rows[i] /= (float)num_tri_per_gc;
+    }
+
+    return num_rays_rows;
+    };
+
+    if (row_callback == NULL) {
+        num_rays = compute_rows(0, num_gc_y, sw_dir_cor);
+    } else {
+        num_rays = stream_rows(compute_rows, num_gc_y, row_size,
+            (size_t)block_rows, row_callback, user_data);
+    }
+
+    auto end_ray = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time_ray = (end_ray - start_ray);
+    kout << "Ray tracing time: " << time_ray.count() << " s" << endl;
+    kout << "Number of rays shot: " << num_rays << endl;
+    double frac_ray = (double)num_rays /
+        ((double)num_tri * (double)dim_sun_0 * (double)dim_sun_1);
+    kout << "Fraction of rays required: " << frac_ray << endl;
+    kernel_stats.time_ray += time_ray.count();
+    kernel_stats.num_rays += num_rays;
+
+    // Release resources allocated through Embree (if not reused)
+    if (scene_ext == NULL) {
+        releaseScene(scene);
+        releaseDevice(device);
+    }
+
+    auto end_tot = std::chrono::high_resolution_clock::now();
+    time = end_tot - start_ini;
+    kout << "Total run time: " << time.count() << " s" << endl;
+    kernel_stats.time_total += time.count();
+
+    //-------------------------------------------------------------------------
+
+    kout << "--------------------------------------------------------" << endl;
+
+}
+
+//-----------------------------------------------------------------------------
+// Adaptive subsampling of triangles (error-controlled)
+//-----------------------------------------------------------------------------
+
+void sw_dir_cor_comp_adaptive(
+    float* vert_grid,
+    int dem_dim_0, int dem_dim_1,
+    float* vert_grid_in,
+    int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
+    double* sun_pos,
+    int dim_sun_0, int dim_sun_1,
+    float* sw_dir_cor,
+    float* sw_dir_cor_err,
+    int pixel_per_gc,
+    int offset_gc,
+    uint8_t* mask,
+    double dist_search,
+    char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    double sw_dir_cor_max,
+    double ang_max,
+    int stride_max,
+    double err_tol) {
+
+    KernelScope scope((dem_dim_in_0 - 1) / pixel_per_gc,
+        (dem_dim_in_1 - 1) / pixel_per_gc);
+
+    kout << "--------------------------------------------------------" << endl;
+    kout << "Compute lookup table with adaptive subsampling" << endl;
+    kout << "--------------------------------------------------------" << endl;
+
+    // Hard-coded settings
+    double ray_org_elev = 0.1;
+    // value to elevate ray origin (-> avoids potential issue with numerical
+    // imprecision / truncation) [m]
+
+    // Number of grid cells
+    int num_gc_y = (dem_dim_in_0 - 1) / pixel_per_gc;
+    int num_gc_x = (dem_dim_in_1 - 1) / pixel_per_gc;
+    kout << "Number of grid cells in y-direction: " << num_gc_y
+        << endl;
+    kout << "Number of grid cells in x-direction: " << num_gc_x << endl;
+
+    // Number of triangles
+    int num_tri = (dem_dim_in_0 - 1) * (dem_dim_in_1 - 1) * 2;
+    kout << "Number of triangles: " << num_tri << endl;
+
+    // Unit conversion(s)
+    double dot_prod_min = cos(deg2rad(ang_max));
+    dist_search *= 1000.0;  // [kilometre] to [metre]
+    kout << "Search distance: " << dist_search << " m" << endl;
 
-            delete[] norm_tilt;
-            delete[] ray_org;
-            delete[] norm_hori;
-            delete[] surf_enl_fac;
-            delete[] sw_dir_cor_ray;
-            
-            } else {
+    kout << "ang_max: " << ang_max << " degree" << endl;
+    kout << "sw_dir_cor_max: " << sw_dir_cor_max  << endl;
+
+    // Sampling settings
+    int stride_init = adapt_stride_init(pixel_per_gc, stride_max);
+    size_t num_tri_per_gc = (size_t)(pixel_per_gc * pixel_per_gc * 2);
+    size_t num_sun = (size_t)dim_sun_0 * (size_t)dim_sun_1;
+    kout << "Initial sampling stride: " << stride_init << " pixel(s)"
+        << endl;
+    kout << "Error tolerance: " << err_tol << endl;
 
+    // Initialisation
+    auto start_ini = std::chrono::high_resolution_clock::now();
+    RTCDevice device = NULL;
+    RTCScene scene = scene_ext;
+    if (scene_ext == NULL) {
+        device = initializeDevice();
+        scene = initializeScene(device, vert_grid, dem_dim_0, dem_dim_1,
+            geom_type, build_quality, compact, robust);
+    } else {
+        kout << "Reuse committed scene" << endl;
+    }
+    auto end_ini = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time = end_ini - start_ini;
+    kout << "Total initialisation time: " << time.count() << " s" << endl;
+
+    //-------------------------------------------------------------------------
+
+    auto start_ray = std::chrono::high_resolution_clock::now();
+    size_t num_rays = 0;
+
+    // Fill masked grid cells with NaN
+    for (size_t i = 0; i < (size_t)num_gc_y; i++) {
+        for (size_t j = 0; j < (size_t)num_gc_x; j++) {
+            size_t lin_ind_gc = lin_ind_2d(num_gc_x, i, j);
+            if (mask[lin_ind_gc] != 1) {
                 size_t ind_lin = lin_ind_4d(num_gc_x, dim_sun_0, dim_sun_1,
                     i, j, 0, 0);
-                for (size_t k = 0; k < (dim_sun_0 * dim_sun_1) ; k++) {
+                for (size_t k = 0; k < num_sun; k++) {
                     sw_dir_cor[ind_lin + k] = NAN;
                 }
+                sw_dir_cor_err[lin_ind_gc] = NAN;
+            }
+        }
+    }
+
+    // Compacted list of active grid cells
+    size_t num_cells;
+    size_t* cells = active_cells(mask, num_gc_x, 0, num_gc_y,
+        vert_grid, dem_dim_1, pixel_per_gc, offset_gc, cost_order,
+        num_cells);
+    std::atomic<size_t> num_cells_full(0);
+
+    num_rays += tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_cells, grain_size), 0.0,
+        [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
+
+    size_t num_rays_beg = num_rays;
+    size_t num_culled = 0;
+
+    // Scratch buffers (sums of correction factors of sampled triangles,
+    // correction factors of current triangle, sampled pixels)
+    ScratchArena &arena = scratch_arena();
+    arena.begin(3 * scratch_size<double>(num_sun)
+        + scratch_size<int>(pixel_per_gc * pixel_per_gc));
+    double* cor_sum = arena.alloc<double>(num_sun);
+    double* cor_sum_sq = arena.alloc<double>(num_sun);
+    double* cor_tri = arena.alloc<double>(num_sun);
+    int* pixels = arena.alloc<int>(pixel_per_gc * pixel_per_gc);
+
+    // Loop through active grid cells
+    //for (size_t ind = 0; ind < num_cells; ind++) {  // serial
+    for (size_t ind = r.begin(); ind < r.end(); ++ind) {  // parallel
+
+        size_t i = cells[ind] / num_gc_x;
+        size_t j = cells[ind] % num_gc_x;
+        size_t num_rays_cell = num_rays;
+
+        for (size_t o = 0; o < num_sun; o++) {
+            cor_sum[o] = 0.0;
+            cor_sum_sq[o] = 0.0;
+        }
+        size_t num_sample = 0;
+        int stride = stride_init;
+        int stride_prev = 0;
+        double err;
+
+        // Refine sample until error is within tolerance
+        while (true) {
+
+            size_t num_pixels = adapt_level_pixels(pixel_per_gc, stride,
+                stride_prev, pixels);
+
+            // Loop through added DEM pixels
+            for (size_t l = 0; l < num_pixels; l++) {
+                size_t k = (i * pixel_per_gc) + (pixels[l] / pixel_per_gc);
+                size_t m = (j * pixel_per_gc) + (pixels[l] % pixel_per_gc);
+
+                // Loop through two triangles per pixel
+                for (size_t n = 0; n < 2; n++) {
+
+                    //---------------------------------------------------------
+                    // Tilted triangle
+                    //---------------------------------------------------------
+
+                    size_t ind_tri_0, ind_tri_1, ind_tri_2;
+                    triangle_vert(n, dem_dim_1,
+                        k + (pixel_per_gc * offset_gc),
+                        m + (pixel_per_gc * offset_gc),
+                        ind_tri_0, ind_tri_1, ind_tri_2);
+
+                    double vert_0_x = (double)vert_grid[ind_tri_0];
+                    double vert_0_y = (double)vert_grid[ind_tri_0 + 1];
+                    double vert_0_z = (double)vert_grid[ind_tri_0 + 2];
+                    double vert_1_x = (double)vert_grid[ind_tri_1];
+                    double vert_1_y = (double)vert_grid[ind_tri_1 + 1];
+                    double vert_1_z = (double)vert_grid[ind_tri_1 + 2];
+                    double vert_2_x = (double)vert_grid[ind_tri_2];
+                    double vert_2_y = (double)vert_grid[ind_tri_2 + 1];
+                    double vert_2_z = (double)vert_grid[ind_tri_2 + 2];
+
+                    double cent_x, cent_y, cent_z;
+                    triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        cent_x, cent_y, cent_z);
+
+                    double norm_tilt_x, norm_tilt_y, norm_tilt_z, area_tilt;
+                    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        norm_tilt_x, norm_tilt_y, norm_tilt_z,
+                        area_tilt);
+
+                    // Ray origin
+                    double ray_org_x = (cent_x
+                        + norm_tilt_x * ray_org_elev);
+                    double ray_org_y = (cent_y
+                        + norm_tilt_y * ray_org_elev);
+                    double ray_org_z = (cent_z
+                        + norm_tilt_z * ray_org_elev);
+
+                    //---------------------------------------------------------
+                    // Horizontal triangle
+                    //---------------------------------------------------------
+
+                    triangle_vert_hori(vert_grid_in, dem_dim_in_1,
+                        k, m, n, radius_earth,
+                        vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z);
+
+                    double norm_hori_x, norm_hori_y, norm_hori_z, area_hori;
+                    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        norm_hori_x, norm_hori_y, norm_hori_z,
+                        area_hori);
+
+                    double surf_enl_fac = area_tilt / area_hori;
+
+                    //---------------------------------------------------------
+                    // Loop through sun positions and compute correction
+                    // factors
+                    //---------------------------------------------------------
+
+                    for (size_t o = 0; o < num_sun; o++) {
+
+                        cor_tri[o] = 0.0;
+                        size_t ind_lin_sun = o * 3;
+
+                        // Compute sun unit vector
+                        double sun_x = (sun_pos[ind_lin_sun] - ray_org_x);
+                        double sun_y = (sun_pos[ind_lin_sun + 1]
+                            - ray_org_y);
+                        double sun_z = (sun_pos[ind_lin_sun + 2]
+                            - ray_org_z);
+                        vec_unit(sun_x, sun_y, sun_z);
+
+                        // Check for self-shadowing (Earth)
+                        double dot_prod_hs = (norm_hori_x * sun_x
+                            + norm_hori_y * sun_y
+                            + norm_hori_z * sun_z);
+                        if (dot_prod_hs <= dot_prod_min) {
+                            num_culled += 1;
+                            continue;  // sw_dir_cor += 0.0
+                        }
+
+                        // Check for self-shadowing (triangle)
+                        double dot_prod_ts = norm_tilt_x * sun_x
+                            + norm_tilt_y * sun_y
+                            + norm_tilt_z * sun_z;
+                        if (dot_prod_ts <= 0.0) {
+                            num_culled += 1;
+                            continue;  // sw_dir_cor += 0.0
+                        }
+
+                        // Intersect context
+                        struct RTCIntersectContext context;
+                        rtcInitIntersectContext(&context);
+
+                        // Ray structure
+                        struct RTCRay ray;
+                        ray.org_x = (float)ray_org_x;
+                        ray.org_y = (float)ray_org_y;
+                        ray.org_z = (float)ray_org_z;
+                        ray.dir_x = (float)sun_x;
+                        ray.dir_y = (float)sun_y;
+                        ray.dir_z = (float)sun_z;
+                        ray.tnear = 0.0;
+                        ray.tfar = (float)dist_search;
+
+                        // Intersect ray with scene
+                        rtcOccluded1(scene, &context, &ray);
+                        if (ray.tfar > 0.0) {
+                            cor_tri[o] = std::min(((dot_prod_ts
+                                / dot_prod_hs) * surf_enl_fac),
+                                sw_dir_cor_max);
+                        }  // else: sw_dir_cor += 0.0
+                        num_rays += 1;
+
+                    }
+
+                    // Accumulate sums of sampled triangles
+                    for (size_t o = 0; o < num_sun; o++) {
+                        cor_sum[o] += cor_tri[o];
+                        cor_sum_sq[o] += cor_tri[o] * cor_tri[o];
+                    }
+                    num_sample += 1;
+
+                }
+
+            }
 
+            // Maximal standard error of mean (over sun positions)
+            err = 0.0;
+            for (size_t o = 0; o < num_sun; o++) {
+                err = std::max(err, adapt_std_err(cor_sum[o],
+                    cor_sum_sq[o], num_sample, num_tri_per_gc));
             }
+            if ((err <= err_tol) || (stride == 1)) {
+                break;
+            }
+            stride_prev = stride;
+            stride = adapt_stride_refine(stride);
+
+        }
 
+        // Mean of sampled triangles
+        size_t ind_lin_cor = lin_ind_4d(num_gc_x, dim_sun_0, dim_sun_1,
+            i, j, 0, 0);
+        for (size_t o = 0; o < num_sun; o++) {
+            sw_dir_cor[ind_lin_cor + o] = (float)(cor_sum[o]
+                / (double)num_sample);
+        }
+        sw_dir_cor_err[cells[ind]] = (float)err;
+        if (num_sample == num_tri_per_gc) {
+            num_cells_full += 1;
         }
+
+        stats_cell(cells[ind], num_rays - num_rays_cell);
+
     }
 
+    stats_thread(num_rays - num_rays_beg, num_culled);
     return num_rays;  // parallel
     }, std::plus<size_t>());  // parallel
 
+    delete[] cells;
+
     auto end_ray = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> time_ray = (end_ray - start_ray);
-    cout << "Ray tracing time: " << time_ray.count() << " s" << endl;
-    cout << "Number of rays shot: " << num_rays << endl;
+    kout << "Ray tracing time: " << time_ray.count() << " s" << endl;
+    kout << "Number of rays shot: " << num_rays << endl;
     double frac_ray = (double)num_rays /
         ((double)num_tri * (double)dim_sun_0 * (double)dim_sun_1);
-    cout << "Fraction of rays required: " << frac_ray << endl;
+    kout << "Fraction of rays required: " << frac_ray << endl;
+    kout << "Fully traced grid cells: " << num_cells_full << " of "
+        << num_cells << endl;
+    float err_max = 0.0;
+    for (size_t i = 0; i < (size_t)(num_gc_y * num_gc_x); i++) {
+        if (mask[i] == 1) {
+            err_max = std::max(err_max, sw_dir_cor_err[i]);
+        }
+    }
+    kout << "Maximal standard error: " << err_max << endl;
+    kernel_stats.time_ray += time_ray.count();
+    kernel_stats.num_rays += num_rays;
+
+    // Release resources allocated through Embree (if not reused)
+    if (scene_ext == NULL) {
+        releaseScene(scene);
+        releaseDevice(device);
+    }
 
-    // Divide accumulated values by number of triangles within grid cell
+    auto end_tot = std::chrono::high_resolution_clock::now();
+    time = end_tot - start_ini;
+    kout << "Total run time: " << time.count() << " s" << endl;
+    kernel_stats.time_total += time.count();
+
+    //-------------------------------------------------------------------------
+
+    kout << "--------------------------------------------------------" << endl;
+
+}
+
+//-----------------------------------------------------------------------------
+// Classify sun positions with horizon bounds (only ambiguous band is traced)
+// (upper bound is guaranteed -> sun positions above are lit; lower bound is
+// approximate and only used with 'approx_shadow')
+//-----------------------------------------------------------------------------
+
+template <int ALG>
+static void sw_dir_cor_comp_hori_bound_spec(
+    float* vert_grid,
+    int dem_dim_0, int dem_dim_1,
+    float* vert_grid_in,
+    int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
+    double* sun_pos,
+    int dim_sun_0, int dim_sun_1,
+    float* sw_dir_cor,
+    int pixel_per_gc,
+    int offset_gc,
+    uint8_t* mask,
+    double dist_search,
+    char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    double sw_dir_cor_max,
+    double ang_max,
+    int hori_azim_num,
+    double hori_acc,
+    double elev_ang_low_lim,
+    double bound_margin,
+    int approx_shadow,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data) {
+
+    KernelScope scope((dem_dim_in_0 - 1) / pixel_per_gc,
+        (dem_dim_in_1 - 1) / pixel_per_gc);
+
+    kout << "--------------------------------------------------------" << endl;
+    kout << "Compute lookup table with horizon bounds" << endl;
+    kout << "--------------------------------------------------------" << endl;
+
+    // Hard-coded settings
+    double ray_org_elev = 0.1;
+    // value to elevate ray origin (-> avoids potential issue with numerical
+    // imprecision / truncation) [m]
+    double elev_ang_up_lim = 89.98;
+    // upper limit for elevation angle [degree]
+    double bound_slack = 1.0e-5;
+    // slack for upper horizon bound (-> round-off errors of ray
+    // intersection in single precision) [-]
+
+    // Number of grid cells
+    int num_gc_y = (dem_dim_in_0 - 1) / pixel_per_gc;
+    int num_gc_x = (dem_dim_in_1 - 1) / pixel_per_gc;
+    kout << "Number of grid cells in y-direction: " << num_gc_y
+        << endl;
+    kout << "Number of grid cells in x-direction: " << num_gc_x << endl;
+
+    // Number of triangles
+    int num_tri = (dem_dim_in_0 - 1) * (dem_dim_in_1 - 1) * 2;
+    kout << "Number of triangles: " << num_tri << endl;
+
+    // Unit conversion(s)
+    double dot_prod_min = cos(deg2rad(ang_max));
+    dist_search *= 1000.0;  // [kilometre] to [metre]
+    kout << "Search distance: " << dist_search << " m" << endl;
+    hori_acc = deg2rad(hori_acc);
+    elev_ang_low_lim = deg2rad(elev_ang_low_lim);
+    elev_ang_up_lim = deg2rad(elev_ang_up_lim);
+    bound_margin = deg2rad(bound_margin);
+
+    kout << "ang_max: " << ang_max << " degree" << endl;
+    kout << "sw_dir_cor_max: " << sw_dir_cor_max  << endl;
+
+    // Algorithm for lower horizon bounds (kernel specialised at compile
+    // time)
+    kout << "Horizon bound azimuth sectors: " << hori_azim_num << endl;
+    if (approx_shadow != 0) {
+        kout << "Lower horizon bound algorithm: " << hori_alg_labels[ALG]
+            << " (approximate)" << endl;
+    }
+
+    // Initialisation
+    auto start_ini = std::chrono::high_resolution_clock::now();
+    RTCDevice device = NULL;
+    RTCScene scene = scene_ext;
+    if (scene_ext == NULL) {
+        device = initializeDevice();
+        scene = initializeScene(device, vert_grid, dem_dim_0, dem_dim_1,
+            geom_type, build_quality, compact, robust);
+    } else {
+        kout << "Reuse committed scene" << endl;
+    }
+
+    // Quadtree of DEM (guaranteed upper horizon bounds)
+    Heightfield hf = heightfield_build(vert_grid, dem_dim_0, dem_dim_1);
+    auto end_ini = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time = end_ini - start_ini;
+    kout << "Total initialisation time: " << time.count() << " s" << endl;
+
+    // Azimuth and elevation angles of lower horizon bounds
+    double* azim_sin = new double[hori_azim_num];
+    double* azim_cos = new double[hori_azim_num];
+    for (int i = 0; i < hori_azim_num; i++) {
+        double ang = ((2 * M_PI) / hori_azim_num * i);
+        azim_sin[i] = sin(ang);
+        azim_cos[i] = cos(ang);
+    }
+    int elev_num = ((int)ceil((elev_ang_up_lim - elev_ang_low_lim)
+        / (hori_acc / 5.0)) + 1);
+    double* elev_ang = new double[elev_num];
+    double* elev_sin = new double[elev_num];
+    double* elev_cos = new double[elev_num];
+    for (int i = 0; i < elev_num; i++) {
+        double ang = elev_ang_up_lim - (hori_acc / 5.0) * i;
+        elev_ang[elev_num - i - 1] = ang;
+        elev_sin[elev_num - i - 1] = sin(ang);
+        elev_cos[elev_num - i - 1] = cos(ang);
+    }
+    double azim_spac = (2.0 * M_PI) / (double)hori_azim_num;
+
+    //-------------------------------------------------------------------------
+
+    auto start_ray = std::chrono::high_resolution_clock::now();
+    size_t num_rays = 0;
+    size_t num_sun = (size_t)dim_sun_0 * (size_t)dim_sun_1;
+    size_t row_size = num_gc_x * num_sun;
     float num_tri_per_gc = pixel_per_gc * pixel_per_gc * 2.0;
-    size_t num_elem = (num_gc_y * num_gc_x * dim_sun_0 * dim_sun_1);
-    for (size_t i = 0; i < num_elem; i++) {
-        sw_dir_cor[i] /= num_tri_per_gc;
+    std::atomic<size_t> num_bound_rays(0);
+    std::atomic<size_t> num_lit(0);
+    std::atomic<size_t> num_shadow(0);
+
+    // Compute rows [row_beg, row_end) of lookup table ('sw_dir_cor_rows'
+    // only holds these rows)
+    auto compute_rows = [&](size_t row_beg, size_t row_end,
+        float* sw_dir_cor_rows) {
+
+    // Fill masked grid cells with NaN
+    for (size_t i = row_beg; i < row_end; i++) {
+        for (size_t j = 0; j < (size_t)num_gc_x; j++) {
+            size_t lin_ind_gc = lin_ind_2d(num_gc_x, i, j);
+            if (mask[lin_ind_gc] != 1) {
+                size_t ind_lin = lin_ind_4d(num_gc_x, dim_sun_0, dim_sun_1,
+                    i - row_beg, j, 0, 0);
+                for (size_t k = 0; k < num_sun; k++) {
+                    sw_dir_cor_rows[ind_lin + k] = NAN;
+                }
+            }
+        }
     }
 
-    // Release resources allocated through Embree
-    rtcReleaseScene(scene);
-    rtcReleaseDevice(device);
+    // Compacted list of active grid cells
+    size_t num_cells;
+    size_t* cells = active_cells(mask, num_gc_x, row_beg, row_end,
+        vert_grid, dem_dim_1, pixel_per_gc, offset_gc, cost_order,
+        num_cells);
+
+    size_t num_rays_rows = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_cells, grain_size), 0.0,
+        [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
+
+    size_t num_rays_beg = num_rays;
+    size_t num_culled = 0;
+    size_t num_bound_rays_thread = 0;
+    size_t num_lit_thread = 0;
+    size_t num_shadow_thread = 0;
+
+    // Correction factors of grid cell (accumulated locally and written
+    // to lookup table once per grid cell) and horizon bounds (periodic)
+    ScratchArena &arena = scratch_arena();
+    arena.begin(scratch_size<double>(num_sun)
+        + scratch_size<double>(hori_azim_num + 1)
+        + 2 * scratch_size<double>(hori_azim_num));
+    double* sw_dir_cor_gc = arena.alloc<double>(num_sun);
+    double* horizon = arena.alloc<double>(hori_azim_num + 1);
+    double* bound_sin_low = arena.alloc<double>(hori_azim_num);
+    double* bound_sin_up = arena.alloc<double>(hori_azim_num);
+
+    // Loop through active grid cells
+    //for (size_t ind = 0; ind < num_cells; ind++) {  // serial
+    for (size_t ind = r.begin(); ind < r.end(); ++ind) {  // parallel
+
+        size_t i = cells[ind] / num_gc_x;
+        size_t j = cells[ind] % num_gc_x;
+        size_t num_rays_cell = num_rays;
+        for (size_t o = 0; o < num_sun; o++) {
+            sw_dir_cor_gc[o] = 0.0;
+        }
+
+        // Loop through 2D-field of DEM pixels
+        for (size_t k = (i * pixel_per_gc);
+            k < ((i * pixel_per_gc) + pixel_per_gc); k++) {
+            for (size_t m = (j * pixel_per_gc);
+                m < ((j * pixel_per_gc) + pixel_per_gc); m++) {
+
+                // Loop through two triangles per pixel
+                for (size_t n = 0; n < 2; n++) {
+
+                    //---------------------------------------------------------
+                    // Tilted triangle
+                    //---------------------------------------------------------
+
+                    size_t ind_tri_0, ind_tri_1, ind_tri_2;
+                    triangle_vert(n, dem_dim_1,
+                        k + (pixel_per_gc * offset_gc),
+                        m + (pixel_per_gc * offset_gc),
+                        ind_tri_0, ind_tri_1, ind_tri_2);
+
+                    double vert_0_x = (double)vert_grid[ind_tri_0];
+                    double vert_0_y = (double)vert_grid[ind_tri_0 + 1];
+                    double vert_0_z = (double)vert_grid[ind_tri_0 + 2];
+                    double vert_1_x = (double)vert_grid[ind_tri_1];
+                    double vert_1_y = (double)vert_grid[ind_tri_1 + 1];
+                    double vert_1_z = (double)vert_grid[ind_tri_1 + 2];
+                    double vert_2_x = (double)vert_grid[ind_tri_2];
+                    double vert_2_y = (double)vert_grid[ind_tri_2 + 1];
+                    double vert_2_z = (double)vert_grid[ind_tri_2 + 2];
+
+                    double cent_x, cent_y, cent_z;
+                    triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        cent_x, cent_y, cent_z);
+
+                    double norm_tilt_x, norm_tilt_y, norm_tilt_z, area_tilt;
+                    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        norm_tilt_x, norm_tilt_y, norm_tilt_z,
+                        area_tilt);
+
+                    // Ray origin
+                    double ray_org_x = (cent_x
+                        + norm_tilt_x * ray_org_elev);
+                    double ray_org_y = (cent_y
+                        + norm_tilt_y * ray_org_elev);
+                    double ray_org_z = (cent_z
+                        + norm_tilt_z * ray_org_elev);
+
+                    //---------------------------------------------------------
+                    // Horizontal triangle
+                    //---------------------------------------------------------
+
+                    triangle_vert_hori(vert_grid_in, dem_dim_in_1,
+                        k, m, n, radius_earth,
+                        vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z);
+
+                    double norm_hori_x, norm_hori_y, norm_hori_z, area_hori;
+                    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+                        vert_1_x, vert_1_y, vert_1_z,
+                        vert_2_x, vert_2_y, vert_2_z,
+                        norm_hori_x, norm_hori_y, norm_hori_z,
+                        area_hori);
+
+                    double surf_enl_fac = area_tilt / area_hori;
+
+                    //---------------------------------------------------------
+                    // Horizon bounds per azimuth sector
+                    //---------------------------------------------------------
+
+                    // Local ENU coordinate system (see 'horizon_comp.cpp')
+                    double north_x = 0.0;
+                    double north_y = 1.0;
+                    double north_z = -norm_hori_y / norm_hori_z;
+                    vec_unit(north_x, north_y, north_z);
+                    double east_x, east_y, east_z;
+                    cross_prod(north_x, north_y, north_z,
+                        norm_hori_x, norm_hori_y, norm_hori_z,
+                        east_x, east_y, east_z);
+
+                    // Upper bound of horizon within sector from quadtree
+                    // of DEM (guaranteed; origin as seen by Embree)
+                    double org[3] = {(double)(float)ray_org_x,
+                        (double)(float)ray_org_y, (double)(float)ray_org_z};
+                    double east[3] = {east_x, east_y, east_z};
+                    double north[3] = {north_x, north_y, north_z};
+                    double up[3] = {norm_hori_x, norm_hori_y, norm_hori_z};
+                    heightfield_horizon_bound(hf, org, east, north, up,
+                        hori_azim_num, dist_search, bound_sin_up);
+
+                    // Lower bound of horizon within sector between two
+                    // traced azimuth directions (approximate: margin for
+                    // horizon accuracy and azimuthal variation within
+                    // sector)
+                    if (approx_shadow != 0) {
+                        double rot_inv[3][3]
+                            = {{east_x, north_x, norm_hori_x},
+                               {east_y, north_y, norm_hori_y},
+                               {east_z, north_z, norm_hori_z}};
+                        size_t num_rays_hori = 0;
+                        horizon_detect<ALG>(
+                            (float)ray_org_x, (float)ray_org_y,
+                            (float)ray_org_z,
+                            hori_azim_num, hori_acc,
+                            0.0f, (float)dist_search,
+                            elev_ang_low_lim, elev_ang_up_lim, elev_num,
+                            scene, num_rays_hori, &horizon[0],
+                            azim_sin, azim_cos, elev_ang,
+                            elev_cos, elev_sin, rot_inv);
+                        num_rays += num_rays_hori;
+                        num_bound_rays_thread += num_rays_hori;
+                        horizon[hori_azim_num] = horizon[0];
+                        for (size_t o = 0; o < (size_t)hori_azim_num; o++) {
+                            double hori_min = std::min(horizon[o],
+                                horizon[o + 1]);
+                            bound_sin_low[o] = sin(std::max(hori_min
+                                - bound_margin, -M_PI / 2.0));
+                        }
+                    }
+
+                    //---------------------------------------------------------
+                    // Loop through sun positions and compute correction
+                    // factors
+                    //---------------------------------------------------------
+
+                    for (size_t o = 0; o < num_sun; o++) {
+
+                        size_t ind_lin_sun = o * 3;
+
+                        // Compute sun unit vector
+                        double sun_x = (sun_pos[ind_lin_sun] - ray_org_x);
+                        double sun_y = (sun_pos[ind_lin_sun + 1]
+                            - ray_org_y);
+                        double sun_z = (sun_pos[ind_lin_sun + 2]
+                            - ray_org_z);
+                        vec_unit(sun_x, sun_y, sun_z);
+
+                        // Check for self-shadowing (Earth)
+                        double dot_prod_hs = (norm_hori_x * sun_x
+                            + norm_hori_y * sun_y
+                            + norm_hori_z * sun_z);
+                        if (dot_prod_hs <= dot_prod_min) {
+                            num_culled += 1;
+                            continue;  // sw_dir_cor += 0.0
+                        }
+
+                        // Check for self-shadowing (triangle)
+                        double dot_prod_ts = norm_tilt_x * sun_x
+                            + norm_tilt_y * sun_y
+                            + norm_tilt_z * sun_z;
+                        if (dot_prod_ts <= 0.0) {
+                            num_culled += 1;
+                            continue;  // sw_dir_cor += 0.0
+                        }
+
+                        // Classify sun position with horizon bounds of
+                        // its azimuth sector ('dot_prod_hs': sine of sun
+                        // elevation in local ENU coordinate system)
+                        double sun_azim = atan2(east_x * sun_x
+                            + east_y * sun_y + east_z * sun_z,
+                            north_x * sun_x + north_y * sun_y
+                            + north_z * sun_z);
+                        if (sun_azim < 0.0) {
+                            sun_azim += (2.0 * M_PI);
+                        }
+                        size_t ind_sec = std::min((size_t)(sun_azim
+                            / azim_spac), (size_t)(hori_azim_num - 1));
+                        bool lit;
+                        if (dot_prod_hs > (bound_sin_up[ind_sec]
+                            + bound_slack)) {
+                            lit = true;  // above upper horizon bound
+                            num_lit_thread += 1;
+                        } else if ((approx_shadow != 0)
+                            && (dot_prod_hs <= bound_sin_low[ind_sec])) {
+                            lit = false;  // below lower horizon bound
+                            num_shadow_thread += 1;
+                        } else {
+
+                            // Intersect context
+                            struct RTCIntersectContext context;
+                            rtcInitIntersectContext(&context);
+
+                            // Ray structure
+                            struct RTCRay ray;
+                            ray.org_x = (float)ray_org_x;
+                            ray.org_y = (float)ray_org_y;
+                            ray.org_z = (float)ray_org_z;
+                            ray.dir_x = (float)sun_x;
+                            ray.dir_y = (float)sun_y;
+                            ray.dir_z = (float)sun_z;
+                            ray.tnear = 0.0;
+                            ray.tfar = (float)dist_search;
+
+                            // Intersect ray with scene
+                            rtcOccluded1(scene, &context, &ray);
+                            lit = (ray.tfar > 0.0);
+                            num_rays += 1;
+
+                        }
+                        if (lit) {
+                            sw_dir_cor_gc[o] += std::min(((dot_prod_ts
+                                / dot_prod_hs) * surf_enl_fac),
+                                sw_dir_cor_max);
+                        }  // else: sw_dir_cor += 0.0
+
+                    }
+
+                }
+
+            }
+        }
+
+        // Divide accumulated values by number of triangles within grid
+        // cell and write to lookup table
+        size_t ind_lin_cor = lin_ind_4d(num_gc_x, dim_sun_0, dim_sun_1,
+            i - row_beg, j, 0, 0);
+        for (size_t o = 0; o < num_sun; o++) {
+            sw_dir_cor_rows[ind_lin_cor + o] = (float)(sw_dir_cor_gc[o]
+                / num_tri_per_gc);
+        }
+
+        stats_cell(cells[ind], num_rays - num_rays_cell);
+
+    }
+
+    num_bound_rays += num_bound_rays_thread;
+    num_lit += num_lit_thread;
+    num_shadow += num_shadow_thread;
+
+    stats_thread(num_rays - num_rays_beg, num_culled);
+    return num_rays;  // parallel
+    }, std::plus<size_t>());  // parallel
+
+    delete[] cells;
+
+    return num_rays_rows;
+    };
+
+    if (row_callback == NULL) {
+        num_rays = compute_rows(0, num_gc_y, sw_dir_cor);
+    } else {
+        num_rays = stream_rows(compute_rows, num_gc_y, row_size,
+            (size_t)block_rows, row_callback, user_data);
+    }
+
+    auto end_ray = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time_ray = (end_ray - start_ray);
+    kout << "Ray tracing time: " << time_ray.count() << " s" << endl;
+    kout << "Number of rays shot: " << num_rays << " (horizon bounds: "
+        << num_bound_rays << ")" << endl;
+    double frac_ray = (double)num_rays /
+        ((double)num_tri * (double)dim_sun_0 * (double)dim_sun_1);
+    kout << "Fraction of rays required: " << frac_ray << endl;
+    kout << "Sun positions classified as lit (upper horizon bound): "
+        << num_lit << endl;
+    if (approx_shadow != 0) {
+        kout << "Sun positions classified as shaded (lower horizon bound): "
+            << num_shadow << endl;
+    }
+    kernel_stats.time_ray += time_ray.count();
+    kernel_stats.num_rays += num_rays;
+
+    delete[] azim_sin;
+    delete[] azim_cos;
+    delete[] elev_ang;
+    delete[] elev_sin;
+    delete[] elev_cos;
+    heightfield_release(hf);
+
+    // Release resources allocated through Embree (if not reused)
+    if (scene_ext == NULL) {
+        releaseScene(scene);
+        releaseDevice(device);
+    }
 
     auto end_tot = std::chrono::high_resolution_clock::now();
     time = end_tot - start_ini;
-    cout << "Total run time: " << time.count() << " s" << endl;
+    kout << "Total run time: " << time.count() << " s" << endl;
+    kernel_stats.time_total += time.count();
+
+    //-------------------------------------------------------------------------
+
+    kout << "--------------------------------------------------------" << endl;
+
+}
+
+void sw_dir_cor_comp_hori_bound(
+    float* vert_grid,
+    int dem_dim_0, int dem_dim_1,
+    float* vert_grid_in,
+    int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
+    double* sun_pos,
+    int dim_sun_0, int dim_sun_1,
+    float* sw_dir_cor,
+    int pixel_per_gc,
+    int offset_gc,
+    uint8_t* mask,
+    double dist_search,
+    char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    double sw_dir_cor_max,
+    double ang_max,
+    int hori_azim_num,
+    double hori_acc,
+    char* ray_algorithm,
+    double elev_ang_low_lim,
+    double bound_margin,
+    int approx_shadow,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data) {
+
+    // Single dispatch to kernel specialised for horizon detection algorithm
+    // (guess from previous azimuth direction is not used for bounds)
+    int alg = hori_alg_index(ray_algorithm);
+    if (alg == HORI_ALG_GUESS_CONSTANT) {
+        alg = HORI_ALG_BINARY_SEARCH;
+    }
+    dispatch_hori_alg(alg, [&](auto alg_c) {
+        constexpr int ALG = decltype(alg_c)::value;
+        sw_dir_cor_comp_hori_bound_spec<ALG>(vert_grid, dem_dim_0, dem_dim_1,
+            vert_grid_in, dem_dim_in_0, dem_dim_in_1, radius_earth, sun_pos,
+            dim_sun_0, dim_sun_1, sw_dir_cor, pixel_per_gc, offset_gc, mask,
+            dist_search, geom_type, scene_ext, build_quality, compact, robust,
+            grain_size, cost_order, sw_dir_cor_max, ang_max, hori_azim_num,
+            hori_acc, elev_ang_low_lim, bound_margin, approx_shadow,
+            block_rows, row_callback, user_data);
+    });
+
+}
+
+//#############################################################################
+// Out-of-core tiling
+//#############################################################################
+
+// Tile of domain (grid cells [gc_y_beg, gc_y_end) x [gc_x_beg, gc_x_end)
+// of inner domain) with DEM data including halo of 'offset_gc' grid cells
+struct Tile {
+    int gc_y_beg, gc_y_end, gc_x_beg, gc_x_end;
+    int dem_dim_0, dem_dim_1;
+    int dem_dim_in_0, dem_dim_in_1;
+    float* vert_grid;
+    float* vert_grid_in;
+    double* sun_pos;
+    uint8_t* mask;
+    float* sw_dir_cor;
+    RTCScene scene;
+};
+
+// Load DEM data of tile (callback) and build its scene
+bool tile_load(Tile &tile, int gc_y_beg, int gc_y_end, int gc_x_beg,
+    int gc_x_end, int pixel_per_gc, int offset_gc, int num_gc_x,
+    size_t num_sun, uint8_t* mask, int hori_implicit, RTCDevice device,
+    char* geom_type, char* build_quality, int compact, int robust,
+    tile_load_t tile_load_cb, void* user_data) {
+
+    tile.gc_y_beg = gc_y_beg;
+    tile.gc_y_end = gc_y_end;
+    tile.gc_x_beg = gc_x_beg;
+    tile.gc_x_end = gc_x_end;
+    int num_gc_y_t = gc_y_end - gc_y_beg;
+    int num_gc_x_t = gc_x_end - gc_x_beg;
+    tile.dem_dim_in_0 = num_gc_y_t * pixel_per_gc + 1;
+    tile.dem_dim_in_1 = num_gc_x_t * pixel_per_gc + 1;
+    tile.dem_dim_0 = tile.dem_dim_in_0 + 2 * offset_gc * pixel_per_gc;
+    tile.dem_dim_1 = tile.dem_dim_in_1 + 2 * offset_gc * pixel_per_gc;
+    size_t num_vert = (size_t)tile.dem_dim_0 * (size_t)tile.dem_dim_1;
+    size_t num_vert_in = (size_t)tile.dem_dim_in_0
+        * (size_t)tile.dem_dim_in_1;
+    tile.vert_grid = new float[num_vert * 3 + 16];
+    // padding for shared Embree vertex buffer (16 byte reads)
+    std::fill(tile.vert_grid + num_vert * 3,
+        tile.vert_grid + num_vert * 3 + 16, 0.0);
+    tile.vert_grid_in = NULL;
+    if (hori_implicit == 0) {
+        tile.vert_grid_in = new float[num_vert_in * 3 + 16];
+        std::fill(tile.vert_grid_in + num_vert_in * 3,
+            tile.vert_grid_in + num_vert_in * 3 + 16, 0.0);
+    }
+    tile.sun_pos = new double[num_sun * 3];
+    tile.mask = new uint8_t[num_gc_y_t * num_gc_x_t];
+    for (int i = 0; i < num_gc_y_t; i++) {
+        for (int j = 0; j < num_gc_x_t; j++) {
+            tile.mask[lin_ind_2d(num_gc_x_t, i, j)]
+                = mask[lin_ind_2d(num_gc_x, gc_y_beg + i, gc_x_beg + j)];
+        }
+    }
+    tile.sw_dir_cor = NULL;
+    tile.scene = NULL;
+
+    if (tile_load_cb(gc_y_beg, gc_y_end, gc_x_beg, gc_x_end,
+        tile.vert_grid, tile.vert_grid_in, tile.sun_pos, user_data) != 0) {
+        return false;
+    }
+    tile.scene = initializeScene(device, tile.vert_grid, tile.dem_dim_0,
+        tile.dem_dim_1, geom_type, build_quality, compact, robust);
+    return true;
+
+}
+
+// Release resources of tile
+void tile_free(Tile &tile) {
+
+    if (tile.scene != NULL) {
+        releaseScene(tile.scene);
+    }
+    delete[] tile.vert_grid;
+    delete[] tile.vert_grid_in;
+    delete[] tile.sun_pos;
+    delete[] tile.mask;
+    delete[] tile.sw_dir_cor;
+    tile.scene = NULL;
+    tile.vert_grid = NULL;
+    tile.vert_grid_in = NULL;
+    tile.sun_pos = NULL;
+    tile.mask = NULL;
+    tile.sw_dir_cor = NULL;
+
+}
+
+void sw_dir_cor_comp_tiled(
+    int num_gc_y, int num_gc_x,
+    double radius_earth,
+    int dim_sun_0, int dim_sun_1,
+    float* sw_dir_cor,
+    int pixel_per_gc,
+    int offset_gc,
+    uint8_t* mask,
+    double dist_search,
+    char* geom_type,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    int refrac_cor,
+    double sw_dir_cor_max,
+    double ang_max,
+    double mem_budget,
+    tile_load_t tile_load_cb,
+    tile_store_t tile_store_cb,
+    void* user_data) {
+
+    KernelScope scope;  // no rays per grid cell (tiles use local indices)
+
+    kout << "--------------------------------------------------------" << endl;
+    kout << "Compute lookup table tile-wise (out-of-core)" << endl;
+    kout << "--------------------------------------------------------" << endl;
+
+    // Hard-coded settings
+    double bytes_per_vert = 12.0 + 36.0;
+    // vertex buffer and estimate of BVH memory per DEM vertex [byte]
+    int hori_implicit = (radius_earth > 0.0) ? 1 : 0;
+    // horizontal triangles computed analytically (no inner DEM of tiles)
+    int dem_dim_lim = 32767;
+    // maximal dimension length of tile DEM [-]
+
+    auto start_tot = std::chrono::high_resolution_clock::now();
+
+    // Tile size (square; two tiles in memory -> next tile is loaded and
+    // its scene built while current tile is traced)
+    size_t num_sun = (size_t)dim_sun_0 * (size_t)dim_sun_1;
+    double mem_budget_byte = mem_budget * pow(10.0, 9);
+    int tile_gc = std::max(num_gc_y, num_gc_x);
+    while (tile_gc > 0) {
+        double dem_dim_0 = (double)((std::min(tile_gc, num_gc_y)
+            + 2 * offset_gc) * pixel_per_gc + 1);
+        double dem_dim_1 = (double)((std::min(tile_gc, num_gc_x)
+            + 2 * offset_gc) * pixel_per_gc + 1);
+        double num_gc_tile = (double)std::min(tile_gc, num_gc_y)
+            * (double)std::min(tile_gc, num_gc_x);
+        double mem_tile = dem_dim_0 * dem_dim_1 * bytes_per_vert
+            + num_gc_tile * (double)(pixel_per_gc * pixel_per_gc) * 12.0
+            * (double)(1 - hori_implicit)
+            + num_gc_tile * (double)num_sun * 4.0;
+        if (((2.0 * mem_tile) <= mem_budget_byte)
+            && (dem_dim_0 <= dem_dim_lim) && (dem_dim_1 <= dem_dim_lim)) {
+            break;
+        }
+        tile_gc -= 1;
+    }
+    if (tile_gc == 0) {
+        cerr << "Error: memory budget is too small for a single grid cell "
+            << "with halo" << endl;
+        return;
+    }
+    int num_tile_y = (num_gc_y + tile_gc - 1) / tile_gc;
+    int num_tile_x = (num_gc_x + tile_gc - 1) / tile_gc;
+    int num_tile = num_tile_y * num_tile_x;
+    kout << "Memory budget: " << mem_budget << " GB" << endl;
+    kout << "Tile size: " << tile_gc << " grid cells (halo: " << offset_gc
+        << " grid cells)" << endl;
+    kout << "Number of tiles: " << num_tile << " (" << num_tile_y << " x "
+        << num_tile_x << ")" << endl;
 
     //-------------------------------------------------------------------------
 
-    cout << "--------------------------------------------------------" << endl;
+    RTCDevice device = initializeDevice();
+    Tile tile[2] = {};
+    tbb::task_group tg;
+    bool success = true;
+
+    // Load first tile
+    int ind_buf = 0;
+    success = tile_load(tile[0], 0, std::min(tile_gc, num_gc_y), 0,
+        std::min(tile_gc, num_gc_x), pixel_per_gc, offset_gc, num_gc_x,
+        num_sun, mask, hori_implicit, device, geom_type, build_quality,
+        compact, robust, tile_load_cb, user_data);
+
+    for (int t = 0; (t < num_tile) && success; t++) {
+
+        // Trace current tile (asynchronously)
+        Tile &cur = tile[ind_buf];
+        size_t num_elem = (size_t)(cur.gc_y_end - cur.gc_y_beg)
+            * (size_t)(cur.gc_x_end - cur.gc_x_beg) * num_sun;
+        cur.sw_dir_cor = new float[num_elem];
+        std::fill(cur.sw_dir_cor, cur.sw_dir_cor + num_elem, 0.0);
+        tg.run([&] {
+            sw_dir_cor_comp(cur.vert_grid, cur.dem_dim_0, cur.dem_dim_1,
+                cur.vert_grid_in, cur.dem_dim_in_0, cur.dem_dim_in_1,
+                radius_earth,
+                cur.sun_pos, dim_sun_0, dim_sun_1, cur.sw_dir_cor,
+                pixel_per_gc, offset_gc, cur.mask, dist_search, geom_type,
+                cur.scene, build_quality, compact, robust, grain_size,
+                cost_order, 0, refrac_cor, sw_dir_cor_max, ang_max, 1,
+                NULL, NULL);
+        });
+
+        // Load next tile and build its scene
+        if ((t + 1) < num_tile) {
+            int t_y = (t + 1) / num_tile_x;
+            int t_x = (t + 1) % num_tile_x;
+            success = tile_load(tile[1 - ind_buf], t_y * tile_gc,
+                std::min((t_y + 1) * tile_gc, num_gc_y), t_x * tile_gc,
+                std::min((t_x + 1) * tile_gc, num_gc_x), pixel_per_gc,
+                offset_gc, num_gc_x, num_sun, mask, hori_implicit, device,
+                geom_type, build_quality, compact, robust, tile_load_cb,
+                user_data);
+        }
+        tg.wait();
+
+        // Stitch output of current tile
+        int num_gc_x_t = cur.gc_x_end - cur.gc_x_beg;
+        if (sw_dir_cor != NULL) {
+            for (int i = cur.gc_y_beg; i < cur.gc_y_end; i++) {
+                size_t ind_lin = lin_ind_4d(num_gc_x, dim_sun_0, dim_sun_1,
+                    i, cur.gc_x_beg, 0, 0);
+                size_t ind_lin_t = lin_ind_4d(num_gc_x_t, dim_sun_0,
+                    dim_sun_1, i - cur.gc_y_beg, 0, 0, 0);
+                std::copy(cur.sw_dir_cor + ind_lin_t, cur.sw_dir_cor
+                    + ind_lin_t + num_gc_x_t * num_sun,
+                    sw_dir_cor + ind_lin);
+            }
+        }
+        if (tile_store_cb != NULL) {
+            tile_store_cb(cur.gc_y_beg, cur.gc_y_end, cur.gc_x_beg,
+                cur.gc_x_end, cur.sw_dir_cor, user_data);
+        }
+        tile_free(cur);
+        ind_buf = 1 - ind_buf;
+
+    }
+
+    if (!success) {
+        cerr << "Error: loading DEM data of tile failed" << endl;
+    }
+    tile_free(tile[0]);
+    tile_free(tile[1]);
+    releaseDevice(device);
+
+    auto end_tot = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time = end_tot - start_tot;
+    kout << "Total run time (all tiles): " << time.count() << " s" << endl;
+    kernel_stats.time_total = time.count();
+
+    kout << "--------------------------------------------------------" << endl;
 
 }
@@ -1,14 +1,33 @@
 // Copyright (c) 2023 ETH Zurich, Christian R. Steger
 // MIT License
 
-#ifndef TESTLIB_H
-#define TESTLIB_H
+#ifndef RAYS_COMP_H
+#define RAYS_COMP_H
+
+#include "row_stream.h"
+#include <embree3/rtcore.h>
+#include <cstdint>
+
+// Callback loading DEM data of tile (grid cells [gc_y_beg, gc_y_end) x
+// [gc_x_beg, gc_x_end) of inner domain) into provided buffers: vertices
+// including halo of 'offset_gc' grid cells, vertices of inner domain (NULL
+// if horizontal triangles are computed analytically) and sun positions (all
+// in local ENU coordinates of tile). Returns 0 on success.
+typedef int (*tile_load_t)(int gc_y_beg, int gc_y_end, int gc_x_beg,
+    int gc_x_end, float* vert_grid, float* vert_grid_in, double* sun_pos,
+    void* user_data);
+
+// Callback receiving finished lookup table of tile (buffer is only valid
+// during call)
+typedef void (*tile_store_t)(int gc_y_beg, int gc_y_end, int gc_x_beg,
+    int gc_x_end, float* sw_dir_cor, void* user_data);
 
 void sw_dir_cor_comp(
     float* vert_grid,
     int dem_dim_0, int dem_dim_1,
     float* vert_grid_in,
     int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
     double* sun_pos,
     int dim_sun_0, int dim_sun_1,
     float* sw_dir_cor,
@@ -17,14 +36,26 @@ void sw_dir_cor_comp(
     uint8_t* mask,
     double dist_search,
     char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    int use_float32,
+    int refrac_cor,
     double sw_dir_cor_max,
-    double ang_max);
+    double ang_max,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data);
 
 void sw_dir_cor_comp_coherent(
     float* vert_grid,
     int dem_dim_0, int dem_dim_1,
     float* vert_grid_in,
     int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
     double* sun_pos,
     int dim_sun_0, int dim_sun_1,
     float* sw_dir_cor,
@@ -33,23 +64,150 @@ void sw_dir_cor_comp_coherent(
     uint8_t* mask,
     double dist_search,
     char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
     double sw_dir_cor_max,
-    double ang_max);
+    double ang_max,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data);
 
 void sw_dir_cor_comp_coherent_rp8(
     float* vert_grid,
     int dem_dim_0, int dem_dim_1,
     float* vert_grid_in,
     int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
+    double* sun_pos,
+    int dim_sun_0, int dim_sun_1,
+    float* sw_dir_cor,
+    int pixel_per_gc,
+    int offset_gc,
+    uint8_t* mask,
+    double dist_search,
+    char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    double sw_dir_cor_max,
+    double ang_max,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data);
+
+void sw_dir_cor_comp_stream(
+    float* vert_grid,
+    int dem_dim_0, int dem_dim_1,
+    float* vert_grid_in,
+    int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
+    double* sun_pos,
+    int dim_sun_0, int dim_sun_1,
+    float* sw_dir_cor,
+    int pixel_per_gc,
+    int offset_gc,
+    uint8_t* mask,
+    double dist_search,
+    char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    double sw_dir_cor_max,
+    double ang_max,
+    int batch_size,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data);
+
+void sw_dir_cor_comp_adaptive(
+    float* vert_grid,
+    int dem_dim_0, int dem_dim_1,
+    float* vert_grid_in,
+    int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
     double* sun_pos,
     int dim_sun_0, int dim_sun_1,
     float* sw_dir_cor,
+    float* sw_dir_cor_err,
+    int pixel_per_gc,
+    int offset_gc,
+    uint8_t* mask,
+    double dist_search,
+    char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    double sw_dir_cor_max,
+    double ang_max,
+    int stride_max,
+    double err_tol);
+
+void sw_dir_cor_comp_hori_bound(
+    float* vert_grid,
+    int dem_dim_0, int dem_dim_1,
+    float* vert_grid_in,
+    int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
+    double* sun_pos,
+    int dim_sun_0, int dim_sun_1,
+    float* sw_dir_cor,
+    int pixel_per_gc,
+    int offset_gc,
+    uint8_t* mask,
+    double dist_search,
+    char* geom_type,
+    RTCScene scene_ext,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    double sw_dir_cor_max,
+    double ang_max,
+    int hori_azim_num,
+    double hori_acc,
+    char* ray_algorithm,
+    double elev_ang_low_lim,
+    double bound_margin,
+    int approx_shadow,
+    int block_rows,
+    row_callback_t row_callback,
+    void* user_data);
+
+void sw_dir_cor_comp_tiled(
+    int num_gc_y, int num_gc_x,
+    double radius_earth,
+    int dim_sun_0, int dim_sun_1,
+    float* sw_dir_cor,
     int pixel_per_gc,
     int offset_gc,
     uint8_t* mask,
     double dist_search,
     char* geom_type,
+    char* build_quality,
+    int compact,
+    int robust,
+    int grain_size,
+    int cost_order,
+    int refrac_cor,
     double sw_dir_cor_max,
-    double ang_max);
+    double ang_max,
+    double mem_budget,
+    tile_load_t tile_load_cb,
+    tile_store_t tile_store_cb,
+    void* user_data);
 
 #endif
@@ -2,6 +2,15 @@
 // MIT License
 
 #include "sun_position_comp.h"
+#include "kernel_stats.h"
+#include "embree_core.h"
+#include "horizon_detect.h"
+#include "geometry_core.h"
+#include "horizon_file.h"
+#include "scratch_arena.h"
+#include "refraction.h"
+#include "kernel_variants.h"
+#include "heightfield.h"
 #include <cstdio>
 #include <embree3/rtcore.h>
 #include <stdio.h>
@@ -24,106 +33,10 @@ using namespace shapes;
 // Auxiliary functions
 //#############################################################################
 
-// ----------------------------------------------------------------------------
-// Unit conversion
-// ----------------------------------------------------------------------------
-
-// Convert degree to radian
-inline double deg2rad(double ang) {
-    /* Parameters
-       ----------
-       ang: angle [degree]
-
-       Returns
-       ----------
-       ang: angle [radian]
-    */
-    return ((ang / 180.0) * M_PI);
-}
-
-// Convert radian to degree
-inline double rad2deg(double ang) {
-    /* Parameters
-       ----------
-       ang: angle [radian]
-
-       Returns
-       ----------
-       ang: angle [degree]
-    */
-    return ((ang / M_PI) * 180.0);
-}
-
-// Convert from Kelvin to degree Celsius
-inline double K2degC(double temp) {
-    /* Parameters
-       ----------
-       temp: temperature [Kelvin]
-
-       Returns
-       ----------
-       temp: temperature [degree Celsius]*/
-    return (temp - 273.15);
-}
-
-// ----------------------------------------------------------------------------
-// Compute linear array index from multidimensional subscripts
-// ----------------------------------------------------------------------------
-
-// Linear index from subscripts (2D-array)
-inline size_t lin_ind_2d(size_t dim_1, size_t ind_0, size_t ind_1) {
-    /* Parameters
-       ----------
-       dim_1: second dimension length of two-dimensional array [-]
-       ind_0: first array indices [-]
-       ind_1: second array indices [-]
-
-       Returns
-       ----------
-       ind_lin: linear index of array [-]
-    */
-    return (ind_0 * dim_1 + ind_1);
-}
-
 // ----------------------------------------------------------------------------
 // Vector and matrix operations
 // ----------------------------------------------------------------------------
 
-// Unit vector
-inline void vec_unit(double &v_x, double &v_y, double &v_z) {
-    /* Parameters
-       ----------
-       v_x: x-component of vector [arbitrary]
-       v_y: y-component of vector [arbitrary]
-       v_z: z-component of vector [arbitrary]
-    */
-    double mag = sqrt(v_x * v_x + v_y * v_y + v_z * v_z);
-    v_x = v_x / mag;
-    v_y = v_y / mag;
-    v_z = v_z / mag;
-}
-
-// Cross product
-inline void cross_prod(double a_x, double a_y, double a_z,
-    double b_x, double b_y, double b_z,
-    double &c_x, double &c_y, double &c_z) {
-    /* Parameters
-       ----------
-       a_x: x-component of vector a [arbitrary]
-       a_y: y-component of vector a [arbitrary]
-       a_z: z-component of vector a [arbitrary]
-       b_x: x-component of vector b [arbitrary]
-       b_y: y-component of vector b [arbitrary]
-       b_z: z-component of vector b [arbitrary]
-       c_x: x-component of vector c [arbitrary]
-       c_y: y-component of vector c [arbitrary]
-       c_z: z-component of vector c [arbitrary]
-    */
-    c_x = a_y * b_z - a_z * b_y;
-    c_y = a_z * b_x - a_x * b_z;
-    c_z = a_x * b_y - a_y * b_x;
-}
-
 // Vector rotation (according to Rodrigues' rotation formula)
 inline void vec_rot(double k_x, double k_y, double k_z, double theta,
     double &v_x, double &v_y, double &v_z) {
@@ -151,385 +64,1400 @@ inline void vec_rot(double k_x, double k_y, double k_z, double theta,
     v_z = v_z_rot;
 }
 
+// Rotation matrix from global to local ENU coordinate system
+inline void rot_mat_local(double norm_hori_x, double norm_hori_y,
+    double norm_hori_z, double (&rot)[3][3]) {
+    /* Parameters
+       ----------
+       norm_hori_x: x-component of horizontal surface normal [-]
+       norm_hori_y: y-component of horizontal surface normal [-]
+       norm_hori_z: z-component of horizontal surface normal [-]
+       rot: rotation matrix (rows: east, north and up vector) [-]
+
+       Notes
+       ----------
+       The north vector is approximated (orthogonal to x-axis of global ENU
+       coordinate system). The orientation of the coordinate system in which
+       the horizon is computed can be arbitrary as long as the z-axis aligns
+       with the local horizontal surface normal.*/
+    double north_x = 0.0;
+    double north_y = 1.0;
+    double north_z = -norm_hori_y / norm_hori_z;
+    vec_unit(north_x, north_y, north_z);
+    double east_x, east_y, east_z;
+    cross_prod(north_x, north_y, north_z,
+        norm_hori_x, norm_hori_y, norm_hori_z,
+        east_x, east_y, east_z);
+    rot[0][0] = east_x;
+    rot[0][1] = east_y;
+    rot[0][2] = east_z;
+    rot[1][0] = north_x;
+    rot[1][1] = north_y;
+    rot[1][2] = north_z;
+    rot[2][0] = norm_hori_x;
+    rot[2][1] = norm_hori_y;
+    rot[2][2] = norm_hori_z;
+}
+
 // ----------------------------------------------------------------------------
 // Triangle operations
 // ----------------------------------------------------------------------------
 
-// Triangle surface normal and area
-inline void triangle_normal_area(
-    double &vert_0_x, double &vert_0_y, double &vert_0_z,
-    double &vert_1_x, double &vert_1_y, double &vert_1_z,
-    double &vert_2_x, double &vert_2_y, double &vert_2_z,
-    double &norm_x, double &norm_y, double &norm_z,
-    double &area) {
+// Geometry of tilted and horizontal triangle
+inline void triangle_geometry(float* vert_grid, size_t dem_dim_1,
+    float* vert_grid_in, size_t dem_dim_in_1, double radius_earth,
+    size_t ind_0, size_t ind_1, size_t n, size_t offset, double ray_org_elev,
+    TriangleGeom &geom) {
     /* Parameters
        ----------
-       vert_0_x: x-component of first triangle vertices [m]
-       vert_0_y: y-component of first triangle vertices [m]
-       vert_0_z: z-component of first triangle vertices [m]
-       vert_1_x: x-component of second triangle vertices [m]
-       vert_1_y: y-component of second triangle vertices [m]
-       vert_1_z: z-component of second triangle vertices [m]
-       vert_2_x: x-component of third triangle vertices [m]
-       vert_2_y: y-component of third triangle vertices [m]
-       vert_2_z: z-component of third triangle vertices [m]
-       norm_x: x-component of triangle surface normal [-]
-       norm_y: y-component of triangle surface normal [-]
-       norm_z: z-component of triangle surface normal [-]
-       area: area of triangle [m2]
+       vert_grid: vertices of DEM [m]
+       dem_dim_1: second dimension length of DEM [-]
+       vert_grid_in: vertices of inner DEM with 0.0 m elevation (or NULL ->
+                     horizontal triangle computed analytically) [m]
+       dem_dim_in_1: second dimension length of inner DEM [-]
+       radius_earth: radius of Earth (only used without inner DEM) [m]
+       ind_0: first index of pixel in inner DEM [-]
+       ind_1: second index of pixel in inner DEM [-]
+       n: triangle within pixel (0: lower left, 1: upper right) [-]
+       offset: offset between DEM and inner DEM [pixel]
+       ray_org_elev: value to elevate ray origin [m]
+       geom: geometry of tilted and horizontal triangle
     */
-    double a_x = vert_2_x - vert_1_x;
-    double a_y = vert_2_y - vert_1_y;
-    double a_z = vert_2_z - vert_1_z;
-    double b_x = vert_0_x - vert_1_x;
-    double b_y = vert_0_y - vert_1_y;
-    double b_z = vert_0_z - vert_1_z;
-
-    norm_x = a_y * b_z - a_z * b_y;
-    norm_y = a_z * b_x - a_x * b_z;
-    norm_z = a_x * b_y - a_y * b_x;
-
-    double mag = sqrt(norm_x * norm_x + norm_y * norm_y + norm_z * norm_z);
-    norm_x = norm_x / mag;
-    norm_y = norm_y / mag;
-    norm_z = norm_z / mag;
-
-    area = mag / 2.0;
+
+    // Tilted triangle
+    size_t ind_tri_0, ind_tri_1, ind_tri_2;
+    triangle_vert(n, dem_dim_1, ind_0 + offset, ind_1 + offset,
+        ind_tri_0, ind_tri_1, ind_tri_2);
+
+    double vert_0_x = (double)vert_grid[ind_tri_0];
+    double vert_0_y = (double)vert_grid[ind_tri_0 + 1];
+    double vert_0_z = (double)vert_grid[ind_tri_0 + 2];
+    double vert_1_x = (double)vert_grid[ind_tri_1];
+    double vert_1_y = (double)vert_grid[ind_tri_1 + 1];
+    double vert_1_z = (double)vert_grid[ind_tri_1 + 2];
+    double vert_2_x = (double)vert_grid[ind_tri_2];
+    double vert_2_y = (double)vert_grid[ind_tri_2 + 1];
+    double vert_2_z = (double)vert_grid[ind_tri_2 + 2];
+
+    double cent_x, cent_y, cent_z;
+    triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
+        vert_1_x, vert_1_y, vert_1_z,
+        vert_2_x, vert_2_y, vert_2_z,
+        cent_x, cent_y, cent_z);
+
+    double area_tilt;
+    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+        vert_1_x, vert_1_y, vert_1_z,
+        vert_2_x, vert_2_y, vert_2_z,
+        geom.norm_tilt_x, geom.norm_tilt_y, geom.norm_tilt_z,
+        area_tilt);
+
+    // Ray origin
+    geom.ray_org_x = (cent_x + geom.norm_tilt_x * ray_org_elev);
+    geom.ray_org_y = (cent_y + geom.norm_tilt_y * ray_org_elev);
+    geom.ray_org_z = (cent_z + geom.norm_tilt_z * ray_org_elev);
+
+    // Horizontal triangle
+    triangle_vert_hori(vert_grid_in, dem_dim_in_1,
+        ind_0, ind_1, n, radius_earth,
+        vert_0_x, vert_0_y, vert_0_z,
+        vert_1_x, vert_1_y, vert_1_z,
+        vert_2_x, vert_2_y, vert_2_z);
+
+    double area_hori;
+    triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
+        vert_1_x, vert_1_y, vert_1_z,
+        vert_2_x, vert_2_y, vert_2_z,
+        geom.norm_hori_x, geom.norm_hori_y, geom.norm_hori_z,
+        area_hori);
+
+    geom.surf_enl_fac = area_tilt / area_hori;
+
+    // Elevation (distance between centroid of DEM triangle and 'base
+    // triangle'; required for atmospheric refraction)
+    double cent_base_x, cent_base_y, cent_base_z;
+    triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
+        vert_1_x, vert_1_y, vert_1_z,
+        vert_2_x, vert_2_y, vert_2_z,
+        cent_base_x, cent_base_y, cent_base_z);
+    geom.elevation = sqrt(pow(cent_x - cent_base_x, 2)
+        + pow(cent_y - cent_base_y, 2)
+        + pow(cent_z - cent_base_z, 2));
+
 }
 
-// Triangle centroid
-inline void triangle_centroid(
-    double &vert_0_x, double &vert_0_y, double &vert_0_z,
-    double &vert_1_x, double &vert_1_y, double &vert_1_z,
-    double &vert_2_x, double &vert_2_y, double &vert_2_z,
-    double &cent_x, double &cent_y, double &cent_z) {
+// ----------------------------------------------------------------------------
+// Atmospheric refraction
+// ----------------------------------------------------------------------------
+
+// Correct sun vector for atmospheric refraction
+inline void sun_vec_refrac(const RefracTable &table, int refrac_cor,
+    TriangleGeom &geom, double &sun_x, double &sun_y, double &sun_z,
+    double &dot_prod_hs) {
     /* Parameters
        ----------
-       vert_0_x: x-component of first triangle vertices [m]
-       vert_0_y: y-component of first triangle vertices [m]
-       vert_0_z: z-component of first triangle vertices [m]
-       vert_1_x: x-component of second triangle vertices [m]
-       vert_1_y: y-component of second triangle vertices [m]
-       vert_1_z: z-component of second triangle vertices [m]
-       vert_2_x: x-component of third triangle vertices [m]
-       vert_2_y: y-component of third triangle vertices [m]
-       vert_2_z: z-component of third triangle vertices [m]
-       cent_x: x-component of triangle centroid [-]
-       cent_y: y-component of triangle centroid [-]
-        cent_z: z-component of triangle centroid [-]
-    */
-    cent_x = (vert_0_x + vert_1_x + vert_2_x) / 3.0;
-    cent_y = (vert_0_y + vert_1_y + vert_2_y) / 3.0;
-    cent_z = (vert_0_z + vert_1_z + vert_2_z) / 3.0;
+       table: lookup table of refraction correction
+       refrac_cor: lookup table (REFRAC_TABLE) or exact computation with
+                   Rodrigues' rotation formula (REFRAC_EXACT; reference)
+       geom: geometry of tilted and horizontal triangle
+       sun_x: x-component of sun unit vector [-]
+       sun_y: y-component of sun unit vector [-]
+       sun_z: z-component of sun unit vector [-]
+       dot_prod_hs: dot product between horizontal surface normal and sun
+                    unit vector [-]*/
+
+    if (refrac_cor == REFRAC_TABLE) {
+        sun_vec_refrac_table(table, geom.elevation, geom.norm_hori_x,
+            geom.norm_hori_y, geom.norm_hori_z, sun_x, sun_y, sun_z,
+            dot_prod_hs);
+        return;
+    }
+
+    // Update sun position
+    double elev_ang_true = 90.0 - rad2deg(acos(dot_prod_hs));
+    double refrac_ang = refrac_angle(elev_ang_true, geom.elevation);
+    double k_x, k_y, k_z;
+    cross_prod(sun_x, sun_y, sun_z,
+        geom.norm_hori_x, geom.norm_hori_y, geom.norm_hori_z,
+        k_x, k_y, k_z);
+    vec_unit(k_x, k_y, k_z);
+    vec_rot(k_x, k_y, k_z, deg2rad(refrac_ang), sun_x, sun_y, sun_z);
+    dot_prod_hs = (geom.norm_hori_x * sun_x + geom.norm_hori_y * sun_y
+        + geom.norm_hori_z * sun_z);
+
+}
+
+//#############################################################################
+// Initialise terrain
+//#############################################################################
+
+CppTerrain::CppTerrain() {
+
+    device = initializeDevice();
+    scene = NULL;
+
+    geom_cache_cl = 0;
+    ray_org_x_cl = NULL;
+    ray_org_y_cl = NULL;
+    ray_org_z_cl = NULL;
+    norm_tilt_x_cl = NULL;
+    norm_tilt_y_cl = NULL;
+    norm_tilt_z_cl = NULL;
+    norm_hori_x_cl = NULL;
+    norm_hori_y_cl = NULL;
+    norm_hori_z_cl = NULL;
+    surf_enl_fac_cl = NULL;
+    elevation_cl = NULL;
+
+    hori_cache_cl = 0;
+    hori_azim_num_cl = 0;
+    hori_acc_cl = 0.0;
+    hori_data_cl = NULL;
+    hori_map_cl = NULL;
+    hori_map_size_cl = 0;
+
+    bound_azim_num_cl = 0;
+    hori_bound_cl = NULL;
+
+    refrac_table_cl.data = NULL;
+
+}
+
+CppTerrain::~CppTerrain() {
+
+    free_geom_cache();
+    free_horizon_cache();
+    reset_incremental();
+    refrac_table_free(refrac_table_cl);
+
+    // Release resources allocated through Embree
+    if (scene != NULL) {
+        releaseScene(scene);
+    }
+    releaseDevice(device);
+
 }
 
-// Vertices of lower left triangle (within pixel)
-inline void triangle_vert_ll(size_t dim_1, size_t ind_0, size_t ind_1,
-    size_t &ind_tri_0, size_t &ind_tri_1, size_t &ind_tri_2) {
+void CppTerrain::free_geom_cache() {
+
+    delete[] ray_org_x_cl;
+    delete[] ray_org_y_cl;
+    delete[] ray_org_z_cl;
+    delete[] norm_tilt_x_cl;
+    delete[] norm_tilt_y_cl;
+    delete[] norm_tilt_z_cl;
+    delete[] norm_hori_x_cl;
+    delete[] norm_hori_y_cl;
+    delete[] norm_hori_z_cl;
+    delete[] surf_enl_fac_cl;
+    delete[] elevation_cl;
+    ray_org_x_cl = NULL;
+    ray_org_y_cl = NULL;
+    ray_org_z_cl = NULL;
+    norm_tilt_x_cl = NULL;
+    norm_tilt_y_cl = NULL;
+    norm_tilt_z_cl = NULL;
+    norm_hori_x_cl = NULL;
+    norm_hori_y_cl = NULL;
+    norm_hori_z_cl = NULL;
+    surf_enl_fac_cl = NULL;
+    elevation_cl = NULL;
+    geom_cache_cl = 0;
+
+}
+
+void CppTerrain::free_horizon_cache() {
+
+    if (hori_map_cl != NULL) {
+        horizon_file_unmap(hori_map_cl, hori_map_size_cl);
+    } else {
+        delete[] hori_data_cl;
+    }
+    hori_data_cl = NULL;
+    hori_map_cl = NULL;
+    hori_map_size_cl = 0;
+    hori_azim_num_cl = 0;
+    hori_acc_cl = 0.0;
+    hori_cache_cl = 0;
+
+}
+
+void CppTerrain::reset_incremental() {
+
+    delete[] hori_bound_cl;
+    hori_bound_cl = NULL;
+    bound_azim_num_cl = 0;
+
+}
+
+void CppTerrain::initialise(
+    float* vert_grid,
+    int dem_dim_0, int dem_dim_1,
+    float* vert_grid_in,
+    int dem_dim_in_0, int dem_dim_in_1,
+    double radius_earth,
+    int pixel_per_gc,
+    int offset_gc,
+	unsigned char* mask,
+    double dist_search,
+    char* geom_type,
+    double sw_dir_cor_max,
+    double ang_max,
+    int geom_cache,
+    char* build_quality,
+    int compact,
+    int robust) {
+
+    vert_grid_cl = vert_grid;
+    dem_dim_0_cl = dem_dim_0;
+    dem_dim_1_cl = dem_dim_1;
+    vert_grid_in_cl = vert_grid_in;
+    dem_dim_in_0_cl = dem_dim_in_0;
+    dem_dim_in_1_cl = dem_dim_in_1;
+    radius_earth_cl = radius_earth;
+    pixel_per_gc_cl = pixel_per_gc;
+    offset_gc_cl = offset_gc;
+    mask_cl = mask;
+    sw_dir_cor_max_cl = sw_dir_cor_max;
+    ang_max_cl = ang_max;
+
+    // Hard-coded settings
+    ray_org_elev_cl = 0.1;
+    // value to elevate ray origin (-> avoids potential issue with numerical
+    // imprecision / truncation) [m]
+
+    // Number of grid cells
+    num_gc_y_cl = (dem_dim_in_0 - 1) / pixel_per_gc;
+    num_gc_x_cl = (dem_dim_in_1 - 1) / pixel_per_gc;
+
+    // Number of triangles
+    num_tri_cl = (dem_dim_in_0 - 1) * (dem_dim_in_1 - 1) * 2;
+    kout << "Number of triangles: " << num_tri_cl << endl;
+    num_tri_per_gc_cl = pixel_per_gc * pixel_per_gc * 2;
+
+    // Unit conversion(s)
+    dot_prod_min_cl = cos(deg2rad(ang_max));
+    dist_search_cl = dist_search * 1000.0;  // [kilometre] to [metre]
+    kout << "Search distance: " << dist_search_cl << " m" << endl;
+
+    kout << "ang_max: " << ang_max << " degree" << endl;
+    kout << "sw_dir_cor_max: " << sw_dir_cor_max  << endl;
+
+    // Lookup table for atmospheric refraction
+    if (refrac_table_cl.data == NULL) {
+        refrac_table_build(refrac_table_cl);
+    }
+
+    KernelScope scope;
+
+    auto start_ini = std::chrono::high_resolution_clock::now();
+
+    if (scene != NULL) {
+        releaseScene(scene);
+    }
+    scene = initializeScene(device, vert_grid, dem_dim_0, dem_dim_1,
+        geom_type, build_quality, compact, robust);
+
+    //-------------------------------------------------------------------------
+    // Per-triangle geometry cache (independent of sun position)
+    //-------------------------------------------------------------------------
+
+    free_horizon_cache();  // horizon depends on terrain -> invalidate
+    reset_incremental();
+    free_geom_cache();
+    if (geom_cache == 1) {
+
+        auto start_cache = std::chrono::high_resolution_clock::now();
+
+        size_t num_elem = (size_t)num_gc_y_cl * (size_t)num_gc_x_cl
+            * (size_t)num_tri_per_gc_cl;
+        ray_org_x_cl = new double[num_elem];
+        ray_org_y_cl = new double[num_elem];
+        ray_org_z_cl = new double[num_elem];
+        norm_tilt_x_cl = new double[num_elem];
+        norm_tilt_y_cl = new double[num_elem];
+        norm_tilt_z_cl = new double[num_elem];
+        norm_hori_x_cl = new double[num_elem];
+        norm_hori_y_cl = new double[num_elem];
+        norm_hori_z_cl = new double[num_elem];
+        surf_enl_fac_cl = new double[num_elem];
+        elevation_cl = new double[num_elem];
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, num_gc_y_cl),
+            [&](tbb::blocked_range<size_t> r) {
+        for (size_t i = r.begin(); i < r.end(); ++i) {
+            for (size_t j = 0; j < (size_t)num_gc_x_cl; j++) {
+
+                size_t lin_ind_gc = lin_ind_2d(num_gc_x_cl, i, j);
+                if (mask_cl[lin_ind_gc] != 1) {
+                    continue;
+                }
+
+                size_t ind_tri = lin_ind_gc * num_tri_per_gc_cl;
+                for (size_t k = (i * pixel_per_gc_cl);
+                    k < ((i * pixel_per_gc_cl) + pixel_per_gc_cl); k++) {
+                    for (size_t m = (j * pixel_per_gc_cl);
+                        m < ((j * pixel_per_gc_cl) + pixel_per_gc_cl); m++) {
+                        for (size_t n = 0; n < 2; n++) {
+
+                            TriangleGeom geom;
+                            triangle_geometry(vert_grid_cl, dem_dim_1_cl,
+                                vert_grid_in_cl, dem_dim_in_1_cl,
+                                radius_earth_cl, k, m, n,
+                                (pixel_per_gc_cl * offset_gc_cl),
+                                ray_org_elev_cl, geom);
+                            ray_org_x_cl[ind_tri] = geom.ray_org_x;
+                            ray_org_y_cl[ind_tri] = geom.ray_org_y;
+                            ray_org_z_cl[ind_tri] = geom.ray_org_z;
+                            norm_tilt_x_cl[ind_tri] = geom.norm_tilt_x;
+                            norm_tilt_y_cl[ind_tri] = geom.norm_tilt_y;
+                            norm_tilt_z_cl[ind_tri] = geom.norm_tilt_z;
+                            norm_hori_x_cl[ind_tri] = geom.norm_hori_x;
+                            norm_hori_y_cl[ind_tri] = geom.norm_hori_y;
+                            norm_hori_z_cl[ind_tri] = geom.norm_hori_z;
+                            surf_enl_fac_cl[ind_tri] = geom.surf_enl_fac;
+                            elevation_cl[ind_tri] = geom.elevation;
+                            ind_tri += 1;
+
+                        }
+                    }
+                }
+
+            }
+        }
+        });
+
+        geom_cache_cl = 1;
+
+        auto end_cache = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> time_cache = end_cache - start_cache;
+        kout << "Geometry cache build time: " << time_cache.count() << " s"
+            << endl;
+        kout << "Size of geometry cache: " << std::fixed
+            << std::setprecision(3)
+            << (double)(num_elem * 11 * sizeof(double)) / pow(10.0, 9)
+            << " GB" << std::defaultfloat << std::setprecision(6) << endl;
+
+    }
+
+    auto end_ini = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time = end_ini - start_ini;
+    kout << "Total initialisation time: " << time.count() << " s" << endl;
+    kernel_stats.time_total = time.count();
+
+}
+
+//#############################################################################
+// Geometry of triangle (from cache or computed on the fly)
+//#############################################################################
+
+void CppTerrain::triangle_geom(size_t i, size_t j, size_t k, size_t m,
+    size_t n, TriangleGeom &geom) {
     /* Parameters
        ----------
+       i: grid cell index in y-direction [-]
+       j: grid cell index in x-direction [-]
+       k: pixel index in y-direction (inner DEM) [-]
+       m: pixel index in x-direction (inner DEM) [-]
+       n: triangle within pixel (0: lower left, 1: upper right) [-]
+       geom: geometry of tilted and horizontal triangle
+    */
+
+    if (geom_cache_cl == 1) {
+        size_t ind_tri = lin_ind_2d(num_gc_x_cl, i, j) * num_tri_per_gc_cl
+            + (((k - i * pixel_per_gc_cl) * pixel_per_gc_cl
+            + (m - j * pixel_per_gc_cl)) * 2) + n;
+        geom.ray_org_x = ray_org_x_cl[ind_tri];
+        geom.ray_org_y = ray_org_y_cl[ind_tri];
+        geom.ray_org_z = ray_org_z_cl[ind_tri];
+        geom.norm_tilt_x = norm_tilt_x_cl[ind_tri];
+        geom.norm_tilt_y = norm_tilt_y_cl[ind_tri];
+        geom.norm_tilt_z = norm_tilt_z_cl[ind_tri];
+        geom.norm_hori_x = norm_hori_x_cl[ind_tri];
+        geom.norm_hori_y = norm_hori_y_cl[ind_tri];
+        geom.norm_hori_z = norm_hori_z_cl[ind_tri];
+        geom.surf_enl_fac = surf_enl_fac_cl[ind_tri];
+        geom.elevation = elevation_cl[ind_tri];
+    } else {
+        triangle_geometry(vert_grid_cl, dem_dim_1_cl, vert_grid_in_cl,
+            dem_dim_in_1_cl, radius_earth_cl, k, m, n,
+            (pixel_per_gc_cl * offset_gc_cl),
+            ray_org_elev_cl, geom);
+    }
+
+}
+
+//#############################################################################
+// Compute correction factors
+//#############################################################################
+
+template <int REFRAC>
+size_t CppTerrain::sw_dir_cor_spec(double* sun_pos, float* sw_dir_cor) {
+
+    KernelScope scope(num_gc_y_cl, num_gc_x_cl);
+
+    auto start_ray = std::chrono::high_resolution_clock::now();
+    size_t num_rays = 0;
+
+    num_rays += tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_gc_y_cl), 0.0,
+        [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
+
+    size_t num_rays_beg = num_rays;
+    size_t num_culled = 0;
+
+    // Loop through 2D-field of grid cells
+    //for (size_t i = 0; i < num_gc_y_cl; i++) {  // serial
+    for (size_t i=r.begin(); i<r.end(); ++i) {  // parallel
+        for (size_t j = 0; j < (size_t)num_gc_x_cl; j++) {
+
+            size_t lin_ind_gc = lin_ind_2d(num_gc_x_cl, i, j);
+            if (mask_cl[lin_ind_gc] == 1) {
+
+            size_t num_rays_cell = num_rays;
+
+            // Loop through 2D-field of DEM pixels
+            for (size_t k = (i * pixel_per_gc_cl);
+                k < ((i * pixel_per_gc_cl) + pixel_per_gc_cl); k++) {
+                for (size_t m = (j * pixel_per_gc_cl);
+                    m < ((j * pixel_per_gc_cl) + pixel_per_gc_cl); m++) {
+
+                    // Loop through two triangles per pixel
+                    for (size_t n = 0; n < 2; n++) {
+
+                        // Tilted and horizontal triangle
+                        TriangleGeom geom;
+                        triangle_geom(i, j, k, m, n, geom);
+
+                        //-----------------------------------------------------
+                        // Compute correction factor
+                        //-----------------------------------------------------
+
+                        // Compute sun unit vector
+                        double sun_x = (sun_pos[0] - geom.ray_org_x);
+                        double sun_y = (sun_pos[1] - geom.ray_org_y);
+                        double sun_z = (sun_pos[2] - geom.ray_org_z);
+                        vec_unit(sun_x, sun_y, sun_z);
+
+                        // Consider atmospheric refraction (optional)
+                        double dot_prod_hs = (geom.norm_hori_x * sun_x
+                            + geom.norm_hori_y * sun_y
+                            + geom.norm_hori_z * sun_z);
+                        if (REFRAC != REFRAC_NONE) {
+                            sun_vec_refrac(refrac_table_cl, REFRAC, geom,
+                                sun_x, sun_y, sun_z, dot_prod_hs);
+                        }
+
+                        // Check for self-shadowing (Earth)
+                        if (dot_prod_hs <= dot_prod_min_cl) {
+                            num_culled += 1;
+                            continue;  // sw_dir_cor += 0.0
+                        }
+
+                        // Check for self-shadowing (triangle)
+                        double dot_prod_ts = geom.norm_tilt_x * sun_x
+                            + geom.norm_tilt_y * sun_y
+                            + geom.norm_tilt_z * sun_z;
+                        if (dot_prod_ts <= 0.0) {
+                            num_culled += 1;
+                            continue;  // sw_dir_cor += 0.0
+                        }
+
+                        // Intersect context
+                        struct RTCIntersectContext context;
+                        rtcInitIntersectContext(&context);
+
+                        // Ray structure
+                        struct RTCRay ray;
+                        ray.org_x = (float)geom.ray_org_x;
+                        ray.org_y = (float)geom.ray_org_y;
+                        ray.org_z = (float)geom.ray_org_z;
+                        ray.dir_x = (float)sun_x;
+                        ray.dir_y = (float)sun_y;
+                        ray.dir_z = (float)sun_z;
+                        ray.tnear = 0.0;
+                        ray.tfar = (float)dist_search_cl;
+                        // std::numeric_limits<float>::infinity();
+
+                        // Intersect ray with scene
+                        rtcOccluded1(scene, &context, &ray);
+                        if (ray.tfar > 0.0) {
+                            // no intersection -> 'tfar' is not updated;
+                            // otherwise 'tfar' = -inf
+                            sw_dir_cor[lin_ind_gc] =
+                                sw_dir_cor[lin_ind_gc]
+                                + (float)(std::min(((dot_prod_ts
+                                / dot_prod_hs)
+                                * geom.surf_enl_fac), sw_dir_cor_max_cl));
+                        }  // else: sw_dir_cor += 0.0
+                        num_rays += 1;
+
+                    }
+
+                }
+            }
+
+            stats_cell(lin_ind_gc, num_rays - num_rays_cell);
+
+            } else {
+
+                sw_dir_cor[lin_ind_gc] = NAN;
+
+            }
+
+        }
+    }
+
+    stats_thread(num_rays - num_rays_beg, num_culled);
+    return num_rays;  // parallel
+    }, std::plus<size_t>());  // parallel
+
+    auto end_ray = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time_ray = (end_ray - start_ray);
+    kout << "Ray tracing time: " << time_ray.count() << " s" << endl;
+    kout << "Number of rays shot: " << num_rays << endl;
+    double frac_ray = (double)num_rays / (double)num_tri_cl;
+    kout << "Fraction of rays required: " << frac_ray << endl;
+    kernel_stats.time_ray += time_ray.count();
+    kernel_stats.time_total += time_ray.count();
+    kernel_stats.num_rays += num_rays;
+
+    // Divide accumulated values by number of triangles within grid cell
+    float num_tri_per_gc = pixel_per_gc_cl * pixel_per_gc_cl * 2.0;
+    size_t num_elem = (num_gc_y_cl * num_gc_x_cl);
+    for (size_t i = 0; i < num_elem; i++) {
+        sw_dir_cor[i] /= num_tri_per_gc;
+    }
+
+    return num_rays;
+
+}
+
+size_t CppTerrain::sw_dir_cor(double* sun_pos, float* sw_dir_cor,
+    int refrac_cor) {
+
+    // Single dispatch to kernel specialised for refraction correction
+    return dispatch_refrac(refrac_cor, [&](auto refrac) {
+        return sw_dir_cor_spec<decltype(refrac)::value>(sun_pos, sw_dir_cor);
+    });
+
+}
+
+//#############################################################################
+// Compute correction factors for a batch of sun positions
+//#############################################################################
+
+template <int REFRAC>
+void CppTerrain::sw_dir_cor_batch_spec(double* sun_pos, int num_sun,
+    float* sw_dir_cor) {
+
+    KernelScope scope(num_gc_y_cl, num_gc_x_cl);
+
+    auto start_ray = std::chrono::high_resolution_clock::now();
+    size_t num_rays = 0;
+
+    size_t num_gc = (size_t)num_gc_y_cl * (size_t)num_gc_x_cl;
+    float num_tri_per_gc = pixel_per_gc_cl * pixel_per_gc_cl * 2.0;
+
+    num_rays += tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_gc_y_cl), 0.0,
+        [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
+
+    size_t num_rays_beg = num_rays;
+    size_t num_culled = 0;
+
+    ScratchArena &arena = scratch_arena();
+    arena.begin(scratch_size<float>(num_sun));
+    float* sw_dir_cor_agg = arena.alloc<float>(num_sun);
+    // accumulated correction factors of grid cell for all sun positions
+
+    // Loop through 2D-field of grid cells
+    for (size_t i=r.begin(); i<r.end(); ++i) {  // parallel
+        for (size_t j = 0; j < (size_t)num_gc_x_cl; j++) {
+
+            size_t lin_ind_gc = lin_ind_2d(num_gc_x_cl, i, j);
+            if (mask_cl[lin_ind_gc] == 1) {
+
+            size_t num_rays_cell = num_rays;
+
+            for (size_t o = 0; o < (size_t)num_sun; o++) {
+                sw_dir_cor_agg[o] = 0.0;
+            }
+
+            // Loop through 2D-field of DEM pixels
+            for (size_t k = (i * pixel_per_gc_cl);
+                k < ((i * pixel_per_gc_cl) + pixel_per_gc_cl); k++) {
+                for (size_t m = (j * pixel_per_gc_cl);
+                    m < ((j * pixel_per_gc_cl) + pixel_per_gc_cl); m++) {
+
+                    // Loop through two triangles per pixel
+                    for (size_t n = 0; n < 2; n++) {
+
+                        // Tilted and horizontal triangle (loaded once and
+                        // reused for all sun positions)
+                        TriangleGeom geom;
+                        triangle_geom(i, j, k, m, n, geom);
+
+                        //-----------------------------------------------------
+                        // Loop through sun positions and compute correction
+                        // factors
+                        //-----------------------------------------------------
+
+                        for (size_t o = 0; o < (size_t)num_sun; o++) {
+
+                            // Compute sun unit vector
+                            double sun_x = (sun_pos[o * 3] - geom.ray_org_x);
+                            double sun_y = (sun_pos[o * 3 + 1]
+                                - geom.ray_org_y);
+                            double sun_z = (sun_pos[o * 3 + 2]
+                                - geom.ray_org_z);
+                            vec_unit(sun_x, sun_y, sun_z);
+
+                            // Consider atmospheric refraction (optional)
+                            double dot_prod_hs = (geom.norm_hori_x * sun_x
+                                + geom.norm_hori_y * sun_y
+                                + geom.norm_hori_z * sun_z);
+                            if (REFRAC != REFRAC_NONE) {
+                                sun_vec_refrac(refrac_table_cl, REFRAC,
+                                    geom, sun_x, sun_y, sun_z, dot_prod_hs);
+                            }
+
+                            // Check for self-shadowing (Earth)
+                            if (dot_prod_hs <= dot_prod_min_cl) {
+                                num_culled += 1;
+                                continue;  // sw_dir_cor += 0.0
+                            }
+
+                            // Check for self-shadowing (triangle)
+                            double dot_prod_ts = geom.norm_tilt_x * sun_x
+                                + geom.norm_tilt_y * sun_y
+                                + geom.norm_tilt_z * sun_z;
+                            if (dot_prod_ts <= 0.0) {
+                                num_culled += 1;
+                                continue;  // sw_dir_cor += 0.0
+                            }
+
+                            // Intersect context
+                            struct RTCIntersectContext context;
+                            rtcInitIntersectContext(&context);
+
+                            // Ray structure
+                            struct RTCRay ray;
+                            ray.org_x = (float)geom.ray_org_x;
+                            ray.org_y = (float)geom.ray_org_y;
+                            ray.org_z = (float)geom.ray_org_z;
+                            ray.dir_x = (float)sun_x;
+                            ray.dir_y = (float)sun_y;
+                            ray.dir_z = (float)sun_z;
+                            ray.tnear = 0.0;
+                            ray.tfar = (float)dist_search_cl;
+
+                            // Intersect ray with scene
+                            rtcOccluded1(scene, &context, &ray);
+                            if (ray.tfar > 0.0) {
+                                // no intersection -> 'tfar' is not updated;
+                                // otherwise 'tfar' = -inf
+                                sw_dir_cor_agg[o] = sw_dir_cor_agg[o]
+                                    + (float)(std::min(((dot_prod_ts
+                                    / dot_prod_hs) * geom.surf_enl_fac),
+                                    sw_dir_cor_max_cl));
+                            }  // else: sw_dir_cor += 0.0
+                            num_rays += 1;
+
+                        }
+
+                    }
+
+                }
+            }
+
+            // Divide accumulated values by number of triangles within grid
+            // cell
+            for (size_t o = 0; o < (size_t)num_sun; o++) {
+                sw_dir_cor[o * num_gc + lin_ind_gc]
+                    = sw_dir_cor_agg[o] / num_tri_per_gc;
+            }
+
+            stats_cell(lin_ind_gc, num_rays - num_rays_cell);
+
+            } else {
+
+                for (size_t o = 0; o < (size_t)num_sun; o++) {
+                    sw_dir_cor[o * num_gc + lin_ind_gc] = NAN;
+                }
+
+            }
+
+        }
+    }
+
+    stats_thread(num_rays - num_rays_beg, num_culled);
+    return num_rays;  // parallel
+    }, std::plus<size_t>());  // parallel
+
+    auto end_ray = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time_ray = (end_ray - start_ray);
+    kout << "Ray tracing time (" << num_sun << " sun positions): "
+        << time_ray.count() << " s" << endl;
+    kout << "Number of rays shot: " << num_rays << endl;
+    double frac_ray = (double)num_rays
+        / ((double)num_tri_cl * (double)num_sun);
+    kout << "Fraction of rays required: " << frac_ray << endl;
+    kernel_stats.time_ray += time_ray.count();
+    kernel_stats.time_total += time_ray.count();
+    kernel_stats.num_rays += num_rays;
+
+}
+
+void CppTerrain::sw_dir_cor_batch(double* sun_pos, int num_sun,
+    float* sw_dir_cor, int refrac_cor) {
+
+    // Single dispatch to kernel specialised for refraction correction
+    dispatch_refrac(refrac_cor, [&](auto refrac) {
+        sw_dir_cor_batch_spec<decltype(refrac)::value>(sun_pos, num_sun,
+            sw_dir_cor);
+    });
+
+}
+
+//#############################################################################
+// Build horizon cache
+//#############################################################################
+
+template <int ALG>
+void CppTerrain::build_horizon_cache_spec(int hori_azim_num, double hori_acc,
+    double elev_ang_low_lim, int hori_quant) {
+
+    KernelScope scope(num_gc_y_cl, num_gc_x_cl);
+
+    kout << "--------------------------------------------------------" << endl;
+    kout << "Build horizon cache" << endl;
+    kout << "--------------------------------------------------------" << endl;
+
+    // Hard-coded settings
+    double elev_ang_up_lim = 89.98;
+    // upper limit for elevation angle [degree]
+
+    // Unit conversion(s)
+    hori_acc = deg2rad(hori_acc);
+    elev_ang_low_lim = deg2rad(elev_ang_low_lim);
+    elev_ang_up_lim = deg2rad(elev_ang_up_lim);
+
+    // Algorithm for horizon detection (kernel specialised at compile time)
+    kout << "Horizon detection algorithm: " << hori_alg_labels[ALG]
+        << endl;
+
+    // ------------------------------------------------------------------------
+    // Allocate and initialise arrays with evaluated trigonometric functions
+    // ------------------------------------------------------------------------
+
+    // Azimuth angles
+    double* azim_sin = new double[hori_azim_num];
+    double* azim_cos = new double[hori_azim_num];
+    double ang;
+    for (int i = 0; i < hori_azim_num; i++) {
+        ang = ((2 * M_PI) / hori_azim_num * i);
+        azim_sin[i] = sin(ang);
+        azim_cos[i] = cos(ang);
+    }
+
+    // Elevation angles
+    int elev_num = ((int)ceil((elev_ang_up_lim - elev_ang_low_lim)
+        / (hori_acc / 5.0)) + 1);
+    double* elev_ang = new double[elev_num];
+    double* elev_sin = new double[elev_num];
+    double* elev_cos = new double[elev_num];
+    for (int i = 0; i < elev_num; i++) {
+        ang = elev_ang_up_lim - (hori_acc / 5.0) * i;
+        elev_ang[elev_num - i - 1] = ang;
+        elev_sin[elev_num - i - 1] = sin(ang);
+        elev_cos[elev_num - i - 1] = cos(ang);
+    }
+
+    // Allocate horizon cache (same triangle order as geometry cache and
+    // same record layout as horizon file)
+    free_horizon_cache();
+    HorizonFileHeader header;
+    horizon_header_init(header, num_gc_y_cl, num_gc_x_cl, num_tri_per_gc_cl,
+        hori_azim_num, hori_quant, elev_ang_low_lim, hori_acc);
+    size_t num_elem = (size_t)num_gc_y_cl * (size_t)num_gc_x_cl
+        * (size_t)num_tri_per_gc_cl;
+    hori_data_cl = new unsigned char[num_elem * header.record_size];
+
+    //-------------------------------------------------------------------------
+
+    auto start_ray = std::chrono::high_resolution_clock::now();
+    size_t num_rays = 0;
+
+    num_rays += tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_gc_y_cl), 0.0,
+        [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
+
+    size_t num_rays_beg = num_rays;
+    size_t num_culled = 0;
+
+    // Scratch buffer (reused for all grid cells of task)
+    ScratchArena &arena = scratch_arena();
+    arena.begin(scratch_size<double>(hori_azim_num));
+    double* horizon = arena.alloc<double>(hori_azim_num);
+
+    // Loop through 2D-field of grid cells
+    for (size_t i=r.begin(); i<r.end(); ++i) {  // parallel
+        for (size_t j = 0; j < (size_t)num_gc_x_cl; j++) {
+
+            size_t lin_ind_gc = lin_ind_2d(num_gc_x_cl, i, j);
+            if (mask_cl[lin_ind_gc] != 1) {
+                continue;
+            }
+            size_t num_rays_cell = num_rays;
+
+            size_t ind_tri = lin_ind_gc * num_tri_per_gc_cl;
+            for (size_t k = (i * pixel_per_gc_cl);
+                k < ((i * pixel_per_gc_cl) + pixel_per_gc_cl); k++) {
+                for (size_t m = (j * pixel_per_gc_cl);
+                    m < ((j * pixel_per_gc_cl) + pixel_per_gc_cl); m++) {
+                    for (size_t n = 0; n < 2; n++) {
+
+                        // Tilted and horizontal triangle
+                        TriangleGeom geom;
+                        triangle_geom(i, j, k, m, n, geom);
+
+                        // Compute horizon in local ENU coordinate system
+                        double rot[3][3];
+                        rot_mat_local(geom.norm_hori_x, geom.norm_hori_y,
+                            geom.norm_hori_z, rot);
+                        double rot_inv[3][3] = {
+                            {rot[0][0], rot[1][0], rot[2][0]},
+                            {rot[0][1], rot[1][1], rot[2][1]},
+                            {rot[0][2], rot[1][2], rot[2][2]}};
+                        horizon_detect<ALG>(
+                            (float)geom.ray_org_x, (float)geom.ray_org_y,
+                            (float)geom.ray_org_z,
+                            hori_azim_num, hori_acc,
+                            0.0f, (float)dist_search_cl,
+                            elev_ang_low_lim, elev_ang_up_lim, elev_num,
+                            scene, num_rays, &horizon[0],
+                            azim_sin, azim_cos, elev_ang,
+                            elev_cos, elev_sin, rot_inv);
+
+                        // Store quantised sine of horizon and its
+                        // minimum/maximum
+                        horizon_record_quant(horizon, header,
+                            &hori_data_cl[ind_tri * header.record_size]);
+                        ind_tri += 1;
+
+                    }
+                }
+            }
+            stats_cell(lin_ind_gc, num_rays - num_rays_cell);
+
+        }
+    }
+
+    stats_thread(num_rays - num_rays_beg, num_culled);
+    return num_rays;  // parallel
+    }, std::plus<size_t>());  // parallel
+
+    hori_azim_num_cl = hori_azim_num;
+    hori_acc_cl = header.acc;
+    hori_quant_cl = header.quant;
+    hori_scale_cl = header.scale;
+    hori_offset_cl = header.offset;
+    hori_record_size_cl = header.record_size;
+    hori_cache_cl = 1;
+
+    auto end_ray = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time_ray = (end_ray - start_ray);
+    kout << "Ray tracing time: " << time_ray.count() << " s" << endl;
+    kout << "Number of rays shot: " << num_rays << endl;
+    kout << "Size of horizon cache: " << std::fixed << std::setprecision(3)
+        << (double)(num_elem * header.record_size) / pow(10.0, 9)
+        << " GB" << std::defaultfloat << std::setprecision(6) << endl;
+    kernel_stats.time_ray += time_ray.count();
+    kernel_stats.time_total += time_ray.count();
+    kernel_stats.num_rays += num_rays;
+
+    delete[] azim_sin;
+    delete[] azim_cos;
+    delete[] elev_ang;
+    delete[] elev_sin;
+    delete[] elev_cos;
+
+    kout << "--------------------------------------------------------" << endl;
+
+}
+
+void CppTerrain::build_horizon_cache(int hori_azim_num, double hori_acc,
+    char* ray_algorithm, double elev_ang_low_lim, int hori_quant) {
+
+    // Single dispatch to kernel specialised for horizon detection algorithm
+    dispatch_hori_alg(hori_alg_index(ray_algorithm), [&](auto alg) {
+        build_horizon_cache_spec<decltype(alg)::value>(hori_azim_num, hori_acc,
+            elev_ang_low_lim, hori_quant);
+    });
+
+}
+
+//#############################################################################
+// Save / load horizon cache (horizon file)
+//#############################################################################
+
+bool CppTerrain::save_horizon_cache(char* hori_file) {
+
+    KernelScope scope;
+
+    if (hori_cache_cl != 1) {
+        cerr << "Error: horizon cache is not built" << endl;
+        return false;
+    }
+
+    HorizonFileHeader header;
+    horizon_header_init(header, num_gc_y_cl, num_gc_x_cl, num_tri_per_gc_cl,
+        hori_azim_num_cl, hori_quant_cl, 0.0, hori_acc_cl);
+    header.scale = hori_scale_cl;
+    header.offset = hori_offset_cl;
+    int fd = horizon_file_create(hori_file, header, mask_cl);
+    if (fd == -1) {
+        return false;
+    }
+    bool success = true;
+    for (size_t i = 0; i < (size_t)(num_gc_y_cl * num_gc_x_cl); i++) {
+        if (mask_cl[i] == 1) {
+            success = success && horizon_file_write_chunk(fd, header, i,
+                &hori_data_cl[i * header.chunk_size]);
+        }
+    }
+    horizon_file_close(fd);
+    if (!success) {
+        cerr << "Error: writing horizon file failed" << endl;
+    }
+    return success;
+
+}
+
+bool CppTerrain::load_horizon_cache(char* hori_file) {
+
+    KernelScope scope;
 
-    */
-    ind_tri_0 = (ind_0 * dim_1 + ind_1) * 3;
-    ind_tri_1 = (ind_0 * dim_1 + ind_1 + 1) * 3;
-    ind_tri_2 = ((ind_0 + 1) * dim_1 + ind_1) * 3;
-}
+    free_horizon_cache();
+    HorizonFileHeader header;
+    size_t map_size;
+    unsigned char* map = horizon_file_map(hori_file, header, map_size);
+    if (map == NULL) {
+        return false;
+    }
 
-// Vertices of upper right triangle (within pixel)
-inline void triangle_vert_ur(size_t dim_1, size_t ind_0, size_t ind_1,
-    size_t &ind_tri_0, size_t &ind_tri_1, size_t &ind_tri_2) {
-    /* Parameters
-       ----------
+    // Check consistency with terrain (horizon of required grid cells
+    // available)
+    bool consistent = (header.num_gc_y == num_gc_y_cl)
+        && (header.num_gc_x == num_gc_x_cl)
+        && (header.num_tri_per_gc == num_tri_per_gc_cl);
+    for (size_t i = 0; (i < (size_t)(num_gc_y_cl * num_gc_x_cl)) && consistent;
+        i++) {
+        if ((mask_cl[i] == 1) && (map[header.offset_mask + i] != 1)) {
+            consistent = false;
+        }
+    }
+    if (!consistent) {
+        cerr << "Error: horizon file is inconsistent with terrain" << endl;
+        horizon_file_unmap(map, map_size);
+        return false;
+    }
 
-    */
-    ind_tri_0 = (ind_0 * dim_1 + ind_1 + 1) * 3;
-    ind_tri_1 = ((ind_0 + 1) * dim_1 + ind_1 + 1) * 3;
-    ind_tri_2 = ((ind_0 + 1) * dim_1 + ind_1) * 3;
+    // Use mapped data directly (zero-copy)
+    hori_map_cl = map;
+    hori_map_size_cl = map_size;
+    hori_data_cl = map + header.offset_data;
+    hori_azim_num_cl = header.hori_azim_num;
+    hori_acc_cl = header.acc;
+    hori_quant_cl = header.quant;
+    hori_scale_cl = header.scale;
+    hori_offset_cl = header.offset;
+    hori_record_size_cl = header.record_size;
+    hori_cache_cl = 1;
+    kout << "Horizon cache loaded from " << hori_file << endl;
+    return true;
 
 }
 
-// Store above two functions in array
-void (*func_ptr[2])(size_t dim_1, size_t ind_0, size_t ind_1,
-    size_t &ind_tri_0, size_t &ind_tri_1, size_t &ind_tri_2)
-    = {triangle_vert_ll, triangle_vert_ur};
-
-// ----------------------------------------------------------------------------
-// Atmospheric refraction
-// ----------------------------------------------------------------------------
+//#############################################################################
+// Sine of horizon in direction of sun (from horizon cache)
+//#############################################################################
 
-// Estimate atmospheric refraction
-inline double atmos_refrac(double elev_ang_true, double temp,
-    double pressure) {
+double CppTerrain::horizon_sin_interp(unsigned char* record,
+    TriangleGeom &geom, double sun_x, double sun_y, double sun_z) {
     /* Parameters
        ----------
-       elev_ang_true: true solar elevation angle [degree]
-       temp: temperature [degree Celsius]
-       pressure: atmospheric pressure [kPa]
+       record: horizon record of triangle (see 'horizon_file.h')
+       geom: geometry of tilted and horizontal triangle
+       sun_x: x-component of sun unit vector [-]
+       sun_y: y-component of sun unit vector [-]
+       sun_z: z-component of sun unit vector [-]
 
        Returns
        ----------
-       refrac_cor: refraction correction [degree]
+       horizon_sin_sun: sine of horizon (linearly interpolated in azimuth
+                        direction of sun) [-]
+    */
+
+    double azim_spac = (2.0 * M_PI) / (double)hori_azim_num_cl;
+    double rot[3][3];
+    rot_mat_local(geom.norm_hori_x, geom.norm_hori_y, geom.norm_hori_z, rot);
+    double sun_loc_x = rot[0][0] * sun_x + rot[0][1] * sun_y
+        + rot[0][2] * sun_z;
+    double sun_loc_y = rot[1][0] * sun_x + rot[1][1] * sun_y
+        + rot[1][2] * sun_z;
+    double sun_azim = atan2(sun_loc_x, sun_loc_y);
+    if (sun_azim < 0.0) {
+        sun_azim += (2.0 * M_PI);
+    }
+    // range: [0.0 <= 'sun_azim < 2.0 * pi]
+    int ind_0 = std::min(int(sun_azim / azim_spac), hori_azim_num_cl - 1);
+    int ind_1 = (ind_0 + 1) % hori_azim_num_cl;  // periodic horizon
+    double weight = (sun_azim - (ind_0 * azim_spac)) / azim_spac;
+    return horizon_record_value(record, ind_0 + 2, hori_quant_cl,
+        hori_scale_cl, hori_offset_cl) * (1.0 - weight)
+        + horizon_record_value(record, ind_1 + 2, hori_quant_cl,
+        hori_scale_cl, hori_offset_cl) * weight;
 
-       Reference
-       ----------
-       - Saemundsson, P. (1986). "Astronomical Refraction". Sky and Telescope.
-         72: 70
-       - Meeus, J. (1998): Astronomical Algorithm - Second edition, p. 106*/
-    double lower = -1.0;
-    double upper = 90.0;
-    elev_ang_true = std::max(lower, std::min(elev_ang_true, upper));
-    double refrac_cor = (1.02 / tan(deg2rad(elev_ang_true + 10.3
-        / (elev_ang_true + 5.11))));
-    refrac_cor += 0.0019279;  // set R = 0.0 for h = 90.0 degree
-    refrac_cor *= (pressure / 101.0) * (283.0 / (273.0 + temp));
-    return refrac_cor * (1.0 / 60.0);
 }
 
 //#############################################################################
-// Miscellaneous
+// Compute correction factors from horizon cache (no ray tracing)
 //#############################################################################
 
-// Namespace
-#if defined(RTC_NAMESPACE_USE)
-    RTC_NAMESPACE_USE
-#endif
+template <int REFRAC>
+void CppTerrain::sw_dir_cor_horizon_spec(double* sun_pos, float* sw_dir_cor) {
 
-// Error function
-void errorFunction(void* userPtr, enum RTCError error, const char* str) {
-    printf("error %d: %s\n", error, str);
-}
+    KernelScope scope(num_gc_y_cl, num_gc_x_cl);
 
-// Initialisation of device and registration of error handler
-RTCDevice initializeDevice() {
-    RTCDevice device = rtcNewDevice(NULL);
-    if (!device) {
-        printf("error %d: cannot create device\n", rtcGetDeviceError(NULL));
+    if (hori_cache_cl != 1) {
+        cerr << "Error: horizon cache is not built" << endl;
+        return;
     }
-    rtcSetDeviceErrorFunction(device, errorFunction, NULL);
-    return device;
-}
 
-//#############################################################################
-// Create scene from geometries
-//#############################################################################
+    auto start_comp = std::chrono::high_resolution_clock::now();
+    size_t num_interp = 0;
 
-// Structures for triangle and quad
-struct Triangle { int v0, v1, v2; };
-struct Quad { int v0, v1, v2, v3; };
-// -> above structures must contain 32-bit integers (-> Embree documentation).
-//    Theoretically, these integers should be unsigned but the binary
-//    representation until 2'147'483'647 is identical between signed/unsigned
-//    integer.
-
-// Initialise scene
-RTCScene initializeScene(RTCDevice device, float* vert_grid,
-    int dem_dim_0, int dem_dim_1, char* geom_type) {
-
-    RTCScene scene = rtcNewScene(device);
-    rtcSetSceneFlags(scene, RTC_SCENE_FLAG_ROBUST);
-
-    int num_vert = (dem_dim_0 * dem_dim_1);
-    printf("DEM dimensions: (%d, %d) \n", dem_dim_0, dem_dim_1);
-    printf("Number of vertices: %d \n", num_vert);
-
-    RTCGeometryType rtc_geom_type;
-    if (strcmp(geom_type, "triangle") == 0) {
-        rtc_geom_type = RTC_GEOMETRY_TYPE_TRIANGLE;
-    } else if (strcmp(geom_type, "quad") == 0) {
-        rtc_geom_type = RTC_GEOMETRY_TYPE_QUAD;
-    } else {
-        rtc_geom_type = RTC_GEOMETRY_TYPE_GRID;
-    }
+    num_interp += tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_gc_y_cl), 0.0,
+        [&](tbb::blocked_range<size_t> r, size_t num_interp) {  // parallel
 
-    RTCGeometry geom = rtcNewGeometry(device, rtc_geom_type);
-    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0,
-        RTC_FORMAT_FLOAT3, vert_grid, 0, 3*sizeof(float), num_vert);
+    size_t num_culled = 0;
 
-    //-------------------------------------------------------------------------
-    // Triangle
-    //-------------------------------------------------------------------------
-    if (strcmp(geom_type, "triangle") == 0) {
-        cout << "Selected geometry type: triangle" << endl;
-        int num_tri = ((dem_dim_0 - 1) * (dem_dim_1 - 1)) * 2;
-        printf("Number of triangles: %d \n", num_tri);
-        Triangle* triangles = (Triangle*) rtcSetNewGeometryBuffer(geom,
-            RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, sizeof(Triangle),
-            num_tri);
-        int n = 0;
-        for (int i = 0; i < (dem_dim_0 - 1); i++) {
-            for (int j = 0; j < (dem_dim_1 - 1); j++) {
-                triangles[n].v0 = (i * dem_dim_1) + j;
-                triangles[n].v1 = (i * dem_dim_1) + j + 1;
-                triangles[n].v2 = ((i + 1) * dem_dim_1) + j;
-                n++;
-                triangles[n].v0 = (i * dem_dim_1) + j + 1;
-                triangles[n].v1 = ((i + 1) * dem_dim_1) + j + 1;
-                triangles[n].v2 = ((i + 1) * dem_dim_1) + j;
-                n++;
+    // Loop through 2D-field of grid cells
+    for (size_t i=r.begin(); i<r.end(); ++i) {  // parallel
+        for (size_t j = 0; j < (size_t)num_gc_x_cl; j++) {
+
+            size_t lin_ind_gc = lin_ind_2d(num_gc_x_cl, i, j);
+            if (mask_cl[lin_ind_gc] == 1) {
+
+            // Loop through 2D-field of DEM pixels
+            for (size_t k = (i * pixel_per_gc_cl);
+                k < ((i * pixel_per_gc_cl) + pixel_per_gc_cl); k++) {
+                for (size_t m = (j * pixel_per_gc_cl);
+                    m < ((j * pixel_per_gc_cl) + pixel_per_gc_cl); m++) {
+
+                    // Loop through two triangles per pixel
+                    for (size_t n = 0; n < 2; n++) {
+
+                        // Tilted and horizontal triangle
+                        TriangleGeom geom;
+                        triangle_geom(i, j, k, m, n, geom);
+                        size_t ind_tri = lin_ind_gc * num_tri_per_gc_cl
+                            + (((k - i * pixel_per_gc_cl) * pixel_per_gc_cl
+                            + (m - j * pixel_per_gc_cl)) * 2) + n;
+
+                        // Compute sun unit vector
+                        double sun_x = (sun_pos[0] - geom.ray_org_x);
+                        double sun_y = (sun_pos[1] - geom.ray_org_y);
+                        double sun_z = (sun_pos[2] - geom.ray_org_z);
+                        vec_unit(sun_x, sun_y, sun_z);
+
+                        // Consider atmospheric refraction (optional)
+                        double dot_prod_hs = (geom.norm_hori_x * sun_x
+                            + geom.norm_hori_y * sun_y
+                            + geom.norm_hori_z * sun_z);
+                        if (REFRAC != REFRAC_NONE) {
+                            sun_vec_refrac(refrac_table_cl, REFRAC, geom,
+                                sun_x, sun_y, sun_z, dot_prod_hs);
+                        }
+
+                        // Check for self-shadowing (Earth)
+                        if (dot_prod_hs <= dot_prod_min_cl) {
+                            num_culled += 1;
+                            continue;  // sw_dir_cor += 0.0
+                        }
+
+                        // Check for self-shadowing (triangle)
+                        double dot_prod_ts = geom.norm_tilt_x * sun_x
+                            + geom.norm_tilt_y * sun_y
+                            + geom.norm_tilt_z * sun_z;
+                        if (dot_prod_ts <= 0.0) {
+                            num_culled += 1;
+                            continue;  // sw_dir_cor += 0.0
+                        }
+
+                        // Compare sun position to location's overall
+                        // minimal/maximal horizon -> separate cases that
+                        // require less expensive operations ('dot_prod_hs'
+                        // is the sine of the sun elevation angle in the
+                        // local ENU coordinate system)
+                        unsigned char* record = &hori_data_cl[ind_tri
+                            * hori_record_size_cl];
+                        if (dot_prod_hs <= horizon_record_value(record, 0,
+                            hori_quant_cl, hori_scale_cl, hori_offset_cl)) {
+                            continue;  // shadow (sw_dir_cor += 0.0)
+                        } else if (dot_prod_hs <= horizon_record_value(record,
+                            1, hori_quant_cl, hori_scale_cl,
+                            hori_offset_cl)) {
+                            double horizon_sin_sun = horizon_sin_interp(
+                                record, geom, sun_x, sun_y, sun_z);
+                            num_interp += 1;
+                            if (dot_prod_hs <= horizon_sin_sun) {
+                                continue;  // shadow (sw_dir_cor += 0.0)
+                            }
+                        }
+
+                        // Compute correction factor for illuminated case
+                        sw_dir_cor[lin_ind_gc] = sw_dir_cor[lin_ind_gc]
+                            + (float)(std::min(((dot_prod_ts / dot_prod_hs)
+                            * geom.surf_enl_fac), sw_dir_cor_max_cl));
+
+                    }
+
+                }
             }
-        }
-    //-------------------------------------------------------------------------
-    // Quad
-    //-------------------------------------------------------------------------
-    } else if (strcmp(geom_type, "quad") == 0) {
-        cout << "Selected geometry type: quad" << endl;
-        int num_quad = ((dem_dim_0 - 1) * (dem_dim_1 - 1));
-        printf("Number of quads: %d \n", num_quad);
-        Quad* quads = (Quad*) rtcSetNewGeometryBuffer(geom,
-            RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT4, sizeof(Quad),
-            num_quad);
-        int n = 0;
-        for (int i = 0; i < (dem_dim_0 - 1); i++) {
-            for (int j = 0; j < (dem_dim_1 - 1); j++) {
-                //  identical to grid scene (-> otherwise reverse v0, v1, ...)
-                quads[n].v0 = (i * dem_dim_1) + j;
-                quads[n].v1 = (i * dem_dim_1) + j + 1;
-                quads[n].v2 = ((i + 1) * dem_dim_1) + j + 1;
-                quads[n].v3 = ((i + 1) * dem_dim_1) + j;
-                n++;
+
+            } else {
+
+                sw_dir_cor[lin_ind_gc] = NAN;
+
             }
+
         }
-    //-------------------------------------------------------------------------
-    // Grid
-    //-------------------------------------------------------------------------
-    } else {
-        cout << "Selected geometry type: grid" << endl;
-        RTCGrid* grid = (RTCGrid*)rtcSetNewGeometryBuffer(geom,
-            RTC_BUFFER_TYPE_GRID, 0, RTC_FORMAT_GRID, sizeof(RTCGrid), 1);
-        grid[0].startVertexID = 0;
-        grid[0].stride        = dem_dim_1;
-        grid[0].width         = dem_dim_1;
-        grid[0].height        = dem_dim_0;
     }
-    //-------------------------------------------------------------------------
 
-    auto start = std::chrono::high_resolution_clock::now();
-
-    // Commit geometry
-    rtcCommitGeometry(geom);
+    stats_thread(0, num_culled);
+    return num_interp;  // parallel
+    }, std::plus<size_t>());  // parallel
 
-    rtcAttachGeometry(scene, geom);
-    rtcReleaseGeometry(geom);
+    auto end_comp = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time_comp = (end_comp - start_comp);
+    kout << "Horizon lookup time: " << time_comp.count() << " s" << endl;
+    kout << "Number of horizon interpolations: " << num_interp << endl;
+    kernel_stats.time_total += time_comp.count();
 
-    //-------------------------------------------------------------------------
+    // Divide accumulated values by number of triangles within grid cell
+    float num_tri_per_gc = pixel_per_gc_cl * pixel_per_gc_cl * 2.0;
+    size_t num_elem = (num_gc_y_cl * num_gc_x_cl);
+    for (size_t i = 0; i < num_elem; i++) {
+        sw_dir_cor[i] /= num_tri_per_gc;
+    }
 
-    // Commit scene
-    rtcCommitScene(scene);
+}
 
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> time = end - start;
-    cout << "BVH build time: " << time.count() << " s" << endl;
+void CppTerrain::sw_dir_cor_horizon(double* sun_pos, float* sw_dir_cor,
+    int refrac_cor) {
 
-    return scene;
+    // Single dispatch to kernel specialised for refraction correction
+    dispatch_refrac(refrac_cor, [&](auto refrac) {
+        sw_dir_cor_horizon_spec<decltype(refrac)::value>(sun_pos, sw_dir_cor);
+    });
 
 }
 
 //#############################################################################
-// Initialise terrain
+// Compute correction factors incrementally (trace only triangles that are
+// not provably lit)
 //#############################################################################
 
-CppTerrain::CppTerrain() {
+void CppTerrain::build_horizon_bound(int hori_azim_num) {
+    /* Parameters
+       ----------
+       hori_azim_num: number of azimuth sectors of horizon bounds [-]
 
-    device = initializeDevice();
+       Notes
+       ----------
+       The upper bound of the horizon per triangle and azimuth sector is
+       derived from a quadtree of the DEM (see 'heightfield_horizon_bound';
+       no rays) and stored as sine of the elevation angle (rounded up to
+       single precision). Sector 'o' covers the azimuth angles [o, o + 1)
+       * 2 * pi / hori_azim_num in the local ENU coordinate system.*/
 
-}
+    auto start_bound = std::chrono::high_resolution_clock::now();
 
-CppTerrain::~CppTerrain() {
+    reset_incremental();
+    size_t num_elem = (size_t)num_gc_y_cl * (size_t)num_gc_x_cl
+        * (size_t)num_tri_per_gc_cl * (size_t)hori_azim_num;
+    hori_bound_cl = new float[num_elem];
+    bound_azim_num_cl = hori_azim_num;
+    Heightfield hf = heightfield_build(vert_grid_cl, dem_dim_0_cl,
+        dem_dim_1_cl);
 
-    // Release resources allocated through Embree
-    rtcReleaseScene(scene);
-    rtcReleaseDevice(device);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_gc_y_cl),
+        [&](tbb::blocked_range<size_t> r) {  // parallel
 
-}
+    double* bound_sin_up = new double[hori_azim_num];
 
-void CppTerrain::initialise(
-    float* vert_grid,
-    int dem_dim_0, int dem_dim_1,
-    float* vert_grid_in,
-    int dem_dim_in_0, int dem_dim_in_1,
-    int pixel_per_gc,
-    int offset_gc,
-	unsigned char* mask,
-    double dist_search,
-    char* geom_type,
-    double sw_dir_cor_max,
-    double ang_max) {
+    // Loop through 2D-field of grid cells
+    for (size_t i=r.begin(); i<r.end(); ++i) {  // parallel
+        for (size_t j = 0; j < (size_t)num_gc_x_cl; j++) {
 
-    vert_grid_cl = vert_grid;
-    dem_dim_0_cl = dem_dim_0;
-    dem_dim_1_cl = dem_dim_1;
-    vert_grid_in_cl = vert_grid_in;
-    dem_dim_in_0_cl = dem_dim_in_0;
-    dem_dim_in_1_cl = dem_dim_in_1;
-    pixel_per_gc_cl = pixel_per_gc;
-    offset_gc_cl = offset_gc;
-    mask_cl = mask;
-    sw_dir_cor_max_cl = sw_dir_cor_max;
-    ang_max_cl = ang_max;
+            size_t lin_ind_gc = lin_ind_2d(num_gc_x_cl, i, j);
+            if (mask_cl[lin_ind_gc] == 0) {
+                continue;
+            }
 
-    // Hard-coded settings
-    ray_org_elev_cl = 0.1;
-    // value to elevate ray origin (-> avoids potential issue with numerical
-    // imprecision / truncation) [m]
+            // Loop through 2D-field of DEM pixels
+            for (size_t k = (i * pixel_per_gc_cl);
+                k < ((i * pixel_per_gc_cl) + pixel_per_gc_cl); k++) {
+                for (size_t m = (j * pixel_per_gc_cl);
+                    m < ((j * pixel_per_gc_cl) + pixel_per_gc_cl); m++) {
 
-    // Number of grid cells
-    num_gc_y_cl = (dem_dim_in_0 - 1) / pixel_per_gc;
-    num_gc_x_cl = (dem_dim_in_1 - 1) / pixel_per_gc;
+                    // Loop through two triangles per pixel
+                    for (size_t n = 0; n < 2; n++) {
 
-    // Number of triangles
-    num_tri_cl = (dem_dim_in_0 - 1) * (dem_dim_in_1 - 1) * 2;
-    cout << "Number of triangles: " << num_tri_cl << endl;
+                        TriangleGeom geom;
+                        triangle_geom(i, j, k, m, n, geom);
+                        size_t ind_tri = lin_ind_gc * num_tri_per_gc_cl
+                            + (((k - i * pixel_per_gc_cl) * pixel_per_gc_cl
+                            + (m - j * pixel_per_gc_cl)) * 2) + n;
+
+                        // Upper bound of horizon in local ENU coordinate
+                        // system (origin as seen by Embree)
+                        double rot[3][3];
+                        rot_mat_local(geom.norm_hori_x, geom.norm_hori_y,
+                            geom.norm_hori_z, rot);
+                        double org[3] = {(double)(float)geom.ray_org_x,
+                            (double)(float)geom.ray_org_y,
+                            (double)(float)geom.ray_org_z};
+                        heightfield_horizon_bound(hf, org, rot[0], rot[1],
+                            rot[2], hori_azim_num, dist_search_cl,
+                            bound_sin_up);
+                        float* bound = &hori_bound_cl[ind_tri
+                            * hori_azim_num];
+                        for (int o = 0; o < hori_azim_num; o++) {
+                            bound[o] = (float)bound_sin_up[o];
+                            if ((double)bound[o] < bound_sin_up[o]) {
+                                bound[o] = nextafterf(bound[o], 2.0f);
+                            }
+                        }
 
-    // Unit conversion(s)
-    dot_prod_min_cl = cos(deg2rad(ang_max));
-    dist_search_cl = dist_search * 1000.0;  // [kilometre] to [metre]
-    cout << "Search distance: " << dist_search_cl << " m" << endl;
+                    }
 
-    cout << "ang_max: " << ang_max << " degree" << endl;
-    cout << "sw_dir_cor_max: " << sw_dir_cor_max  << endl;
+                }
+            }
 
-    auto start_ini = std::chrono::high_resolution_clock::now();
+        }
+    }
 
-    scene = initializeScene(device, vert_grid, dem_dim_0, dem_dim_1,
-        geom_type);
+    delete[] bound_sin_up;
+    });  // parallel
 
-    auto end_ini = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> time = end_ini - start_ini;
-    cout << "Total initialisation time: " << time.count() << " s" << endl;
+    heightfield_release(hf);
+
+    auto end_bound = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> time_bound = (end_bound - start_bound);
+    kout << "Horizon bound time: " << time_bound.count() << " s" << endl;
+    kout << "Size of horizon bounds: " << std::fixed << std::setprecision(3)
+        << (double)(num_elem * sizeof(float)) / pow(10.0, 9.0)
+        << " GB" << std::defaultfloat << std::setprecision(6) << endl;
 
 }
 
-//#############################################################################
-// Compute correction factors
-//#############################################################################
+template <int REFRAC>
+size_t CppTerrain::sw_dir_cor_incremental_spec(double* sun_pos,
+    float* sw_dir_cor) {
+    /* Parameters
+       ----------
+       sun_pos: sun position in ENU coordinates (x, y, z) [metre]
+       sw_dir_cor: shortwave correction factor (y, x) [-]
+       REFRAC: atmospheric refraction correction (REFRAC_NONE,
+               REFRAC_TABLE or REFRAC_EXACT) [-]
+
+       Returns
+       ----------
+       num_rays: number of rays traced
+
+       Notes
+       ----------
+       A triangle is lit without ray tracing if the sun is above the upper
+       bound of the horizon in the azimuth sector of the sun (see
+       'build_horizon_bound'). This bound is guaranteed, i.e. the result is
+       identical to the one of 'sw_dir_cor'. All other triangles are ray
+       traced; there is no guaranteed lower bound of the horizon
+       (terrain narrower than an azimuth sector may be lower than the
+       horizon of the enclosing azimuth directions) -> shadowed triangles
+       are always re-traced.*/
+
+    KernelScope scope(num_gc_y_cl, num_gc_x_cl);
 
-void CppTerrain::sw_dir_cor(double* sun_pos, float* sw_dir_cor,
-    int refrac_cor) {
- 
     auto start_ray = std::chrono::high_resolution_clock::now();
     size_t num_rays = 0;
 
-	// Parameters for reference atmosphere
-	double temperature_ref = 283.15;  // reference temperature at sea level [K]
-	double pressure_ref = 101.0;  // reference pressure at sea level [kPa]
-	double lapse_rate = 0.0065;  // temperature lapse rate [K m-1]
-	double g = 9.81;  // acceleration due to gravity at sea level [m s-2]
-	double R_d = 287.0;  // gas constant for dry air [J K-1 kg-1]
-	double exp_baro = (g / (R_d * lapse_rate));
-	// exponent for barometric formula
+    // Slack for upper horizon bound (-> round-off errors of ray intersection
+    // in single precision) [-]
+    double bound_slack = 1.0e-5;
+    double azim_spac = (2.0 * M_PI) / (double)bound_azim_num_cl;
 
     num_rays += tbb::parallel_reduce(
         tbb::blocked_range<size_t>(0, num_gc_y_cl), 0.0,
         [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
 
+    size_t num_rays_beg = num_rays;
+    size_t num_culled = 0;
+
     // Loop through 2D-field of grid cells
     //for (size_t i = 0; i < num_gc_y_cl; i++) {  // serial
     for (size_t i=r.begin(); i<r.end(); ++i) {  // parallel
-        for (size_t j = 0; j < num_gc_x_cl; j++) {
+        for (size_t j = 0; j < (size_t)num_gc_x_cl; j++) {
 
             size_t lin_ind_gc = lin_ind_2d(num_gc_x_cl, i, j);
             if (mask_cl[lin_ind_gc] == 1) {
 
+            size_t num_rays_cell = num_rays;
+
             // Loop through 2D-field of DEM pixels
             for (size_t k = (i * pixel_per_gc_cl);
                 k < ((i * pixel_per_gc_cl) + pixel_per_gc_cl); k++) {
@@ -539,172 +1467,103 @@ void CppTerrain::sw_dir_cor(double* sun_pos, float* sw_dir_cor,
                     // Loop through two triangles per pixel
                     for (size_t n = 0; n < 2; n++) {
 
-                        //-----------------------------------------------------
-                        // Tilted triangle
-                        //-----------------------------------------------------
-
-                        size_t ind_tri_0, ind_tri_1, ind_tri_2;
-                        func_ptr[n](dem_dim_1_cl,
-                            k + (pixel_per_gc_cl * offset_gc_cl),
-                            m + (pixel_per_gc_cl * offset_gc_cl),
-                            ind_tri_0, ind_tri_1, ind_tri_2);
-
-                        double vert_0_x = (double)vert_grid_cl[ind_tri_0];
-                        double vert_0_y = (double)vert_grid_cl[ind_tri_0 + 1];
-                        double vert_0_z = (double)vert_grid_cl[ind_tri_0 + 2];
-                        double vert_1_x = (double)vert_grid_cl[ind_tri_1];
-                        double vert_1_y = (double)vert_grid_cl[ind_tri_1 + 1];
-                        double vert_1_z = (double)vert_grid_cl[ind_tri_1 + 2];
-                        double vert_2_x = (double)vert_grid_cl[ind_tri_2];
-                        double vert_2_y = (double)vert_grid_cl[ind_tri_2 + 1];
-                        double vert_2_z = (double)vert_grid_cl[ind_tri_2 + 2];
-
-                        double cent_x, cent_y, cent_z;
-                        triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            cent_x, cent_y, cent_z);
-
-                        double norm_tilt_x, norm_tilt_y, norm_tilt_z,
-                            area_tilt;
-                        triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            norm_tilt_x, norm_tilt_y, norm_tilt_z,
-                            area_tilt);
-
-                        // Ray origin
-                        double ray_org_x = (cent_x
-                            + norm_tilt_x * ray_org_elev_cl);
-                        double ray_org_y = (cent_y
-                            + norm_tilt_y * ray_org_elev_cl);
-                        double ray_org_z = (cent_z
-                            + norm_tilt_z * ray_org_elev_cl);
-
-                        //-----------------------------------------------------
-                        // Horizontal triangle
-                        //-----------------------------------------------------
-
-                        func_ptr[n](dem_dim_in_1_cl, k, m,
-                            ind_tri_0, ind_tri_1, ind_tri_2);
-
-                        vert_0_x = (double)vert_grid_in_cl[ind_tri_0];
-                        vert_0_y = (double)vert_grid_in_cl[ind_tri_0 + 1];
-                        vert_0_z = (double)vert_grid_in_cl[ind_tri_0 + 2];
-                        vert_1_x = (double)vert_grid_in_cl[ind_tri_1];
-                        vert_1_y = (double)vert_grid_in_cl[ind_tri_1 + 1];
-                        vert_1_z = (double)vert_grid_in_cl[ind_tri_1 + 2];
-                        vert_2_x = (double)vert_grid_in_cl[ind_tri_2];
-                        vert_2_y = (double)vert_grid_in_cl[ind_tri_2 + 1];
-                        vert_2_z = (double)vert_grid_in_cl[ind_tri_2 + 2];
-
-                        double norm_hori_x, norm_hori_y, norm_hori_z,
-                            area_hori;
-                        triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            norm_hori_x, norm_hori_y, norm_hori_z,
-                            area_hori);
-
-                        double surf_enl_fac = area_tilt / area_hori;
-
-                        //-----------------------------------------------------
-                        // Compute correction factor
-                        //-----------------------------------------------------
+                        // Tilted and horizontal triangle
+                        TriangleGeom geom;
+                        triangle_geom(i, j, k, m, n, geom);
+                        size_t ind_tri = lin_ind_gc * num_tri_per_gc_cl
+                            + (((k - i * pixel_per_gc_cl) * pixel_per_gc_cl
+                            + (m - j * pixel_per_gc_cl)) * 2) + n;
 
                         // Compute sun unit vector
-                        double sun_x = (sun_pos[0] - ray_org_x);
-                        double sun_y = (sun_pos[1] - ray_org_y);
-                        double sun_z = (sun_pos[2] - ray_org_z);
+                        double sun_x = (sun_pos[0] - geom.ray_org_x);
+                        double sun_y = (sun_pos[1] - geom.ray_org_y);
+                        double sun_z = (sun_pos[2] - geom.ray_org_z);
                         vec_unit(sun_x, sun_y, sun_z);
 
                         // Consider atmospheric refraction (optional)
-                        double dot_prod_hs = (norm_hori_x * sun_x
-                            + norm_hori_y * sun_y
-                            + norm_hori_z * sun_z);
-                        if (refrac_cor == 1) {
-
-                            // Compute elevation (distance between centroid
-                            // of DEM triangle and 'base triangle')
-                            double cent_base_x, cent_base_y, cent_base_z;
-                            triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
-                                vert_1_x, vert_1_y, vert_1_z,
-                                vert_2_x, vert_2_y, vert_2_z,
-                                cent_base_x, cent_base_y, cent_base_z);
-                            double elevation
-                                = sqrt(pow(cent_x - cent_base_x, 2)
-                                + pow(cent_y - cent_base_y, 2)
-                                + pow(cent_z - cent_base_z, 2));
-
-                            // Update sun position
-                            double elev_ang_true = 90.0
-                                - rad2deg(acos(dot_prod_hs));
-                            double temperature = temperature_ref
-                                - (lapse_rate * elevation);
-                            double pressure = pressure_ref
-                                * pow((temperature / temperature_ref),
-                                exp_baro);
-                            double refrac_cor = atmos_refrac(elev_ang_true,
-                                K2degC(temperature), pressure);
-                            double k_x, k_y, k_z;
-                            cross_prod(sun_x, sun_y, sun_z,
-                                norm_hori_x, norm_hori_y, norm_hori_z,
-                                k_x, k_y, k_z);
-                            vec_unit(k_x, k_y, k_z);
-                            vec_rot(k_x, k_y, k_z, deg2rad(refrac_cor),
-                                sun_x, sun_y, sun_z);
-                            dot_prod_hs = (norm_hori_x * sun_x
-                                + norm_hori_y * sun_y   + norm_hori_z * sun_z);
-
+                        double dot_prod_hs = (geom.norm_hori_x * sun_x
+                            + geom.norm_hori_y * sun_y
+                            + geom.norm_hori_z * sun_z);
+                        if (REFRAC != REFRAC_NONE) {
+                            sun_vec_refrac(refrac_table_cl, REFRAC, geom,
+                                sun_x, sun_y, sun_z, dot_prod_hs);
                         }
 
                         // Check for self-shadowing (Earth)
                         if (dot_prod_hs <= dot_prod_min_cl) {
-                            continue;   // sw_dir_cor += 0.0
+                            num_culled += 1;
+                            continue;  // sw_dir_cor += 0.0
                         }
 
                         // Check for self-shadowing (triangle)
-                        double dot_prod_ts = norm_tilt_x * sun_x
-                            + norm_tilt_y * sun_y
-                            + norm_tilt_z * sun_z;
+                        double dot_prod_ts = geom.norm_tilt_x * sun_x
+                            + geom.norm_tilt_y * sun_y
+                            + geom.norm_tilt_z * sun_z;
                         if (dot_prod_ts <= 0.0) {
+                            num_culled += 1;
                             continue;  // sw_dir_cor += 0.0
                         }
 
-                        // Intersect context
-                        struct RTCIntersectContext context;
-                        rtcInitIntersectContext(&context);
+                        // Upper horizon bound of azimuth sector of sun
+                        // ('dot_prod_hs': sine of sun elevation angle in
+                        // local ENU coordinate system)
+                        double rot[3][3];
+                        rot_mat_local(geom.norm_hori_x, geom.norm_hori_y,
+                            geom.norm_hori_z, rot);
+                        double sun_azim = atan2(rot[0][0] * sun_x
+                            + rot[0][1] * sun_y + rot[0][2] * sun_z,
+                            rot[1][0] * sun_x + rot[1][1] * sun_y
+                            + rot[1][2] * sun_z);
+                        if (sun_azim < 0.0) {
+                            sun_azim += (2.0 * M_PI);
+                        }
+                        int ind_sec = std::min(int(sun_azim / azim_spac),
+                            bound_azim_num_cl - 1);
+                        double bound_sin_up = (double)hori_bound_cl[ind_tri
+                            * bound_azim_num_cl + ind_sec];
+
+                        bool lit;
+                        if (dot_prod_hs > (bound_sin_up + bound_slack)) {
+                            lit = true;  // above upper horizon bound
+                        } else {
+
+                            // Intersect context
+                            struct RTCIntersectContext context;
+                            rtcInitIntersectContext(&context);
+
+                            // Ray structure
+                            struct RTCRay ray;
+                            ray.org_x = (float)geom.ray_org_x;
+                            ray.org_y = (float)geom.ray_org_y;
+                            ray.org_z = (float)geom.ray_org_z;
+                            ray.dir_x = (float)sun_x;
+                            ray.dir_y = (float)sun_y;
+                            ray.dir_z = (float)sun_z;
+                            ray.tnear = 0.0;
+                            ray.tfar = (float)dist_search_cl;
+
+                            // Intersect ray with scene
+                            rtcOccluded1(scene, &context, &ray);
+                            lit = (ray.tfar > 0.0);
+                            num_rays += 1;
 
-                        // Ray structure
-                        struct RTCRay ray;
-                        ray.org_x = (float)ray_org_x;
-                        ray.org_y = (float)ray_org_y;
-                        ray.org_z = (float)ray_org_z;
-                        ray.dir_x = (float)sun_x;
-                        ray.dir_y = (float)sun_y;
-                        ray.dir_z = (float)sun_z;
-                        ray.tnear = 0.0;
-                        ray.tfar = (float)dist_search_cl;
-                        // std::numeric_limits<float>::infinity();
+                        }
 
-                        // Intersect ray with scene
-                        rtcOccluded1(scene, &context, &ray);
-                        if (ray.tfar > 0.0) {
-                            // no intersection -> 'tfar' is not updated;
-                            // otherwise 'tfar' = -inf
+                        if (lit) {
                             sw_dir_cor[lin_ind_gc] =
                                 sw_dir_cor[lin_ind_gc]
                                 + (float)(std::min(((dot_prod_ts
                                 / dot_prod_hs)
-                                * surf_enl_fac), sw_dir_cor_max_cl));
+                                * geom.surf_enl_fac), sw_dir_cor_max_cl));
                         }  // else: sw_dir_cor += 0.0
-                        num_rays += 1;
 
                     }
 
                 }
             }
 
+            stats_cell(lin_ind_gc, num_rays - num_rays_cell);
+
             } else {
 
                 sw_dir_cor[lin_ind_gc] = NAN;
@@ -714,15 +1573,19 @@ void CppTerrain::sw_dir_cor(double* sun_pos, float* sw_dir_cor,
         }
     }
 
+    stats_thread(num_rays - num_rays_beg, num_culled);
     return num_rays;  // parallel
     }, std::plus<size_t>());  // parallel
 
     auto end_ray = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> time_ray = (end_ray - start_ray);
-    cout << "Ray tracing time: " << time_ray.count() << " s" << endl;
-    cout << "Number of rays shot: " << num_rays << endl;
+    kout << "Ray tracing time: " << time_ray.count() << " s" << endl;
+    kout << "Number of rays shot: " << num_rays << endl;
     double frac_ray = (double)num_rays / (double)num_tri_cl;
-    cout << "Fraction of rays required: " << frac_ray << endl;
+    kout << "Fraction of rays required: " << frac_ray << endl;
+    kernel_stats.time_ray += time_ray.count();
+    kernel_stats.time_total += time_ray.count();
+    kernel_stats.num_rays += num_rays;
 
     // Divide accumulated values by number of triangles within grid cell
     float num_tri_per_gc = pixel_per_gc_cl * pixel_per_gc_cl * 2.0;
@@ -731,13 +1594,34 @@ void CppTerrain::sw_dir_cor(double* sun_pos, float* sw_dir_cor,
         sw_dir_cor[i] /= num_tri_per_gc;
     }
 
+    return num_rays;
+
+}
+
+size_t CppTerrain::sw_dir_cor_incremental(double* sun_pos, float* sw_dir_cor,
+    int refrac_cor, int hori_azim_num) {
+
+    // Horizon bounds (first call or changed number of azimuth sectors)
+    if ((hori_bound_cl == NULL) || (bound_azim_num_cl != hori_azim_num)) {
+        build_horizon_bound(hori_azim_num);
+    }
+
+    // Single dispatch to kernel specialised for refraction correction
+    return dispatch_refrac(refrac_cor, [&](auto refrac) {
+        return sw_dir_cor_incremental_spec<decltype(refrac)::value>(sun_pos,
+            sw_dir_cor);
+    });
+
 }
 
 //#############################################################################
 // Compute correction factors with coherent rays
 //#############################################################################
 
-void CppTerrain::sw_dir_cor_coherent(double* sun_pos, float* sw_dir_cor) {
+template <int REFRAC>
+void CppTerrain::sw_dir_cor_coherent_spec(double* sun_pos, float* sw_dir_cor) {
+
+    KernelScope scope(num_gc_y_cl, num_gc_x_cl);
 
     auto start_ray = std::chrono::high_resolution_clock::now();
     size_t num_rays = 0;
@@ -749,16 +1633,26 @@ void CppTerrain::sw_dir_cor_coherent(double* sun_pos, float* sw_dir_cor) {
         tbb::blocked_range<size_t>(0, num_gc_y_cl), 0.0,
         [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
 
+    size_t num_rays_beg = num_rays;
+    size_t num_culled = 0;
+
+    // Scratch buffers (rays of grid cell; reused for all grid cells of task)
+    ScratchArena &arena = scratch_arena();
+    arena.begin(scratch_size<RTCRay>(num_tri_per_gc)
+        + scratch_size<float>(num_tri_per_gc));
+    RTCRay* rays = arena.alloc<RTCRay>(num_tri_per_gc);
+    float* sw_dir_cor_ray = arena.alloc<float>(num_tri_per_gc);
+
     // Loop through 2D-field of grid cells
     //for (size_t i = 0; i < num_gc_y_cl; i++) {  // serial
     for (size_t i=r.begin(); i<r.end(); ++i) {  // parallel
-        for (size_t j = 0; j < num_gc_x_cl; j++) {
+        for (size_t j = 0; j < (size_t)num_gc_x_cl; j++) {
 
             size_t lin_ind_gc = lin_ind_2d(num_gc_x_cl, i, j);
             if (mask_cl[lin_ind_gc] == 1) {
 
-            RTCRay rays[num_tri_per_gc];
-            float* sw_dir_cor_ray = new float[num_tri_per_gc];
+            size_t num_rays_cell = num_rays;
+
             unsigned int num_rays_gc = 0;
 
             // Loop through pixels within grid cell
@@ -770,103 +1664,48 @@ void CppTerrain::sw_dir_cor_coherent(double* sun_pos, float* sw_dir_cor) {
                     // Loop through two triangles per pixel
                     for (size_t n = 0; n < 2; n++) {
 
-                        //-----------------------------------------------------
-                        // Tilted triangle
-                        //-----------------------------------------------------
-
-                        size_t ind_tri_0, ind_tri_1, ind_tri_2;
-                        func_ptr[n](dem_dim_1_cl,
-                            k + (pixel_per_gc_cl * offset_gc_cl),
-                            m + (pixel_per_gc_cl * offset_gc_cl),
-                            ind_tri_0, ind_tri_1, ind_tri_2);
-
-                        double vert_0_x = (double)vert_grid_cl[ind_tri_0];
-                        double vert_0_y = (double)vert_grid_cl[ind_tri_0 + 1];
-                        double vert_0_z = (double)vert_grid_cl[ind_tri_0 + 2];
-                        double vert_1_x = (double)vert_grid_cl[ind_tri_1];
-                        double vert_1_y = (double)vert_grid_cl[ind_tri_1 + 1];
-                        double vert_1_z = (double)vert_grid_cl[ind_tri_1 + 2];
-                        double vert_2_x = (double)vert_grid_cl[ind_tri_2];
-                        double vert_2_y = (double)vert_grid_cl[ind_tri_2 + 1];
-                        double vert_2_z = (double)vert_grid_cl[ind_tri_2 + 2];
-
-                        double cent_x, cent_y, cent_z;
-                        triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            cent_x, cent_y, cent_z);
-
-                        double norm_tilt_x, norm_tilt_y, norm_tilt_z, area_tilt;
-                        triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            norm_tilt_x, norm_tilt_y, norm_tilt_z,
-                            area_tilt);
-
-                        // Ray origin
-                        double ray_org_x = (cent_x
-                            + norm_tilt_x * ray_org_elev_cl);
-                        double ray_org_y = (cent_y
-                            + norm_tilt_y * ray_org_elev_cl);
-                        double ray_org_z = (cent_z
-                            + norm_tilt_z * ray_org_elev_cl);
-
-                        //-----------------------------------------------------
-                        // Horizontal triangle
-                        //-----------------------------------------------------
-
-                        func_ptr[n](dem_dim_in_1_cl, k, m,
-                            ind_tri_0, ind_tri_1, ind_tri_2);
-
-                        vert_0_x = (double)vert_grid_in_cl[ind_tri_0];
-                        vert_0_y = (double)vert_grid_in_cl[ind_tri_0 + 1];
-                        vert_0_z = (double)vert_grid_in_cl[ind_tri_0 + 2];
-                        vert_1_x = (double)vert_grid_in_cl[ind_tri_1];
-                        vert_1_y = (double)vert_grid_in_cl[ind_tri_1 + 1];
-                        vert_1_z = (double)vert_grid_in_cl[ind_tri_1 + 2];
-                        vert_2_x = (double)vert_grid_in_cl[ind_tri_2];
-                        vert_2_y = (double)vert_grid_in_cl[ind_tri_2 + 1];
-                        vert_2_z = (double)vert_grid_in_cl[ind_tri_2 + 2];
-
-                        double norm_hori_x, norm_hori_y, norm_hori_z, area_hori;
-                        triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            norm_hori_x, norm_hori_y, norm_hori_z,
-                            area_hori);
-
-                        double surf_enl_fac = area_tilt / area_hori;
+                        // Tilted and horizontal triangle
+                        TriangleGeom geom;
+                        triangle_geom(i, j, k, m, n, geom);
 
                         //-----------------------------------------------------
                         // Compute correction factor
                         //-----------------------------------------------------
 
                         // Compute sun unit vector
-                        double sun_x = (sun_pos[0] - ray_org_x);
-                        double sun_y = (sun_pos[1] - ray_org_y);
-                        double sun_z = (sun_pos[2] - ray_org_z);
+                        double sun_x = (sun_pos[0] - geom.ray_org_x);
+                        double sun_y = (sun_pos[1] - geom.ray_org_y);
+                        double sun_z = (sun_pos[2] - geom.ray_org_z);
                         vec_unit(sun_x, sun_y, sun_z);
 
+                        // Consider atmospheric refraction (optional)
+                        double dot_prod_hs = (geom.norm_hori_x * sun_x
+                            + geom.norm_hori_y * sun_y
+                            + geom.norm_hori_z * sun_z);
+                        if (REFRAC != REFRAC_NONE) {
+                            sun_vec_refrac(refrac_table_cl, REFRAC, geom,
+                                sun_x, sun_y, sun_z, dot_prod_hs);
+                        }
+
                         // Check for self-shadowing (Earth)
-                        double dot_prod_hs = (norm_hori_x * sun_x
-                            + norm_hori_y * sun_y
-                            + norm_hori_z * sun_z);
                         if (dot_prod_hs <= dot_prod_min_cl) {
+                            num_culled += 1;
                             continue;  // sw_dir_cor += 0.0
                         }
 
                         // Check for self-shadowing (triangle)
-                        double dot_prod_ts = norm_tilt_x * sun_x
-                            + norm_tilt_y * sun_y
-                            + norm_tilt_z * sun_z;
+                        double dot_prod_ts = geom.norm_tilt_x * sun_x
+                            + geom.norm_tilt_y * sun_y
+                            + geom.norm_tilt_z * sun_z;
                         if (dot_prod_ts <= 0.0) {
+                            num_culled += 1;
                             continue;  // sw_dir_cor += 0.0
                         }
 
                         // Add ray
-                        rays[num_rays_gc].org_x = (float)ray_org_x;
-                        rays[num_rays_gc].org_y = (float)ray_org_y;
-                        rays[num_rays_gc].org_z = (float)ray_org_z;
+                        rays[num_rays_gc].org_x = (float)geom.ray_org_x;
+                        rays[num_rays_gc].org_y = (float)geom.ray_org_y;
+                        rays[num_rays_gc].org_z = (float)geom.ray_org_z;
                         rays[num_rays_gc].dir_x = (float)sun_x;
                         rays[num_rays_gc].dir_y = (float)sun_y;
                         rays[num_rays_gc].dir_z = (float)sun_z;
@@ -877,7 +1716,7 @@ void CppTerrain::sw_dir_cor_coherent(double* sun_pos, float* sw_dir_cor) {
 
                         sw_dir_cor_ray[num_rays_gc] =
                             (float)(std::min(((dot_prod_ts / dot_prod_hs)
-                            * surf_enl_fac), sw_dir_cor_max_cl));
+                            * geom.surf_enl_fac), sw_dir_cor_max_cl));
                         num_rays_gc = num_rays_gc + 1;
 
                     }
@@ -904,11 +1743,11 @@ void CppTerrain::sw_dir_cor_coherent(double* sun_pos, float* sw_dir_cor) {
                 }  // else: sw_dir_cor += 0.0
             }
 
-            delete[] sw_dir_cor_ray;
-
             sw_dir_cor[lin_ind_gc]
                 = sw_dir_cor_agg / (float)num_tri_per_gc;
 
+            stats_cell(lin_ind_gc, num_rays - num_rays_cell);
+
             } else {
 
                 sw_dir_cor[lin_ind_gc] = NAN;
@@ -918,15 +1757,29 @@ void CppTerrain::sw_dir_cor_coherent(double* sun_pos, float* sw_dir_cor) {
         }
     }
 
+    stats_thread(num_rays - num_rays_beg, num_culled);
     return num_rays;  // parallel
     }, std::plus<size_t>());  // parallel
 
     auto end_ray = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> time_ray = (end_ray - start_ray);
-    cout << "Ray tracing time: " << time_ray.count() << " s" << endl;
-    cout << "Number of rays shot: " << num_rays << endl;
+    kout << "Ray tracing time: " << time_ray.count() << " s" << endl;
+    kout << "Number of rays shot: " << num_rays << endl;
     double frac_ray = (double)num_rays / (double)num_tri_cl;
-    cout << "Fraction of rays required: " << frac_ray << endl;
+    kout << "Fraction of rays required: " << frac_ray << endl;
+    kernel_stats.time_ray += time_ray.count();
+    kernel_stats.time_total += time_ray.count();
+    kernel_stats.num_rays += num_rays;
+
+}
+
+void CppTerrain::sw_dir_cor_coherent(double* sun_pos, float* sw_dir_cor,
+    int refrac_cor) {
+
+    // Single dispatch to kernel specialised for refraction correction
+    dispatch_refrac(refrac_cor, [&](auto refrac) {
+        sw_dir_cor_coherent_spec<decltype(refrac)::value>(sun_pos, sw_dir_cor);
+    });
 
 }
 
@@ -934,10 +1787,14 @@ void CppTerrain::sw_dir_cor_coherent(double* sun_pos, float* sw_dir_cor) {
 // Compute correction factors with coherent rays (packages with 8 rays)
 //#############################################################################
 
-void CppTerrain::sw_dir_cor_coherent_rp8(double* sun_pos, float* sw_dir_cor) {
+template <int REFRAC>
+void CppTerrain::sw_dir_cor_coherent_rp8_spec(double* sun_pos,
+    float* sw_dir_cor) {
+
+    KernelScope scope(num_gc_y_cl, num_gc_x_cl);
 
     if (pixel_per_gc_cl % 2) {
-        cout << "Error: method is only implemented for even " <<
+        cerr << "Error: method is only implemented for even " <<
             "'pixel_per_gc' values" << endl;
         return;
     }
@@ -952,16 +1809,26 @@ void CppTerrain::sw_dir_cor_coherent_rp8(double* sun_pos, float* sw_dir_cor) {
         tbb::blocked_range<size_t>(0, num_gc_y_cl), 0.0,
         [&](tbb::blocked_range<size_t> r, size_t num_rays) {  // parallel
 
+    size_t num_rays_beg = num_rays;
+    size_t num_culled = 0;
+
+    // Scratch buffers (ray packet of block of 4 pixels; reused for all grid
+    // cells of task)
+    ScratchArena &arena = scratch_arena();
+    arena.begin(scratch_size<RTCRay8>(1) + scratch_size<float>(8));
+    RTCRay8 &ray8 = *arena.alloc<RTCRay8>(1);
+    float* sw_dir_cor_ray = arena.alloc<float>(8);
+
     // Loop through 2D-field of grid cells
     //for (size_t i = 0; i < num_gc_y_cl; i++) {  // serial
     for (size_t i=r.begin(); i<r.end(); ++i) {  // parallel
-        for (size_t j = 0; j < num_gc_x_cl; j++) {
+        for (size_t j = 0; j < (size_t)num_gc_x_cl; j++) {
 
             size_t lin_ind_gc = lin_ind_2d(num_gc_x_cl, i, j);
             if (mask_cl[lin_ind_gc] == 1) {
 
-            RTCRay8 ray8;
-            float* sw_dir_cor_ray = new float[8];
+            size_t num_rays_cell = num_rays;
+
             float sw_dir_cor_agg = 0.0;
 
             // Loop through pixels within grid cell (-> process by blocks of 4)
@@ -979,105 +1846,48 @@ void CppTerrain::sw_dir_cor_coherent_rp8(double* sun_pos, float* sw_dir_cor) {
                     // Loop through two triangles per pixel
                     for (size_t n = 0; n < 2; n++) {
 
-                        //-----------------------------------------------------
-                        // Tilted triangle
-                        //-----------------------------------------------------
-
-                        size_t ind_tri_0, ind_tri_1, ind_tri_2;
-                        func_ptr[n](dem_dim_1_cl,
-                            k_block + (pixel_per_gc_cl * offset_gc_cl),
-                            m_block + (pixel_per_gc_cl * offset_gc_cl),
-                            ind_tri_0, ind_tri_1, ind_tri_2);
-
-                        double vert_0_x = (double)vert_grid_cl[ind_tri_0];
-                        double vert_0_y = (double)vert_grid_cl[ind_tri_0 + 1];
-                        double vert_0_z = (double)vert_grid_cl[ind_tri_0 + 2];
-                        double vert_1_x = (double)vert_grid_cl[ind_tri_1];
-                        double vert_1_y = (double)vert_grid_cl[ind_tri_1 + 1];
-                        double vert_1_z = (double)vert_grid_cl[ind_tri_1 + 2];
-                        double vert_2_x = (double)vert_grid_cl[ind_tri_2];
-                        double vert_2_y = (double)vert_grid_cl[ind_tri_2 + 1];
-                        double vert_2_z = (double)vert_grid_cl[ind_tri_2 + 2];
-
-                        double cent_x, cent_y, cent_z;
-                        triangle_centroid(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            cent_x, cent_y, cent_z);
-
-                        double norm_tilt_x, norm_tilt_y, norm_tilt_z,
-                            area_tilt;
-                        triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            norm_tilt_x, norm_tilt_y, norm_tilt_z,
-                            area_tilt);
-
-                        // Ray origin
-                        double ray_org_x = (cent_x
-                            + norm_tilt_x * ray_org_elev_cl);
-                        double ray_org_y = (cent_y
-                            + norm_tilt_y * ray_org_elev_cl);
-                        double ray_org_z = (cent_z
-                            + norm_tilt_z * ray_org_elev_cl);
-
-                        //-----------------------------------------------------
-                        // Horizontal triangle
-                        //-----------------------------------------------------
-
-                        func_ptr[n](dem_dim_in_1_cl, k_block, m_block,
-                            ind_tri_0, ind_tri_1, ind_tri_2);
-
-                        vert_0_x = (double)vert_grid_in_cl[ind_tri_0];
-                        vert_0_y = (double)vert_grid_in_cl[ind_tri_0 + 1];
-                        vert_0_z = (double)vert_grid_in_cl[ind_tri_0 + 2];
-                        vert_1_x = (double)vert_grid_in_cl[ind_tri_1];
-                        vert_1_y = (double)vert_grid_in_cl[ind_tri_1 + 1];
-                        vert_1_z = (double)vert_grid_in_cl[ind_tri_1 + 2];
-                        vert_2_x = (double)vert_grid_in_cl[ind_tri_2];
-                        vert_2_y = (double)vert_grid_in_cl[ind_tri_2 + 1];
-                        vert_2_z = (double)vert_grid_in_cl[ind_tri_2 + 2];
-
-                        double norm_hori_x, norm_hori_y, norm_hori_z,
-                            area_hori;
-                        triangle_normal_area(vert_0_x, vert_0_y, vert_0_z,
-                            vert_1_x, vert_1_y, vert_1_z,
-                            vert_2_x, vert_2_y, vert_2_z,
-                            norm_hori_x, norm_hori_y, norm_hori_z,
-                            area_hori);
-
-                        double surf_enl_fac = area_tilt / area_hori;
+                        // Tilted and horizontal triangle
+                        TriangleGeom geom;
+                        triangle_geom(i, j, k_block, m_block, n, geom);
 
                         //-----------------------------------------------------
                         // Compute correction factor
                         //-----------------------------------------------------
 
                         // Compute sun unit vector
-                        double sun_x = (sun_pos[0] - ray_org_x);
-                        double sun_y = (sun_pos[1] - ray_org_y);
-                        double sun_z = (sun_pos[2] - ray_org_z);
+                        double sun_x = (sun_pos[0] - geom.ray_org_x);
+                        double sun_y = (sun_pos[1] - geom.ray_org_y);
+                        double sun_z = (sun_pos[2] - geom.ray_org_z);
                         vec_unit(sun_x, sun_y, sun_z);
 
+                        // Consider atmospheric refraction (optional)
+                        double dot_prod_hs = (geom.norm_hori_x * sun_x
+                            + geom.norm_hori_y * sun_y
+                            + geom.norm_hori_z * sun_z);
+                        if (REFRAC != REFRAC_NONE) {
+                            sun_vec_refrac(refrac_table_cl, REFRAC, geom,
+                                sun_x, sun_y, sun_z, dot_prod_hs);
+                        }
+
                         // Check for self-shadowing (Earth)
-                        double dot_prod_hs = (norm_hori_x * sun_x
-                            + norm_hori_y * sun_y
-                            + norm_hori_z * sun_z);
                         if (dot_prod_hs <= dot_prod_min_cl) {
+                            num_culled += 1;
                             continue;  // sw_dir_cor += 0.0
                         }
 
                         // Check for self-shadowing (triangle)
-                        double dot_prod_ts = norm_tilt_x * sun_x
-                            + norm_tilt_y * sun_y
-                            + norm_tilt_z * sun_z;
+                        double dot_prod_ts = geom.norm_tilt_x * sun_x
+                            + geom.norm_tilt_y * sun_y
+                            + geom.norm_tilt_z * sun_z;
                         if (dot_prod_ts <= 0.0) {
+                            num_culled += 1;
                             continue;  // sw_dir_cor += 0.0
                         }
 
                         // Add ray
-                        ray8.org_x[num_rays_gc] = (float)ray_org_x;
-                        ray8.org_y[num_rays_gc] = (float)ray_org_y;
-                        ray8.org_z[num_rays_gc] = (float)ray_org_z;
+                        ray8.org_x[num_rays_gc] = (float)geom.ray_org_x;
+                        ray8.org_y[num_rays_gc] = (float)geom.ray_org_y;
+                        ray8.org_z[num_rays_gc] = (float)geom.ray_org_z;
                         ray8.tnear[num_rays_gc] = 0.0;
                         ray8.dir_x[num_rays_gc] = (float)sun_x;
                         ray8.dir_y[num_rays_gc] = (float)sun_y;
@@ -1089,7 +1899,7 @@ void CppTerrain::sw_dir_cor_coherent_rp8(double* sun_pos, float* sw_dir_cor) {
 
                         sw_dir_cor_ray[num_rays_gc] =
                             (float)(std::min(((dot_prod_ts / dot_prod_hs)
-                            * surf_enl_fac), sw_dir_cor_max_cl));
+                            * geom.surf_enl_fac), sw_dir_cor_max_cl));
                         num_rays_gc = num_rays_gc + 1;
 
                     }
@@ -1117,10 +1927,10 @@ void CppTerrain::sw_dir_cor_coherent_rp8(double* sun_pos, float* sw_dir_cor) {
                 }
             }
 
-            delete[] sw_dir_cor_ray;
-
             sw_dir_cor[lin_ind_gc] = sw_dir_cor_agg / num_tri_per_gc;
 
+            stats_cell(lin_ind_gc, num_rays - num_rays_cell);
+
             } else {
 
                 sw_dir_cor[lin_ind_gc] = NAN;
@@ -1130,14 +1940,29 @@ void CppTerrain::sw_dir_cor_coherent_rp8(double* sun_pos, float* sw_dir_cor) {
         }
     }
 
+    stats_thread(num_rays - num_rays_beg, num_culled);
     return num_rays;  // parallel
     }, std::plus<size_t>());  // parallel
 
     auto end_ray = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> time_ray = (end_ray - start_ray);
-    cout << "Ray tracing time: " << time_ray.count() << " s" << endl;
-    cout << "Number of rays shot: " << num_rays << endl;
+    kout << "Ray tracing time: " << time_ray.count() << " s" << endl;
+    kout << "Number of rays shot: " << num_rays << endl;
     double frac_ray = (double)num_rays / (double)num_tri_cl;
-    cout << "Fraction of rays required: " << frac_ray << endl;
+    kout << "Fraction of rays required: " << frac_ray << endl;
+    kernel_stats.time_ray += time_ray.count();
+    kernel_stats.time_total += time_ray.count();
+    kernel_stats.num_rays += num_rays;
+
+}
+
+void CppTerrain::sw_dir_cor_coherent_rp8(double* sun_pos, float* sw_dir_cor,
+    int refrac_cor) {
+
+    // Single dispatch to kernel specialised for refraction correction
+    dispatch_refrac(refrac_cor, [&](auto refrac) {
+        sw_dir_cor_coherent_rp8_spec<decltype(refrac)::value>(sun_pos,
+            sw_dir_cor);
+    });
 
 }
@@ -1,6 +1,18 @@
 #include <embree3/rtcore.h>
+#include <cstddef>
+#include "refraction.h"
 
 namespace shapes {
+
+// Geometry of DEM triangle (tilted and horizontal '0 m' triangle)
+struct TriangleGeom {
+    double ray_org_x, ray_org_y, ray_org_z;
+    double norm_tilt_x, norm_tilt_y, norm_tilt_z;
+    double norm_hori_x, norm_hori_y, norm_hori_z;
+    double surf_enl_fac;
+    double elevation;
+};
+
 class CppTerrain {
 public:
     RTCDevice device;
@@ -8,7 +20,8 @@ public:
     int dem_dim_0_cl, dem_dim_1_cl;
     float* vert_grid_cl;
     int dem_dim_in_0_cl, dem_dim_in_1_cl;
-    float* vert_grid_in_cl;
+    float* vert_grid_in_cl;  // NULL -> horizontal triangles analytically
+    double radius_earth_cl;
     int pixel_per_gc_cl;
     int offset_gc_cl;
     unsigned char* mask_cl;
@@ -18,7 +31,36 @@ public:
     double ray_org_elev_cl;
     int num_gc_y_cl, num_gc_x_cl;
     int num_tri_cl;
+    int num_tri_per_gc_cl;
     double dot_prod_min_cl;
+    // Per-triangle geometry cache (structure of arrays; optional)
+    int geom_cache_cl;
+    double* ray_org_x_cl;
+    double* ray_org_y_cl;
+    double* ray_org_z_cl;
+    double* norm_tilt_x_cl;
+    double* norm_tilt_y_cl;
+    double* norm_tilt_z_cl;
+    double* norm_hori_x_cl;
+    double* norm_hori_y_cl;
+    double* norm_hori_z_cl;
+    double* surf_enl_fac_cl;
+    double* elevation_cl;
+    // Per-triangle horizon cache (quantised sine of horizon; optional)
+    int hori_cache_cl;
+    int hori_azim_num_cl;
+    int hori_quant_cl;
+    double hori_scale_cl, hori_offset_cl;
+    double hori_acc_cl;  // accuracy of horizon [radian]
+    size_t hori_record_size_cl;
+    unsigned char* hori_data_cl;  // records [min, max, horizon] per triangle
+    unsigned char* hori_map_cl;  // memory-mapped horizon file (optional)
+    size_t hori_map_size_cl;
+    // Per-triangle upper bound of horizon (incremental mode; optional)
+    int bound_azim_num_cl;
+    float* hori_bound_cl;  // sine of horizon per triangle and azimuth sector
+    // Lookup table for atmospheric refraction (built by 'initialise')
+    RefracTable refrac_table_cl;
     CppTerrain();
     ~CppTerrain();
     void initialise(
@@ -26,15 +68,59 @@ public:
         int dem_dim_0, int dem_dim_1,
         float* vert_grid_in,
         int dem_dim_in_0, int dem_dim_in_1,
+        double radius_earth,
         int pixel_per_gc,
         int offset_gc,
         unsigned char* mask,
         double dist_search,
         char* geom_type,
         double sw_dir_cor_max,
-        double ang_max);
-    void sw_dir_cor(double* sun_pos, float* sw_dir_cor, int refrac_cor);
-    void sw_dir_cor_coherent(double* sun_pos, float* sw_dir_cor);
-    void sw_dir_cor_coherent_rp8(double* sun_pos, float* sw_dir_cor);
+        double ang_max,
+        int geom_cache,
+        char* build_quality,
+        int compact,
+        int robust);
+    void triangle_geom(size_t i, size_t j, size_t k, size_t m, size_t n,
+        TriangleGeom &geom);
+    void free_geom_cache();
+    void build_horizon_cache(int hori_azim_num, double hori_acc,
+        char* ray_algorithm, double elev_ang_low_lim, int hori_quant);
+    bool save_horizon_cache(char* hori_file);
+    bool load_horizon_cache(char* hori_file);
+    void free_horizon_cache();
+    double horizon_sin_interp(unsigned char* record, TriangleGeom &geom,
+        double sun_x, double sun_y, double sun_z);
+    void build_horizon_bound(int hori_azim_num);
+    void reset_incremental();
+    size_t sw_dir_cor(double* sun_pos, float* sw_dir_cor, int refrac_cor);
+    void sw_dir_cor_batch(double* sun_pos, int num_sun, float* sw_dir_cor,
+        int refrac_cor);
+    void sw_dir_cor_horizon(double* sun_pos, float* sw_dir_cor,
+        int refrac_cor);
+    size_t sw_dir_cor_incremental(double* sun_pos, float* sw_dir_cor,
+        int refrac_cor, int hori_azim_num);
+    void sw_dir_cor_coherent(double* sun_pos, float* sw_dir_cor,
+        int refrac_cor);
+    void sw_dir_cor_coherent_rp8(double* sun_pos, float* sw_dir_cor,
+        int refrac_cor);
+    // Kernels specialised at compile time for horizon detection algorithm
+    // (HORI_ALG_*) or refraction correction (REFRAC_*); selected once per
+    // call by above methods
+    template <int ALG>
+    void build_horizon_cache_spec(int hori_azim_num, double hori_acc,
+        double elev_ang_low_lim, int hori_quant);
+    template <int REFRAC>
+    size_t sw_dir_cor_spec(double* sun_pos, float* sw_dir_cor);
+    template <int REFRAC>
+    void sw_dir_cor_batch_spec(double* sun_pos, int num_sun,
+        float* sw_dir_cor);
+    template <int REFRAC>
+    void sw_dir_cor_horizon_spec(double* sun_pos, float* sw_dir_cor);
+    template <int REFRAC>
+    size_t sw_dir_cor_incremental_spec(double* sun_pos, float* sw_dir_cor);
+    template <int REFRAC>
+    void sw_dir_cor_coherent_spec(double* sun_pos, float* sw_dir_cor);
+    template <int REFRAC>
+    void sw_dir_cor_coherent_rp8_spec(double* sun_pos, float* sw_dir_cor);
 };
 }
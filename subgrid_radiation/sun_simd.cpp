@@ -0,0 +1,323 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "sun_simd.h"
+#include <math.h>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SUN_SIMD_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SUN_SIMD_NEON
+#endif
+
+//#############################################################################
+// Structure of arrays
+//#############################################################################
+
+void sun_pos_soa(const double* sun_pos, size_t num, float* sun_x,
+    float* sun_y, float* sun_z) {
+
+    for (size_t i = 0; i < num; i++) {
+        sun_x[i] = (float)sun_pos[i * 3];
+        sun_y[i] = (float)sun_pos[i * 3 + 1];
+        sun_z[i] = (float)sun_pos[i * 3 + 2];
+    }
+
+}
+
+//#############################################################################
+// Sun unit vectors and correction factors
+//#############################################################################
+
+typedef void (*sun_vec_cor_t)(size_t num, const float* sun_x,
+    const float* sun_y, const float* sun_z, float ray_org_x, float ray_org_y,
+    float ray_org_z, float norm_hori_x, float norm_hori_y, float norm_hori_z,
+    float norm_tilt_x, float norm_tilt_y, float norm_tilt_z,
+    float surf_enl_fac, float dot_prod_min, float sw_dir_cor_max,
+    float* dir_x, float* dir_y, float* dir_z, float* sw_dir_cor);
+
+//-----------------------------------------------------------------------------
+// Scalar (also used for remainder of SIMD loops)
+//-----------------------------------------------------------------------------
+
+static void sun_vec_cor_scalar(size_t num, const float* sun_x,
+    const float* sun_y, const float* sun_z, float ray_org_x, float ray_org_y,
+    float ray_org_z, float norm_hori_x, float norm_hori_y, float norm_hori_z,
+    float norm_tilt_x, float norm_tilt_y, float norm_tilt_z,
+    float surf_enl_fac, float dot_prod_min, float sw_dir_cor_max,
+    float* dir_x, float* dir_y, float* dir_z, float* sw_dir_cor) {
+
+    for (size_t i = 0; i < num; i++) {
+        float sun_x_r = sun_x[i] - ray_org_x;
+        float sun_y_r = sun_y[i] - ray_org_y;
+        float sun_z_r = sun_z[i] - ray_org_z;
+        float len = sqrtf(sun_x_r * sun_x_r + sun_y_r * sun_y_r
+            + sun_z_r * sun_z_r);
+        sun_x_r /= len;
+        sun_y_r /= len;
+        sun_z_r /= len;
+        float dot_prod_hs = norm_hori_x * sun_x_r + norm_hori_y * sun_y_r
+            + norm_hori_z * sun_z_r;
+        float dot_prod_ts = norm_tilt_x * sun_x_r + norm_tilt_y * sun_y_r
+            + norm_tilt_z * sun_z_r;
+        dir_x[i] = sun_x_r;
+        dir_y[i] = sun_y_r;
+        dir_z[i] = sun_z_r;
+        if ((dot_prod_hs > dot_prod_min) && (dot_prod_ts > 0.0f)) {
+            sw_dir_cor[i] = std::min((dot_prod_ts / dot_prod_hs)
+                * surf_enl_fac, sw_dir_cor_max);
+        } else {
+            sw_dir_cor[i] = 0.0f;  // self-shadowing (Earth or triangle)
+        }
+    }
+
+}
+
+#ifdef SUN_SIMD_X86
+
+//-----------------------------------------------------------------------------
+// AVX2 (8 lanes)
+//-----------------------------------------------------------------------------
+
+__attribute__((target("avx2,fma")))
+static void sun_vec_cor_avx2(size_t num, const float* sun_x,
+    const float* sun_y, const float* sun_z, float ray_org_x, float ray_org_y,
+    float ray_org_z, float norm_hori_x, float norm_hori_y, float norm_hori_z,
+    float norm_tilt_x, float norm_tilt_y, float norm_tilt_z,
+    float surf_enl_fac, float dot_prod_min, float sw_dir_cor_max,
+    float* dir_x, float* dir_y, float* dir_z, float* sw_dir_cor) {
+
+    __m256 org_x = _mm256_set1_ps(ray_org_x);
+    __m256 org_y = _mm256_set1_ps(ray_org_y);
+    __m256 org_z = _mm256_set1_ps(ray_org_z);
+    __m256 hori_x = _mm256_set1_ps(norm_hori_x);
+    __m256 hori_y = _mm256_set1_ps(norm_hori_y);
+    __m256 hori_z = _mm256_set1_ps(norm_hori_z);
+    __m256 tilt_x = _mm256_set1_ps(norm_tilt_x);
+    __m256 tilt_y = _mm256_set1_ps(norm_tilt_y);
+    __m256 tilt_z = _mm256_set1_ps(norm_tilt_z);
+    __m256 enl = _mm256_set1_ps(surf_enl_fac);
+    __m256 prod_min = _mm256_set1_ps(dot_prod_min);
+    __m256 cor_max = _mm256_set1_ps(sw_dir_cor_max);
+    __m256 zero = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; (i + 8) <= num; i += 8) {
+        __m256 sun_x_r = _mm256_sub_ps(_mm256_loadu_ps(sun_x + i), org_x);
+        __m256 sun_y_r = _mm256_sub_ps(_mm256_loadu_ps(sun_y + i), org_y);
+        __m256 sun_z_r = _mm256_sub_ps(_mm256_loadu_ps(sun_z + i), org_z);
+        __m256 len = _mm256_sqrt_ps(_mm256_fmadd_ps(sun_x_r, sun_x_r,
+            _mm256_fmadd_ps(sun_y_r, sun_y_r,
+            _mm256_mul_ps(sun_z_r, sun_z_r))));
+        sun_x_r = _mm256_div_ps(sun_x_r, len);
+        sun_y_r = _mm256_div_ps(sun_y_r, len);
+        sun_z_r = _mm256_div_ps(sun_z_r, len);
+        __m256 dot_prod_hs = _mm256_fmadd_ps(hori_x, sun_x_r,
+            _mm256_fmadd_ps(hori_y, sun_y_r, _mm256_mul_ps(hori_z, sun_z_r)));
+        __m256 dot_prod_ts = _mm256_fmadd_ps(tilt_x, sun_x_r,
+            _mm256_fmadd_ps(tilt_y, sun_y_r, _mm256_mul_ps(tilt_z, sun_z_r)));
+        __m256 cor = _mm256_min_ps(_mm256_mul_ps(_mm256_div_ps(dot_prod_ts,
+            dot_prod_hs), enl), cor_max);
+        __m256 valid = _mm256_and_ps(
+            _mm256_cmp_ps(dot_prod_hs, prod_min, _CMP_GT_OQ),
+            _mm256_cmp_ps(dot_prod_ts, zero, _CMP_GT_OQ));
+        _mm256_storeu_ps(dir_x + i, sun_x_r);
+        _mm256_storeu_ps(dir_y + i, sun_y_r);
+        _mm256_storeu_ps(dir_z + i, sun_z_r);
+        _mm256_storeu_ps(sw_dir_cor + i, _mm256_and_ps(cor, valid));
+    }
+
+    sun_vec_cor_scalar(num - i, sun_x + i, sun_y + i, sun_z + i,
+        ray_org_x, ray_org_y, ray_org_z, norm_hori_x, norm_hori_y,
+        norm_hori_z, norm_tilt_x, norm_tilt_y, norm_tilt_z, surf_enl_fac,
+        dot_prod_min, sw_dir_cor_max, dir_x + i, dir_y + i, dir_z + i,
+        sw_dir_cor + i);
+
+}
+
+//-----------------------------------------------------------------------------
+// AVX-512 (16 lanes)
+//-----------------------------------------------------------------------------
+
+__attribute__((target("avx512f")))
+static void sun_vec_cor_avx512(size_t num, const float* sun_x,
+    const float* sun_y, const float* sun_z, float ray_org_x, float ray_org_y,
+    float ray_org_z, float norm_hori_x, float norm_hori_y, float norm_hori_z,
+    float norm_tilt_x, float norm_tilt_y, float norm_tilt_z,
+    float surf_enl_fac, float dot_prod_min, float sw_dir_cor_max,
+    float* dir_x, float* dir_y, float* dir_z, float* sw_dir_cor) {
+
+    __m512 org_x = _mm512_set1_ps(ray_org_x);
+    __m512 org_y = _mm512_set1_ps(ray_org_y);
+    __m512 org_z = _mm512_set1_ps(ray_org_z);
+    __m512 hori_x = _mm512_set1_ps(norm_hori_x);
+    __m512 hori_y = _mm512_set1_ps(norm_hori_y);
+    __m512 hori_z = _mm512_set1_ps(norm_hori_z);
+    __m512 tilt_x = _mm512_set1_ps(norm_tilt_x);
+    __m512 tilt_y = _mm512_set1_ps(norm_tilt_y);
+    __m512 tilt_z = _mm512_set1_ps(norm_tilt_z);
+    __m512 enl = _mm512_set1_ps(surf_enl_fac);
+    __m512 prod_min = _mm512_set1_ps(dot_prod_min);
+    __m512 cor_max = _mm512_set1_ps(sw_dir_cor_max);
+    __m512 zero = _mm512_setzero_ps();
+
+    size_t i = 0;
+    for (; (i + 16) <= num; i += 16) {
+        __m512 sun_x_r = _mm512_sub_ps(_mm512_loadu_ps(sun_x + i), org_x);
+        __m512 sun_y_r = _mm512_sub_ps(_mm512_loadu_ps(sun_y + i), org_y);
+        __m512 sun_z_r = _mm512_sub_ps(_mm512_loadu_ps(sun_z + i), org_z);
+        __m512 len = _mm512_sqrt_ps(_mm512_fmadd_ps(sun_x_r, sun_x_r,
+            _mm512_fmadd_ps(sun_y_r, sun_y_r,
+            _mm512_mul_ps(sun_z_r, sun_z_r))));
+        sun_x_r = _mm512_div_ps(sun_x_r, len);
+        sun_y_r = _mm512_div_ps(sun_y_r, len);
+        sun_z_r = _mm512_div_ps(sun_z_r, len);
+        __m512 dot_prod_hs = _mm512_fmadd_ps(hori_x, sun_x_r,
+            _mm512_fmadd_ps(hori_y, sun_y_r, _mm512_mul_ps(hori_z, sun_z_r)));
+        __m512 dot_prod_ts = _mm512_fmadd_ps(tilt_x, sun_x_r,
+            _mm512_fmadd_ps(tilt_y, sun_y_r, _mm512_mul_ps(tilt_z, sun_z_r)));
+        __m512 cor = _mm512_min_ps(_mm512_mul_ps(_mm512_div_ps(dot_prod_ts,
+            dot_prod_hs), enl), cor_max);
+        __mmask16 valid = _mm512_cmp_ps_mask(dot_prod_hs, prod_min,
+            _CMP_GT_OQ) & _mm512_cmp_ps_mask(dot_prod_ts, zero, _CMP_GT_OQ);
+        _mm512_storeu_ps(dir_x + i, sun_x_r);
+        _mm512_storeu_ps(dir_y + i, sun_y_r);
+        _mm512_storeu_ps(dir_z + i, sun_z_r);
+        _mm512_storeu_ps(sw_dir_cor + i, _mm512_maskz_mov_ps(valid, cor));
+    }
+
+    sun_vec_cor_scalar(num - i, sun_x + i, sun_y + i, sun_z + i,
+        ray_org_x, ray_org_y, ray_org_z, norm_hori_x, norm_hori_y,
+        norm_hori_z, norm_tilt_x, norm_tilt_y, norm_tilt_z, surf_enl_fac,
+        dot_prod_min, sw_dir_cor_max, dir_x + i, dir_y + i, dir_z + i,
+        sw_dir_cor + i);
+
+}
+
+#endif
+
+#ifdef SUN_SIMD_NEON
+
+//-----------------------------------------------------------------------------
+// NEON (4 lanes)
+//-----------------------------------------------------------------------------
+
+static void sun_vec_cor_neon(size_t num, const float* sun_x,
+    const float* sun_y, const float* sun_z, float ray_org_x, float ray_org_y,
+    float ray_org_z, float norm_hori_x, float norm_hori_y, float norm_hori_z,
+    float norm_tilt_x, float norm_tilt_y, float norm_tilt_z,
+    float surf_enl_fac, float dot_prod_min, float sw_dir_cor_max,
+    float* dir_x, float* dir_y, float* dir_z, float* sw_dir_cor) {
+
+    float32x4_t org_x = vdupq_n_f32(ray_org_x);
+    float32x4_t org_y = vdupq_n_f32(ray_org_y);
+    float32x4_t org_z = vdupq_n_f32(ray_org_z);
+    float32x4_t hori_x = vdupq_n_f32(norm_hori_x);
+    float32x4_t hori_y = vdupq_n_f32(norm_hori_y);
+    float32x4_t hori_z = vdupq_n_f32(norm_hori_z);
+    float32x4_t tilt_x = vdupq_n_f32(norm_tilt_x);
+    float32x4_t tilt_y = vdupq_n_f32(norm_tilt_y);
+    float32x4_t tilt_z = vdupq_n_f32(norm_tilt_z);
+    float32x4_t enl = vdupq_n_f32(surf_enl_fac);
+    float32x4_t prod_min = vdupq_n_f32(dot_prod_min);
+    float32x4_t cor_max = vdupq_n_f32(sw_dir_cor_max);
+    float32x4_t zero = vdupq_n_f32(0.0f);
+
+    size_t i = 0;
+    for (; (i + 4) <= num; i += 4) {
+        float32x4_t sun_x_r = vsubq_f32(vld1q_f32(sun_x + i), org_x);
+        float32x4_t sun_y_r = vsubq_f32(vld1q_f32(sun_y + i), org_y);
+        float32x4_t sun_z_r = vsubq_f32(vld1q_f32(sun_z + i), org_z);
+        // vfmaq_f32(a, b, c) = a + b * c
+        float32x4_t len = vsqrtq_f32(vfmaq_f32(vfmaq_f32(
+            vmulq_f32(sun_z_r, sun_z_r), sun_y_r, sun_y_r),
+            sun_x_r, sun_x_r));
+        sun_x_r = vdivq_f32(sun_x_r, len);
+        sun_y_r = vdivq_f32(sun_y_r, len);
+        sun_z_r = vdivq_f32(sun_z_r, len);
+        float32x4_t dot_prod_hs = vfmaq_f32(vfmaq_f32(
+            vmulq_f32(hori_z, sun_z_r), hori_y, sun_y_r), hori_x, sun_x_r);
+        float32x4_t dot_prod_ts = vfmaq_f32(vfmaq_f32(
+            vmulq_f32(tilt_z, sun_z_r), tilt_y, sun_y_r), tilt_x, sun_x_r);
+        float32x4_t cor = vminq_f32(vmulq_f32(vdivq_f32(dot_prod_ts,
+            dot_prod_hs), enl), cor_max);
+        uint32x4_t valid = vandq_u32(vcgtq_f32(dot_prod_hs, prod_min),
+            vcgtq_f32(dot_prod_ts, zero));
+        vst1q_f32(dir_x + i, sun_x_r);
+        vst1q_f32(dir_y + i, sun_y_r);
+        vst1q_f32(dir_z + i, sun_z_r);
+        vst1q_f32(sw_dir_cor + i, vreinterpretq_f32_u32(vandq_u32(
+            vreinterpretq_u32_f32(cor), valid)));
+    }
+
+    sun_vec_cor_scalar(num - i, sun_x + i, sun_y + i, sun_z + i,
+        ray_org_x, ray_org_y, ray_org_z, norm_hori_x, norm_hori_y,
+        norm_hori_z, norm_tilt_x, norm_tilt_y, norm_tilt_z, surf_enl_fac,
+        dot_prod_min, sw_dir_cor_max, dir_x + i, dir_y + i, dir_z + i,
+        sw_dir_cor + i);
+
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+// Runtime selection of instruction set
+//-----------------------------------------------------------------------------
+
+struct SunSimdImpl {
+    sun_vec_cor_t function;
+    const char* isa;
+};
+
+static SunSimdImpl sun_simd_select() {
+#if defined(SUN_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return {sun_vec_cor_avx512, "avx512"};
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return {sun_vec_cor_avx2, "avx2"};
+    }
+#elif defined(SUN_SIMD_NEON)
+    return {sun_vec_cor_neon, "neon"};
+#endif
+    return {sun_vec_cor_scalar, "scalar"};
+}
+
+static const SunSimdImpl sun_simd_impl = sun_simd_select();
+
+void sun_vec_cor_f32(size_t num, const float* sun_x, const float* sun_y,
+    const float* sun_z, float ray_org_x, float ray_org_y, float ray_org_z,
+    float norm_hori_x, float norm_hori_y, float norm_hori_z,
+    float norm_tilt_x, float norm_tilt_y, float norm_tilt_z,
+    float surf_enl_fac, float dot_prod_min, float sw_dir_cor_max,
+    float* dir_x, float* dir_y, float* dir_z, float* sw_dir_cor) {
+    /* Parameters
+       ----------
+       num: number of sun positions [-]
+       sun_x, sun_y, sun_z: sun positions (SoA) [metre]
+       ray_org_x, ray_org_y, ray_org_z: ray origin [metre]
+       norm_hori_x, norm_hori_y, norm_hori_z: horizontal surface normal [-]
+       norm_tilt_x, norm_tilt_y, norm_tilt_z: tilted surface normal [-]
+       surf_enl_fac: surface enlargement factor [-]
+       dot_prod_min: minimal dot product of horizontal normal and sun [-]
+       sw_dir_cor_max: maximal correction factor [-]
+       dir_x, dir_y, dir_z: sun unit vectors [-]
+       sw_dir_cor: correction factors (0.0: self-shadowing) [-]
+    */
+
+    sun_simd_impl.function(num, sun_x, sun_y, sun_z, ray_org_x, ray_org_y,
+        ray_org_z, norm_hori_x, norm_hori_y, norm_hori_z, norm_tilt_x,
+        norm_tilt_y, norm_tilt_z, surf_enl_fac, dot_prod_min,
+        sw_dir_cor_max, dir_x, dir_y, dir_z, sw_dir_cor);
+
+}
+
+const char* sun_simd_isa() {
+
+    return sun_simd_impl.isa;
+
+}
@@ -0,0 +1,33 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef SUN_SIMD_H
+#define SUN_SIMD_H
+
+#include <cstddef>
+
+// Single precision (float32) computation of sun unit vectors and correction
+// factors of one triangle for many sun positions (explicit SIMD: AVX-512 or
+// AVX2 on x86-64, selected at runtime according to CPU support; NEON on
+// ARM64; scalar otherwise). Sun positions are provided as structure of
+// arrays (SoA). The double precision code in the kernels is kept as
+// reference.
+
+// Convert sun positions (num, 3) to structure of arrays (float32)
+void sun_pos_soa(const double* sun_pos, size_t num, float* sun_x,
+    float* sun_y, float* sun_z);
+
+// Compute sun unit vectors (relative to ray origin) and correction factors
+// (sw_dir_cor = dot_prod_ts / dot_prod_hs * surf_enl_fac, limited by
+// sw_dir_cor_max; 0.0 for self-shadowing by Earth or triangle)
+void sun_vec_cor_f32(size_t num, const float* sun_x, const float* sun_y,
+    const float* sun_z, float ray_org_x, float ray_org_y, float ray_org_z,
+    float norm_hori_x, float norm_hori_y, float norm_hori_z,
+    float norm_tilt_x, float norm_tilt_y, float norm_tilt_z,
+    float surf_enl_fac, float dot_prod_min, float sw_dir_cor_max,
+    float* dir_x, float* dir_y, float* dir_z, float* sw_dir_cor);
+
+// Instruction set used by 'sun_vec_cor_f32' (avx512, avx2, neon, scalar)
+const char* sun_simd_isa();
+
+#endif
@@ -0,0 +1,578 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#include "svf_simd.h"
+#include <math.h>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SVF_SIMD_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SVF_SIMD_NEON
+#endif
+
+//#############################################################################
+// Double precision (reference)
+//#############################################################################
+
+double svf_integrate(size_t num, const double* azim_sin,
+    const double* azim_cos, const double* horizon, double tilt_x,
+    double tilt_y, double tilt_z, double* horizon_sin,
+    double* horizon_sin_min, double* horizon_sin_max) {
+    /* Parameters
+       ----------
+       num: number of azimuth directions [-]
+       azim_sin, azim_cos: sine/cosine of azimuth angles [-]
+       horizon: horizon elevation angles [radian]
+       tilt_x, tilt_y, tilt_z: tilted surface normal in local ENU
+                               coordinates [-]
+       horizon_sin: sine of horizon elevation angles (output; skipped if
+                    NULL) [-]
+       horizon_sin_min, horizon_sin_max: minimal/maximal sine of horizon
+                                         elevation angles (output; only set
+                                         if 'horizon_sin' is not NULL) [-]
+
+       Returns
+       ----------
+       agg: sum of inner integral [-]
+    */
+
+    double agg = 0.0;
+    double sin_min = 1.0;
+    double sin_max = -1.0;
+    for (size_t o = 0; o < num; o++) {
+
+        // Compute plane-sphere intersection
+        double dot_prod = tilt_x * azim_sin[o] + tilt_y * azim_cos[o];
+        double hori_plane = atan(-dot_prod / tilt_z);
+        double hori_elev = std::max(horizon[o], hori_plane);
+
+        // Compute inner integral (sin(2x) / 2 = sin(x) * cos(x))
+        double elev_sin = sin(hori_elev);
+        double elev_cos = cos(hori_elev);
+        agg += dot_prod * ((M_PI / 2.0) - hori_elev - elev_sin * elev_cos)
+            + tilt_z * elev_cos * elev_cos;
+
+        // Sine of horizon
+        if (horizon_sin != NULL) {
+            horizon_sin[o] = sin(horizon[o]);
+            sin_min = std::min(sin_min, horizon_sin[o]);
+            sin_max = std::max(sin_max, horizon_sin[o]);
+        }
+
+    }
+    if (horizon_sin != NULL) {
+        *horizon_sin_min = sin_min;
+        *horizon_sin_max = sin_max;
+    }
+    return agg;
+
+}
+
+//#############################################################################
+// Single precision
+//#############################################################################
+
+// Coefficients of polynomial approximations:
+// - sin/cos: Taylor series up to degree 11/12 (absolute error below 1e-7
+//   within [-pi / 2, pi / 2])
+// - atan: argument reduction to [-tan(pi / 8), tan(pi / 8)] and minimax
+//   polynomial of degree 9 (Cephes 'atanf')
+static const float sin_c1 = -1.0f / 6.0f;
+static const float sin_c2 = 1.0f / 120.0f;
+static const float sin_c3 = -1.0f / 5040.0f;
+static const float sin_c4 = 1.0f / 362880.0f;
+static const float sin_c5 = -1.0f / 39916800.0f;
+static const float cos_c1 = -1.0f / 2.0f;
+static const float cos_c2 = 1.0f / 24.0f;
+static const float cos_c3 = -1.0f / 720.0f;
+static const float cos_c4 = 1.0f / 40320.0f;
+static const float cos_c5 = -1.0f / 3628800.0f;
+static const float cos_c6 = 1.0f / 479001600.0f;
+static const float atan_c0 = 8.05374449538e-2f;
+static const float atan_c1 = -1.38776856032e-1f;
+static const float atan_c2 = 1.99777106478e-1f;
+static const float atan_c3 = -3.33329491539e-1f;
+static const float tan_3pi_8 = 2.414213562373095f;
+static const float tan_pi_8 = 0.4142135623730950f;
+static const float pi_2_f = 1.5707963267948966f;
+static const float pi_4_f = 0.7853981633974483f;
+
+typedef double (*svf_integrate_t)(size_t num, const float* azim_sin,
+    const float* azim_cos, const double* horizon, float tilt_x,
+    float tilt_y, float tilt_z, double* horizon_sin,
+    double* horizon_sin_min, double* horizon_sin_max);
+
+//-----------------------------------------------------------------------------
+// Scalar (also used for remainder of SIMD loops)
+//-----------------------------------------------------------------------------
+
+static inline float sin_f32(float x) {
+    float x2 = x * x;
+    float p = (((sin_c5 * x2 + sin_c4) * x2 + sin_c3) * x2 + sin_c2) * x2
+        + sin_c1;
+    return x + x * x2 * p;
+}
+
+static inline float cos_f32(float x) {
+    float x2 = x * x;
+    float p = ((((cos_c6 * x2 + cos_c5) * x2 + cos_c4) * x2 + cos_c3)
+        * x2 + cos_c2) * x2 + cos_c1;
+    return 1.0f + x2 * p;
+}
+
+static inline float atan_f32(float x) {
+    float x_abs = fabsf(x);
+    float y = 0.0f;
+    if (x_abs > tan_3pi_8) {
+        y = pi_2_f;
+        x_abs = -1.0f / x_abs;
+    } else if (x_abs > tan_pi_8) {
+        y = pi_4_f;
+        x_abs = (x_abs - 1.0f) / (x_abs + 1.0f);
+    }
+    float z = x_abs * x_abs;
+    y += (((atan_c0 * z + atan_c1) * z + atan_c2) * z + atan_c3) * z * x_abs
+        + x_abs;
+    return (x < 0.0f) ? -y : y;
+}
+
+static double svf_integrate_scalar(size_t num, const float* azim_sin,
+    const float* azim_cos, const double* horizon, float tilt_x,
+    float tilt_y, float tilt_z, double* horizon_sin,
+    double* horizon_sin_min, double* horizon_sin_max) {
+
+    float tilt_z_inv = 1.0f / tilt_z;
+    double agg = 0.0;
+    float sin_min = 1.0f;
+    float sin_max = -1.0f;
+    for (size_t o = 0; o < num; o++) {
+        float dot_prod = tilt_x * azim_sin[o] + tilt_y * azim_cos[o];
+        float hori_plane = atan_f32(-dot_prod * tilt_z_inv);
+        float hori = (float)horizon[o];
+        float hori_elev = std::max(hori, hori_plane);
+        float elev_sin = sin_f32(hori_elev);
+        float elev_cos = cos_f32(hori_elev);
+        agg += dot_prod * (pi_2_f - hori_elev - elev_sin * elev_cos)
+            + tilt_z * elev_cos * elev_cos;
+        if (horizon_sin != NULL) {
+            float hori_sin = sin_f32(hori);
+            horizon_sin[o] = hori_sin;
+            sin_min = std::min(sin_min, hori_sin);
+            sin_max = std::max(sin_max, hori_sin);
+        }
+    }
+    if (horizon_sin != NULL) {
+        *horizon_sin_min = sin_min;
+        *horizon_sin_max = sin_max;
+    }
+    return agg;
+
+}
+
+#ifdef SVF_SIMD_X86
+
+//-----------------------------------------------------------------------------
+// AVX2 (8 lanes)
+//-----------------------------------------------------------------------------
+
+__attribute__((target("avx2,fma")))
+static inline __m256 sin_avx2(__m256 x) {
+    __m256 x2 = _mm256_mul_ps(x, x);
+    __m256 p = _mm256_fmadd_ps(_mm256_set1_ps(sin_c5), x2,
+        _mm256_set1_ps(sin_c4));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(sin_c3));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(sin_c2));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(sin_c1));
+    return _mm256_fmadd_ps(_mm256_mul_ps(x, x2), p, x);
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 cos_avx2(__m256 x) {
+    __m256 x2 = _mm256_mul_ps(x, x);
+    __m256 p = _mm256_fmadd_ps(_mm256_set1_ps(cos_c6), x2,
+        _mm256_set1_ps(cos_c5));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(cos_c4));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(cos_c3));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(cos_c2));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(cos_c1));
+    return _mm256_fmadd_ps(x2, p, _mm256_set1_ps(1.0f));
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 atan_avx2(__m256 x) {
+    __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 sign = _mm256_and_ps(x, sign_mask);
+    __m256 x_abs = _mm256_andnot_ps(sign_mask, x);
+    __m256 big = _mm256_cmp_ps(x_abs, _mm256_set1_ps(tan_3pi_8),
+        _CMP_GT_OQ);
+    __m256 mid = _mm256_andnot_ps(big, _mm256_cmp_ps(x_abs,
+        _mm256_set1_ps(tan_pi_8), _CMP_GT_OQ));
+    // Argument reduction with single division
+    __m256 num = _mm256_blendv_ps(_mm256_blendv_ps(x_abs,
+        _mm256_sub_ps(x_abs, one), mid), _mm256_set1_ps(-1.0f), big);
+    __m256 den = _mm256_blendv_ps(_mm256_blendv_ps(one,
+        _mm256_add_ps(x_abs, one), mid), x_abs, big);
+    __m256 x_r = _mm256_div_ps(num, den);
+    __m256 y = _mm256_blendv_ps(_mm256_blendv_ps(_mm256_setzero_ps(),
+        _mm256_set1_ps(pi_4_f), mid), _mm256_set1_ps(pi_2_f), big);
+    __m256 z = _mm256_mul_ps(x_r, x_r);
+    __m256 p = _mm256_fmadd_ps(_mm256_set1_ps(atan_c0), z,
+        _mm256_set1_ps(atan_c1));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(atan_c2));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(atan_c3));
+    y = _mm256_add_ps(y, _mm256_fmadd_ps(_mm256_mul_ps(p, z), x_r, x_r));
+    return _mm256_xor_ps(y, sign);
+}
+
+__attribute__((target("avx2,fma")))
+static double svf_integrate_avx2(size_t num, const float* azim_sin,
+    const float* azim_cos, const double* horizon, float tilt_x,
+    float tilt_y, float tilt_z, double* horizon_sin,
+    double* horizon_sin_min, double* horizon_sin_max) {
+
+    __m256 t_x = _mm256_set1_ps(tilt_x);
+    __m256 t_y = _mm256_set1_ps(tilt_y);
+    __m256 t_z = _mm256_set1_ps(tilt_z);
+    __m256 t_z_inv_neg = _mm256_set1_ps(-1.0f / tilt_z);
+    __m256 pi_2 = _mm256_set1_ps(pi_2_f);
+    __m256 agg_v = _mm256_setzero_ps();
+    __m256 sin_min_v = _mm256_set1_ps(1.0f);
+    __m256 sin_max_v = _mm256_set1_ps(-1.0f);
+
+    size_t i = 0;
+    for (; (i + 8) <= num; i += 8) {
+        __m256 dot_prod = _mm256_fmadd_ps(t_x, _mm256_loadu_ps(azim_sin + i),
+            _mm256_mul_ps(t_y, _mm256_loadu_ps(azim_cos + i)));
+        __m256 hori_plane = atan_avx2(_mm256_mul_ps(dot_prod, t_z_inv_neg));
+        __m256 hori = _mm256_insertf128_ps(_mm256_castps128_ps256(
+            _mm256_cvtpd_ps(_mm256_loadu_pd(horizon + i))),
+            _mm256_cvtpd_ps(_mm256_loadu_pd(horizon + i + 4)), 1);
+        __m256 hori_elev = _mm256_max_ps(hori, hori_plane);
+        __m256 elev_sin = sin_avx2(hori_elev);
+        __m256 elev_cos = cos_avx2(hori_elev);
+        __m256 term = _mm256_sub_ps(_mm256_sub_ps(pi_2, hori_elev),
+            _mm256_mul_ps(elev_sin, elev_cos));
+        agg_v = _mm256_add_ps(agg_v, _mm256_fmadd_ps(dot_prod, term,
+            _mm256_mul_ps(t_z, _mm256_mul_ps(elev_cos, elev_cos))));
+        if (horizon_sin != NULL) {
+            __m256 hori_sin = sin_avx2(hori);
+            _mm256_storeu_pd(horizon_sin + i,
+                _mm256_cvtps_pd(_mm256_castps256_ps128(hori_sin)));
+            _mm256_storeu_pd(horizon_sin + i + 4,
+                _mm256_cvtps_pd(_mm256_extractf128_ps(hori_sin, 1)));
+            sin_min_v = _mm256_min_ps(sin_min_v, hori_sin);
+            sin_max_v = _mm256_max_ps(sin_max_v, hori_sin);
+        }
+    }
+
+    double sin_min, sin_max;
+    double agg = svf_integrate_scalar(num - i, azim_sin + i, azim_cos + i,
+        horizon + i, tilt_x, tilt_y, tilt_z,
+        (horizon_sin != NULL) ? horizon_sin + i : NULL, &sin_min, &sin_max);
+    float agg_l[8], sin_min_l[8], sin_max_l[8];
+    _mm256_storeu_ps(agg_l, agg_v);
+    _mm256_storeu_ps(sin_min_l, sin_min_v);
+    _mm256_storeu_ps(sin_max_l, sin_max_v);
+    for (int k = 0; k < 8; k++) {
+        agg += agg_l[k];
+    }
+    if (horizon_sin != NULL) {
+        for (int k = 0; k < 8; k++) {
+            sin_min = std::min(sin_min, (double)sin_min_l[k]);
+            sin_max = std::max(sin_max, (double)sin_max_l[k]);
+        }
+        *horizon_sin_min = sin_min;
+        *horizon_sin_max = sin_max;
+    }
+    return agg;
+
+}
+
+//-----------------------------------------------------------------------------
+// AVX-512 (16 lanes)
+//-----------------------------------------------------------------------------
+
+__attribute__((target("avx512f")))
+static inline __m512 sin_avx512(__m512 x) {
+    __m512 x2 = _mm512_mul_ps(x, x);
+    __m512 p = _mm512_fmadd_ps(_mm512_set1_ps(sin_c5), x2,
+        _mm512_set1_ps(sin_c4));
+    p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(sin_c3));
+    p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(sin_c2));
+    p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(sin_c1));
+    return _mm512_fmadd_ps(_mm512_mul_ps(x, x2), p, x);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 cos_avx512(__m512 x) {
+    __m512 x2 = _mm512_mul_ps(x, x);
+    __m512 p = _mm512_fmadd_ps(_mm512_set1_ps(cos_c6), x2,
+        _mm512_set1_ps(cos_c5));
+    p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(cos_c4));
+    p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(cos_c3));
+    p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(cos_c2));
+    p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(cos_c1));
+    return _mm512_fmadd_ps(x2, p, _mm512_set1_ps(1.0f));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 atan_avx512(__m512 x) {
+    __m512 one = _mm512_set1_ps(1.0f);
+    __m512 x_abs = _mm512_abs_ps(x);
+    __mmask16 neg = _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_LT_OQ);
+    __mmask16 big = _mm512_cmp_ps_mask(x_abs, _mm512_set1_ps(tan_3pi_8),
+        _CMP_GT_OQ);
+    __mmask16 mid = _mm512_cmp_ps_mask(x_abs, _mm512_set1_ps(tan_pi_8),
+        _CMP_GT_OQ) & ~big;
+    // Argument reduction with single division
+    __m512 num = _mm512_mask_blend_ps(big, _mm512_mask_blend_ps(mid, x_abs,
+        _mm512_sub_ps(x_abs, one)), _mm512_set1_ps(-1.0f));
+    __m512 den = _mm512_mask_blend_ps(big, _mm512_mask_blend_ps(mid, one,
+        _mm512_add_ps(x_abs, one)), x_abs);
+    __m512 x_r = _mm512_div_ps(num, den);
+    __m512 y = _mm512_mask_blend_ps(big, _mm512_mask_blend_ps(mid,
+        _mm512_setzero_ps(), _mm512_set1_ps(pi_4_f)),
+        _mm512_set1_ps(pi_2_f));
+    __m512 z = _mm512_mul_ps(x_r, x_r);
+    __m512 p = _mm512_fmadd_ps(_mm512_set1_ps(atan_c0), z,
+        _mm512_set1_ps(atan_c1));
+    p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(atan_c2));
+    p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(atan_c3));
+    y = _mm512_add_ps(y, _mm512_fmadd_ps(_mm512_mul_ps(p, z), x_r, x_r));
+    return _mm512_mask_sub_ps(y, neg, _mm512_setzero_ps(), y);
+}
+
+__attribute__((target("avx512f")))
+static double svf_integrate_avx512(size_t num, const float* azim_sin,
+    const float* azim_cos, const double* horizon, float tilt_x,
+    float tilt_y, float tilt_z, double* horizon_sin,
+    double* horizon_sin_min, double* horizon_sin_max) {
+
+    __m512 t_x = _mm512_set1_ps(tilt_x);
+    __m512 t_y = _mm512_set1_ps(tilt_y);
+    __m512 t_z = _mm512_set1_ps(tilt_z);
+    __m512 t_z_inv_neg = _mm512_set1_ps(-1.0f / tilt_z);
+    __m512 pi_2 = _mm512_set1_ps(pi_2_f);
+    __m512 agg_v = _mm512_setzero_ps();
+    __m512 sin_min_v = _mm512_set1_ps(1.0f);
+    __m512 sin_max_v = _mm512_set1_ps(-1.0f);
+
+    size_t i = 0;
+    for (; (i + 16) <= num; i += 16) {
+        __m512 dot_prod = _mm512_fmadd_ps(t_x, _mm512_loadu_ps(azim_sin + i),
+            _mm512_mul_ps(t_y, _mm512_loadu_ps(azim_cos + i)));
+        __m512 hori_plane = atan_avx512(_mm512_mul_ps(dot_prod, t_z_inv_neg));
+        __m512 hori = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(
+            _mm512_castps256_ps512(_mm512_cvtpd_ps(
+            _mm512_loadu_pd(horizon + i)))), _mm256_castps_pd(
+            _mm512_cvtpd_ps(_mm512_loadu_pd(horizon + i + 8))), 1));
+        __m512 hori_elev = _mm512_max_ps(hori, hori_plane);
+        __m512 elev_sin = sin_avx512(hori_elev);
+        __m512 elev_cos = cos_avx512(hori_elev);
+        __m512 term = _mm512_sub_ps(_mm512_sub_ps(pi_2, hori_elev),
+            _mm512_mul_ps(elev_sin, elev_cos));
+        agg_v = _mm512_add_ps(agg_v, _mm512_fmadd_ps(dot_prod, term,
+            _mm512_mul_ps(t_z, _mm512_mul_ps(elev_cos, elev_cos))));
+        if (horizon_sin != NULL) {
+            __m512 hori_sin = sin_avx512(hori);
+            _mm512_storeu_pd(horizon_sin + i,
+                _mm512_cvtps_pd(_mm512_castps512_ps256(hori_sin)));
+            _mm512_storeu_pd(horizon_sin + i + 8,
+                _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(
+                _mm512_castps_pd(hori_sin), 1))));
+            sin_min_v = _mm512_min_ps(sin_min_v, hori_sin);
+            sin_max_v = _mm512_max_ps(sin_max_v, hori_sin);
+        }
+    }
+
+    double sin_min, sin_max;
+    double agg = svf_integrate_scalar(num - i, azim_sin + i, azim_cos + i,
+        horizon + i, tilt_x, tilt_y, tilt_z,
+        (horizon_sin != NULL) ? horizon_sin + i : NULL, &sin_min, &sin_max);
+    float agg_l[16], sin_min_l[16], sin_max_l[16];
+    _mm512_storeu_ps(agg_l, agg_v);
+    _mm512_storeu_ps(sin_min_l, sin_min_v);
+    _mm512_storeu_ps(sin_max_l, sin_max_v);
+    for (int k = 0; k < 16; k++) {
+        agg += agg_l[k];
+    }
+    if (horizon_sin != NULL) {
+        for (int k = 0; k < 16; k++) {
+            sin_min = std::min(sin_min, (double)sin_min_l[k]);
+            sin_max = std::max(sin_max, (double)sin_max_l[k]);
+        }
+        *horizon_sin_min = sin_min;
+        *horizon_sin_max = sin_max;
+    }
+    return agg;
+
+}
+
+#endif
+
+#ifdef SVF_SIMD_NEON
+
+//-----------------------------------------------------------------------------
+// NEON (4 lanes)
+//-----------------------------------------------------------------------------
+
+// vfmaq_f32(a, b, c) = a + b * c
+
+static inline float32x4_t sin_neon(float32x4_t x) {
+    float32x4_t x2 = vmulq_f32(x, x);
+    float32x4_t p = vfmaq_f32(vdupq_n_f32(sin_c4), vdupq_n_f32(sin_c5), x2);
+    p = vfmaq_f32(vdupq_n_f32(sin_c3), p, x2);
+    p = vfmaq_f32(vdupq_n_f32(sin_c2), p, x2);
+    p = vfmaq_f32(vdupq_n_f32(sin_c1), p, x2);
+    return vfmaq_f32(x, vmulq_f32(x, x2), p);
+}
+
+static inline float32x4_t cos_neon(float32x4_t x) {
+    float32x4_t x2 = vmulq_f32(x, x);
+    float32x4_t p = vfmaq_f32(vdupq_n_f32(cos_c5), vdupq_n_f32(cos_c6), x2);
+    p = vfmaq_f32(vdupq_n_f32(cos_c4), p, x2);
+    p = vfmaq_f32(vdupq_n_f32(cos_c3), p, x2);
+    p = vfmaq_f32(vdupq_n_f32(cos_c2), p, x2);
+    p = vfmaq_f32(vdupq_n_f32(cos_c1), p, x2);
+    return vfmaq_f32(vdupq_n_f32(1.0f), x2, p);
+}
+
+static inline float32x4_t atan_neon(float32x4_t x) {
+    float32x4_t one = vdupq_n_f32(1.0f);
+    float32x4_t x_abs = vabsq_f32(x);
+    uint32x4_t neg = vcltq_f32(x, vdupq_n_f32(0.0f));
+    uint32x4_t big = vcgtq_f32(x_abs, vdupq_n_f32(tan_3pi_8));
+    uint32x4_t mid = vbicq_u32(vcgtq_f32(x_abs, vdupq_n_f32(tan_pi_8)),
+        big);
+    // Argument reduction with single division
+    float32x4_t num = vbslq_f32(big, vdupq_n_f32(-1.0f), vbslq_f32(mid,
+        vsubq_f32(x_abs, one), x_abs));
+    float32x4_t den = vbslq_f32(big, x_abs, vbslq_f32(mid,
+        vaddq_f32(x_abs, one), one));
+    float32x4_t x_r = vdivq_f32(num, den);
+    float32x4_t y = vbslq_f32(big, vdupq_n_f32(pi_2_f), vbslq_f32(mid,
+        vdupq_n_f32(pi_4_f), vdupq_n_f32(0.0f)));
+    float32x4_t z = vmulq_f32(x_r, x_r);
+    float32x4_t p = vfmaq_f32(vdupq_n_f32(atan_c1), vdupq_n_f32(atan_c0),
+        z);
+    p = vfmaq_f32(vdupq_n_f32(atan_c2), p, z);
+    p = vfmaq_f32(vdupq_n_f32(atan_c3), p, z);
+    y = vaddq_f32(y, vfmaq_f32(x_r, vmulq_f32(p, z), x_r));
+    return vbslq_f32(neg, vnegq_f32(y), y);
+}
+
+static double svf_integrate_neon(size_t num, const float* azim_sin,
+    const float* azim_cos, const double* horizon, float tilt_x,
+    float tilt_y, float tilt_z, double* horizon_sin,
+    double* horizon_sin_min, double* horizon_sin_max) {
+
+    float32x4_t t_x = vdupq_n_f32(tilt_x);
+    float32x4_t t_y = vdupq_n_f32(tilt_y);
+    float32x4_t t_z = vdupq_n_f32(tilt_z);
+    float32x4_t t_z_inv_neg = vdupq_n_f32(-1.0f / tilt_z);
+    float32x4_t pi_2 = vdupq_n_f32(pi_2_f);
+    float32x4_t agg_v = vdupq_n_f32(0.0f);
+    float32x4_t sin_min_v = vdupq_n_f32(1.0f);
+    float32x4_t sin_max_v = vdupq_n_f32(-1.0f);
+
+    size_t i = 0;
+    for (; (i + 4) <= num; i += 4) {
+        float32x4_t dot_prod = vfmaq_f32(vmulq_f32(t_y,
+            vld1q_f32(azim_cos + i)), t_x, vld1q_f32(azim_sin + i));
+        float32x4_t hori_plane = atan_neon(vmulq_f32(dot_prod,
+            t_z_inv_neg));
+        float32x4_t hori = vcombine_f32(vcvt_f32_f64(vld1q_f64(horizon + i)),
+            vcvt_f32_f64(vld1q_f64(horizon + i + 2)));
+        float32x4_t hori_elev = vmaxq_f32(hori, hori_plane);
+        float32x4_t elev_sin = sin_neon(hori_elev);
+        float32x4_t elev_cos = cos_neon(hori_elev);
+        float32x4_t term = vsubq_f32(vsubq_f32(pi_2, hori_elev),
+            vmulq_f32(elev_sin, elev_cos));
+        agg_v = vaddq_f32(agg_v, vfmaq_f32(vmulq_f32(t_z,
+            vmulq_f32(elev_cos, elev_cos)), dot_prod, term));
+        if (horizon_sin != NULL) {
+            float32x4_t hori_sin = sin_neon(hori);
+            vst1q_f64(horizon_sin + i, vcvt_f64_f32(vget_low_f32(hori_sin)));
+            vst1q_f64(horizon_sin + i + 2, vcvt_high_f64_f32(hori_sin));
+            sin_min_v = vminq_f32(sin_min_v, hori_sin);
+            sin_max_v = vmaxq_f32(sin_max_v, hori_sin);
+        }
+    }
+
+    double sin_min, sin_max;
+    double agg = svf_integrate_scalar(num - i, azim_sin + i, azim_cos + i,
+        horizon + i, tilt_x, tilt_y, tilt_z,
+        (horizon_sin != NULL) ? horizon_sin + i : NULL, &sin_min, &sin_max);
+    agg += vaddvq_f32(agg_v);
+    if (horizon_sin != NULL) {
+        *horizon_sin_min = std::min(sin_min, (double)vminvq_f32(sin_min_v));
+        *horizon_sin_max = std::max(sin_max, (double)vmaxvq_f32(sin_max_v));
+    }
+    return agg;
+
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+// Runtime selection of instruction set
+//-----------------------------------------------------------------------------
+
+struct SvfSimdImpl {
+    svf_integrate_t function;
+    const char* isa;
+};
+
+static SvfSimdImpl svf_simd_select() {
+#if defined(SVF_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return {svf_integrate_avx512, "avx512"};
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return {svf_integrate_avx2, "avx2"};
+    }
+#elif defined(SVF_SIMD_NEON)
+    return {svf_integrate_neon, "neon"};
+#endif
+    return {svf_integrate_scalar, "scalar"};
+}
+
+static const SvfSimdImpl svf_simd_impl = svf_simd_select();
+
+double svf_integrate_f32(size_t num, const float* azim_sin,
+    const float* azim_cos, const double* horizon, float tilt_x,
+    float tilt_y, float tilt_z, double* horizon_sin,
+    double* horizon_sin_min, double* horizon_sin_max) {
+    /* Parameters
+       ----------
+       num: number of azimuth directions [-]
+       azim_sin, azim_cos: sine/cosine of azimuth angles [-]
+       horizon: horizon elevation angles within [-pi / 2, pi / 2] [radian]
+       tilt_x, tilt_y, tilt_z: tilted surface normal in local ENU
+                               coordinates [-]
+       horizon_sin: sine of horizon elevation angles (output; skipped if
+                    NULL) [-]
+       horizon_sin_min, horizon_sin_max: minimal/maximal sine of horizon
+                                         elevation angles (output; only set
+                                         if 'horizon_sin' is not NULL) [-]
+
+       Returns
+       ----------
+       agg: sum of inner integral [-]
+    */
+
+    return svf_simd_impl.function(num, azim_sin, azim_cos, horizon, tilt_x,
+        tilt_y, tilt_z, horizon_sin, horizon_sin_min, horizon_sin_max);
+
+}
+
+const char* svf_simd_isa() {
+
+    return svf_simd_impl.isa;
+
+}
@@ -0,0 +1,36 @@
+// Copyright (c) 2023 ETH Zurich, Christian R. Steger
+// MIT License
+
+#ifndef SVF_SIMD_H
+#define SVF_SIMD_H
+
+#include <cstddef>
+
+// Fused integration of the sky view factor of one triangle from its horizon
+// (single pass over all azimuth directions). Besides the inner integral,
+// the sine of the horizon and its minimum/maximum are optionally computed
+// (required for subsequent shadow tests against sun positions). Sine and
+// cosine of the azimuth angles are precomputed once per kernel run. The
+// single precision (float32) variant uses polynomial approximations of
+// sin/cos/atan and explicit SIMD (AVX-512 or AVX2 on x86-64, selected at
+// runtime according to CPU support; NEON on ARM64; scalar otherwise) and
+// requires horizon elevation angles within [-pi / 2, pi / 2]. The double
+// precision variant is the reference.
+
+// Sum of inner integral over azimuth directions (multiply by
+// azim_spac / (2 * pi) to obtain sky view factor); horizon_sin (may be
+// NULL), horizon_sin_min and horizon_sin_max are set if required
+double svf_integrate(size_t num, const double* azim_sin,
+    const double* azim_cos, const double* horizon, double tilt_x,
+    double tilt_y, double tilt_z, double* horizon_sin,
+    double* horizon_sin_min, double* horizon_sin_max);
+
+double svf_integrate_f32(size_t num, const float* azim_sin,
+    const float* azim_cos, const double* horizon, float tilt_x,
+    float tilt_y, float tilt_z, double* horizon_sin,
+    double* horizon_sin_min, double* horizon_sin_max);
+
+// Instruction set used by 'svf_integrate_f32' (avx512, avx2, neon, scalar)
+const char* svf_simd_isa();
+
+#endif
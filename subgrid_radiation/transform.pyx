@@ -244,6 +244,101 @@ def _ecef2enu_1d_in_place(double[:] x_ecef, double[:] y_ecef, double[:] z_ecef,
                      + sin_lat * (z_ecef_temp - z_ecef_or))
 
 
+# -----------------------------------------------------------------------------
+
+cdef extern from "dem_vertices.h":
+    size_t vertex_buffer_size(size_t num_vert)
+    double c_dem_vertices "dem_vertices" (
+            const double* lon, const double* lat, const float* elevation,
+            int dim_0, int dim_1, int offset_px, double lon_or,
+            double lat_or, double radius_earth, float* vert_grid,
+            float* vert_grid_in) nogil
+
+def dem_vertices(lon, lat, elevation, trans_lonlat2enu, int offset_px=0,
+                 bint inner=True):
+    """Padded vertex buffers of DEM and inner '0.0 m surface' in ENU
+    coordinates.
+
+    Fused alternative to 'lonlat2ecef', 'ecef2enu' and
+    'auxiliary.rearrange_pad_buffer': the geographic coordinates are read
+    once and the padded (Embree-aligned) vertex buffers are directly written
+    in a single parallel pass (C++; no full-size temporary arrays).
+
+    Parameters
+    ----------
+    lon : ndarray of double
+        Array (two-dimensional) with geographic longitude [degree]
+    lat : ndarray of double
+        Array (two-dimensional) with geographic latitude [degree]
+    elevation : ndarray of float
+        Array (two-dimensional) with elevation above sphere [metre]
+    trans_lonlat2enu : class
+        Instance of class `TransformerLonlat2enu`
+    offset_px : int
+        Offset of inner domain (both dimensions) in number of pixels
+        (pixel_per_gc * offset_gc)
+    inner : bool
+        Compute vertex buffer of inner domain with 0.0 m elevation
+
+    Returns
+    -------
+    vert_grid : ndarray of float
+        Array (one-dimensional) with padded vertex buffer of DEM [metre]
+    vert_grid_in : ndarray of float or None
+        Array (one-dimensional) with padded vertex buffer of inner domain
+        with 0.0 m elevation [metre]
+    value_abs_max : double
+        Maximal absolute ENU coordinate value of inner domain [metre]"""
+
+    # Check arguments
+    if (lon.ndim != 2) or (lon.shape != lat.shape) \
+            or (lat.shape != elevation.shape):
+        raise ValueError("Inconsistent shapes / number of dimensions of "
+                         + "input arrays")
+    if (lon.dtype != "float64") or (lat.dtype != "float64"):
+        raise ValueError("Input array(s) has/have incorrect data type(s)")
+    if not isinstance(trans_lonlat2enu, TransformerLonlat2enu):
+        raise ValueError("Input argument 'trans_lonlat2enu' must be instance "
+                         + "of class 'TransformerLonlat2enu'")
+    if (offset_px < 0) or (2 * offset_px >= min(lon.shape)):
+        raise ValueError("Value for 'offset_px' is outside of valid range")
+
+    # Ensure that passed arrays are contiguous in memory
+    cdef double[:, ::1] lon_c = np.ascontiguousarray(lon)
+    cdef double[:, ::1] lat_c = np.ascontiguousarray(lat)
+    cdef float[:, ::1] elevation_c \
+        = np.ascontiguousarray(elevation, dtype=np.float32)
+
+    # Allocate vertex buffers
+    cdef int dim_0 = lon.shape[0]
+    cdef int dim_1 = lon.shape[1]
+    cdef size_t num_vert_in = (<size_t>(dim_0 - 2 * offset_px)
+                               * (dim_1 - 2 * offset_px))
+    cdef float[::1] vert_grid \
+        = np.empty(vertex_buffer_size(<size_t>dim_0 * dim_1),
+                   dtype=np.float32)
+    cdef float[::1] vert_grid_in = None
+    cdef float* vert_grid_in_ptr = NULL
+    if inner:
+        vert_grid_in = np.empty(vertex_buffer_size(num_vert_in),
+                                dtype=np.float32)
+        vert_grid_in_ptr = &vert_grid_in[0]
+
+    cdef double lon_or = trans_lonlat2enu.lon_or
+    cdef double lat_or = trans_lonlat2enu.lat_or
+    cdef double radius_earth = trans_lonlat2enu.radius_earth
+    cdef double value_abs_max
+    with nogil:
+        value_abs_max = c_dem_vertices(
+            &lon_c[0, 0], &lat_c[0, 0], &elevation_c[0, 0], dim_0, dim_1,
+            offset_px, lon_or, lat_or, radius_earth, &vert_grid[0],
+            vert_grid_in_ptr)
+
+    if not inner:
+        return np.asarray(vert_grid), None, value_abs_max
+    return np.asarray(vert_grid), np.asarray(vert_grid_in), value_abs_max
+
+
 # -----------------------------------------------------------------------------
 
 class TransformerLonlat2enu:
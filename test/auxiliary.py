@@ -0,0 +1,79 @@
+# Description: Test partitioning of grid cell rows (MPI processing scripts)
+#
+# Copyright (c) 2023 ETH Zurich, Christian R. Steger
+# MIT License
+
+# Load modules
+import numpy as np
+from subgrid_radiation import auxiliary
+
+# -----------------------------------------------------------------------------
+# Partitions cover all grid cell rows exactly once
+# -----------------------------------------------------------------------------
+
+np.random.seed(2)
+for num_rows in (1, 2, 7, 50, 333):
+    masks = [np.ones((num_rows, 40), dtype=np.uint8),
+             np.zeros((num_rows, 40), dtype=np.uint8),
+             (np.random.random((num_rows, 40)) < 0.3).astype(np.uint8)]
+    mask = np.zeros((num_rows, 40), dtype=np.uint8)
+    mask[:(num_rows // 4 + 1), :] = 1  # active cells only in north
+    masks.append(mask)
+    for mask in masks:
+        for num_parts in np.unique([1, 2, 3, 8, num_rows]):
+            if num_parts > num_rows:
+                continue
+            bands = auxiliary.partition_rows(mask, num_parts)
+            assert len(bands) == num_parts
+            rows = np.concatenate([np.arange(*i) for i in bands])
+            assert np.array_equal(rows, np.arange(num_rows))
+            assert all((row_end - row_beg) >= 1
+                       for (row_beg, row_end) in bands)
+print("Partitions of grid cell rows are complete and disjoint")
+
+# Active grid cells are balanced
+mask = np.ones((200, 40), dtype=np.uint8)
+bands = auxiliary.partition_rows(mask, 4)
+num_active = [mask[i:j, :].sum() for (i, j) in bands]
+print("Active grid cells per band: " + str(num_active))
+assert (max(num_active) - min(num_active)) <= mask.shape[1]
+
+# Invalid number of bands
+for num_parts in (0, mask.shape[0] + 1):
+    try:
+        auxiliary.partition_rows(mask, num_parts)
+        raise AssertionError("invalid number of bands accepted")
+    except ValueError:
+        pass
+
+# -----------------------------------------------------------------------------
+# Halo slices of DEM rows
+# -----------------------------------------------------------------------------
+
+num_rows = 23  # grid cell rows of inner domain
+pixel_per_gc = 5
+offset_gc = 3
+dem_dim_0 = (num_rows + 2 * offset_gc) * pixel_per_gc + 1
+dem_rows = np.arange(dem_dim_0)  # row indices of DEM with halo
+dem_rows_in = dem_rows[(offset_gc * pixel_per_gc):
+                       (dem_dim_0 - offset_gc * pixel_per_gc)]
+for num_parts in (1, 2, 5, num_rows):
+    mask = np.ones((num_rows, 10), dtype=np.uint8)
+    bands = auxiliary.partition_rows(mask, num_parts)
+    rows_in = []
+    for (row_beg, row_end) in bands:
+        slice_dem, slice_dem_in = auxiliary.dem_row_slices(
+            row_beg, row_end, pixel_per_gc, offset_gc)
+        rows_dem = dem_rows[slice_dem]
+        rows_dem_in = dem_rows[slice_dem_in]
+        # inner rows: vertices of band's grid cells (edges included)
+        assert rows_dem_in[0] == (row_beg + offset_gc) * pixel_per_gc
+        assert len(rows_dem_in) == (row_end - row_beg) * pixel_per_gc + 1
+        # halo of 'offset_gc' grid cells on both sides
+        assert rows_dem[0] == rows_dem_in[0] - offset_gc * pixel_per_gc
+        assert rows_dem[-1] == rows_dem_in[-1] + offset_gc * pixel_per_gc
+        assert rows_dem[-1] < dem_dim_0
+        rows_in.append(rows_dem_in[:-1])  # shared edge row counted once
+    rows_in.append(dem_rows_in[-1:])
+    assert np.array_equal(np.concatenate(rows_in), dem_rows_in)
+print("DEM row slices with halo are correct")
@@ -19,6 +19,7 @@ from netCDF4 import Dataset
 import time
 from subgrid_radiation import transform, auxiliary
 from subgrid_radiation import sun_position
+from subgrid_radiation.sun_position_array import horizon
 from utilities.grid import grid_frame
 from utilities.plot import truncate_colormap
 
@@ -192,6 +193,19 @@ print((" Default: ").center(79, "-"))
 terrain.sw_dir_cor(sun_pos, sw_dir_cor, refrac_cor=False)
 print("Number of NaN-values: " + str(np.isnan(sw_dir_cor).sum()))
 sw_dir_cor_def = sw_dir_cor.copy()
+print((" Without geometry cache: ").center(79, "-"))
+terrain_nc = sun_position.Terrain()
+terrain_nc.initialise(
+    vert_grid, dem_dim_0, dem_dim_1,
+    vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+    pixel_per_gc, offset_gc, mask, dist_search=dist_search,
+    geom_type=geom_type, ang_max=ang_max,
+    sw_dir_cor_max=sw_dir_cor_max, geom_cache=False)
+terrain_nc.sw_dir_cor(sun_pos, sw_dir_cor, refrac_cor=False)
+print("Identical to cached geometry: "
+      + str(np.array_equal(sw_dir_cor, sw_dir_cor_def, equal_nan=True)))
+assert np.array_equal(sw_dir_cor, sw_dir_cor_def, equal_nan=True)
+del terrain_nc
 print((" Coherent rays: ").center(79, "-"))
 terrain.sw_dir_cor_coherent(sun_pos, sw_dir_cor)
 print("Number of NaN-values: " + str(np.isnan(sw_dir_cor).sum()))
@@ -202,6 +216,85 @@ terrain.sw_dir_cor_coherent_rp8(sun_pos, sw_dir_cor)
 print("Number of NaN-values: " + str(np.isnan(sw_dir_cor).sum()))
 print("Maximal absolute deviation: %.6f"
       % np.nanmax(np.abs(sw_dir_cor - sw_dir_cor_def)))
+print((" Atmospheric refraction (lookup table vs. exact): ").center(79, "-"))
+terrain.sw_dir_cor(sun_pos, sw_dir_cor, refrac_cor="exact")
+sw_dir_cor_refrac = sw_dir_cor.copy()
+terrain.sw_dir_cor(sun_pos, sw_dir_cor, refrac_cor="table")
+print("Maximal absolute deviation: %.6f"
+      % np.nanmax(np.abs(sw_dir_cor - sw_dir_cor_refrac)))
+
+# Horizon cache (no ray tracing for individual sun positions)
+terrain.build_horizon_cache(hori_azim_num=360, hori_acc=0.1,
+                            ray_algorithm="binary_search")
+terrain.save_horizon_cache(path_work + "horizon_cache.bin")
+terrain.load_horizon_cache(path_work + "horizon_cache.bin")  # memory-mapped
+
+# Round trip of horizon file
+hori_data, mask_file, scale, offset \
+    = horizon.read_horizon_file(path_work + "horizon_cache.bin")
+print((" Horizon file: ").center(79, "-"))
+print("Shape of data: " + str(hori_data.shape) + ", data type: "
+      + str(hori_data.dtype))
+assert hori_data.shape == (mask.shape + (pixel_per_gc * pixel_per_gc * 2,
+                                         360 + 2))
+assert np.array_equal(mask_file, mask)
+data_act = hori_data[mask == 1].astype(np.float64) * scale + offset
+assert np.all(data_act[:, :, 0] <= data_act[:, :, 2:].min(axis=2))
+assert np.all(data_act[:, :, 1] >= data_act[:, :, 2:].max(axis=2))
+assert np.all(hori_data[mask == 0] == 0)
+del hori_data, mask_file
+
+# Files with wrong version or size are rejected
+with open(path_work + "horizon_cache.bin", "rb") as f:
+    hori_bytes = f.read()
+hori_bytes_corrupt = {
+    "version": hori_bytes[:8] + np.int32(2).tobytes() + hori_bytes[12:],
+    "truncated": hori_bytes[:-1],
+    "header": hori_bytes[:60]}
+for i in hori_bytes_corrupt.keys():
+    with open(path_work + "horizon_cache_corrupt.bin", "wb") as f:
+        f.write(hori_bytes_corrupt[i])
+    for func in (horizon.read_horizon_file, terrain.load_horizon_cache):
+        try:
+            func(path_work + "horizon_cache_corrupt.bin")
+            raise AssertionError("horizon file with wrong " + i
+                                 + " accepted")
+        except ValueError:
+            pass
+os.remove(path_work + "horizon_cache_corrupt.bin")
+print("Horizon files with wrong version or size are rejected")
+print((" Horizon cache: ").center(79, "-"))
+terrain.sw_dir_cor_horizon(sun_pos, sw_dir_cor)
+print("Number of NaN-values: " + str(np.isnan(sw_dir_cor).sum()))
+print("Maximal absolute deviation: %.6f"
+      % np.nanmax(np.abs(sw_dir_cor - sw_dir_cor_def)))
+print((" Incremental (traces not provably lit triangles): ")
+      .center(79, "-"))
+# sun track with 1-minute time steps (subsolar longitude: 0.25 degree);
+# results must be identical to 'sw_dir_cor' for every step
+terrain.reset_incremental()
+sw_dir_cor_ref = np.empty_like(sw_dir_cor)
+for i in range(30):
+    x_ecef, y_ecef, z_ecef \
+        = transform.lonlat2ecef(subsol_lon - 0.25 * i, subsol_lat,
+                                subsol_dist, trans_lonlat2enu)
+    x_enu, y_enu, z_enu = transform.ecef2enu(x_ecef, y_ecef, z_ecef,
+                                             trans_lonlat2enu)
+    sun_pos_step = np.array([x_enu[0], y_enu[0], z_enu[0]])
+    num_rays_ref = terrain.sw_dir_cor(sun_pos_step, sw_dir_cor_ref)
+    num_rays = terrain.sw_dir_cor_incremental(sun_pos_step, sw_dir_cor)
+    num_dev = (~((sw_dir_cor == sw_dir_cor_ref)
+                 | (np.isnan(sw_dir_cor) & np.isnan(sw_dir_cor_ref)))).sum()
+    print("Step %2d: " % i + "rays traced: %d" % num_rays
+          + " (%d" % num_rays_ref + " without bounds), deviating grid "
+          + "cells: %d" % num_dev)
+    assert num_rays <= num_rays_ref
+    assert np.array_equal(sw_dir_cor, sw_dir_cor_ref, equal_nan=True)
+print((" Incremental (other number of azimuth sectors): ").center(79, "-"))
+num_rays = terrain.sw_dir_cor_incremental(sun_pos, sw_dir_cor,
+                                          hori_azim_num=16)
+print("Number of rays traced: " + str(num_rays))
+assert np.array_equal(sw_dir_cor, sw_dir_cor_def, equal_nan=True)
 
 # Check output
 print("Range of 'sw_dir_cor'-values: [%.2f" % np.nanmin(sw_dir_cor)
@@ -245,6 +338,29 @@ for ind_i, i in enumerate(subsol_lat_1d):
         sw_dir_cor_arr[:, :, ind_i, ind_j] = sw_dir_cor
 print("Elapsed time: " + "%.2f" % (time.time() - t_beg) + " sec")
 
+# Compute correction factors for all sun positions in one batch
+subsol_lon_2d, subsol_lat_2d = np.meshgrid(subsol_lon_1d, subsol_lat_1d)
+subsol_dist_2d = np.empty(subsol_lon_2d.shape, dtype=np.float64)
+subsol_dist_2d[:] = Distance(au=1).m
+x_ecef, y_ecef, z_ecef \
+    = transform.lonlat2ecef(subsol_lon_2d, subsol_lat_2d, subsol_dist_2d,
+                            trans_lonlat2enu)
+x_enu, y_enu, z_enu = transform.ecef2enu(x_ecef, y_ecef, z_ecef,
+                                         trans_lonlat2enu)
+sun_pos_batch = np.stack((x_enu.ravel(), y_enu.ravel(), z_enu.ravel()),
+                         axis=1)
+sw_dir_cor_batch = np.empty((sun_pos_batch.shape[0],) + sw_dir_cor.shape,
+                            dtype=np.float32)
+t_beg = time.time()
+terrain.sw_dir_cor_batch(sun_pos_batch, sw_dir_cor_batch)
+print("Elapsed time (batch): " + "%.2f" % (time.time() - t_beg) + " sec")
+sw_dir_cor_batch = sw_dir_cor_batch.reshape(subsol_lat_1d.size,
+                                            subsol_lon_1d.size,
+                                            *sw_dir_cor.shape)
+print("Maximal absolute deviation (batch): %.6f"
+      % np.nanmax(np.abs(sw_dir_cor_batch.transpose(2, 3, 0, 1)
+                         - sw_dir_cor_arr)))
+
 # Compare result with output from 'subsolar_lookup'
 ds = xr.open_dataset(path_work + "SW_dir_cor_lookup.nc")
 ind_beg = np.where(subsol_lon_1d == ds["subsolar_lon"].values[0])[0][0]
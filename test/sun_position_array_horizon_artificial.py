@@ -7,6 +7,7 @@
 # MIT License
 
 # Load modules
+import time
 import numpy as np
 import matplotlib.pyplot as plt
 import matplotlib as mpl
@@ -121,6 +122,10 @@ mask = np.ones((num_gc_y, num_gc_x), dtype=np.uint8)
 # Compute spatially aggregated correction factors
 # -----------------------------------------------------------------------------
 
+# Build scene once (BVH is reused by both computations below)
+scene = sun_position_array.rays.Scene()
+scene.initialise(vert_grid, dem_dim_0, dem_dim_1, geom_type=geom_type)
+
 # Compute sky view factor
 sky_view_factor, area_increase_factor, sky_view_area_factor \
     = sun_position_array.horizon.sky_view_factor(
@@ -129,7 +134,114 @@ sky_view_factor, area_increase_factor, sky_view_area_factor \
         pixel_per_gc, offset_gc,
         mask=mask, dist_search=dist_search, hori_azim_num=hori_azim_num,
         hori_acc=hori_acc, ray_algorithm=ray_algorithm,
-        elev_ang_low_lim=elev_ang_low_lim, geom_type=geom_type)
+        elev_ang_low_lim=elev_ang_low_lim, geom_type=geom_type,
+        scene=scene)
+sky_view_factor_f32 = sun_position_array.horizon.sky_view_factor(
+    vert_grid, dem_dim_0, dem_dim_1,
+    vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+    pixel_per_gc, offset_gc,
+    mask=mask, dist_search=dist_search, hori_azim_num=hori_azim_num,
+    hori_acc=hori_acc, ray_algorithm=ray_algorithm,
+    elev_ang_low_lim=elev_ang_low_lim, geom_type=geom_type,
+    scene=scene, precision="float32")[0]
+print("Maximal absolute deviation: %.6f"
+      % np.nanmax(np.abs(sky_view_factor_f32 - sky_view_factor)))
+
+# Compare kernel specialisations for packets of 4/8/16 rays (results must be
+# identical to 'binary_search')
+print(len(sun_position_array.horizon.kernel_variants()),
+      "kernel specialisations")
+sky_view_factor_alg = {}
+for i in ("binary_search", "binary_search_packet4", "binary_search_packet",
+          "binary_search_packet16"):
+    t_beg = time.perf_counter()
+    sky_view_factor_alg[i] = sun_position_array.horizon.sky_view_factor(
+        vert_grid, dem_dim_0, dem_dim_1,
+        vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+        pixel_per_gc, offset_gc,
+        mask=mask, dist_search=dist_search, hori_azim_num=hori_azim_num,
+        hori_acc=hori_acc, ray_algorithm=i,
+        elev_ang_low_lim=elev_ang_low_lim, geom_type=geom_type,
+        scene=scene)[0]
+    print(i + ": %.3f s" % (time.perf_counter() - t_beg)
+          + ", maximal absolute deviation: %.6f"
+          % np.nanmax(np.abs(sky_view_factor_alg[i]
+                             - sky_view_factor_alg["binary_search"])))
+
+# Scheduling over active grid cells (compacted list with grain size, order
+# of decreasing cost estimate) -> results must be identical to default
+for grain_size, cost_order in ((4, True), (16, False)):
+    sky_view_factor_sched = sun_position_array.horizon.sky_view_factor(
+        vert_grid, dem_dim_0, dem_dim_1,
+        vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+        pixel_per_gc, offset_gc,
+        mask=mask, dist_search=dist_search, hori_azim_num=hori_azim_num,
+        hori_acc=hori_acc, ray_algorithm=ray_algorithm,
+        elev_ang_low_lim=elev_ang_low_lim, geom_type=geom_type,
+        scene=scene, grain_size=grain_size, cost_order=cost_order)[0]
+    print("Scheduling (grain_size=%d" % grain_size
+          + ", cost_order=%s): " % cost_order + "maximal absolute deviation "
+          + "from default: %.6f" % np.nanmax(np.abs(sky_view_factor_sched
+                                                    - sky_view_factor)))
+    assert np.array_equal(sky_view_factor_sched, sky_view_factor,
+                          equal_nan=True)
+
+# Near-/far-field horizon (full-resolution DEM up to 'dist_near', coarse DEM
+# with maximal elevations beyond): the coarse terrain lies above the fine
+# terrain -> horizon is rather over- than underestimated, sky view factor
+# must not exceed the full-resolution value by more than the accuracy of the
+# horizon detection
+for dist_near, coarse_fac in ((10.0, 2), (10.0, 4), (25.0, 8)):
+    t_beg = time.perf_counter()
+    sky_view_factor_nf = sun_position_array.horizon.sky_view_factor(
+        vert_grid, dem_dim_0, dem_dim_1,
+        vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+        pixel_per_gc, offset_gc,
+        mask=mask, dist_search=dist_search, hori_azim_num=hori_azim_num,
+        hori_acc=hori_acc, ray_algorithm="binary_search",
+        elev_ang_low_lim=elev_ang_low_lim, geom_type=geom_type,
+        scene=scene, dist_near=dist_near, coarse_fac=coarse_fac)[0]
+    dev = sky_view_factor_nf - sky_view_factor_alg["binary_search"]
+    print("Near/far field (dist_near: %.1f km" % dist_near
+          + ", coarse_fac: %d): " % coarse_fac
+          + "%.3f s" % (time.perf_counter() - t_beg)
+          + ", deviation (min/max/mean): %.6f" % np.nanmin(dev)
+          + ", %.6f" % np.nanmax(dev) + ", %.6f" % np.nanmean(dev))
+    assert np.nanmax(dev) < 0.02
+    assert np.nanmean(np.abs(dev)) < 0.01
+
+# Adaptive subsampling: without tolerance, all triangles are traced (stride
+# 1) -> identical to 'sky_view_factor' up to round-off of the aggregation;
+# with tolerance, the returned standard error must bound the actual
+# deviation (three standard errors; exact for grid cells with error 0.0)
+for err_tol in (0.0, 0.005, 0.02):
+    sky_view_factor_ad, area_increase_factor_ad, sky_view_area_factor_ad, \
+        sky_view_factor_err \
+        = sun_position_array.horizon.sky_view_factor_adaptive(
+            vert_grid, dem_dim_0, dem_dim_1,
+            vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+            pixel_per_gc, offset_gc,
+            mask=mask, dist_search=dist_search, hori_azim_num=hori_azim_num,
+            hori_acc=hori_acc, ray_algorithm=ray_algorithm,
+            elev_ang_low_lim=elev_ang_low_lim, geom_type=geom_type,
+            scene=scene, err_tol=err_tol)
+    dev = np.maximum(np.abs(sky_view_factor_ad - sky_view_factor),
+                     np.abs(sky_view_area_factor_ad - sky_view_area_factor))
+    exceed = dev > (3.0 * sky_view_factor_err + 1e-6)
+    print("Adaptive subsampling (err_tol=%.3f): " % err_tol
+          + "%.1f %% of grid cells subsampled"
+          % ((sky_view_factor_err > 0.0).mean() * 100.0)
+          + ", maximal absolute deviation: %.6f" % np.nanmax(dev)
+          + ", deviation exceeds 3 standard errors in %d" % exceed.sum()
+          + " of %d grid cells" % exceed.size)
+    assert np.nanmax(np.abs(area_increase_factor_ad
+                            - area_increase_factor)) < 1e-6
+    if err_tol == 0.0:
+        assert np.all(sky_view_factor_err == 0.0)
+        assert np.nanmax(dev) < 1e-6
+    assert np.all(sky_view_factor_err <= err_tol)
+    assert np.all(dev[sky_view_factor_err == 0.0] < 1e-6)
+    assert exceed.mean() <= 0.01
 
 # Compute sky view factor and SW_dir correction factor
 sw_dir_cor, sky_view_factor, area_increase_factor, sky_view_area_factor \
@@ -140,7 +252,62 @@ sw_dir_cor, sky_view_factor, area_increase_factor, sky_view_area_factor \
         mask=mask, dist_search=dist_search, hori_azim_num=hori_azim_num,
         hori_acc=hori_acc, ray_algorithm=ray_algorithm,
         elev_ang_low_lim=elev_ang_low_lim, geom_type=geom_type,
-        ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max)
+        ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max, scene=scene)
+
+# Stream lookup table in blocks of grid cell rows (results must be identical)
+sw_dir_cor_stream = np.empty_like(sw_dir_cor)
+
+
+def row_callback(row_beg, sw_dir_cor_rows):
+    sw_dir_cor_stream[row_beg:(row_beg + sw_dir_cor_rows.shape[0])] \
+        = sw_dir_cor_rows
+
+
+out_stream = sun_position_array.horizon.sky_view_factor_sw_dir_cor(
+    vert_grid, dem_dim_0, dem_dim_1,
+    vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+    sun_pos, pixel_per_gc, offset_gc,
+    mask=mask, dist_search=dist_search, hori_azim_num=hori_azim_num,
+    hori_acc=hori_acc, ray_algorithm=ray_algorithm,
+    elev_ang_low_lim=elev_ang_low_lim, geom_type=geom_type,
+    ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max, scene=scene,
+    row_callback=row_callback, block_rows=7)
+assert out_stream[0] is None
+assert np.array_equal(sw_dir_cor_stream, sw_dir_cor, equal_nan=True)
+assert np.array_equal(out_stream[1], sky_view_factor, equal_nan=True)
+
+# Compare heightfield (quadtree without Embree BVH) with grid geometry (same
+# triangles -> deviations only from single precision intersection tests)
+scene_hf = sun_position_array.rays.Scene()
+scene_hf.initialise(vert_grid, dem_dim_0, dem_dim_1, geom_type="heightfield")
+sw_dir_cor_hf, sky_view_factor_hf = \
+    sun_position_array.horizon.sky_view_factor_sw_dir_cor(
+        vert_grid, dem_dim_0, dem_dim_1,
+        vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+        sun_pos, pixel_per_gc, offset_gc,
+        mask=mask, dist_search=dist_search, hori_azim_num=hori_azim_num,
+        hori_acc=hori_acc, ray_algorithm=ray_algorithm,
+        elev_ang_low_lim=elev_ang_low_lim,
+        ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max, scene=scene_hf)[:2]
+sw_dir_cor_rays_grid, sw_dir_cor_rays_hf = [
+    sun_position_array.rays.sw_dir_cor(
+        vert_grid, dem_dim_0, dem_dim_1,
+        vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+        sun_pos, pixel_per_gc, offset_gc,
+        mask=mask, dist_search=dist_search, ang_max=ang_max,
+        sw_dir_cor_max=sw_dir_cor_max, scene=i) for i in (scene, scene_hf)]
+dev = {"sky_view_factor": np.abs(sky_view_factor_hf - sky_view_factor),
+       "sw_dir_cor (horizon)": np.abs(sw_dir_cor_hf - sw_dir_cor),
+       "sw_dir_cor (rays)": np.abs(sw_dir_cor_rays_hf
+                                   - sw_dir_cor_rays_grid)}
+for i in dev.keys():
+    print("Heightfield vs. grid, " + i + ": %d of %d"
+          % ((dev[i] > 1e-5).sum(), dev[i].size) + " values differ "
+          + "(maximal/mean absolute deviation: %.6f"
+          % np.nanmax(dev[i]) + ", %.6f)" % np.nanmean(dev[i]))
+assert np.nanmax(dev["sky_view_factor"]) < 0.01
+assert np.nanmean(dev["sw_dir_cor (horizon)"]) < 0.01
+assert np.nanmean(dev["sw_dir_cor (rays)"]) < 0.01
 
 # Test plot for sky view factor related quantities
 data_2d = {"sky_view_factor": sky_view_factor,
@@ -7,6 +7,7 @@
 
 # Load modules
 import os
+import time
 import numpy as np
 import xarray as xr
 import cartopy.crs as ccrs
@@ -222,6 +223,39 @@ sw_dir_cor_coh_rp8 = sun_position_array.rays.sw_dir_cor_coherent_rp8(
     ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max)
 print("Maximal absolute deviation: %.6f"
       % np.nanmax(np.abs(sw_dir_cor_coh_rp8 - sw_dir_cor_def)))
+sw_dir_cor_stream = sun_position_array.rays.sw_dir_cor_stream(
+    vert_grid, dem_dim_0, dem_dim_1,
+    vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+    sun_pos, pixel_per_gc, offset_gc, mask,
+    dist_search=dist_search, geom_type=geom_type,
+    ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max)
+print("Maximal absolute deviation: %.6f"
+      % np.nanmax(np.abs(sw_dir_cor_stream - sw_dir_cor_def)))
+sw_dir_cor_f32 = sun_position_array.rays.sw_dir_cor(
+    vert_grid, dem_dim_0, dem_dim_1,
+    vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+    sun_pos, pixel_per_gc, offset_gc, mask,
+    dist_search=dist_search, geom_type=geom_type,
+    ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max, precision="float32")
+print("Maximal absolute deviation: %.6f"
+      % np.nanmax(np.abs(sw_dir_cor_f32 - sw_dir_cor_def)))
+
+# Horizontal triangles computed analytically (radial projection onto sphere
+# with 'radius_earth'): same vertices as 'vert_grid_in' (0.0 m surface of
+# spherical Earth) up to single precision round-off of the latter
+sw_dir_cor_ana = sun_position_array.rays.sw_dir_cor(
+    vert_grid, dem_dim_0, dem_dim_1,
+    None, dem_dim_in_0, dem_dim_in_1,
+    sun_pos, pixel_per_gc, offset_gc, mask,
+    dist_search=dist_search, geom_type=geom_type,
+    ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max,
+    radius_earth=radius_earth)
+dev = np.abs(sw_dir_cor_ana - sw_dir_cor_def)
+print("Analytical horizontal triangles: maximal/mean absolute deviation: "
+      + "%.6f" % np.nanmax(dev) + ", %.6f" % np.nanmean(dev))
+assert np.array_equal(np.isnan(sw_dir_cor_ana), np.isnan(sw_dir_cor_def))
+assert np.nanmean(dev) < 1e-4
+assert np.nanpercentile(dev, 99.9) < 1e-3
 sw_dir_cor = sw_dir_cor_coh_rp8  # select output that is further considered
 
 # Check output
@@ -295,3 +329,50 @@ ncfile.close()
 ds = xr.open_dataset(path_work + "SW_dir_cor_lookup.nc")
 f_cor = ds["f_cor"].values
 ds.close()
+
+# -----------------------------------------------------------------------------
+# Evaluate lookup table for arbitrary subsolar points (no ray tracing)
+# -----------------------------------------------------------------------------
+
+# Memory-mappable copy of lookup table (encoded)
+sun_position_array.rays.save_lookup_table(
+    path_work + "SW_dir_cor_lookup.lut",
+    sun_position_array.rays.encode_sw_dir_cor(sw_dir_cor, "uint16",
+                                              sw_dir_cor_max),
+    subsol_lat, subsol_lon, sw_dir_cor_max=sw_dir_cor_max)
+lut = sun_position_array.rays.LookupTable(path_work + "SW_dir_cor_lookup.lut")
+
+# Nodes of lookup table (deviation: encoding)
+sw_dir_cor_lut = lut.sw_dir_cor(subsol_lat_2d.ravel(), subsol_lon_2d.ravel())
+print("Maximal absolute deviation (nodes): %.6f"
+      % np.nanmax(np.abs(sw_dir_cor_lut.reshape(subsol_lat.size,
+                                                subsol_lon.size,
+                                                num_gc_y, num_gc_x)
+                         - sw_dir_cor.transpose(2, 3, 0, 1))))
+
+# Random subsolar points (deviation: interpolation)
+num_sun = 100
+subsol_lat_rand = np.random.uniform(-23.5, 23.5, num_sun)
+subsol_lon_rand = np.random.uniform(-180.0, 180.0, num_sun)
+t_beg = time.perf_counter()
+sw_dir_cor_lut = lut.sw_dir_cor(subsol_lat_rand, subsol_lon_rand)
+print("Evaluation of lookup table: %.4f" % (time.perf_counter() - t_beg)
+      + " s")
+x_ecef, y_ecef, z_ecef \
+    = transform.lonlat2ecef(subsol_lon_rand, subsol_lat_rand,
+                            np.full(num_sun, Distance(au=1).m),
+                            trans_lonlat2enu)
+x_enu, y_enu, z_enu = transform.ecef2enu(x_ecef, y_ecef, z_ecef,
+                                         trans_lonlat2enu)
+sun_pos_rand = np.stack((x_enu, y_enu, z_enu), axis=1)[np.newaxis, :, :]
+t_beg = time.perf_counter()
+sw_dir_cor_rand = sun_position_array.rays.sw_dir_cor(
+    vert_grid, dem_dim_0, dem_dim_1,
+    vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+    np.ascontiguousarray(sun_pos_rand), pixel_per_gc, offset_gc, mask,
+    dist_search=dist_search, geom_type=geom_type,
+    ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max)
+print("Ray tracing: %.4f" % (time.perf_counter() - t_beg) + " s")
+print("Mean absolute deviation (interpolation): %.6f"
+      % np.nanmean(np.abs(sw_dir_cor_lut
+                          - sw_dir_cor_rand[:, :, 0, :].transpose(2, 0, 1))))
@@ -144,3 +144,148 @@ if plot:
 
 # Save correction factors
 np.save(path_work + "SW_dir_cor_artifical_rays.npy", sw_dir_cor)
+
+# -----------------------------------------------------------------------------
+# Compare classification with horizon bounds with reference
+# -----------------------------------------------------------------------------
+
+# Reference (all sun positions ray traced)
+sw_dir_cor_ref = rays.sw_dir_cor(
+    vert_grid, dem_dim_0, dem_dim_1,
+    vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+    sun_pos, pixel_per_gc, offset_gc,
+    mask=mask, dist_search=dist_search, geom_type=geom_type,
+    ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max)
+
+# Guaranteed upper horizon bound (-> identical) and additional approximate
+# lower horizon bound
+for approx_shadow in (False, True):
+    sw_dir_cor_hb = rays.sw_dir_cor_hori_bound(
+        vert_grid, dem_dim_0, dem_dim_1,
+        vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+        sun_pos, pixel_per_gc, offset_gc,
+        mask=mask, dist_search=dist_search, geom_type=geom_type,
+        ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max,
+        approx_shadow=approx_shadow)
+    mismatch = np.abs(sw_dir_cor_hb - sw_dir_cor_ref) > 1e-5
+    print("Horizon bounds (approx_shadow=%s): " % approx_shadow
+          + "%d of %d" % (mismatch.sum(), mismatch.size)
+          + " values differ from 'sw_dir_cor' (maximal absolute deviation: "
+          + "%.5f)" % np.nanmax(np.abs(sw_dir_cor_hb - sw_dir_cor_ref)))
+    if not approx_shadow:
+        assert mismatch.sum() == 0
+
+# -----------------------------------------------------------------------------
+# Compare scheduling over active grid cells with default
+# -----------------------------------------------------------------------------
+
+# Mask with unevenly distributed active grid cells (every third row and
+# right part of every second row masked); grid cells are computed
+# independently -> results must be identical for any schedule
+mask_sched = mask.copy()
+mask_sched[::3, :] = 0
+mask_sched[1::2, (num_gc_x // 2):] = 0
+for func in (rays.sw_dir_cor, rays.sw_dir_cor_coherent_rp8):
+    sw_dir_cor_sched = {}
+    for grain_size, cost_order in ((1, False), (4, True), (16, False)):
+        sw_dir_cor_sched[(grain_size, cost_order)] = func(
+            vert_grid, dem_dim_0, dem_dim_1,
+            vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+            sun_pos, pixel_per_gc, offset_gc,
+            mask=mask_sched, dist_search=dist_search, geom_type=geom_type,
+            ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max,
+            grain_size=grain_size, cost_order=cost_order)
+    for i in ((4, True), (16, False)):
+        print(func.__name__ + " (grain_size=%d" % i[0]
+              + ", cost_order=%s): " % i[1] + "maximal absolute deviation "
+              + "from default: %.6f" % np.nanmax(np.abs(
+                  sw_dir_cor_sched[i] - sw_dir_cor_sched[(1, False)])))
+        assert np.array_equal(sw_dir_cor_sched[i],
+                               sw_dir_cor_sched[(1, False)], equal_nan=True)
+    assert np.all(np.isnan(sw_dir_cor_sched[(1, False)][mask_sched == 0]))
+
+# -----------------------------------------------------------------------------
+# Compare adaptive subsampling with reference
+# -----------------------------------------------------------------------------
+
+# Without tolerance, all triangles are traced (stride 1) -> identical to
+# reference up to single precision round-off of the aggregation
+sw_dir_cor_ad, sw_dir_cor_err = rays.sw_dir_cor_adaptive(
+    vert_grid, dem_dim_0, dem_dim_1,
+    vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+    sun_pos, pixel_per_gc, offset_gc,
+    mask=mask, dist_search=dist_search, geom_type=geom_type,
+    ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max, err_tol=0.0)
+print("Adaptive subsampling (err_tol=0.0): maximal absolute deviation: "
+      + "%.6f" % np.nanmax(np.abs(sw_dir_cor_ad - sw_dir_cor_ref)))
+assert np.all(sw_dir_cor_err == 0.0)
+assert np.nanmax(np.abs(sw_dir_cor_ad - sw_dir_cor_ref)) < 1e-5
+
+# With tolerance, the returned standard error must bound the actual
+# deviation (three standard errors; exact for grid cells with error 0.0)
+for err_tol in (0.01, 0.05):
+    sw_dir_cor_ad, sw_dir_cor_err = rays.sw_dir_cor_adaptive(
+        vert_grid, dem_dim_0, dem_dim_1,
+        vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+        sun_pos, pixel_per_gc, offset_gc,
+        mask=mask, dist_search=dist_search, geom_type=geom_type,
+        ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max, err_tol=err_tol)
+    dev = np.nanmax(np.abs(sw_dir_cor_ad - sw_dir_cor_ref), axis=(2, 3))
+    exceed = dev > (3.0 * sw_dir_cor_err + 1e-5)
+    print("Adaptive subsampling (err_tol=%.2f): " % err_tol
+          + "%.1f %% of grid cells subsampled"
+          % ((sw_dir_cor_err > 0.0).mean() * 100.0)
+          + ", maximal absolute deviation: %.5f" % dev.max()
+          + ", deviation exceeds 3 standard errors in %d" % exceed.sum()
+          + " of %d grid cells" % exceed.size)
+    assert np.all(sw_dir_cor_err <= err_tol)
+    assert np.all(dev[sw_dir_cor_err == 0.0] < 1e-5)
+    assert exceed.mean() <= 0.01
+
+# -----------------------------------------------------------------------------
+# Compare tile-wise (out-of-core) computation with reference
+# -----------------------------------------------------------------------------
+
+# Search distance equal to width of halo (offset_gc * pixel_per_gc * 100 m)
+# -> terrain outside of tiles is out of reach and results must be identical
+dist_search_tile = 10.0  # [kilometre]
+sw_dir_cor_ref = rays.sw_dir_cor(
+    vert_grid, dem_dim_0, dem_dim_1,
+    vert_grid_in, dem_dim_in_0, dem_dim_in_1,
+    sun_pos, pixel_per_gc, offset_gc,
+    mask=mask, dist_search=dist_search_tile, geom_type=geom_type,
+    ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max)
+tiles_loaded = []
+
+
+def tile_loader(gc_y_beg, gc_y_end, gc_x_beg, gc_x_end):
+    tiles_loaded.append((gc_y_beg, gc_y_end, gc_x_beg, gc_x_end))
+    slice_tile = (slice(gc_y_beg * pixel_per_gc,
+                        (gc_y_end + 2 * offset_gc) * pixel_per_gc + 1),
+                  slice(gc_x_beg * pixel_per_gc,
+                        (gc_x_end + 2 * offset_gc) * pixel_per_gc + 1))
+    slice_tile_in = (slice((gc_y_beg + offset_gc) * pixel_per_gc,
+                           (gc_y_end + offset_gc) * pixel_per_gc + 1),
+                     slice((gc_x_beg + offset_gc) * pixel_per_gc,
+                           (gc_x_end + offset_gc) * pixel_per_gc + 1))
+    vert_grid_tile = auxiliary.rearrange_pad_buffer(
+        x[slice_tile], y[slice_tile], z[slice_tile])
+    vert_grid_tile_in = auxiliary.rearrange_pad_buffer(
+        x[slice_tile_in], y[slice_tile_in], z_zero[slice_tile_in])
+    return vert_grid_tile, vert_grid_tile_in, sun_pos
+
+
+# Memory budget of ~30 MB -> several tiles (~180 MB for entire domain)
+sw_dir_cor_tiled = rays.sw_dir_cor_tiled(
+    tile_loader, num_gc_y, num_gc_x, sun_pos.shape[0], sun_pos.shape[1],
+    pixel_per_gc, offset_gc, mask=mask, dist_search=dist_search_tile,
+    geom_type=geom_type, ang_max=ang_max, sw_dir_cor_max=sw_dir_cor_max,
+    mem_budget=0.03)
+dev = np.abs(sw_dir_cor_tiled - sw_dir_cor_ref)
+print("Tile-wise computation (%d tiles): " % len(tiles_loaded)
+      + "%d of %d" % ((dev > 1e-5).sum(), dev.size) + " values differ "
+      + "from 'sw_dir_cor' (maximal absolute deviation: %.6f)"
+      % np.nanmax(dev))
+assert len(tiles_loaded) > 1
+assert np.array_equal(np.isnan(sw_dir_cor_tiled), np.isnan(sw_dir_cor_ref))
+assert np.nanmax(dev) < 1e-5
@@ -6,7 +6,7 @@
 # Load modules
 import numpy as np
 import time
-from subgrid_radiation import transform
+from subgrid_radiation import transform, auxiliary
 from pyproj import CRS, Transformer
 
 # -----------------------------------------------------------------------------
@@ -99,3 +99,66 @@ t_beg = time.perf_counter()
 transform.lonlat2ecef(lon, lat, elevation, trans_lonlat2enu, in_place=True)
 transform.ecef2enu(lon, lat, elevation, trans_lonlat2enu, in_place=True)
 print("Elapsed time: %.3f" % (time.perf_counter() - t_beg) + " s")
+
+# -----------------------------------------------------------------------------
+# Fused computation of padded vertex buffers
+# -----------------------------------------------------------------------------
+
+# Test data (elevation in single precision -> identical input for both paths)
+shp = (301, 401)
+lon, lat = np.meshgrid(np.linspace(7.0, 10.0, shp[1], dtype=np.float64),
+                       np.linspace(45.0, 47.0, shp[0], dtype=np.float64))
+elevation = np.random.uniform(0.0, 4500.0, shp).astype(np.float32)
+radius_earth = 6371229.0  # COSMO/ICON [m]
+trans_lonlat2enu = transform.TransformerLonlat2enu(
+    lon_or=lon.mean(), lat_or=lat.mean(), radius_earth=radius_earth)
+
+
+def vertices_ref(elevation):
+    x_ecef, y_ecef, z_ecef = transform.lonlat2ecef(
+        lon, lat, elevation.astype(np.float64), trans_lonlat2enu)
+    return transform.ecef2enu(x_ecef, y_ecef, z_ecef, trans_lonlat2enu)
+
+
+def max_ulp(buffer, buffer_ref):
+    # deviation in units of last place (single precision; values close to
+    # the ENU origin relative to 1.0 m)
+    spacing = np.spacing(np.maximum(np.abs(buffer_ref), np.float32(1.0)))
+    return (np.abs(buffer.astype(np.float64) - buffer_ref) / spacing).max()
+
+
+x_enu, y_enu, z_enu = vertices_ref(elevation)
+vert_grid_ref = auxiliary.rearrange_pad_buffer(
+    x_enu.astype(np.float32), y_enu.astype(np.float32),
+    z_enu.astype(np.float32))
+x_enu_in, y_enu_in, z_enu_in = vertices_ref(np.zeros_like(elevation))
+for offset_px in (0, 1, 50):
+    slice_in = (slice(offset_px, shp[0] - offset_px),
+                slice(offset_px, shp[1] - offset_px))
+    vert_grid_in_ref = auxiliary.rearrange_pad_buffer(
+        x_enu_in[slice_in].astype(np.float32),
+        y_enu_in[slice_in].astype(np.float32),
+        z_enu_in[slice_in].astype(np.float32))
+    value_abs_max_ref = max(np.abs(x_enu_in[slice_in]).max(),
+                            np.abs(y_enu_in[slice_in]).max(),
+                            np.abs(z_enu_in[slice_in]).max())
+    vert_grid, vert_grid_in, value_abs_max = transform.dem_vertices(
+        lon, lat, elevation, trans_lonlat2enu, offset_px=offset_px)
+    print("Fused vertex buffers (offset_px: %d): " % offset_px
+          + "maximal deviation (DEM/inner): %.1f" % max_ulp(
+              vert_grid, vert_grid_ref)
+          + ", %.1f ulp" % max_ulp(vert_grid_in, vert_grid_in_ref)
+          + ", 'value_abs_max': %.6f m" % value_abs_max)
+    assert vert_grid.dtype == vert_grid_in.dtype == np.float32
+    assert vert_grid.shape == vert_grid_ref.shape
+    assert vert_grid_in.shape == vert_grid_in_ref.shape
+    assert max_ulp(vert_grid, vert_grid_ref) <= 1.0
+    assert max_ulp(vert_grid_in, vert_grid_in_ref) <= 1.0
+    assert np.all(vert_grid[(shp[0] * shp[1] * 3):] == 0.0)
+    assert abs(value_abs_max - value_abs_max_ref) \
+        <= 1e-9 * value_abs_max_ref
+    vert_grid_no_in, vert_grid_in_none = transform.dem_vertices(
+        lon, lat, elevation, trans_lonlat2enu, offset_px=offset_px,
+        inner=False)[:2]
+    assert vert_grid_in_none is None
+    assert np.array_equal(vert_grid_no_in, vert_grid)